@@ -0,0 +1,403 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "../config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <milter/manager.h>
+#include <milter/core/milter-glib-compatible.h>
+
+#include "milter-benchmark.h"
+
+#define MAX_N_FAKE_CHILDREN 6
+#define N_BODY_CHUNKS 4
+
+/*
+ * A fake child is a MilterClient that accepts everything. It
+ * runs its own event loop in a thread of this process, so no
+ * external milter is needed.
+ */
+typedef struct _FakeChild
+{
+    MilterClient *client;
+    MilterEventLoop *loop;
+    GThread *thread;
+    gchar *path;
+    gchar *spec;
+} FakeChild;
+
+typedef enum
+{
+    SESSION_STEP_CONNECT,
+    SESSION_STEP_HELO,
+    SESSION_STEP_ENVELOPE_FROM,
+    SESSION_STEP_ENVELOPE_RECIPIENT,
+    SESSION_STEP_DATA,
+    SESSION_STEP_HEADER_FROM,
+    SESSION_STEP_HEADER_TO,
+    SESSION_STEP_HEADER_SUBJECT,
+    SESSION_STEP_END_OF_HEADER,
+    SESSION_STEP_BODY,
+    SESSION_STEP_END_OF_MESSAGE = SESSION_STEP_BODY + N_BODY_CHUNKS,
+    SESSION_STEP_QUIT
+} SessionStep;
+
+typedef struct _ChildrenData
+{
+    MilterEventLoop *loop;
+    MilterManagerConfiguration *configuration;
+    FakeChild fake_children[MAX_N_FAKE_CHILDREN];
+    guint n_children;
+    MilterManagerChildren *children;
+    guint step;
+    gchar body_chunk[4096];
+    struct sockaddr_in address;
+    gboolean failed;
+} ChildrenData;
+
+static MilterStatus
+cb_fake_continue (MilterClientContext *context)
+{
+    return MILTER_STATUS_CONTINUE;
+}
+
+static void
+cb_fake_connection_established (MilterClient *client,
+                                MilterClientContext *context,
+                                gpointer user_data)
+{
+#define CONNECT(name)                                                   \
+    g_signal_connect(context, name, G_CALLBACK(cb_fake_continue), NULL)
+
+    CONNECT("negotiate");
+    CONNECT("connect");
+    CONNECT("helo");
+    CONNECT("envelope-from");
+    CONNECT("envelope-recipient");
+    CONNECT("data");
+    CONNECT("header");
+    CONNECT("end-of-header");
+    CONNECT("body");
+    CONNECT("end-of-message");
+    CONNECT("abort");
+
+#undef CONNECT
+}
+
+static gpointer
+fake_child_run (gpointer user_data)
+{
+    FakeChild *child = user_data;
+    GError *error = NULL;
+
+    if (!milter_client_run(child->client, &error)) {
+        g_printerr("failed to run fake child: %s\n", error->message);
+        g_error_free(error);
+    }
+
+    return NULL;
+}
+
+static gboolean
+fake_child_start (FakeChild *child, guint i)
+{
+    GMainContext *context;
+    GError *error = NULL;
+
+    child->path = g_strdup_printf("%s/milter-benchmark-%u-%u.sock",
+                                  g_get_tmp_dir(), getpid(), i);
+    child->spec = g_strdup_printf("unix:%s", child->path);
+    unlink(child->path);
+
+    child->client = milter_client_new();
+    context = g_main_context_new();
+    child->loop = milter_glib_event_loop_new(context);
+    g_main_context_unref(context);
+    milter_client_set_event_loop(child->client, child->loop);
+    g_signal_connect(child->client, "connection-established",
+                     G_CALLBACK(cb_fake_connection_established), NULL);
+
+    if (!milter_client_set_connection_spec(child->client, child->spec,
+                                           &error) ||
+        !milter_client_listen(child->client, &error)) {
+        g_printerr("failed to listen fake child: <%s>: %s\n",
+                   child->spec, error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    child->thread = g_thread_try_new("fake_child", fake_child_run, child,
+                                     &error);
+    if (!child->thread) {
+        g_printerr("failed to create fake child thread: %s\n",
+                   error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+cb_fake_child_shutdown (gpointer user_data)
+{
+    FakeChild *child = user_data;
+
+    milter_client_shutdown(child->client);
+
+    return FALSE;
+}
+
+static void
+fake_child_stop (FakeChild *child)
+{
+    if (child->thread) {
+        milter_event_loop_add_idle(child->loop, cb_fake_child_shutdown, child);
+        g_thread_join(child->thread);
+    }
+    if (child->client)
+        g_object_unref(child->client);
+    if (child->loop)
+        g_object_unref(child->loop);
+    if (child->path) {
+        unlink(child->path);
+        g_free(child->path);
+    }
+    g_free(child->spec);
+}
+
+static void
+send_next (ChildrenData *data)
+{
+    MilterManagerChildren *children = data->children;
+    guint step = data->step++;
+
+    switch (step) {
+    case SESSION_STEP_CONNECT:
+        milter_manager_children_connect(children, "mx.example.net",
+                                        (struct sockaddr *)&(data->address),
+                                        sizeof(data->address));
+        break;
+    case SESSION_STEP_HELO:
+        milter_manager_children_helo(children, "mx.example.net");
+        break;
+    case SESSION_STEP_ENVELOPE_FROM:
+        milter_manager_children_envelope_from(children,
+                                              "<sender@example.net>");
+        break;
+    case SESSION_STEP_ENVELOPE_RECIPIENT:
+        milter_manager_children_envelope_recipient(children,
+                                                   "<receiver@example.com>");
+        break;
+    case SESSION_STEP_DATA:
+        milter_manager_children_data(children);
+        break;
+    case SESSION_STEP_HEADER_FROM:
+        milter_manager_children_header(children, "From",
+                                       "<sender@example.net>");
+        break;
+    case SESSION_STEP_HEADER_TO:
+        milter_manager_children_header(children, "To",
+                                       "<receiver@example.com>");
+        break;
+    case SESSION_STEP_HEADER_SUBJECT:
+        milter_manager_children_header(children, "Subject", "Benchmark");
+        break;
+    case SESSION_STEP_END_OF_HEADER:
+        milter_manager_children_end_of_header(children);
+        break;
+    case SESSION_STEP_END_OF_MESSAGE:
+        milter_manager_children_end_of_message(children, NULL, 0);
+        break;
+    case SESSION_STEP_QUIT:
+        milter_manager_children_quit(children);
+        break;
+    default:
+        milter_manager_children_body(children,
+                                     data->body_chunk,
+                                     sizeof(data->body_chunk));
+        break;
+    }
+}
+
+static void
+cb_negotiate_reply (MilterManagerChildren *children,
+                    MilterOption *option,
+                    MilterMacrosRequests *macros_requests,
+                    gpointer user_data)
+{
+    send_next(user_data);
+}
+
+static void
+cb_continue (MilterManagerChildren *children, gpointer user_data)
+{
+    send_next(user_data);
+}
+
+static void
+cb_accept (MilterManagerChildren *children, gpointer user_data)
+{
+    ChildrenData *data = user_data;
+
+    data->step = SESSION_STEP_QUIT;
+    send_next(data);
+}
+
+static void
+cb_failed (MilterManagerChildren *children, gpointer user_data)
+{
+    ChildrenData *data = user_data;
+
+    data->failed = TRUE;
+    data->step = SESSION_STEP_QUIT;
+    send_next(data);
+}
+
+static void
+cb_error (MilterErrorEmittable *emittable, GError *error, gpointer user_data)
+{
+    ChildrenData *data = user_data;
+
+    g_printerr("children error: %s\n", error->message);
+    data->failed = TRUE;
+}
+
+static void
+cb_finished (MilterFinishedEmittable *emittable, gpointer user_data)
+{
+    ChildrenData *data = user_data;
+
+    milter_event_loop_quit(data->loop);
+}
+
+static void
+run_session (gpointer user_data)
+{
+    ChildrenData *data = user_data;
+    MilterOption *option;
+    guint i;
+
+    data->children = milter_manager_children_new(data->configuration,
+                                                 data->loop);
+    for (i = 0; i < data->n_children; i++) {
+        MilterManagerEgg *egg;
+        MilterManagerChild *child;
+        gchar *name;
+
+        name = g_strdup_printf("fake-child-%u", i);
+        egg = milter_manager_egg_new(name);
+        g_free(name);
+        milter_manager_egg_set_connection_spec(egg,
+                                               data->fake_children[i].spec,
+                                               NULL);
+        child = milter_manager_egg_hatch(egg);
+        milter_manager_children_add_child(data->children, child);
+        g_object_unref(child);
+        g_object_unref(egg);
+    }
+
+#define CONNECT(name, callback)                                         \
+    g_signal_connect(data->children, name, G_CALLBACK(callback), data)
+
+    CONNECT("negotiate-reply", cb_negotiate_reply);
+    CONNECT("continue", cb_continue);
+    CONNECT("accept", cb_accept);
+    CONNECT("reject", cb_failed);
+    CONNECT("temporary-failure", cb_failed);
+    CONNECT("discard", cb_failed);
+    CONNECT("error", cb_error);
+    CONNECT("finished", cb_finished);
+
+#undef CONNECT
+
+    data->step = SESSION_STEP_CONNECT;
+    option = milter_option_new(6, MILTER_ACTION_ADD_HEADERS, MILTER_STEP_NONE);
+    if (milter_manager_children_negotiate(data->children, option, NULL))
+        milter_event_loop_run(data->loop);
+    else
+        data->failed = TRUE;
+    g_object_unref(option);
+
+    g_object_unref(data->children);
+    data->children = NULL;
+}
+
+static void
+benchmark_session (ChildrenData *data, guint n_children)
+{
+    gchar *name;
+
+    data->n_children = n_children;
+    data->failed = FALSE;
+    run_session(data);
+    if (data->failed) {
+        g_printerr("skip children benchmark with %u children: "
+                   "failed to process a session\n", n_children);
+        return;
+    }
+
+    name = g_strdup_printf("children/session/%u", n_children);
+    benchmark_run(name, run_session, data,
+                  1, sizeof(data->body_chunk) * N_BODY_CHUNKS);
+    g_free(name);
+}
+
+void
+benchmark_children (void)
+{
+    ChildrenData data;
+    guint i;
+    gboolean started = TRUE;
+
+    memset(&data, 0, sizeof(data));
+    data.loop = milter_glib_event_loop_new(NULL);
+    data.configuration = milter_manager_configuration_new(NULL);
+    memset(data.body_chunk, 'X', sizeof(data.body_chunk));
+    data.address.sin_family = AF_INET;
+    data.address.sin_port = g_htons(50443);
+    inet_pton(AF_INET, "192.168.123.123", &(data.address.sin_addr));
+
+    for (i = 0; i < MAX_N_FAKE_CHILDREN && started; i++) {
+        started = fake_child_start(&(data.fake_children[i]), i);
+    }
+
+    if (started) {
+        benchmark_session(&data, 1);
+        benchmark_session(&data, MAX_N_FAKE_CHILDREN);
+    }
+
+    for (i = 0; i < MAX_N_FAKE_CHILDREN; i++) {
+        fake_child_stop(&(data.fake_children[i]));
+    }
+    g_object_unref(data.configuration);
+    g_object_unref(data.loop);
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
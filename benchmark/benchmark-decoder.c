@@ -0,0 +1,211 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "../config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+
+#include <milter/core.h>
+
+#include "milter-benchmark.h"
+
+typedef struct _DecoderData
+{
+    MilterDecoder *(*decoder_new) (void);
+    GString *packets;
+} DecoderData;
+
+/*
+ * Packet captures in data/packet/ are text dumps. Commands
+ * from MTA are dumped at the beginning of line and replies
+ * from milter are indented:
+ *
+ *   0000  00 00 00 0d 4f 00 00 00 02 00 00 01 3f 00 00 00   ....O.......?...
+ *     0000  00 00 00 01 63                                    ....c
+ */
+static void
+parse_dump_line (const gchar *line, GString *commands, GString *replies)
+{
+    const gchar *current;
+    GString *packets;
+    guint i;
+
+    if (line[0] == ' ') {
+        packets = replies;
+        current = line + strspn(line, " ");
+    } else {
+        packets = commands;
+        current = line;
+    }
+
+    for (i = 0; i < 4; i++) {
+        if (!g_ascii_isxdigit(current[i]))
+            return;
+    }
+    current += 4;
+    if (!g_str_has_prefix(current, "  "))
+        return;
+    current += 2;
+
+    while (g_ascii_isxdigit(current[0]) && g_ascii_isxdigit(current[1])) {
+        g_string_append_c(packets,
+                          g_ascii_xdigit_value(current[0]) * 16 +
+                          g_ascii_xdigit_value(current[1]));
+        current += 2;
+        if (current[0] != ' ' || current[1] == ' ')
+            break;
+        current++;
+    }
+}
+
+static gboolean
+is_decodable (MilterDecoder *(*decoder_new) (void), GString *packets)
+{
+    MilterDecoder *decoder;
+    gboolean success;
+
+    decoder = decoder_new();
+    success = milter_decoder_decode(decoder, packets->str, packets->len, NULL);
+    if (success)
+        success = milter_decoder_end_decode(decoder, NULL);
+    g_object_unref(decoder);
+
+    return success;
+}
+
+static void
+load_packets (GString *commands, GString *replies)
+{
+    GDir *dir;
+    const gchar *name;
+    GError *error = NULL;
+
+    dir = g_dir_open(benchmark_get_packet_dir(), 0, &error);
+    if (!dir) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return;
+    }
+
+    while ((name = g_dir_read_name(dir))) {
+        gchar *path, *content;
+        gchar **lines;
+        GString *file_commands, *file_replies;
+        gint i;
+
+        if (!g_str_has_suffix(name, ".log"))
+            continue;
+
+        path = g_build_filename(benchmark_get_packet_dir(), name, NULL);
+        if (!g_file_get_contents(path, &content, NULL, &error)) {
+            g_printerr("%s\n", error->message);
+            g_clear_error(&error);
+            g_free(path);
+            continue;
+        }
+
+        file_commands = g_string_new(NULL);
+        file_replies = g_string_new(NULL);
+        lines = g_strsplit(content, "\n", -1);
+        for (i = 0; lines[i]; i++) {
+            parse_dump_line(lines[i], file_commands, file_replies);
+        }
+        g_strfreev(lines);
+        g_free(content);
+
+        if (is_decodable(milter_command_decoder_new, file_commands))
+            g_string_append_len(commands,
+                                file_commands->str, file_commands->len);
+        else
+            g_printerr("skip undecodable commands: <%s>\n", path);
+        if (is_decodable(milter_reply_decoder_new, file_replies))
+            g_string_append_len(replies,
+                                file_replies->str, file_replies->len);
+        else
+            g_printerr("skip undecodable replies: <%s>\n", path);
+
+        g_string_free(file_commands, TRUE);
+        g_string_free(file_replies, TRUE);
+        g_free(path);
+    }
+    g_dir_close(dir);
+}
+
+static void
+decode (gpointer user_data)
+{
+    DecoderData *data = user_data;
+    MilterDecoder *decoder;
+
+    decoder = data->decoder_new();
+    milter_decoder_decode(decoder, data->packets->str, data->packets->len,
+                          NULL);
+    milter_decoder_end_decode(decoder, NULL);
+    g_object_unref(decoder);
+}
+
+static guint
+count_packets (GString *packets)
+{
+    guint n_packets = 0;
+    gsize offset = 0;
+
+    while (offset + sizeof(guint32) <= packets->len) {
+        guint32 length;
+
+        memcpy(&length, packets->str + offset, sizeof(length));
+        offset += sizeof(length) + g_ntohl(length);
+        n_packets++;
+    }
+
+    return n_packets;
+}
+
+void
+benchmark_decoder (void)
+{
+    GString *commands, *replies;
+    DecoderData data;
+
+    commands = g_string_new(NULL);
+    replies = g_string_new(NULL);
+    load_packets(commands, replies);
+
+    if (commands->len > 0) {
+        data.decoder_new = milter_command_decoder_new;
+        data.packets = commands;
+        benchmark_run("decoder/command", decode, &data,
+                      count_packets(commands), commands->len);
+    }
+    if (replies->len > 0) {
+        data.decoder_new = milter_reply_decoder_new;
+        data.packets = replies;
+        benchmark_run("decoder/reply", decode, &data,
+                      count_packets(replies), replies->len);
+    }
+
+    g_string_free(commands, TRUE);
+    g_string_free(replies, TRUE);
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
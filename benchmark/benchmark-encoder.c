@@ -0,0 +1,104 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "../config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+
+#include <milter/core.h>
+
+#include "milter-benchmark.h"
+
+typedef struct _EncoderData
+{
+    MilterCommandEncoder *encoder;
+    gchar *chunk;
+    gsize chunk_size;
+    GHashTable *macros;
+} EncoderData;
+
+static void
+encode_body (gpointer user_data)
+{
+    EncoderData *data = user_data;
+    const gchar *packet;
+    gsize packet_size, packed_size;
+
+    milter_command_encoder_encode_body(data->encoder,
+                                       &packet, &packet_size,
+                                       data->chunk, data->chunk_size,
+                                       &packed_size);
+}
+
+static void
+encode_define_macro (gpointer user_data)
+{
+    EncoderData *data = user_data;
+    const gchar *packet;
+    gsize packet_size;
+
+    milter_command_encoder_encode_define_macro(data->encoder,
+                                               &packet, &packet_size,
+                                               MILTER_COMMAND_CONNECT,
+                                               data->macros);
+}
+
+static void
+encode_header (gpointer user_data)
+{
+    EncoderData *data = user_data;
+    const gchar *packet;
+    gsize packet_size;
+
+    milter_command_encoder_encode_header(data->encoder,
+                                         &packet, &packet_size,
+                                         "Subject",
+                                         "Re: benchmark of milter encoder");
+}
+
+void
+benchmark_encoder (void)
+{
+    EncoderData data;
+
+    data.encoder = MILTER_COMMAND_ENCODER(milter_command_encoder_new());
+    data.chunk_size = MILTER_CHUNK_SIZE;
+    data.chunk = g_new(gchar, data.chunk_size);
+    memset(data.chunk, 'X', data.chunk_size);
+    data.macros = g_hash_table_new(g_str_hash, g_str_equal);
+    g_hash_table_insert(data.macros, "j", "mx.example.com");
+    g_hash_table_insert(data.macros, "daemon_name", "mx.example.com");
+    g_hash_table_insert(data.macros, "v", "Postfix 2.5.5");
+    g_hash_table_insert(data.macros, "{client_addr}", "192.168.1.1");
+    g_hash_table_insert(data.macros, "{client_name}", "client.example.net");
+
+    benchmark_run("encoder/body", encode_body, &data, 1, data.chunk_size);
+    benchmark_run("encoder/define-macro", encode_define_macro, &data, 1, 0);
+    benchmark_run("encoder/header", encode_header, &data, 1, 0);
+
+    g_hash_table_unref(data.macros);
+    g_free(data.chunk);
+    g_object_unref(data.encoder);
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
@@ -0,0 +1,158 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "../config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <unistd.h>
+
+#include <milter/core.h>
+
+#include "milter-benchmark.h"
+
+#define N_SOURCES 1000
+
+typedef struct _EventLoopData
+{
+    MilterEventLoop *loop;
+    GIOChannel *channel;
+    guint ids[N_SOURCES];
+    guint n_remained_idles;
+} EventLoopData;
+
+static gboolean
+cb_never_called (gpointer user_data)
+{
+    return FALSE;
+}
+
+static gboolean
+cb_io_never_called (GIOChannel *channel, GIOCondition condition,
+                    gpointer user_data)
+{
+    return FALSE;
+}
+
+static gboolean
+cb_idle (gpointer user_data)
+{
+    EventLoopData *data = user_data;
+
+    data->n_remained_idles--;
+    return FALSE;
+}
+
+static void
+churn_timeouts (gpointer user_data)
+{
+    EventLoopData *data = user_data;
+    guint i;
+
+    for (i = 0; i < N_SOURCES; i++) {
+        data->ids[i] = milter_event_loop_add_timeout(data->loop, 3600.0,
+                                                     cb_never_called, data);
+    }
+    for (i = 0; i < N_SOURCES; i++) {
+        milter_event_loop_remove(data->loop, data->ids[i]);
+    }
+}
+
+static void
+churn_watches (gpointer user_data)
+{
+    EventLoopData *data = user_data;
+    guint i;
+
+    for (i = 0; i < N_SOURCES; i++) {
+        data->ids[i] = milter_event_loop_watch_io(data->loop,
+                                                  data->channel,
+                                                  G_IO_IN,
+                                                  cb_io_never_called,
+                                                  data);
+    }
+    for (i = 0; i < N_SOURCES; i++) {
+        milter_event_loop_remove(data->loop, data->ids[i]);
+    }
+}
+
+static void
+dispatch_idles (gpointer user_data)
+{
+    EventLoopData *data = user_data;
+    guint i;
+
+    data->n_remained_idles = N_SOURCES;
+    for (i = 0; i < N_SOURCES; i++) {
+        milter_event_loop_add_idle(data->loop, cb_idle, data);
+    }
+    while (data->n_remained_idles > 0) {
+        milter_event_loop_iterate(data->loop, FALSE);
+    }
+}
+
+static void
+benchmark_loop (const gchar *backend, MilterEventLoop *loop)
+{
+    EventLoopData data;
+    gchar *name;
+    int fds[2];
+
+    if (pipe(fds) == -1) {
+        g_printerr("failed to create pipe for event loop benchmark\n");
+        return;
+    }
+
+    data.loop = loop;
+    data.channel = g_io_channel_unix_new(fds[0]);
+
+    name = g_strdup_printf("event-loop/%s/timeout", backend);
+    benchmark_run(name, churn_timeouts, &data, N_SOURCES, 0);
+    g_free(name);
+
+    name = g_strdup_printf("event-loop/%s/watch-io", backend);
+    benchmark_run(name, churn_watches, &data, N_SOURCES, 0);
+    g_free(name);
+
+    name = g_strdup_printf("event-loop/%s/idle", backend);
+    benchmark_run(name, dispatch_idles, &data, N_SOURCES, 0);
+    g_free(name);
+
+    g_io_channel_unref(data.channel);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+void
+benchmark_event_loop (void)
+{
+    MilterEventLoop *loop;
+
+    loop = milter_glib_event_loop_new(NULL);
+    benchmark_loop("glib", loop);
+    g_object_unref(loop);
+
+    loop = milter_libev_event_loop_new();
+    benchmark_loop("libev", loop);
+    g_object_unref(loop);
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
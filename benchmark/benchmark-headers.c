@@ -0,0 +1,106 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "../config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <milter/core.h>
+
+#include "milter-benchmark.h"
+
+#define N_HEADERS 30
+
+typedef struct _HeadersData
+{
+    gchar *names[N_HEADERS];
+    MilterHeaders *headers;
+} HeadersData;
+
+static void
+append_headers (gpointer user_data)
+{
+    HeadersData *data = user_data;
+    MilterHeaders *headers;
+    guint i;
+
+    headers = milter_headers_new();
+    for (i = 0; i < N_HEADERS; i++) {
+        milter_headers_append_header(headers, data->names[i], "value");
+    }
+    g_object_unref(headers);
+}
+
+static void
+lookup_headers (gpointer user_data)
+{
+    HeadersData *data = user_data;
+    guint i;
+
+    for (i = 0; i < N_HEADERS; i++) {
+        milter_headers_lookup_by_name(data->headers, data->names[i]);
+    }
+}
+
+static void
+change_headers (gpointer user_data)
+{
+    HeadersData *data = user_data;
+    guint i;
+
+    for (i = 0; i < N_HEADERS; i++) {
+        milter_headers_change_header(data->headers, data->names[i], 1,
+                                     "changed value");
+    }
+}
+
+static void
+copy_headers (gpointer user_data)
+{
+    HeadersData *data = user_data;
+
+    g_object_unref(milter_headers_copy(data->headers));
+}
+
+void
+benchmark_headers (void)
+{
+    HeadersData data;
+    guint i;
+
+    data.headers = milter_headers_new();
+    for (i = 0; i < N_HEADERS; i++) {
+        data.names[i] = g_strdup_printf("X-Benchmark-Header-%u", i);
+        milter_headers_append_header(data.headers, data.names[i], "value");
+    }
+
+    benchmark_run("headers/append", append_headers, &data, N_HEADERS, 0);
+    benchmark_run("headers/lookup", lookup_headers, &data, N_HEADERS, 0);
+    benchmark_run("headers/change", change_headers, &data, N_HEADERS, 0);
+    benchmark_run("headers/copy", copy_headers, &data, N_HEADERS, 0);
+
+    g_object_unref(data.headers);
+    for (i = 0; i < N_HEADERS; i++) {
+        g_free(data.names[i]);
+    }
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
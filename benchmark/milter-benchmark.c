@@ -0,0 +1,178 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "../config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+
+#include <milter/manager.h>
+
+#include "milter-benchmark.h"
+
+static gchar *packet_dir = NULL;
+static gchar *filter = NULL;
+static gdouble min_time = 0.2;
+static gint n_rounds = 5;
+
+static const GOptionEntry option_entries[] =
+{
+    {"packet-dir", 0, 0, G_OPTION_ARG_STRING, &packet_dir,
+     "Read milter packet captures from DIRECTORY. (data/packet)",
+     "DIRECTORY"},
+    {"filter", 0, 0, G_OPTION_ARG_STRING, &filter,
+     "Run only benchmarks whose name matches PATTERN. (*)",
+     "PATTERN"},
+    {"min-time", 0, 0, G_OPTION_ARG_DOUBLE, &min_time,
+     "Run each round for at least SECONDS seconds. (0.2)",
+     "SECONDS"},
+    {"rounds", 0, 0, G_OPTION_ARG_INT, &n_rounds,
+     "Run N rounds and report the median. (5)",
+     "N"},
+    {NULL}
+};
+
+const gchar *
+benchmark_get_packet_dir (void)
+{
+    return packet_dir;
+}
+
+static gdouble
+measure (BenchmarkFunction function, gpointer user_data, guint n_calls)
+{
+    GTimer *timer;
+    gdouble elapsed;
+    guint i;
+
+    timer = g_timer_new();
+    for (i = 0; i < n_calls; i++) {
+        function(user_data);
+    }
+    elapsed = g_timer_elapsed(timer, NULL);
+    g_timer_destroy(timer);
+
+    return elapsed;
+}
+
+static gint
+compare_double (gconstpointer a, gconstpointer b)
+{
+    gdouble value1 = *(const gdouble *)a;
+    gdouble value2 = *(const gdouble *)b;
+
+    if (value1 < value2)
+        return -1;
+    else if (value1 > value2)
+        return 1;
+    else
+        return 0;
+}
+
+void
+benchmark_run (const gchar *name,
+               BenchmarkFunction function,
+               gpointer user_data,
+               guint n_operations,
+               guint64 n_bytes)
+{
+    gdouble *elapsed_times;
+    gdouble elapsed, seconds_per_call;
+    guint n_calls = 1;
+    gint i;
+
+    if (filter && !g_pattern_match_simple(filter, name))
+        return;
+
+    function(user_data);
+    while ((elapsed = measure(function, user_data, n_calls)) < min_time &&
+           n_calls < G_MAXUINT / 2) {
+        if (elapsed > 0.0 && min_time / elapsed < 2.0)
+            n_calls = (guint)(n_calls * (min_time / elapsed)) + 1;
+        else
+            n_calls *= 2;
+    }
+
+    elapsed_times = g_new(gdouble, n_rounds);
+    elapsed_times[0] = elapsed;
+    for (i = 1; i < n_rounds; i++) {
+        elapsed_times[i] = measure(function, user_data, n_calls);
+    }
+    qsort(elapsed_times, n_rounds, sizeof(gdouble), compare_double);
+    seconds_per_call = elapsed_times[n_rounds / 2] / n_calls;
+    g_free(elapsed_times);
+
+    g_print("{\"name\": \"%s\", "
+            "\"calls\": %u, "
+            "\"rounds\": %d, "
+            "\"operations_per_call\": %u, "
+            "\"bytes_per_call\": %" G_GUINT64_FORMAT ", "
+            "\"ns_per_operation\": %.1f, "
+            "\"operations_per_second\": %.1f, "
+            "\"bytes_per_second\": %.1f}\n",
+            name,
+            n_calls,
+            n_rounds,
+            n_operations,
+            n_bytes,
+            seconds_per_call / n_operations * 1e9,
+            n_operations / seconds_per_call,
+            n_bytes / seconds_per_call);
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *option_context;
+    GError *error = NULL;
+
+    milter_manager_init(&argc, &argv);
+    if (!g_getenv("MILTER_LOG_LEVEL"))
+        milter_set_log_level(MILTER_LOG_LEVEL_NONE);
+
+    option_context = g_option_context_new(NULL);
+    g_option_context_add_main_entries(option_context, option_entries, NULL);
+    if (!g_option_context_parse(option_context, &argc, &argv, &error)) {
+        g_print("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(option_context);
+        exit(EXIT_FAILURE);
+    }
+    g_option_context_free(option_context);
+
+    if (n_rounds < 1)
+        n_rounds = 1;
+    if (!packet_dir)
+        packet_dir = g_build_filename("data", "packet", NULL);
+
+    benchmark_decoder();
+    benchmark_encoder();
+    benchmark_headers();
+    benchmark_event_loop();
+    benchmark_children();
+
+    milter_manager_quit();
+
+    return EXIT_SUCCESS;
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
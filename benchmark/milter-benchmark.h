@@ -0,0 +1,53 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __MILTER_BENCHMARK_H__
+#define __MILTER_BENCHMARK_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef void (*BenchmarkFunction) (gpointer user_data);
+
+/*
+ * Runs @function repeatedly and reports a JSON line. @function
+ * does @n_operations operations that process @n_bytes bytes
+ * in total per call.
+ */
+void         benchmark_run              (const gchar       *name,
+                                         BenchmarkFunction  function,
+                                         gpointer           user_data,
+                                         guint              n_operations,
+                                         guint64            n_bytes);
+const gchar *benchmark_get_packet_dir   (void);
+
+void         benchmark_decoder          (void);
+void         benchmark_encoder          (void);
+void         benchmark_headers          (void);
+void         benchmark_children         (void);
+void         benchmark_event_loop       (void);
+
+G_END_DECLS
+
+#endif /* __MILTER_BENCHMARK_H__ */
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
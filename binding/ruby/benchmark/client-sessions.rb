@@ -0,0 +1,134 @@
+#!/usr/bin/env ruby
+#
+# Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+#
+# This library is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library.  If not, see <http://www.gnu.org/licenses/>.
+
+# Measures sessions/s of a trivial Ruby milter. Each session
+# emits the events of a message with a few headers and body
+# chunks on a Milter::ClientContext without network I/O. It
+# compares per-session signal_connect closures with
+# Milter::Client::SessionDispatcher for each body chunk mode.
+#
+# Usage: RUBYLIB=... benchmark/client-sessions.rb [N_SESSIONS]
+#
+# RUBYLIB must include the same directories as
+# test/run-test.sh uses.
+
+require 'benchmark'
+
+require 'milter/client'
+
+n_sessions = Integer(ARGV[0] || 10000)
+n_body_chunks = 8
+body_chunk = "X" * 65535
+
+class TrivialSession < Milter::ClientSession
+  def helo(fqdn)
+  end
+
+  def envelope_from(from)
+  end
+
+  def envelope_recipient(recipient)
+  end
+
+  def header(name, value)
+  end
+
+  def body(chunk)
+  end
+
+  def end_of_message
+    accept
+  end
+end
+
+EVENTS = [:helo, :envelope_from, :envelope_recipient,
+          :header, :body, :end_of_message]
+
+def setup_closures(client, context)
+  session_context = Milter::ClientSessionContext.new(context)
+  session = TrivialSession.new(session_context)
+  EVENTS.each do |event|
+    context.signal_connect(event) do |_context, *args|
+      if event == :end_of_message
+        session.send(event)
+      else
+        session.send(event, *args)
+      end
+      status = session_context.status
+      session_context.clear
+      status
+    end
+  end
+  context.signal_connect(:abort) do |_context, *args|
+    session.reset
+    Milter::Status::DEFAULT
+  end
+end
+
+def run_session(context, body_chunk, n_body_chunks)
+  context.signal_emit("helo", "mx.example.net")
+  context.signal_emit("envelope-from", "<sender@example.net>")
+  context.signal_emit("envelope-recipient", "<receiver@example.com>")
+  context.signal_emit("header", "From", "<sender@example.net>")
+  context.signal_emit("header", "To", "<receiver@example.com>")
+  context.signal_emit("header", "Subject", "Benchmark")
+  n_body_chunks.times do
+    context.signal_emit("body", body_chunk, body_chunk.bytesize)
+  end
+  context.signal_emit("end-of-message", "", 0)
+end
+
+client = Milter::Client.new
+event_loop = Milter::GLibEventLoop.new
+dispatcher = nil
+
+puts("sessions: #{n_sessions}, " +
+     "body: #{n_body_chunks} chunks of #{body_chunk.bytesize} bytes")
+results = []
+Benchmark.bm(20) do |benchmark|
+  runners = [["closures", nil]]
+  Milter::Client::BODY_CHUNK_MODES.each do |mode|
+    runners << ["dispatcher (#{mode})", mode]
+  end
+  runners.each do |label, mode|
+    unless mode.nil?
+      client.body_chunk_mode = mode
+      dispatcher = Milter::Client::SessionDispatcher.new(client,
+                                                         TrivialSession,
+                                                         [])
+    end
+    GC.start
+    result = benchmark.report(label) do
+      n_sessions.times do
+        context = Milter::ClientContext.new(client)
+        context.event_loop = event_loop
+        if mode.nil?
+          setup_closures(client, context)
+        else
+          dispatcher.attach(context)
+        end
+        run_session(context, body_chunk, n_body_chunks)
+      end
+    end
+    results << [label, n_sessions / result.real]
+  end
+end
+
+puts
+results.each do |label, sessions_per_second|
+  puts("%-20s %10.1f sessions/s" % [label, sessions_per_second])
+end
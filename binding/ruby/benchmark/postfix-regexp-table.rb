@@ -0,0 +1,108 @@
+#!/usr/bin/env ruby
+#
+# Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+#
+# This library is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library.  If not, see <http://www.gnu.org/licenses/>.
+
+# Compares sequential regexp evaluation with
+# Milter::Manager::RegexpMatcher on generated Postfix
+# regexp tables.
+#
+# Usage: RUBYLIB=... benchmark/postfix-regexp-table.rb [N_LOOKUPS]
+#
+# RUBYLIB must include the same directories as
+# test/run-test.sh uses.
+
+require 'benchmark'
+require 'stringio'
+
+require 'milter/manager'
+
+n_lookups = Integer(ARGV[0] || 10000)
+table_sizes = [100, 1000, 5000]
+
+def generate_table(size)
+  lines = []
+  size.times do |i|
+    case i % 4
+    when 0
+      lines << "/^user#{i}@example#{i}\\.com$/ REJECT"
+    when 1
+      lines << "/@spam#{i}\\.example\\.net$/ 550 Spam domain"
+    when 2
+      lines << "/^[^@]+@mail#{i}\\.example\\.org$/ DISCARD"
+    else
+      lines << "/^bounce-[0-9]+-#{i}@/ OK"
+    end
+  end
+  lines << "/[%!@].*[%!@]/ 550 Sender-specified routing rejected"
+  lines.join("\n")
+end
+
+def generate_texts(size, n_lookups)
+  texts = []
+  n_lookups.times do |i|
+    case i % 5
+    when 0
+      j = (i * 4) % size
+      texts << "user#{j}@example#{j}.com"
+    when 1
+      texts << "someone@spam#{(i * 4 + 1) % size}.example.net"
+    else
+      texts << "user#{i}@not-listed#{i}.example.jp"
+    end
+  end
+  texts
+end
+
+def sequential_find(regexps, text)
+  regexps.each do |regexp, action|
+    return action if regexp =~ text
+  end
+  nil
+end
+
+table_sizes.each do |size|
+  source = generate_table(size)
+  table = Milter::Manager::PostfixRegexpTable.new
+  input = StringIO.new(source)
+  def input.path
+    "benchmark"
+  end
+  table.parse(input)
+  regexps = source.lines.collect do |line|
+    pattern, action = line.chomp.split(/\/\s+/, 2)
+    [Regexp.new(pattern[1..-1], Regexp::IGNORECASE), action]
+  end
+  texts = generate_texts(size, n_lookups)
+
+  texts.each do |text|
+    expected = sequential_find(regexps, text)
+    actual = table.find(text)
+    if expected != actual
+      raise "result mismatch: <#{text}>: <#{expected}> != <#{actual}>"
+    end
+  end
+
+  puts("table size: #{size}, lookups: #{n_lookups}")
+  Benchmark.bmbm do |benchmark|
+    benchmark.report("sequential") do
+      texts.each {|text| sequential_find(regexps, text)}
+    end
+    benchmark.report("literal prefilter") do
+      texts.each {|text| table.find(text)}
+    end
+  end
+  puts
+end
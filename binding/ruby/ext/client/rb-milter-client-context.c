@@ -301,11 +301,367 @@ get_mail_transaction_shelf (VALUE self)
     return shelf;
 }
 
+typedef enum {
+    BODY_CHUNK_MODE_COPY,
+    BODY_CHUNK_MODE_SHARED,
+    BODY_CHUNK_MODE_BUFFER
+} BodyChunkMode;
+
+#define BODY_CHUNK_MODE_KEY "rb-milter-body-chunk-mode"
+#define BODY_CHUNK_MODE(context)                                        \
+    (GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(context),              \
+                                        BODY_CHUNK_MODE_KEY)))
+
+static ID id_dispatch;
+static ID id_at_session_handler;
+static ID id_at_body_chunk;
+static ID id_at_body_buffer;
+static ID id_copy;
+static ID id_shared;
+static ID id_buffer;
+
+static ID id_negotiate;
+static ID id_connect;
+static ID id_helo;
+static ID id_envelope_from;
+static ID id_envelope_recipient;
+static ID id_data;
+static ID id_unknown;
+static ID id_header;
+static ID id_end_of_header;
+static ID id_body;
+static ID id_end_of_message;
+static ID id_abort;
+static ID id_finished;
+
+#define MAX_DISPATCH_ARGUMENTS 4
+
+typedef struct _DispatchData
+{
+    VALUE handler;
+    int argc;
+    VALUE argv[MAX_DISPATCH_ARGUMENTS];
+} DispatchData;
+
+static VALUE
+invoke_dispatch (VALUE data)
+{
+    DispatchData *dispatch_data = (DispatchData *)data;
+
+    return rb_funcall2(dispatch_data->handler, id_dispatch,
+                       dispatch_data->argc, dispatch_data->argv);
+}
+
+static MilterStatus
+dispatch (MilterClientContext *context, ID event, int argc, ...)
+{
+    DispatchData data;
+    VALUE rb_status;
+    va_list args;
+    int i;
+
+    data.handler = rb_ivar_get(GOBJ2RVAL(context), id_at_session_handler);
+    if (NIL_P(data.handler))
+        return MILTER_STATUS_DEFAULT;
+
+    data.argc = argc + 1;
+    data.argv[0] = ID2SYM(event);
+    va_start(args, argc);
+    for (i = 0; i < argc; i++) {
+        data.argv[i + 1] = va_arg(args, VALUE);
+    }
+    va_end(args);
+
+    rb_status = rbgutil_protect(invoke_dispatch, (VALUE)&data);
+    if (NIL_P(rb_status))
+        return MILTER_STATUS_DEFAULT;
+
+    return RVAL2STATUS(rb_status);
+}
+
+static MilterStatus
+cb_negotiate (MilterClientContext *context,
+              MilterOption *option,
+              MilterMacrosRequests *macros_requests,
+              gpointer user_data)
+{
+    return dispatch(context, id_negotiate, 2,
+                    GOBJ2RVAL(option), GOBJ2RVAL(macros_requests));
+}
+
+static MilterStatus
+cb_connect (MilterClientContext *context,
+            const gchar *host_name,
+            struct sockaddr *address,
+            socklen_t address_length,
+            gpointer user_data)
+{
+    return dispatch(context, id_connect, 2,
+                    rb_str_new2(host_name),
+                    ADDRESS2RVAL(address, address_length));
+}
+
+static MilterStatus
+cb_helo (MilterClientContext *context, const gchar *fqdn, gpointer user_data)
+{
+    return dispatch(context, id_helo, 1, rb_str_new2(fqdn));
+}
+
+static MilterStatus
+cb_envelope_from (MilterClientContext *context,
+                  const gchar *from,
+                  gpointer user_data)
+{
+    return dispatch(context, id_envelope_from, 1, rb_str_new2(from));
+}
+
+static MilterStatus
+cb_envelope_recipient (MilterClientContext *context,
+                       const gchar *recipient,
+                       gpointer user_data)
+{
+    return dispatch(context, id_envelope_recipient, 1, rb_str_new2(recipient));
+}
+
+static MilterStatus
+cb_data (MilterClientContext *context, gpointer user_data)
+{
+    return dispatch(context, id_data, 0);
+}
+
+static MilterStatus
+cb_unknown (MilterClientContext *context,
+            const gchar *command,
+            gpointer user_data)
+{
+    return dispatch(context, id_unknown, 1, rb_str_new2(command));
+}
+
+static MilterStatus
+cb_header (MilterClientContext *context,
+           const gchar *name,
+           const gchar *value,
+           gpointer user_data)
+{
+    return dispatch(context, id_header, 2,
+                    rb_str_new2(name), rb_str_new2(value));
+}
+
+static MilterStatus
+cb_end_of_header (MilterClientContext *context, gpointer user_data)
+{
+    return dispatch(context, id_end_of_header, 0);
+}
+
+static void
+append_body_buffer (VALUE rb_context, const gchar *chunk, gsize size)
+{
+    VALUE rb_buffer;
+
+    rb_buffer = rb_ivar_get(rb_context, id_at_body_buffer);
+    if (NIL_P(rb_buffer)) {
+        rb_buffer = rb_str_buf_new(size);
+        rb_ivar_set(rb_context, id_at_body_buffer, rb_buffer);
+    }
+    rb_str_cat(rb_buffer, chunk, size);
+}
+
+static VALUE
+take_body_buffer (VALUE rb_context)
+{
+    VALUE rb_buffer;
+
+    rb_buffer = rb_ivar_get(rb_context, id_at_body_buffer);
+    rb_ivar_set(rb_context, id_at_body_buffer, Qnil);
+    return rb_buffer;
+}
+
+static MilterStatus
+cb_body (MilterClientContext *context,
+         const gchar *chunk,
+         gsize size,
+         gpointer user_data)
+{
+    VALUE rb_context, rb_chunk;
+
+    rb_context = GOBJ2RVAL(context);
+    switch (BODY_CHUNK_MODE(context)) {
+    case BODY_CHUNK_MODE_SHARED:
+        rb_chunk = rb_ivar_get(rb_context, id_at_body_chunk);
+        if (NIL_P(rb_chunk) || OBJ_FROZEN(rb_chunk)) {
+            rb_chunk = rb_str_buf_new(size);
+            rb_ivar_set(rb_context, id_at_body_chunk, rb_chunk);
+        }
+        rb_str_resize(rb_chunk, 0);
+        rb_str_cat(rb_chunk, chunk, size);
+        break;
+    case BODY_CHUNK_MODE_BUFFER:
+        append_body_buffer(rb_context, chunk, size);
+        return MILTER_STATUS_CONTINUE;
+    default:
+        rb_chunk = rb_str_new(chunk, size);
+        break;
+    }
+
+    return dispatch(context, id_body, 1, rb_chunk);
+}
+
+static MilterStatus
+cb_end_of_message (MilterClientContext *context,
+                   const gchar *chunk,
+                   gsize size,
+                   gpointer user_data)
+{
+    VALUE rb_context, rb_chunk = Qnil;
+
+    rb_context = GOBJ2RVAL(context);
+    if (BODY_CHUNK_MODE(context) == BODY_CHUNK_MODE_BUFFER) {
+        if (chunk && size > 0)
+            append_body_buffer(rb_context, chunk, size);
+        rb_chunk = take_body_buffer(rb_context);
+    } else if (chunk && size > 0) {
+        rb_chunk = rb_str_new(chunk, size);
+    }
+
+    return dispatch(context, id_end_of_message, 1, rb_chunk);
+}
+
+static MilterStatus
+cb_abort (MilterClientContext *context,
+          MilterClientContextState state,
+          gpointer user_data)
+{
+    take_body_buffer(GOBJ2RVAL(context));
+    return dispatch(context, id_abort, 1,
+                    GENUM2RVAL(state, MILTER_TYPE_CLIENT_CONTEXT_STATE));
+}
+
+static void
+cb_finished (MilterClientContext *context, gpointer user_data)
+{
+    dispatch(context, id_finished, 0);
+}
+
+typedef struct _SessionEvent
+{
+    ID *id;
+    const gchar *signal_name;
+    GCallback callback;
+} SessionEvent;
+
+static SessionEvent session_events[] = {
+    {&id_negotiate, "negotiate", G_CALLBACK(cb_negotiate)},
+    {&id_connect, "connect", G_CALLBACK(cb_connect)},
+    {&id_helo, "helo", G_CALLBACK(cb_helo)},
+    {&id_envelope_from, "envelope-from", G_CALLBACK(cb_envelope_from)},
+    {&id_envelope_recipient, "envelope-recipient",
+     G_CALLBACK(cb_envelope_recipient)},
+    {&id_data, "data", G_CALLBACK(cb_data)},
+    {&id_unknown, "unknown", G_CALLBACK(cb_unknown)},
+    {&id_header, "header", G_CALLBACK(cb_header)},
+    {&id_end_of_header, "end-of-header", G_CALLBACK(cb_end_of_header)},
+    {&id_body, "body", G_CALLBACK(cb_body)},
+    {&id_end_of_message, "end-of-message", G_CALLBACK(cb_end_of_message)},
+    {&id_abort, "abort", G_CALLBACK(cb_abort)},
+    {&id_finished, "finished", G_CALLBACK(cb_finished)}
+};
+
+static SessionEvent *
+find_session_event (VALUE rb_event)
+{
+    ID event;
+    guint i;
+
+    event = rb_to_id(rb_event);
+    for (i = 0; i < G_N_ELEMENTS(session_events); i++) {
+        if (*(session_events[i].id) == event)
+            return &(session_events[i]);
+    }
+
+    rb_raise(rb_eArgError, "unknown session event: %s",
+             rb_milter__inspect(rb_event));
+    return NULL;
+}
+
+static BodyChunkMode
+rval2body_chunk_mode (VALUE rb_mode)
+{
+    ID mode;
+
+    if (NIL_P(rb_mode))
+        return BODY_CHUNK_MODE_COPY;
+
+    mode = rb_to_id(rb_mode);
+    if (mode == id_copy)
+        return BODY_CHUNK_MODE_COPY;
+    if (mode == id_shared)
+        return BODY_CHUNK_MODE_SHARED;
+    if (mode == id_buffer)
+        return BODY_CHUNK_MODE_BUFFER;
+
+    rb_raise(rb_eArgError,
+             "body chunk mode should be :copy, :shared or :buffer: %s",
+             rb_milter__inspect(rb_mode));
+    return BODY_CHUNK_MODE_COPY;
+}
+
+static VALUE
+attach_session_handler (VALUE self, VALUE handler, VALUE events,
+                        VALUE rb_body_chunk_mode)
+{
+    MilterClientContext *context;
+    BodyChunkMode body_chunk_mode;
+    SessionEvent **targets;
+    long i, n_events;
+
+    context = SELF(self);
+    body_chunk_mode = rval2body_chunk_mode(rb_body_chunk_mode);
+    Check_Type(events, T_ARRAY);
+
+    n_events = RARRAY_LEN(events);
+    targets = ALLOCA_N(SessionEvent *, n_events);
+    for (i = 0; i < n_events; i++) {
+        targets[i] = find_session_event(RARRAY_PTR(events)[i]);
+    }
+
+    rb_ivar_set(self, id_at_session_handler, handler);
+    g_object_set_data(G_OBJECT(context), BODY_CHUNK_MODE_KEY,
+                      GUINT_TO_POINTER(body_chunk_mode));
+    for (i = 0; i < n_events; i++) {
+        g_signal_connect(context, targets[i]->signal_name,
+                         targets[i]->callback, NULL);
+    }
+
+    return self;
+}
+
 void
 Init_milter_client_context (void)
 {
     VALUE rb_cMilterClientContext;
 
+    id_dispatch = rb_intern("dispatch");
+    id_at_session_handler = rb_intern("@session_handler");
+    id_at_body_chunk = rb_intern("@body_chunk");
+    id_at_body_buffer = rb_intern("@body_buffer");
+    id_copy = rb_intern("copy");
+    id_shared = rb_intern("shared");
+    id_buffer = rb_intern("buffer");
+
+    id_negotiate = rb_intern("negotiate");
+    id_connect = rb_intern("connect");
+    id_helo = rb_intern("helo");
+    id_envelope_from = rb_intern("envelope_from");
+    id_envelope_recipient = rb_intern("envelope_recipient");
+    id_data = rb_intern("data");
+    id_unknown = rb_intern("unknown");
+    id_header = rb_intern("header");
+    id_end_of_header = rb_intern("end_of_header");
+    id_body = rb_intern("body");
+    id_end_of_message = rb_intern("end_of_message");
+    id_abort = rb_intern("abort");
+    id_finished = rb_intern("finished");
+
     rb_cMilterClientContext = G_DEF_CLASS(MILTER_TYPE_CLIENT_CONTEXT,
                                           "ClientContext", rb_mMilter);
     G_DEF_ERROR2(MILTER_CLIENT_CONTEXT_ERROR,
@@ -348,6 +704,8 @@ Init_milter_client_context (void)
                      get_mail_transaction_shelf_value, 1);
     rb_define_method(rb_cMilterClientContext, "mail_transaction_shelf",
                      get_mail_transaction_shelf, 0);
+    rb_define_method(rb_cMilterClientContext, "attach_session_handler",
+                     attach_session_handler, 3);
 
     G_DEF_SIGNAL_FUNC(rb_cMilterClientContext, "connect",
                       rb_milter__connect_signal_convert);
@@ -288,6 +288,40 @@ reload (VALUE self)
     return self;
 }
 
+static VALUE
+save_snapshot (VALUE self, VALUE path)
+{
+    GError *error = NULL;
+
+    if (!milter_manager_configuration_save_snapshot(SELF(self),
+						    RVAL2CSTR(path),
+						    &error)) {
+	RAISE_GERROR(error);
+    }
+
+    return self;
+}
+
+static VALUE
+load_snapshot (VALUE self, VALUE path)
+{
+    GError *error = NULL;
+
+    if (!milter_manager_configuration_load_snapshot(SELF(self),
+						    RVAL2CSTR(path),
+						    &error)) {
+	RAISE_GERROR(error);
+    }
+
+    return self;
+}
+
+static VALUE
+get_shared_cache (VALUE self)
+{
+    return GOBJ2RVAL(milter_manager_configuration_get_shared_cache(SELF(self)));
+}
+
 static void
 mark (gpointer data)
 {
@@ -379,6 +413,14 @@ Init_milter_manager_configuration (void)
     rb_define_method(rb_cMilterManagerConfiguration,
 		     "locations", get_locations, 0);
 
+    rb_define_method(rb_cMilterManagerConfiguration,
+		     "shared_cache", get_shared_cache, 0);
+
+    rb_define_method(rb_cMilterManagerConfiguration,
+		     "save_snapshot", save_snapshot, 1);
+    rb_define_method(rb_cMilterManagerConfiguration,
+		     "load_snapshot", load_snapshot, 1);
+
     rb_define_method(rb_cMilterManagerConfiguration,
 		     "reload", reload, 0);
 }
@@ -0,0 +1,350 @@
+/* -*- c-file-style: "ruby" -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rb-milter-manager-private.h"
+
+#ifndef HAVE_RB_ERRINFO
+#define rb_errinfo() ruby_errinfo
+#endif
+
+#define SELF(self) (MILTER_MANAGER_DNSBL(RVAL2GOBJ(self)))
+#define CALLBACKS_KEY "rb-callback"
+
+typedef struct _CheckContext CheckContext;
+struct _CheckContext
+{
+    MilterManagerDNSBL *dnsbl;
+    VALUE callback;
+};
+
+static inline GList *
+callbacks_get (MilterManagerDNSBL *dnsbl)
+{
+    return g_object_get_data(G_OBJECT(dnsbl), CALLBACKS_KEY);
+}
+
+static inline void
+callbacks_set (MilterManagerDNSBL *dnsbl, GList *callbacks)
+{
+    GObject *object;
+
+    object = G_OBJECT(dnsbl);
+    g_object_steal_data(object, CALLBACKS_KEY);
+    g_object_set_data_full(object,
+			   CALLBACKS_KEY,
+			   callbacks,
+			   (GDestroyNotify)g_list_free);
+}
+
+static CheckContext *
+check_context_new (MilterManagerDNSBL *dnsbl, VALUE callback)
+{
+    CheckContext *context;
+    GList *callbacks;
+
+    context = g_new(CheckContext, 1);
+    context->dnsbl = dnsbl;
+    context->callback = callback;
+
+    callbacks = callbacks_get(dnsbl);
+    callbacks = g_list_prepend(callbacks, (gpointer)callback);
+    callbacks_set(dnsbl, callbacks);
+
+    return context;
+}
+
+static void
+cb_check_context_free (gpointer user_data)
+{
+    CheckContext *context = user_data;
+    GList *callbacks;
+
+    callbacks = callbacks_get(context->dnsbl);
+    callbacks = g_list_remove(callbacks, (gpointer)(context->callback));
+    callbacks_set(context->dnsbl, callbacks);
+
+    g_free(context);
+}
+
+static VALUE
+invoke_callback (VALUE data)
+{
+    VALUE *arguments = (VALUE *)data;
+    return rb_funcall(arguments[0], rb_intern("call"), 2,
+		      arguments[1], arguments[2]);
+}
+
+static void
+cb_check (MilterManagerDNSBL *dnsbl, gboolean listed, const gchar *zone,
+	  gpointer user_data)
+{
+    CheckContext *context = user_data;
+    VALUE arguments[3];
+    int state = 0;
+
+    arguments[0] = context->callback;
+    arguments[1] = CBOOL2RVAL(listed);
+    arguments[2] = CSTR2RVAL(zone);
+    rb_protect(invoke_callback, (VALUE)arguments, &state);
+    if (state) {
+	VALUE logger;
+
+	logger = rb_const_get(rb_mMilter, rb_intern("Logger"));
+	rb_funcall(logger, rb_intern("error"), 1, rb_errinfo());
+    }
+}
+
+static VALUE
+initialize (VALUE self, VALUE event_loop)
+{
+    G_INITIALIZE(self,
+		 milter_manager_dnsbl_new(MILTER_EVENT_LOOP(RVAL2GOBJ(event_loop))));
+    return Qnil;
+}
+
+static VALUE
+add_service (int argc, VALUE *argv, VALUE self)
+{
+    VALUE zone, expected_answer;
+    GError *error = NULL;
+
+    rb_scan_args(argc, argv, "11", &zone, &expected_answer);
+
+    if (!milter_manager_dnsbl_add_service(SELF(self),
+					  RVAL2CSTR(zone),
+					  RVAL2CSTR_ACCEPT_NIL(expected_answer),
+					  &error))
+	RAISE_GERROR(error);
+
+    return self;
+}
+
+static VALUE
+clear_services (VALUE self)
+{
+    milter_manager_dnsbl_clear_services(SELF(self));
+    return self;
+}
+
+static VALUE
+add_name_server (VALUE self, VALUE name_server)
+{
+    GError *error = NULL;
+
+    if (!milter_manager_dnsbl_add_name_server(SELF(self),
+					      RVAL2CSTR(name_server),
+					      &error))
+	RAISE_GERROR(error);
+
+    return self;
+}
+
+static VALUE
+clear_name_servers (VALUE self)
+{
+    milter_manager_dnsbl_clear_name_servers(SELF(self));
+    return self;
+}
+
+static VALUE
+set_timeout (VALUE self, VALUE timeout)
+{
+    milter_manager_dnsbl_set_timeout(SELF(self), NUM2DBL(timeout));
+    return self;
+}
+
+static VALUE
+get_timeout (VALUE self)
+{
+    return rb_float_new(milter_manager_dnsbl_get_timeout(SELF(self)));
+}
+
+static VALUE
+set_n_retries (VALUE self, VALUE n_retries)
+{
+    milter_manager_dnsbl_set_n_retries(SELF(self), NUM2UINT(n_retries));
+    return self;
+}
+
+static VALUE
+get_n_retries (VALUE self)
+{
+    return UINT2NUM(milter_manager_dnsbl_get_n_retries(SELF(self)));
+}
+
+static VALUE
+set_negative_cache_ttl (VALUE self, VALUE ttl)
+{
+    milter_manager_dnsbl_set_negative_cache_ttl(SELF(self), NUM2UINT(ttl));
+    return self;
+}
+
+static VALUE
+get_negative_cache_ttl (VALUE self)
+{
+    return UINT2NUM(milter_manager_dnsbl_get_negative_cache_ttl(SELF(self)));
+}
+
+static VALUE
+set_max_cache_ttl (VALUE self, VALUE ttl)
+{
+    milter_manager_dnsbl_set_max_cache_ttl(SELF(self), NUM2UINT(ttl));
+    return self;
+}
+
+static VALUE
+get_max_cache_ttl (VALUE self)
+{
+    return UINT2NUM(milter_manager_dnsbl_get_max_cache_ttl(SELF(self)));
+}
+
+static VALUE
+set_shared_cache (VALUE self, VALUE cache)
+{
+    MilterManagerSharedCache *shared_cache = NULL;
+
+    if (!NIL_P(cache))
+	shared_cache = MILTER_MANAGER_SHARED_CACHE(RVAL2GOBJ(cache));
+    milter_manager_dnsbl_set_shared_cache(SELF(self), shared_cache);
+    return self;
+}
+
+static VALUE
+get_shared_cache (VALUE self)
+{
+    return GOBJ2RVAL(milter_manager_dnsbl_get_shared_cache(SELF(self)));
+}
+
+static VALUE
+pack_address (VALUE address)
+{
+    if (RVAL2CBOOL(rb_obj_is_kind_of(address, rb_cString)))
+	return address;
+    else
+	return rb_funcall(address, rb_intern("pack"), 0);
+}
+
+static VALUE
+check (VALUE self, VALUE address)
+{
+    VALUE rb_packed_address, rb_block;
+    MilterManagerDNSBL *dnsbl;
+    CheckContext *context;
+
+    rb_block = rb_block_proc();
+    rb_packed_address = pack_address(address);
+
+    dnsbl = SELF(self);
+    context = check_context_new(dnsbl, rb_block);
+    milter_manager_dnsbl_check(dnsbl,
+			       (struct sockaddr *)RSTRING_PTR(rb_packed_address),
+			       RSTRING_LEN(rb_packed_address),
+			       cb_check,
+			       context,
+			       cb_check_context_free);
+
+    return self;
+}
+
+static VALUE
+lookup_cache (VALUE self, VALUE address)
+{
+    VALUE rb_packed_address;
+    gboolean listed = FALSE;
+
+    rb_packed_address = pack_address(address);
+    if (!milter_manager_dnsbl_lookup_cache(SELF(self),
+					   (struct sockaddr *)RSTRING_PTR(rb_packed_address),
+					   RSTRING_LEN(rb_packed_address),
+					   &listed))
+	return Qnil;
+
+    return CBOOL2RVAL(listed);
+}
+
+static VALUE
+clear_cache (VALUE self)
+{
+    milter_manager_dnsbl_clear_cache(SELF(self));
+    return self;
+}
+
+static VALUE
+get_n_pending_queries (VALUE self)
+{
+    return UINT2NUM(milter_manager_dnsbl_get_n_pending_queries(SELF(self)));
+}
+
+static void
+mark (gpointer data)
+{
+    MilterManagerDNSBL *dnsbl = data;
+    GList *callbacks, *node;
+
+    callbacks = callbacks_get(dnsbl);
+    for (node = callbacks; node; node = g_list_next(node)) {
+	VALUE callback = (VALUE)(node->data);
+	rb_gc_mark(callback);
+    }
+}
+
+void
+Init_milter_manager_dnsbl (void)
+{
+    VALUE rb_cMilterManagerDNSBL;
+
+    rb_cMilterManagerDNSBL =
+	G_DEF_CLASS_WITH_GC_FUNC(MILTER_TYPE_MANAGER_DNSBL, "DNSBL",
+				 rb_mMilterManager, mark, NULL);
+    G_DEF_ERROR2(MILTER_MANAGER_DNSBL_ERROR, "DNSBLError",
+		 rb_mMilterManager, rb_eMilterError);
+
+    rb_define_method(rb_cMilterManagerDNSBL, "initialize", initialize, 1);
+    rb_define_method(rb_cMilterManagerDNSBL, "add_service", add_service, -1);
+    rb_define_method(rb_cMilterManagerDNSBL, "clear_services",
+		     clear_services, 0);
+    rb_define_method(rb_cMilterManagerDNSBL, "add_name_server",
+		     add_name_server, 1);
+    rb_define_method(rb_cMilterManagerDNSBL, "clear_name_servers",
+		     clear_name_servers, 0);
+    rb_define_method(rb_cMilterManagerDNSBL, "set_timeout", set_timeout, 1);
+    rb_define_method(rb_cMilterManagerDNSBL, "timeout", get_timeout, 0);
+    rb_define_method(rb_cMilterManagerDNSBL, "set_n_retries",
+		     set_n_retries, 1);
+    rb_define_method(rb_cMilterManagerDNSBL, "n_retries", get_n_retries, 0);
+    rb_define_method(rb_cMilterManagerDNSBL, "set_negative_cache_ttl",
+		     set_negative_cache_ttl, 1);
+    rb_define_method(rb_cMilterManagerDNSBL, "negative_cache_ttl",
+		     get_negative_cache_ttl, 0);
+    rb_define_method(rb_cMilterManagerDNSBL, "set_max_cache_ttl",
+		     set_max_cache_ttl, 1);
+    rb_define_method(rb_cMilterManagerDNSBL, "max_cache_ttl",
+		     get_max_cache_ttl, 0);
+    rb_define_method(rb_cMilterManagerDNSBL, "set_shared_cache",
+		     set_shared_cache, 1);
+    rb_define_method(rb_cMilterManagerDNSBL, "shared_cache",
+		     get_shared_cache, 0);
+    rb_define_method(rb_cMilterManagerDNSBL, "check", check, 1);
+    rb_define_method(rb_cMilterManagerDNSBL, "lookup_cache", lookup_cache, 1);
+    rb_define_method(rb_cMilterManagerDNSBL, "clear_cache", clear_cache, 0);
+    rb_define_method(rb_cMilterManagerDNSBL, "n_pending_queries",
+		     get_n_pending_queries, 0);
+
+    G_DEF_SETTERS(rb_cMilterManagerDNSBL);
+}
@@ -41,6 +41,35 @@ set_connection_spec (VALUE self, VALUE spec)
     return self;
 }
 
+static VALUE
+add_connection_spec (VALUE self, VALUE spec)
+{
+    GError *error = NULL;
+
+    if (!milter_manager_egg_add_connection_spec(SELF(self),
+						RVAL2CSTR(spec),
+						&error))
+	RAISE_GERROR(error);
+
+    return self;
+}
+
+static VALUE
+get_connection_specs (VALUE self)
+{
+    GList *specs, *node;
+    VALUE rb_specs;
+
+    rb_specs = rb_ary_new();
+    specs = milter_manager_egg_get_connection_specs(SELF(self));
+    for (node = specs; node; node = g_list_next(node)) {
+	rb_ary_push(rb_specs, CSTR2RVAL(node->data));
+    }
+    g_list_free(specs);
+
+    return rb_specs;
+}
+
 static VALUE
 merge (VALUE self, VALUE other)
 {
@@ -120,6 +149,10 @@ Init_milter_manager_egg (void)
 
     rb_define_method(rb_cMilterManagerEgg, "set_connection_spec",
 		     set_connection_spec, 1);
+    rb_define_method(rb_cMilterManagerEgg, "add_connection_spec",
+		     add_connection_spec, 1);
+    rb_define_method(rb_cMilterManagerEgg, "connection_specs",
+		     get_connection_specs, 0);
     rb_define_method(rb_cMilterManagerEgg, "merge", merge, 1);
     rb_define_method(rb_cMilterManagerEgg, "to_xml", to_xml, -1);
 
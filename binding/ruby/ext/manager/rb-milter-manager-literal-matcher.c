@@ -0,0 +1,82 @@
+/* -*- c-file-style: "ruby" -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rb-milter-manager-private.h"
+
+#define SELF(self) (MILTER_MANAGER_LITERAL_MATCHER(RVAL2GOBJ(self)))
+
+static VALUE
+initialize (VALUE self)
+{
+    G_INITIALIZE(self, milter_manager_literal_matcher_new());
+    return Qnil;
+}
+
+static VALUE
+add (VALUE self, VALUE literal, VALUE id)
+{
+    milter_manager_literal_matcher_add(SELF(self),
+				       RVAL2CSTR(literal),
+				       NUM2UINT(id));
+    return self;
+}
+
+static VALUE
+match (VALUE self, VALUE text)
+{
+    GArray *ids;
+    VALUE rb_ids;
+    guint i;
+
+    StringValue(text);
+    ids = g_array_new(FALSE, FALSE, sizeof(guint));
+    milter_manager_literal_matcher_match(SELF(self),
+					 RSTRING_PTR(text),
+					 RSTRING_LEN(text),
+					 ids);
+    rb_ids = rb_ary_new2(ids->len);
+    for (i = 0; i < ids->len; i++) {
+	rb_ary_push(rb_ids, UINT2NUM(g_array_index(ids, guint, i)));
+    }
+    g_array_free(ids, TRUE);
+
+    return rb_ids;
+}
+
+static VALUE
+get_size (VALUE self)
+{
+    return UINT2NUM(milter_manager_literal_matcher_get_size(SELF(self)));
+}
+
+void
+Init_milter_manager_literal_matcher (void)
+{
+    VALUE rb_cMilterManagerLiteralMatcher;
+
+    rb_cMilterManagerLiteralMatcher =
+	G_DEF_CLASS(MILTER_TYPE_MANAGER_LITERAL_MATCHER, "LiteralMatcher",
+		    rb_mMilterManager);
+
+    rb_define_method(rb_cMilterManagerLiteralMatcher, "initialize",
+		     initialize, 0);
+    rb_define_method(rb_cMilterManagerLiteralMatcher, "add", add, 2);
+    rb_define_method(rb_cMilterManagerLiteralMatcher, "match", match, 1);
+    rb_define_method(rb_cMilterManagerLiteralMatcher, "size", get_size, 0);
+}
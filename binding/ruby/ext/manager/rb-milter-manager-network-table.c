@@ -0,0 +1,167 @@
+/* -*- c-file-style: "ruby" -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rb-milter-manager-private.h"
+
+#define SELF(self) (MILTER_MANAGER_NETWORK_TABLE(RVAL2GOBJ(self)))
+
+static ID id_to_ip_address;
+
+static VALUE
+initialize (int argc, VALUE *argv, VALUE self)
+{
+    VALUE path;
+    MilterManagerNetworkTable *table;
+    GError *error = NULL;
+
+    rb_scan_args(argc, argv, "01", &path);
+
+    if (NIL_P(path)) {
+	table = milter_manager_network_table_new();
+    } else {
+	table = milter_manager_network_table_new_from_file(RVAL2CSTR(path),
+							   &error);
+	if (!table)
+	    RAISE_GERROR(error);
+    }
+
+    G_INITIALIZE(self, table);
+    return Qnil;
+}
+
+static VALUE
+add (int argc, VALUE *argv, VALUE self)
+{
+    VALUE network, value;
+    GError *error = NULL;
+
+    rb_scan_args(argc, argv, "11", &network, &value);
+
+    if (!milter_manager_network_table_add(SELF(self),
+					  RVAL2CSTR(rb_obj_as_string(network)),
+					  RVAL2CSTR_ACCEPT_NIL(value),
+					  &error))
+	RAISE_GERROR(error);
+
+    return self;
+}
+
+static const gchar *
+address_to_string (VALUE address)
+{
+    if (rb_respond_to(address, id_to_ip_address))
+	address = rb_funcall(address, id_to_ip_address, 0);
+    if (NIL_P(address))
+	return NULL;
+    return RVAL2CSTR(rb_obj_as_string(address));
+}
+
+static VALUE
+lookup (VALUE self, VALUE address, gboolean longest, gboolean *found)
+{
+    const gchar *address_string;
+    const gchar *value = NULL;
+
+    *found = FALSE;
+    address_string = address_to_string(address);
+    if (!address_string)
+	return Qnil;
+
+    *found = milter_manager_network_table_lookup_string(SELF(self),
+							address_string,
+							longest,
+							&value);
+    return CSTR2RVAL(value);
+}
+
+static VALUE
+find (VALUE self, VALUE address)
+{
+    gboolean found;
+
+    return lookup(self, address, FALSE, &found);
+}
+
+static VALUE
+find_longest (VALUE self, VALUE address)
+{
+    gboolean found;
+
+    return lookup(self, address, TRUE, &found);
+}
+
+static VALUE
+include_p (VALUE self, VALUE address)
+{
+    gboolean found;
+
+    lookup(self, address, FALSE, &found);
+    return CBOOL2RVAL(found);
+}
+
+static VALUE
+get_size (VALUE self)
+{
+    return UINT2NUM(milter_manager_network_table_get_size(SELF(self)));
+}
+
+static VALUE
+read_only_p (VALUE self)
+{
+    return CBOOL2RVAL(milter_manager_network_table_is_read_only(SELF(self)));
+}
+
+static VALUE
+save (VALUE self, VALUE path)
+{
+    GError *error = NULL;
+
+    if (!milter_manager_network_table_save(SELF(self), RVAL2CSTR(path),
+					   &error))
+	RAISE_GERROR(error);
+
+    return self;
+}
+
+void
+Init_milter_manager_network_table (void)
+{
+    VALUE rb_cMilterManagerNetworkTable;
+
+    id_to_ip_address = rb_intern("to_ip_address");
+
+    rb_cMilterManagerNetworkTable =
+	G_DEF_CLASS(MILTER_TYPE_MANAGER_NETWORK_TABLE, "NetworkTable",
+		    rb_mMilterManager);
+    G_DEF_ERROR2(MILTER_MANAGER_NETWORK_TABLE_ERROR, "NetworkTableError",
+		 rb_mMilterManager, rb_eMilterError);
+
+    rb_define_method(rb_cMilterManagerNetworkTable, "initialize",
+		     initialize, -1);
+    rb_define_method(rb_cMilterManagerNetworkTable, "add", add, -1);
+    rb_define_method(rb_cMilterManagerNetworkTable, "find", find, 1);
+    rb_define_method(rb_cMilterManagerNetworkTable, "find_longest",
+		     find_longest, 1);
+    rb_define_method(rb_cMilterManagerNetworkTable, "include?",
+		     include_p, 1);
+    rb_define_method(rb_cMilterManagerNetworkTable, "size", get_size, 0);
+    rb_define_method(rb_cMilterManagerNetworkTable, "read_only?",
+		     read_only_p, 0);
+    rb_define_method(rb_cMilterManagerNetworkTable, "save", save, 1);
+}
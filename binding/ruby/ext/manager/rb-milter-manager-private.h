@@ -32,6 +32,10 @@ extern void Init_milter_manager_children (void);
 extern void Init_milter_manager_control_command_encoder (void);
 extern void Init_milter_manager_control_reply_encoder (void);
 extern void Init_milter_manager_control_decoder (void);
+extern void Init_milter_manager_dnsbl (void);
+extern void Init_milter_manager_shared_cache (void);
+extern void Init_milter_manager_network_table (void);
+extern void Init_milter_manager_literal_matcher (void);
 
 extern VALUE rb_milter_manager_gstring_handle_to_xml_signal (guint num, const GValue *values);
 
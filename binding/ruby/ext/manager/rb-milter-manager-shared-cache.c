@@ -0,0 +1,140 @@
+/* -*- c-file-style: "ruby" -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rb-milter-manager-private.h"
+
+#define SELF(self) (MILTER_MANAGER_SHARED_CACHE(RVAL2GOBJ(self)))
+
+static VALUE
+initialize (VALUE self, VALUE n_entries)
+{
+    MilterManagerSharedCache *cache;
+    GError *error = NULL;
+
+    cache = milter_manager_shared_cache_new(NUM2UINT(n_entries), &error);
+    if (!cache)
+	RAISE_GERROR(error);
+
+    G_INITIALIZE(self, cache);
+    return Qnil;
+}
+
+static VALUE
+get_n_entries (VALUE self)
+{
+    return UINT2NUM(milter_manager_shared_cache_get_n_entries(SELF(self)));
+}
+
+static VALUE
+set (VALUE self, VALUE key, VALUE value, VALUE ttl)
+{
+    gboolean stored;
+
+    StringValue(value);
+    stored = milter_manager_shared_cache_set(SELF(self),
+					     RVAL2CSTR(key),
+					     RSTRING_PTR(value),
+					     RSTRING_LEN(value),
+					     NUM2DBL(ttl));
+    return CBOOL2RVAL(stored);
+}
+
+static VALUE
+get (VALUE self, VALUE key)
+{
+    gchar *value = NULL;
+    gsize value_size = 0;
+    VALUE rb_value;
+
+    if (!milter_manager_shared_cache_get(SELF(self), RVAL2CSTR(key),
+					 &value, &value_size))
+	return Qnil;
+
+    rb_value = rb_str_new(value, value_size);
+    g_free(value);
+    return rb_value;
+}
+
+static VALUE
+delete (VALUE self, VALUE key)
+{
+    return CBOOL2RVAL(milter_manager_shared_cache_remove(SELF(self),
+							 RVAL2CSTR(key)));
+}
+
+static VALUE
+clear (VALUE self)
+{
+    milter_manager_shared_cache_clear(SELF(self));
+    return self;
+}
+
+static VALUE
+get_statistics (VALUE self)
+{
+    MilterManagerSharedCacheStatistics statistics;
+    VALUE rb_statistics;
+
+    milter_manager_shared_cache_get_statistics(SELF(self), &statistics);
+
+    rb_statistics = rb_hash_new();
+    rb_hash_aset(rb_statistics, CSTR2RVAL("n_hits"),
+		 ULL2NUM(statistics.n_hits));
+    rb_hash_aset(rb_statistics, CSTR2RVAL("n_misses"),
+		 ULL2NUM(statistics.n_misses));
+    rb_hash_aset(rb_statistics, CSTR2RVAL("n_stores"),
+		 ULL2NUM(statistics.n_stores));
+    rb_hash_aset(rb_statistics, CSTR2RVAL("n_evictions"),
+		 ULL2NUM(statistics.n_evictions));
+    rb_hash_aset(rb_statistics, CSTR2RVAL("n_expirations"),
+		 ULL2NUM(statistics.n_expirations));
+    return rb_statistics;
+}
+
+static VALUE
+reset_statistics (VALUE self)
+{
+    milter_manager_shared_cache_reset_statistics(SELF(self));
+    return self;
+}
+
+void
+Init_milter_manager_shared_cache (void)
+{
+    VALUE rb_cMilterManagerSharedCache;
+
+    rb_cMilterManagerSharedCache =
+	G_DEF_CLASS(MILTER_TYPE_MANAGER_SHARED_CACHE, "SharedCache",
+		    rb_mMilterManager);
+    G_DEF_ERROR2(MILTER_MANAGER_SHARED_CACHE_ERROR, "SharedCacheError",
+		 rb_mMilterManager, rb_eMilterError);
+
+    rb_define_method(rb_cMilterManagerSharedCache, "initialize",
+		     initialize, 1);
+    rb_define_method(rb_cMilterManagerSharedCache, "n_entries",
+		     get_n_entries, 0);
+    rb_define_method(rb_cMilterManagerSharedCache, "set", set, 3);
+    rb_define_method(rb_cMilterManagerSharedCache, "[]", get, 1);
+    rb_define_method(rb_cMilterManagerSharedCache, "delete", delete, 1);
+    rb_define_method(rb_cMilterManagerSharedCache, "clear", clear, 0);
+    rb_define_method(rb_cMilterManagerSharedCache, "statistics",
+		     get_statistics, 0);
+    rb_define_method(rb_cMilterManagerSharedCache, "reset_statistics",
+		     reset_statistics, 0);
+}
@@ -34,4 +34,8 @@ Init_milter_manager (void)
     Init_milter_manager_control_command_encoder();
     Init_milter_manager_control_reply_encoder();
     Init_milter_manager_control_decoder();
+    Init_milter_manager_dnsbl();
+    Init_milter_manager_shared_cache();
+    Init_milter_manager_network_table();
+    Init_milter_manager_literal_matcher();
 }
@@ -78,6 +78,26 @@ context_connect (VALUE self, VALUE host, VALUE address)
     return CBOOL2RVAL(success);
 }
 
+static VALUE
+context_delay_connect (VALUE self)
+{
+    milter_server_context_delay_connect(SELF(self));
+    return self;
+}
+
+static VALUE
+context_resume_connect (VALUE self, VALUE stop)
+{
+    milter_server_context_resume_connect(SELF(self), RVAL2CBOOL(stop));
+    return self;
+}
+
+static VALUE
+context_is_delaying_connect (VALUE self)
+{
+    return CBOOL2RVAL(milter_server_context_is_delaying_connect(SELF(self)));
+}
+
 static VALUE
 context_helo (VALUE self, VALUE fqdn)
 {
@@ -234,6 +254,12 @@ Init_milter_server_context (void)
     rb_define_method(rb_cMilterServerContext, "negotiate",
                      context_negotiate, 1);
     rb_define_method(rb_cMilterServerContext, "connect", context_connect, 2);
+    rb_define_method(rb_cMilterServerContext, "delay_connect",
+                     context_delay_connect, 0);
+    rb_define_method(rb_cMilterServerContext, "resume_connect",
+                     context_resume_connect, 1);
+    rb_define_method(rb_cMilterServerContext, "delaying_connect?",
+                     context_is_delaying_connect, 0);
     rb_define_method(rb_cMilterServerContext, "helo", context_helo, 1);
     rb_define_method(rb_cMilterServerContext, "envelope_from",
                      context_envelope_from, 1);
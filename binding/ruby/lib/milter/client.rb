@@ -19,6 +19,8 @@ require "milter_client.so"
 require "milter/client/session"
 require "milter/client/fallback-session"
 require "milter/client/session-context"
+require "milter/client/session-fiber"
+require "milter/client/session-dispatcher"
 require "milter/client/configuration"
 require "milter/client/context-state"
 require "milter/client/command-line"
@@ -36,17 +38,52 @@ module Milter
       @fallback_status = status
     end
 
+    # Runs session callbacks in Fibers when it is true. See
+    # Milter::Client::SessionFiber.
+    def fiber_mode?
+      @fiber_mode ||= false
+    end
+
+    def fiber_mode=(boolean)
+      @fiber_mode = boolean
+    end
+
+    BODY_CHUNK_MODES = [:copy, :shared, :buffer]
+
+    # How body chunks are passed to Milter::ClientSession#body.
+    # :copy passes a new String for each chunk. :shared reuses
+    # one String for all chunks of a session. It is only valid
+    # in the callback. :buffer accumulates all chunks and
+    # passes the whole body once before end_of_message.
+    def body_chunk_mode
+      @body_chunk_mode ||= :copy
+    end
+
+    def body_chunk_mode=(mode)
+      mode = (mode || :copy).to_sym
+      unless BODY_CHUNK_MODES.include?(mode)
+        raise ArgumentError,
+              "body chunk mode should be one of " +
+              "#{BODY_CHUNK_MODES.inspect}: <#{mode.inspect}>"
+      end
+      @body_chunk_mode = mode
+    end
+
     # just for backward compatibility.
     alias_method :status_on_error, :fallback_status
     alias_method :status_on_error=, :fallback_status=
 
     def register(session_class, *new_arguments)
+      dispatcher = SessionDispatcher.new(self, session_class, new_arguments)
       signal_connect("connection-established") do |_client, context|
         begin
-          setup_session(context, session_class, new_arguments)
+          dispatcher.attach(context)
         rescue Exception
           Milter::Logger.error($!)
-          setup_session(context, ClientFallbackSession, [fallback_status])
+          fallback_dispatcher = SessionDispatcher.new(self,
+                                                      ClientFallbackSession,
+                                                      [fallback_status])
+          fallback_dispatcher.attach(context)
         end
       end
     end
@@ -89,52 +126,6 @@ module Milter
     end
 
     private
-    def setup_session(context, session_class, session_new_arguments)
-      session_context = ClientSessionContext.new(context)
-      session = session_class.new(session_context, *session_new_arguments)
-
-      [:negotiate, :connect, :helo, :envelope_from, :envelope_recipient,
-       :data, :unknown, :header, :end_of_header, :body, :end_of_message,
-       :finished].each do |event|
-        next unless session.respond_to?(event)
-        context.signal_connect(event) do |_context, *args|
-          begin
-            if event == :end_of_message
-              session.send(event)
-            else
-              session.send(event, *args)
-            end
-          rescue Exception
-            Milter::Logger.error($!)
-            session_context.status = fallback_status
-          end
-          status = session_context.status
-          session_context.clear
-          status
-        end
-      end
-
-      context.signal_connect(:abort) do |_context, *args|
-        if session.respond_to?(:abort)
-          begin
-            session.abort(*args)
-          rescue Exception
-            Milter::Logger.error($!)
-            session_context.status = fallback_status
-          end
-        end
-        begin
-          session.reset
-        rescue Exception
-          Milter::Logger.error($!)
-          session_context.status = fallback_status
-        end
-        status = session_context.status
-        session_context.clear
-        status
-      end
-    end
-
     def reload_callbacks
       @reload_callbacks ||= []
     end
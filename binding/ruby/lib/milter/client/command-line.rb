@@ -203,6 +203,20 @@ module Milter
           milter_conf.n_workers = n
         end
 
+        @option_parser.on("--[no-]fiber-mode",
+                          "Run session callbacks in fibers",
+                          "(#{milter_conf.fiber_mode?})") do |boolean|
+          milter_conf.fiber_mode = boolean
+        end
+
+        body_chunk_modes = Milter::Client::BODY_CHUNK_MODES
+        @option_parser.on("--body-chunk-mode=MODE", body_chunk_modes,
+                          "Use MODE to pass body chunks to sessions.",
+                          "available values: [#{body_chunk_modes.join(', ')}]",
+                          "(#{milter_conf.body_chunk_mode})") do |mode|
+          milter_conf.body_chunk_mode = mode
+        end
+
         @option_parser.on("--packet-buffer-size=SIZE",
                           Integer,
                           "Use SIZE as packet buffer size.",
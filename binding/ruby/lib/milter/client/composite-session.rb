@@ -15,7 +15,6 @@
 
 # TODO: header...end-of-message events should be handled as an event set.
 # TODO: status handle may be buggy.
-# TODO: support asynchronous.
 
 module Milter
   class Client
@@ -72,6 +72,8 @@ module Milter
         attr_accessor :max_pending_finished_sessions
         attr_accessor :fallback_status
         attr_writer :daemon, :handle_signal, :run_gc_on_maintain
+        attr_writer :fiber_mode
+        attr_accessor :body_chunk_mode
         attr_reader :maintained_hooks, :event_loop_created_hooks
         def initialize(base_configuration)
           @base_configuration = base_configuration
@@ -90,6 +92,10 @@ module Milter
           @run_gc_on_maintain
         end
 
+        def fiber_mode?
+          @fiber_mode
+        end
+
         def clear
           @name = File.basename($PROGRAM_NAME, ".*"),
           @connection_spec = "inet:20025"
@@ -111,6 +117,8 @@ module Milter
           @max_pending_finished_sessions = 0
           @run_gc_on_maintain = true
           @handle_signal = true
+          @fiber_mode = false
+          @body_chunk_mode = :copy
           @maintained_hooks = []
           @event_loop_created_hooks = []
         end
@@ -131,6 +139,8 @@ module Milter
           end
           client.n_workers = @n_workers
           client.max_pending_finished_sessions = @max_pending_finished_sessions
+          client.fiber_mode = @fiber_mode
+          client.body_chunk_mode = @body_chunk_mode
           unless @maintained_hooks.empty?
             client.on_maintain do
               maintained
@@ -612,6 +622,30 @@ module Milter
           @configuration.n_workers = n_workers
         end
 
+        def fiber_mode?
+          @configuration.fiber_mode?
+        end
+
+        def fiber_mode=(boolean)
+          update_location("fiber_mode", false)
+          @configuration.fiber_mode = boolean
+        end
+
+        def body_chunk_mode
+          @configuration.body_chunk_mode
+        end
+
+        def body_chunk_mode=(mode)
+          available_values = Milter::Client::BODY_CHUNK_MODES
+          normalized_mode = (mode || :copy).to_s.to_sym
+          unless available_values.include?(normalized_mode)
+            raise InvalidValue.new(full_key("body_chunk_mode"),
+                                   available_values, mode)
+          end
+          update_location("body_chunk_mode", mode.nil?)
+          @configuration.body_chunk_mode = normalized_mode
+        end
+
         def packet_buffer_size
           @configuration.packet_buffer_size
         end
@@ -0,0 +1,127 @@
+# Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+#
+# This library is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library.  If not, see <http://www.gnu.org/licenses/>.
+
+module Milter
+  class Client
+    # Routes events of Milter::ClientContext to a session. A
+    # dispatcher is created once for each registered session
+    # class and caches events that the class implements. For
+    # each session, the C extension connects only handlers of
+    # the cached events and calls Handler#dispatch directly
+    # instead of creating Ruby closures.
+    class SessionDispatcher
+      EVENTS = [:negotiate, :connect, :helo, :envelope_from,
+                :envelope_recipient, :data, :unknown, :header,
+                :end_of_header, :body, :end_of_message, :finished]
+
+      attr_reader :events
+      def initialize(client, session_class, session_new_arguments)
+        @client = client
+        @session_class = session_class
+        @session_new_arguments = session_new_arguments
+        @events = EVENTS.select do |event|
+          session_class.public_method_defined?(event)
+        end
+        # end_of_message passes the accumulated body to body in
+        # :buffer body chunk mode.
+        if @events.include?(:body) and !@events.include?(:end_of_message)
+          @events << :end_of_message
+        end
+        # abort is always needed to reset the session.
+        @events << :abort
+        @events.freeze
+      end
+
+      def attach(context)
+        handler = Handler.new(@client, context,
+                              @session_class, @session_new_arguments)
+        context.attach_session_handler(handler, @events,
+                                       @client.body_chunk_mode)
+        handler
+      end
+
+      class Handler
+        attr_reader :session
+        def initialize(client, context, session_class, session_new_arguments)
+          @client = client
+          @session_context = ClientSessionContext.new(context)
+          @session = session_class.new(@session_context, *session_new_arguments)
+          @session_fiber = nil
+          @session_fiber = SessionFiber.new(context) if client.fiber_mode?
+          @buffered_body = (client.body_chunk_mode == :buffer)
+        end
+
+        # Called from the C extension. negotiate is always
+        # processed synchronously because its response needs
+        # the option and macros requests.
+        def dispatch(event, *args)
+          if @session_fiber.nil? or event == :negotiate
+            process(event, args)
+          else
+            response_signal = nil
+            response_signal = "#{event}_response" unless event == :finished
+            @session_fiber.run(response_signal) do
+              process(event, args)
+            end
+          end
+        end
+
+        private
+        def process(event, args)
+          case event
+          when :abort
+            invoke(:abort, args) if @session.respond_to?(:abort)
+            invoke(:reset, [])
+          when :end_of_message
+            process_end_of_message(args.first)
+          else
+            invoke(event, args)
+          end
+          status = @session_context.status
+          @session_context.clear
+          status
+        end
+
+        # The accumulated body is passed to body at once in
+        # :buffer body chunk mode.
+        def process_end_of_message(body)
+          if @buffered_body and body and @session.respond_to?(:body)
+            invoke(:body, [body])
+            return unless continue_status?(@session_context.status)
+            @session_context.clear
+          end
+          invoke(:end_of_message, []) if @session.respond_to?(:end_of_message)
+        end
+
+        def continue_status?(status)
+          case status
+          when String, Symbol
+            status = status.to_s.downcase.gsub(/-/, "_")
+            ["default", "continue"].include?(status)
+          else
+            [Milter::Status::DEFAULT, Milter::Status::CONTINUE].include?(status)
+          end
+        end
+
+        def invoke(method_name, args)
+          @session.__send__(method_name, *args)
+        rescue Exception
+          Milter::Logger.error($!)
+          @session_context.status = @client.fallback_status
+        end
+      end
+    end
+  end
+end
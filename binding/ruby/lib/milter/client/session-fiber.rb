@@ -0,0 +1,227 @@
+# Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+#
+# This library is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library.  If not, see <http://www.gnu.org/licenses/>.
+
+require "fiber"
+require "socket"
+require "resolv"
+
+module Milter
+  class Client
+    # Runs session callbacks of a session in Fibers. If a
+    # callback waits for IO or time by SessionFiber.wait_readable,
+    # SessionFiber.sleep and so on, the callback yields to the
+    # event loop and the response for the event is sent to MTA
+    # when the callback is finished. Events of a session are
+    # processed in order.
+    #
+    # SessionFiber.wait_readable and so on block the process
+    # when they aren't called in a session fiber.
+    class SessionFiber
+      class << self
+        def current
+          Thread.current[:milter_client_session_fiber]
+        end
+
+        def wait_readable(io, timeout=nil)
+          session_fiber = current
+          if session_fiber
+            session_fiber.wait_io(io, GLib::IOChannel::IN, timeout)
+          else
+            not IO.select([io], nil, nil, timeout).nil?
+          end
+        end
+
+        def wait_writable(io, timeout=nil)
+          session_fiber = current
+          if session_fiber
+            session_fiber.wait_io(io, GLib::IOChannel::OUT, timeout)
+          else
+            not IO.select(nil, [io], nil, timeout).nil?
+          end
+        end
+
+        def sleep(seconds)
+          session_fiber = current
+          if session_fiber
+            session_fiber.sleep(seconds)
+          else
+            Kernel.sleep(seconds)
+          end
+          nil
+        end
+
+        # Returns read data or nil on EOF or timeout.
+        def read(io, size, timeout=nil)
+          loop do
+            begin
+              return io.read_nonblock(size)
+            rescue IO::WaitReadable
+              return nil unless wait_readable(io, timeout)
+            rescue EOFError
+              return nil
+            end
+          end
+        end
+
+        # Returns the number of written bytes. It may be less
+        # than data size on timeout.
+        def write(io, data, timeout=nil)
+          data = data.to_s
+          written_size = 0
+          while written_size < data.bytesize
+            begin
+              rest = data.byteslice(written_size, data.bytesize - written_size)
+              written_size += io.write_nonblock(rest)
+            rescue IO::WaitWritable
+              break unless wait_writable(io, timeout)
+            end
+          end
+          written_size
+        end
+
+        # Returns resources of +type+ for +name+ from the first
+        # name server in resolv.conf. It returns an empty array
+        # on timeout.
+        def resolve(name, type=Resolv::DNS::Resource::IN::A, timeout=5)
+          host, port = dns_config.nameserver_port.first
+          query = Resolv::DNS::Message.new(rand(0x10000))
+          query.rd = 1
+          query.add_question(name, type)
+          family = host.include?(":") ? Socket::AF_INET6 : Socket::AF_INET
+          socket = UDPSocket.new(family)
+          begin
+            socket.connect(host, port)
+            socket.send(query.encode, 0)
+            return [] unless wait_readable(socket, timeout)
+            reply = Resolv::DNS::Message.decode(socket.recv(Resolv::DNS::UDPSize))
+            return [] if reply.id != query.id
+            resources = []
+            reply.each_answer do |_name, _ttl, data|
+              resources << data if data.is_a?(type)
+            end
+            resources
+          ensure
+            socket.close
+          end
+        end
+
+        private
+        def dns_config
+          @dns_config ||= Resolv::DNS::Config.new
+          @dns_config.lazy_initialize
+          @dns_config
+        end
+      end
+
+      def initialize(context)
+        @context = context
+        @fiber = nil
+        @response_signal = nil
+        @pending_events = []
+      end
+
+      # Runs the block in a fiber and returns its status. If
+      # the block waits for something, it returns
+      # Milter::Status::PROGRESS and emits +response_signal+
+      # with the status when the block is finished.
+      def run(response_signal=nil, &block)
+        if @fiber
+          @pending_events << [response_signal, block]
+          return Milter::Status::PROGRESS
+        end
+        start(response_signal, block)
+      end
+
+      def running?
+        not @fiber.nil?
+      end
+
+      def wait_io(io, condition, timeout)
+        channel = GLib::IOChannel.new(io)
+        await(timeout) do |event_loop, wake_up|
+          event_loop.watch_io(channel, condition) do |*args|
+            wake_up.call
+            false
+          end
+        end
+      end
+
+      def sleep(seconds)
+        await(nil) do |event_loop, wake_up|
+          event_loop.add_timeout(seconds) do
+            wake_up.call
+            false
+          end
+        end
+      end
+
+      private
+      def start(response_signal, block)
+        fiber = Fiber.new do
+          Thread.current[:milter_client_session_fiber] = self
+          block.call
+        end
+        status = fiber.resume
+        if fiber.alive?
+          @fiber = fiber
+          @response_signal = response_signal
+          Milter::Status::PROGRESS
+        else
+          status
+        end
+      end
+
+      def resume(ready)
+        status = @fiber.resume(ready)
+        return if @fiber.alive?
+        response_signal = @response_signal
+        @fiber = nil
+        @response_signal = nil
+        @context.signal_emit(response_signal, status) if response_signal
+        process_pending_events
+      end
+
+      def process_pending_events
+        until @pending_events.empty?
+          response_signal, block = @pending_events.shift
+          status = start(response_signal, block)
+          break if @fiber
+          @context.signal_emit(response_signal, status) if response_signal
+        end
+      end
+
+      def await(timeout)
+        event_loop = @context.event_loop
+        tags = {}
+        wake_up = lambda do |key|
+          tags.delete(key)
+          resume(key == :ready)
+        end
+        tags[:ready] = yield(event_loop, lambda {wake_up.call(:ready)})
+        if timeout
+          tags[:timeout] = event_loop.add_timeout(timeout) do
+            wake_up.call(:timeout)
+            false
+          end
+        end
+        ready = Fiber.yield
+        tags.each_value do |tag|
+          event_loop.remove(tag)
+        end
+        ready
+      end
+    end
+  end
+end
@@ -148,7 +148,7 @@ module Milter
     end
 
     def watch_io(channel, condition, options=nil, &block)
-      @context.event_loop.watch_io(interval, options, &block)
+      @context.event_loop.watch_io(channel, condition, options, &block)
     end
 
     def watch_child(pid, options=nil, &block)
@@ -167,6 +167,32 @@ module Milter
       @context.event_loop.remove(tag)
     end
 
+    # The following helpers yield to the event loop instead of
+    # blocking the process when the client is in fiber mode.
+    def wait_readable(io, timeout=nil)
+      Milter::Client::SessionFiber.wait_readable(io, timeout)
+    end
+
+    def wait_writable(io, timeout=nil)
+      Milter::Client::SessionFiber.wait_writable(io, timeout)
+    end
+
+    def read_io(io, size, timeout=nil)
+      Milter::Client::SessionFiber.read(io, size, timeout)
+    end
+
+    def write_io(io, data, timeout=nil)
+      Milter::Client::SessionFiber.write(io, data, timeout)
+    end
+
+    def resolve(name, type=Resolv::DNS::Resource::IN::A, timeout=5)
+      Milter::Client::SessionFiber.resolve(name, type, timeout)
+    end
+
+    def sleep(seconds)
+      Milter::Client::SessionFiber.sleep(seconds)
+    end
+
     def [](name)
       @context[name]
     end
@@ -40,6 +40,7 @@ require 'milter/manager/redhat-detector'
 require 'milter/manager/freebsd-rc-detector'
 require 'milter/manager/pkgsrc-rc-detector'
 
+require 'milter/manager/regexp-matcher'
 require 'milter/manager/postfix-cidr-table'
 require 'milter/manager/postfix-regexp-table'
 
@@ -84,6 +85,7 @@ module Milter
       end
 
       def clear
+        @detector_used = false
         @maintained_hooks = nil
         @event_loop_created_hooks = nil
         @netstat_connection_checker = nil
@@ -95,6 +97,24 @@ module Milter
         @maintained_hooks ||= []
       end
 
+      def detector_used
+        @detector_used = true
+      end
+
+      # Snapshot only has values. Hooks, database and log
+      # configurations are Ruby objects or are applied to
+      # Ruby objects directly. Detectors read system files
+      # such as init scripts that aren't snapshot inputs.
+      def snapshot_available?
+        return false if @detector_used
+        return false unless maintained_hooks.empty?
+        return false unless event_loop_created_hooks.empty?
+        return false unless @database.nil? or @database.type.nil?
+        return false if get_location("log.level")
+        return false if get_location("log.path")
+        true
+      end
+
       def event_loop_created_hooks
         @event_loop_created_hooks ||= []
       end
@@ -207,6 +227,7 @@ module Milter
         dump_item("manager.chunk_size", c.chunk_size)
         dump_item("manager.max_pending_finished_sessions",
                   c.max_pending_finished_sessions)
+        dump_item("manager.shared_cache_size", c.shared_cache_size)
         @result << "\n"
       end
 
@@ -314,7 +335,12 @@ module Milter
         name = egg.name
         dump_location("milter[#{name}]")
         @result << "define_milter(#{name.inspect}) do |milter|\n"
-        dump_egg_item(name, "connection_spec", egg.connection_spec.inspect)
+        connection_specs = egg.connection_specs
+        if connection_specs.size > 1
+          dump_egg_item(name, "connection_spec", connection_specs.inspect)
+        else
+          dump_egg_item(name, "connection_spec", egg.connection_spec.inspect)
+        end
         dump_egg_item(name, "description", egg.description.inspect)
         dump_egg_item(name, "enabled", egg.enabled?)
         dump_egg_item(name, "fallback_status", egg.fallback_status.nick.inspect)
@@ -949,6 +975,18 @@ module Milter
             @configuration.max_pending_finished_sessions = n_sessions
           end
 
+          def shared_cache_size
+            @configuration.shared_cache_size
+          end
+
+          def shared_cache_size=(n_entries)
+            @configuration.shared_cache_size = n_entries
+          end
+
+          def shared_cache
+            @configuration.shared_cache
+          end
+
           def maintained_hooks
             @configuration.maintained_hooks
           end
@@ -1158,6 +1196,19 @@ module Milter
           @egg.command_options = options
         end
 
+        def connection_spec=(spec)
+          if spec.is_a?(Array)
+            primary_spec, *rest_specs = spec
+          else
+            primary_spec, rest_specs = spec, []
+          end
+          update_location("connection_spec", primary_spec.nil?)
+          @egg.connection_spec = primary_spec
+          rest_specs.each do |rest_spec|
+            @egg.add_connection_spec(rest_spec)
+          end
+        end
+
         def fallback_status
           status = @egg.fallback_status
           status.nick
@@ -1185,6 +1236,37 @@ module Milter
           @egg.fallback_status = value
         end
 
+        def shed_status
+          status = @egg.shed_status
+          if status == Status::DEFAULT
+            "fallback"
+          else
+            status.nick
+          end
+        end
+
+        def shed_status=(status)
+          available_values = {
+            "fallback" => Status::DEFAULT,
+            "reject" => Status::REJECT,
+            "temporary-failure" => Status::TEMPORARY_FAILURE,
+            "discard" => Status::DISCARD,
+          }
+          if status.respond_to?(:nick)
+            normalized_status = status.nick
+          else
+            normalized_status = status.to_s.downcase.gsub(/_/, '-')
+          end
+          value = available_values[normalized_status]
+          if value.nil?
+            raise InvalidValue.new("milter.shed_status",
+                                   available_values.keys,
+                                   status)
+          end
+          update_location("shed_status", false)
+          @egg.shed_status = value
+        end
+
         def method_missing(name, *args, &block)
           result = @egg.send(name, *args, &block)
           if /=\z/ =~ name.to_s
@@ -16,8 +16,8 @@
 module Milter::Manager
   class AddressMatcher
     def initialize
-      @local_addresses = []
-      @remote_addresses = []
+      @local_addresses = NetworkTable.new
+      @remote_addresses = NetworkTable.new
     end
 
     def local_address?(address)
@@ -39,29 +39,33 @@ module Milter::Manager
     end
 
     def add_local_address(address)
-      @local_addresses << ensure_address(address)
+      @local_addresses.add(network_string(address))
     end
 
     def add_remote_address(address)
-      @remote_addresses << ensure_address(address)
+      @remote_addresses.add(network_string(address))
     end
 
     private
     def custom_local_address?(ip_address)
-      @local_addresses.any? do |local_address|
-        local_address.include?(ip_address)
-      end
+      @local_addresses.include?(ip_address)
     end
 
     def custom_remote_address?(ip_address)
-      @remote_addresses.any? do |remote_address|
-        remote_address.include?(ip_address)
-      end
+      @remote_addresses.include?(ip_address)
     end
 
-    def ensure_address(address)
+    def network_string(address)
       address = IPAddr.new(address) unless address.is_a?(IPAddr)
-      address
+      "#{address}/#{network_prefix(address)}"
+    end
+
+    def network_prefix(address)
+      return address.prefix if address.respond_to?(:prefix)
+      range = address.to_range
+      n_addresses = range.last.to_i - range.first.to_i + 1
+      n_bits = address.ipv4? ? 32 : 128
+      n_bits - (n_addresses.to_s(2).size - 1)
     end
   end
 end
@@ -71,6 +71,21 @@ module Milter::Manager
       @client_context.n_processing_sessions
     end
 
+    def event_loop
+      @children.event_loop
+    end
+
+    # Delays sending connect information to the child milter
+    # until #resume_connect is called. It's available only in
+    # connect stoppers.
+    def delay_connect
+      @child.delay_connect
+    end
+
+    def resume_connect(stop)
+      @child.resume_connect(stop)
+    end
+
     private
     def create_child_contexts
       contexts = {}
@@ -27,6 +27,7 @@ module Milter::Manager
       @configuration = configuration
       @script_name = script_name
       @connection_spec_detector = connection_spec_detector
+      @configuration.detector_used
       init_variables
     end
 
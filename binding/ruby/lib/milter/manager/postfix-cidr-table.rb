@@ -23,7 +23,7 @@ module Milter::Manager
     include PostfixConditionTableParser
 
     def initialize
-      @table = []
+      @table = NetworkTable.new
     end
 
     def parse(io)
@@ -34,14 +34,13 @@ module Milter::Manager
           network = $2
           action = $3
           address << "/#{network}" unless network.nil?
-          ip_address = nil
           begin
-            ip_address = IPAddr.new(address)
-          rescue ArgumentError
+            IPAddr.new(address)
+            @table.add(address, action)
+          rescue ArgumentError, NetworkTableError
             raise InvalidValueError.new(address, $!.message, line,
                                         io.path, line_no)
           end
-          @table << [ip_address, action]
         else
           raise InvalidFormatError.new(line, io.path, line_no)
         end
@@ -49,11 +48,19 @@ module Milter::Manager
     end
 
     def find(address)
-      address = address.to_ip_address if address.respond_to?(:to_ip_address)
-      @table.each do |match_address, action|
-        return action if match_address === address
-      end
-      nil
+      @table.find(address)
+    end
+
+    # Saves the parsed table as a compiled file that can be
+    # loaded by #load_compiled without parsing.
+    def save_compiled(path)
+      @table.save(path)
+    end
+
+    # Replaces the current table with the compiled table at
+    # +path+. The compiled table is mapped into memory.
+    def load_compiled(path)
+      @table = NetworkTable.new(path)
     end
   end
 end
@@ -16,6 +16,7 @@
 require 'English'
 require 'milter/manager/condition-table'
 require 'milter/manager/postfix-condition-table-parser'
+require 'milter/manager/regexp-matcher'
 
 module Milter::Manager
   class PostfixRegexpTable
@@ -23,7 +24,7 @@ module Milter::Manager
     include PostfixConditionTableParser
 
     def initialize
-      @table = []
+      @table = RegexpMatcher.new
     end
 
     def parse(io)
@@ -36,8 +37,8 @@ module Milter::Manager
           pattern = $2
           flag = $3
           regexp = create_regexp(pattern, flag, io, line, line_no)
-          new_table = []
-          current_table << [not_flag == "!", regexp, new_table]
+          new_table = RegexpMatcher.new
+          current_table.add(regexp, new_table, not_flag == "!")
           current_table = new_table
           tables << new_table
         when /\A\s*(!)?\/(.*)\/([imx]+)?\s+(.+)\s*$/
@@ -46,7 +47,7 @@ module Milter::Manager
           flag = $3
           action = $4
           regexp = create_regexp(pattern, flag, io, line, line_no)
-          current_table << [not_flag == "!", regexp, action]
+          current_table.add(regexp, action, not_flag == "!")
         when /\Aendif\s*$/
           current_table = tables.pop
         else
@@ -78,15 +79,8 @@ module Milter::Manager
     end
 
     def find_action(table, text)
-      table.each do |negative, regexp, table_or_action|
-        match_data = nil
-        if negative
-          next if regexp =~ text
-        else
-          match_data = regexp.match(text)
-          next unless match_data
-        end
-        if table_or_action.is_a?(Array)
+      table.each_match(text) do |table_or_action, match_data|
+        if table_or_action.is_a?(RegexpMatcher)
           action = find_action(table_or_action, text)
           return expand_variables(action, match_data) if action
         else
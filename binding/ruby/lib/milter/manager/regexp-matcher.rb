@@ -0,0 +1,213 @@
+# Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+#
+# This library is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library.  If not, see <http://www.gnu.org/licenses/>.
+
+module Milter::Manager
+  # Matches a text against many patterns in registration
+  # order. Each pattern that has a literal that must appear
+  # in any matched text is only evaluated when the literal is
+  # found by LiteralMatcher. Negative patterns, procs and
+  # patterns without such literal are always evaluated.
+  class RegexpMatcher
+    def initialize
+      @entries = []
+      @always_candidates = []
+      @literal_matcher = LiteralMatcher.new
+    end
+
+    def add(pattern, value=nil, negative=false)
+      id = @entries.size
+      @entries << [pattern, value, negative]
+      literal = nil
+      literal = extract_literal(pattern) unless negative
+      if literal
+        @literal_matcher.add(literal, id)
+      else
+        @always_candidates << id
+      end
+      self
+    end
+    alias_method :<<, :add
+
+    def size
+      @entries.size
+    end
+
+    def empty?
+      @entries.empty?
+    end
+
+    def each_match(text)
+      candidates(text).each do |id|
+        pattern, value, negative = @entries[id]
+        match_data = nil
+        if pattern.respond_to?(:call)
+          matched = pattern.call(text)
+        elsif pattern.is_a?(Regexp)
+          match_data = pattern.match(text)
+          matched = !match_data.nil?
+        else
+          matched = (pattern === text)
+        end
+        if negative
+          next if matched
+          match_data = nil
+        else
+          next unless matched
+        end
+        yield(value, match_data)
+      end
+    end
+
+    def match?(text)
+      each_match(text) do
+        return true
+      end
+      false
+    end
+
+    private
+    def candidates(text)
+      # LiteralMatcher folds only ASCII case. Unicode case
+      # folding of IGNORECASE may match non-ASCII text with
+      # ASCII literal.
+      unless text.is_a?(String) and text.ascii_only?
+        return (0...@entries.size).to_a
+      end
+      found_ids = @literal_matcher.match(text)
+      return @always_candidates if found_ids.empty?
+      return found_ids if @always_candidates.empty?
+      (@always_candidates + found_ids).sort
+    end
+
+    UNSUPPORTED_ESCAPE_CHARACTERS = "0123456789xucCMpPkgQE"
+
+    def extract_literal(pattern)
+      case pattern
+      when Regexp
+        return nil if pattern.options & Regexp::EXTENDED != 0
+        literal = extract_regexp_literal(pattern.source)
+      when String
+        literal = pattern
+      else
+        return nil
+      end
+      return nil if literal.nil? or literal.empty?
+      return nil unless literal.ascii_only?
+      literal
+    end
+
+    # Returns the longest run of characters that must appear
+    # in every text matched by +source+ or nil. It gives up on
+    # top level alternation and constructs that aren't
+    # understood.
+    def extract_regexp_literal(source)
+      return nil if /\(\?[a-z]*x/ =~ source
+      runs = []
+      run = ""
+      i = 0
+      while i < source.size
+        character = source[i, 1]
+        literal = nil
+        case character
+        when "|"
+          return nil
+        when "\\"
+          escaped = source[i + 1, 1]
+          return nil if escaped.nil?
+          return nil if UNSUPPORTED_ESCAPE_CHARACTERS.include?(escaped)
+          literal = escaped if /\A[^a-zA-Z]\z/ =~ escaped
+          i += 2
+        when "("
+          i = skip_group(source, i)
+          return nil if i.nil?
+        when "["
+          i = skip_character_class(source, i + 1)
+          return nil if i.nil?
+        when ".", "^", "$"
+          i += 1
+        when "?", "*", "+", "{", ")"
+          return nil
+        else
+          literal = character if character.ascii_only?
+          i += 1
+        end
+
+        quantifier = source[i, 1]
+        case quantifier
+        when "?", "*"
+          i += 1
+        when "{"
+          i = source.index("}", i)
+          return nil if i.nil?
+          i += 1
+        when "+"
+          run << literal if literal
+          i += 1
+        else
+          quantifier = nil
+        end
+        if quantifier.nil? and literal
+          run << literal
+          next
+        end
+        i += 1 while quantifier and ["?", "+"].include?(source[i, 1])
+        runs << run unless run.empty?
+        run = ""
+      end
+      runs << run unless run.empty?
+      runs.max_by {|candidate| candidate.size}
+    end
+
+    def skip_group(source, i)
+      depth = 0
+      while i < source.size
+        case source[i, 1]
+        when "\\"
+          i += 1
+        when "["
+          i = skip_character_class(source, i + 1)
+          return nil if i.nil?
+          next
+        when "("
+          depth += 1
+        when ")"
+          depth -= 1
+          return i + 1 if depth.zero?
+        end
+        i += 1
+      end
+      nil
+    end
+
+    def skip_character_class(source, i)
+      i += 1 if source[i, 1] == "^"
+      i += 1 if source[i, 1] == "]"
+      while i < source.size
+        case source[i, 1]
+        when "\\"
+          i += 1
+        when "["
+          i = skip_character_class(source, i + 1)
+          return nil if i.nil?
+          next
+        when "]"
+          return i + 1
+        end
+        i += 1
+      end
+      nil
+    end
+  end
+end
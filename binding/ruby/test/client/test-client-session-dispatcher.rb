@@ -0,0 +1,119 @@
+# Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+#
+# This library is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library.  If not, see <http://www.gnu.org/licenses/>.
+
+class TestClientSessionDispatcher < Test::Unit::TestCase
+  include MilterTestUtils
+
+  class Session < Milter::ClientSession
+    attr_reader :events
+    def initialize(context)
+      super
+      @events = []
+    end
+
+    def helo(fqdn)
+      @events << [:helo, fqdn]
+      reject if fqdn == "spam.example.com"
+    end
+
+    def body(chunk)
+      @events << [:body, chunk.dup]
+    end
+
+    def end_of_message
+      @events << [:end_of_message]
+    end
+
+    def reset
+      @events << [:reset]
+    end
+  end
+
+  def setup
+    @client = Milter::Client.new
+    @context = Milter::ClientContext.new(@client)
+    @context.event_loop = Milter::GLibEventLoop.new
+  end
+
+  def test_events
+    dispatcher = create_dispatcher
+    assert_equal([:helo, :body, :end_of_message, :abort],
+                 dispatcher.events)
+  end
+
+  def test_helo
+    handler = create_dispatcher.attach(@context)
+    status = @context.signal_emit("helo", "mx.example.com")
+    assert_equal([Milter::Status::DEFAULT, [[:helo, "mx.example.com"]]],
+                 [status, handler.session.events])
+  end
+
+  def test_helo_reject
+    handler = create_dispatcher.attach(@context)
+    status = @context.signal_emit("helo", "spam.example.com")
+    assert_equal([Milter::Status::REJECT,
+                  [[:helo, "spam.example.com"], [:reset]]],
+                 [status, handler.session.events])
+  end
+
+  def test_abort
+    handler = create_dispatcher.attach(@context)
+    @context.signal_emit("abort", Milter::ClientContext::STATE_BODY)
+    assert_equal([[:reset]], handler.session.events)
+  end
+
+  def test_body_copy
+    handler = create_dispatcher.attach(@context)
+    emit_body("chunk1", "chunk2")
+    assert_equal([[:body, "chunk1"], [:body, "chunk2"], [:end_of_message]],
+                 handler.session.events)
+  end
+
+  def test_body_shared
+    @client.body_chunk_mode = :shared
+    handler = create_dispatcher.attach(@context)
+    emit_body("chunk1", "chunk2")
+    assert_equal([[:body, "chunk1"], [:body, "chunk2"], [:end_of_message]],
+                 handler.session.events)
+  end
+
+  def test_body_buffer
+    @client.body_chunk_mode = :buffer
+    handler = create_dispatcher.attach(@context)
+    emit_body("chunk1", "chunk2")
+    assert_equal([[:body, "chunk1chunk2"], [:end_of_message]],
+                 handler.session.events)
+  end
+
+  def test_unknown_body_chunk_mode
+    handler = Milter::Client::SessionDispatcher::Handler.new(@client, @context,
+                                                             Session, [])
+    assert_raise(ArgumentError) do
+      @context.attach_session_handler(handler, [:helo], :unknown)
+    end
+  end
+
+  private
+  def create_dispatcher
+    Milter::Client::SessionDispatcher.new(@client, Session, [])
+  end
+
+  def emit_body(*chunks)
+    chunks.each do |chunk|
+      @context.signal_emit("body", chunk, chunk.bytesize)
+    end
+    @context.signal_emit("end-of-message", "", 0)
+  end
+end
@@ -0,0 +1,121 @@
+# Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+#
+# This library is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library.  If not, see <http://www.gnu.org/licenses/>.
+
+class TestClientSessionFiber < Test::Unit::TestCase
+  include MilterTestUtils
+  include MilterEventLoopTestUtils
+
+  class Context
+    attr_reader :event_loop, :emitted_signals
+    def initialize(event_loop)
+      @event_loop = event_loop
+      @emitted_signals = []
+    end
+
+    def signal_emit(*arguments)
+      @emitted_signals << arguments
+    end
+  end
+
+  def setup
+    @loop = create_event_loop
+    @context = Context.new(@loop)
+    @session_fiber = Milter::Client::SessionFiber.new(@context)
+  end
+
+  def test_run_without_wait
+    status = @session_fiber.run("helo_response") do
+      Milter::Status::ACCEPT
+    end
+    assert_equal([Milter::Status::ACCEPT, []],
+                 [status, @context.emitted_signals])
+  end
+
+  def test_run_with_sleep
+    status = @session_fiber.run("helo_response") do
+      Milter::Client::SessionFiber.sleep(0.01)
+      Milter::Status::ACCEPT
+    end
+    assert_equal([Milter::Status::PROGRESS, []],
+                 [status, @context.emitted_signals])
+    iterate_until {not @session_fiber.running?}
+    assert_equal([["helo_response", Milter::Status::ACCEPT]],
+                 @context.emitted_signals)
+  end
+
+  def test_order
+    events = []
+    @session_fiber.run("header_response") do
+      events << :header_start
+      Milter::Client::SessionFiber.sleep(0.01)
+      events << :header_end
+      Milter::Status::CONTINUE
+    end
+    status = @session_fiber.run("end_of_header_response") do
+      events << :end_of_header
+      Milter::Status::ACCEPT
+    end
+    assert_equal(Milter::Status::PROGRESS, status)
+    iterate_until {not @session_fiber.running?}
+    assert_equal([[:header_start, :header_end, :end_of_header],
+                  [["header_response", Milter::Status::CONTINUE],
+                   ["end_of_header_response", Milter::Status::ACCEPT]]],
+                 [events, @context.emitted_signals])
+  end
+
+  def test_read
+    read_io, write_io = IO.pipe
+    data = nil
+    @session_fiber.run("body_response") do
+      data = Milter::Client::SessionFiber.read(read_io, 100)
+      Milter::Status::CONTINUE
+    end
+    assert_nil(data)
+    write_io.write("data")
+    write_io.flush
+    iterate_until {not @session_fiber.running?}
+    assert_equal(["data", [["body_response", Milter::Status::CONTINUE]]],
+                 [data, @context.emitted_signals])
+  end
+
+  def test_wait_readable_timeout
+    read_io, write_io = IO.pipe
+    ready = nil
+    @session_fiber.run("connect_response") do
+      ready = Milter::Client::SessionFiber.wait_readable(read_io, 0.01)
+      Milter::Status::CONTINUE
+    end
+    iterate_until {not @session_fiber.running?}
+    assert_false(ready)
+  end
+
+  def test_not_in_fiber
+    read_io, write_io = IO.pipe
+    write_io.write("data")
+    write_io.flush
+    assert_nil(Milter::Client::SessionFiber.current)
+    assert_equal("data", Milter::Client::SessionFiber.read(read_io, 100))
+  end
+
+  private
+  def iterate_until(timeout=1)
+    deadline = Time.now + timeout
+    until yield
+      @loop.iterate(:may_block => false)
+      break if Time.now > deadline
+      sleep(0.001)
+    end
+  end
+end
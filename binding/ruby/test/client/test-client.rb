@@ -83,6 +83,21 @@ class TestClient < Test::Unit::TestCase
     end
   end
 
+  def test_fiber_mode
+    assert_false(@client.fiber_mode?)
+    @client.fiber_mode = true
+    assert_true(@client.fiber_mode?)
+  end
+
+  def test_body_chunk_mode
+    assert_equal(:copy, @client.body_chunk_mode)
+    @client.body_chunk_mode = "buffer"
+    assert_equal(:buffer, @client.body_chunk_mode)
+    assert_raise(ArgumentError) do
+      @client.body_chunk_mode = :unknown
+    end
+  end
+
   def test_listen
     port = 12345
     @client.connection_spec = "inet:#{port}"
@@ -257,6 +257,12 @@ class TestConfigurationLoader < Test::Unit::TestCase
     assert_equal(0, @configuration.max_pending_finished_sessions)
   end
 
+  def test_manager_shared_cache_size
+    assert_equal(8192, @configuration.shared_cache_size)
+    @loader.manager.shared_cache_size = 0
+    assert_equal(0, @configuration.shared_cache_size)
+  end
+
   def test_database_type
     assert_equal(nil, @configuration.database.type)
     @loader.database.type = "mysql"
@@ -92,6 +92,16 @@ class TestConfiguration < Test::Unit::TestCase
     assert_equal(29, @configuration.max_pending_finished_sessions)
   end
 
+  def test_shared_cache_size
+    assert_equal(8192, @configuration.shared_cache_size)
+    @configuration.shared_cache_size = 1024
+    assert_equal(1024, @configuration.shared_cache_size)
+  end
+
+  def test_shared_cache
+    assert_nil(@configuration.shared_cache)
+  end
+
   def test_package
     @configuration.package_platform = "pkgsrc"
     assert_equal("pkgsrc", @configuration.package_platform)
@@ -303,6 +313,8 @@ manager.connection_check_interval = 0
 manager.chunk_size = 65535
 # default
 manager.max_pending_finished_sessions = 0
+# default
+manager.shared_cache_size = 8192
 
 # default
 controller.connection_spec = nil
@@ -448,6 +460,8 @@ manager.connection_check_interval = 0
 manager.chunk_size = 65535
 # default
 manager.max_pending_finished_sessions = 0
+# default
+manager.shared_cache_size = 8192
 
 # #{__FILE__}:#{controller_connection_spec}
 controller.connection_spec = "inet:10025"
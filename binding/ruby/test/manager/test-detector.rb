@@ -34,6 +34,12 @@ class TestDetector < Test::Unit::TestCase
                  detector.package_options)
   end
 
+  def test_snapshot_unavailable
+    assert_true(@configuration.snapshot_available?)
+    detector
+    assert_false(@configuration.snapshot_available?)
+  end
+
   private
   def detector
     MockDetector.new(@configuration, "test-milter")
@@ -13,6 +13,8 @@
 # You should have received a copy of the GNU Lesser General Public License
 # along with this library.  If not, see <http://www.gnu.org/licenses/>.
 
+require 'tempfile'
+
 class TestPostfixCIDRTable < Test::Unit::TestCase
 
   include MilterParseTestUtils
@@ -161,6 +163,26 @@ EOC
                  @table.find(ipv4("192.168.1.1")))
   end
 
+  def test_compiled
+    @table.parse(create_input(<<-EOC))
+192.168.1.1             OK
+192.168.1.0/24          REJECT
+2001:2f8:c2:201::0/64   REJECT
+EOC
+    Tempfile.open("cidr-table") do |compiled|
+      compiled.close
+      @table.save_compiled(compiled.path)
+
+      table = Milter::Manager::PostfixCIDRTable.new
+      table.load_compiled(compiled.path)
+      assert_equal(["OK", "REJECT", "REJECT", nil],
+                   [table.find(ipv4("192.168.1.1")),
+                    table.find(ipv4("192.168.1.29")),
+                    table.find(ipv6("2001:2f8:c2:201::1")),
+                    table.find(ipv4("192.168.2.1"))])
+    end
+  end
+
   private
   def ipv4(address, port=2929)
     Milter::SocketAddress::IPv4.new(address, port)
@@ -0,0 +1,96 @@
+# Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+#
+# This library is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library.  If not, see <http://www.gnu.org/licenses/>.
+
+class TestRegexpMatcher < Test::Unit::TestCase
+  def setup
+    @matcher = Milter::Manager::RegexpMatcher.new
+  end
+
+  def test_empty
+    assert_true(@matcher.empty?)
+    assert_false(@matcher.match?("mail.example.com"))
+  end
+
+  def test_literal
+    @matcher.add(/\.google\.com\z/, "google")
+    @matcher.add(/\.example\.com\z/, "example")
+    assert_equal([["example", ".example.com"]],
+                 matches("mail.example.com"))
+    assert_equal([], matches("mail.example.net"))
+  end
+
+  def test_case_insensitive
+    @matcher.add(/\A(?:dhcp|dialup|ppp|[achrsvx]?dsl)[^.]*\d/i, "dynamic")
+    @matcher.add(/\.Example\.com\z/i, "example")
+    assert_equal([["dynamic", "PPP123"], ["example", ".EXAMPLE.COM"]],
+                 matches("PPP123.EXAMPLE.COM"))
+  end
+
+  def test_order
+    @matcher.add(/\d{5}/, "digits")
+    @matcher.add(/example/, "example")
+    @matcher.add(/\A[^.]*\d/, "digit")
+    assert_equal([["digits", "12345"],
+                  ["example", "example"],
+                  ["digit", "12345"]],
+                 matches("12345.example.com"))
+  end
+
+  def test_negative
+    @matcher.add(/\Aowner-/, "owner", true)
+    @matcher.add(/example/, "example")
+    assert_equal([[["owner", nil]], [["example", "example"]]],
+                 [matches("user@example.com").first(1),
+                  matches("owner-ml@example.com")])
+  end
+
+  def test_string
+    @matcher.add("unknown", "unknown")
+    assert_true(@matcher.match?("unknown"))
+    assert_false(@matcher.match?("unknown.example.com"))
+  end
+
+  def test_proc
+    @matcher.add(Proc.new {|host| host.end_with?(".jp")}, "jp")
+    assert_true(@matcher.match?("mail.example.jp"))
+    assert_false(@matcher.match?("mail.example.com"))
+  end
+
+  def test_optional
+    @matcher.add(/mail-?server/, "mail-server")
+    @matcher.add(/x(?:y)?z+/, "xyz")
+    assert_true(@matcher.match?("mailserver.example.com"))
+    assert_true(@matcher.match?("xz.example.com"))
+  end
+
+  def test_alternation
+    @matcher.add(/foo|bar/, "foo-or-bar")
+    assert_true(@matcher.match?("bar.example.com"))
+  end
+
+  def test_non_ascii
+    @matcher.add(/kelvin/i, "kelvin")
+    assert_true(@matcher.match?("\u212Aelvin"))
+  end
+
+  private
+  def matches(text)
+    results = []
+    @matcher.each_match(text) do |value, match_data|
+      results << [value, match_data ? match_data[0] : nil]
+    end
+    results
+  end
+end
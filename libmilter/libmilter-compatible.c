@@ -25,6 +25,8 @@
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -40,16 +42,56 @@ static GIOChannel *listen_channel = NULL;
 static gint listen_backlog = -1;
 static guint timeout = 7210;
 
+static guint n_callback_threads = 0;
+static GThreadPool *callback_threads = NULL;
+static GMutex *operations_mutex = NULL;
+static GQueue *operations = NULL;
+static gint operations_notify_fds[2] = {-1, -1};
+static GIOChannel *operations_notify_channel = NULL;
+static MilterEventLoop *operations_loop = NULL;
+static guint operations_watch_id = 0;
+
 #define SMFI_CONTEXT_GET_PRIVATE(obj)                   \
     (G_TYPE_INSTANCE_GET_PRIVATE((obj),                 \
                                  SMFI_TYPE_CONTEXT,     \
                                  SmfiContextPrivate))
 
+typedef struct _SmfiCallbackJob SmfiCallbackJob;
+typedef MilterStatus (*SmfiCallbackJobFunc) (SmfiCallbackJob *job);
+struct _SmfiCallbackJob
+{
+    SmfiContext *context;
+    SmfiCallbackJobFunc func;
+    const gchar *response_signal_name;
+    MilterStatus status;
+    gchar *name;
+    gchar *value;
+    gchar *data;
+    gsize data_size;
+    MilterClientContextState state;
+};
+
+typedef struct _SmfiOperation SmfiOperation;
+typedef void (*SmfiOperationFunc) (SmfiOperation *operation);
+struct _SmfiOperation
+{
+    SmfiOperationFunc func;
+    SmfiContext *context;
+    gchar *name;
+    gchar *value;
+    gsize value_size;
+    gint index;
+    SmfiCallbackJob *job;
+};
+
 typedef struct _SmfiContextPrivate	SmfiContextPrivate;
 struct _SmfiContextPrivate
 {
     MilterClientContext *client_context;
     gpointer private_data;
+    gboolean in_callback_thread;
+    SmfiCallbackJob *callback_job;
+    GQueue *pending_callback_jobs;
 };
 
 enum
@@ -72,6 +114,7 @@ static void get_property   (GObject         *object,
 
 static void smfi_context_attach_to_client_context   (SmfiContext *context);
 static void smfi_context_detach_from_client_context (SmfiContext *context);
+static void operation_complete_job                  (SmfiOperation *operation);
 
 static void
 smfi_context_class_init (SmfiContextClass *klass)
@@ -103,6 +146,9 @@ smfi_context_init (SmfiContext *context)
     priv = SMFI_CONTEXT_GET_PRIVATE(context);
     priv->client_context = NULL;
     priv->private_data = NULL;
+    priv->in_callback_thread = FALSE;
+    priv->callback_job = NULL;
+    priv->pending_callback_jobs = g_queue_new();
 }
 
 static void
@@ -128,11 +174,18 @@ static void
 dispose (GObject *object)
 {
     SmfiContext *context;
+    SmfiContextPrivate *priv;
 
     context = SMFI_CONTEXT(object);
+    priv = SMFI_CONTEXT_GET_PRIVATE(context);
 
     smfi_context_set_client_context(context, NULL);
 
+    if (priv->pending_callback_jobs) {
+        g_queue_free(priv->pending_callback_jobs);
+        priv->pending_callback_jobs = NULL;
+    }
+
     G_OBJECT_CLASS(smfi_context_parent_class)->dispose(object);
 }
 
@@ -481,6 +534,533 @@ cb_finished (MilterFinishedEmittable *emittable, gpointer user_data)
     g_object_unref(smfi_context);
 }
 
+static MilterClientContext *
+callback_job_get_client_context (SmfiCallbackJob *job)
+{
+    return SMFI_CONTEXT_GET_PRIVATE(job->context)->client_context;
+}
+
+static SmfiCallbackJob *
+callback_job_new (SmfiContext *context, SmfiCallbackJobFunc func,
+                  const gchar *response_signal_name)
+{
+    SmfiCallbackJob *job;
+
+    job = g_new0(SmfiCallbackJob, 1);
+    job->context = g_object_ref(context);
+    job->func = func;
+    job->response_signal_name = response_signal_name;
+    job->status = MILTER_STATUS_DEFAULT;
+
+    return job;
+}
+
+static void
+callback_job_free (SmfiCallbackJob *job)
+{
+    g_object_unref(job->context);
+    if (job->name)
+        g_free(job->name);
+    if (job->value)
+        g_free(job->value);
+    if (job->data)
+        g_free(job->data);
+    g_free(job);
+}
+
+static SmfiOperation *
+operation_new (SmfiContext *context, SmfiOperationFunc func)
+{
+    SmfiOperation *operation;
+
+    operation = g_new0(SmfiOperation, 1);
+    operation->func = func;
+    operation->context = g_object_ref(context);
+
+    return operation;
+}
+
+static void
+operation_free (SmfiOperation *operation)
+{
+    if (operation->job)
+        callback_job_free(operation->job);
+    g_object_unref(operation->context);
+    if (operation->name)
+        g_free(operation->name);
+    if (operation->value)
+        g_free(operation->value);
+    g_free(operation);
+}
+
+static int
+operation_post (SmfiOperation *operation)
+{
+    gchar notification = '\0';
+
+    g_mutex_lock(operations_mutex);
+    g_queue_push_tail(operations, operation);
+    g_mutex_unlock(operations_mutex);
+
+    if (write(operations_notify_fds[1], &notification, 1) == -1 &&
+        errno != EAGAIN) {
+        milter_error("[libmilter][callback-thread][notify][error] %s",
+                     g_strerror(errno));
+    }
+
+    return MI_SUCCESS;
+}
+
+static void
+operations_process (void)
+{
+    while (TRUE) {
+        SmfiOperation *operation;
+
+        g_mutex_lock(operations_mutex);
+        operation = g_queue_pop_head(operations);
+        g_mutex_unlock(operations_mutex);
+        if (!operation)
+            break;
+
+        operation->func(operation);
+        operation_free(operation);
+    }
+}
+
+static gboolean
+cb_operations_notified (GIOChannel *channel, GIOCondition condition,
+                        gpointer user_data)
+{
+    gchar notifications[256];
+
+    while (read(operations_notify_fds[0],
+                notifications, sizeof(notifications)) > 0) {
+    }
+    operations_process();
+
+    return TRUE;
+}
+
+static void
+operations_unwatch (void)
+{
+    if (!operations_loop)
+        return;
+
+    if (operations_watch_id > 0)
+        milter_event_loop_remove(operations_loop, operations_watch_id);
+    operations_watch_id = 0;
+    g_object_unref(operations_loop);
+    operations_loop = NULL;
+}
+
+static void
+operations_watch (MilterEventLoop *loop)
+{
+    if (operations_loop == loop)
+        return;
+
+    operations_unwatch();
+    if (!loop)
+        return;
+
+    operations_loop = g_object_ref(loop);
+    operations_watch_id =
+        milter_event_loop_watch_io(operations_loop,
+                                   operations_notify_channel,
+                                   G_IO_IN | G_IO_PRI,
+                                   cb_operations_notified,
+                                   NULL);
+}
+
+static void
+callback_job_run (gpointer data, gpointer user_data)
+{
+    SmfiCallbackJob *job = data;
+    SmfiContextPrivate *priv;
+    SmfiOperation *operation;
+
+    priv = SMFI_CONTEXT_GET_PRIVATE(job->context);
+    priv->in_callback_thread = TRUE;
+    job->status = job->func(job);
+    priv->in_callback_thread = FALSE;
+
+    operation = operation_new(job->context, operation_complete_job);
+    operation->job = job;
+    operation_post(operation);
+}
+
+static void
+callback_job_dispatch (SmfiContext *context)
+{
+    SmfiContextPrivate *priv;
+    SmfiCallbackJob *job;
+    GError *error = NULL;
+
+    priv = SMFI_CONTEXT_GET_PRIVATE(context);
+    if (priv->callback_job)
+        return;
+
+    job = g_queue_pop_head(priv->pending_callback_jobs);
+    if (!job)
+        return;
+
+    priv->callback_job = job;
+    if (!callback_threads) {
+        callback_job_run(job, NULL);
+        return;
+    }
+
+    g_thread_pool_push(callback_threads, job, &error);
+    if (error) {
+        milter_error("[libmilter][callback-thread][push][error] %s",
+                     error->message);
+        g_error_free(error);
+        callback_job_run(job, NULL);
+    }
+}
+
+static void
+operation_complete_job (SmfiOperation *operation)
+{
+    SmfiContext *context = operation->context;
+    SmfiContextPrivate *priv;
+    SmfiCallbackJob *job = operation->job;
+
+    priv = SMFI_CONTEXT_GET_PRIVATE(context);
+    priv->callback_job = NULL;
+    if (job->response_signal_name) {
+        g_signal_emit_by_name(priv->client_context,
+                              job->response_signal_name,
+                              job->status);
+        callback_job_dispatch(context);
+    } else {
+        /* the last job for the session: xxfi_close() */
+        g_object_unref(context);
+    }
+}
+
+static MilterStatus
+callback_job_push (SmfiCallbackJob *job)
+{
+    SmfiContextPrivate *priv;
+
+    priv = SMFI_CONTEXT_GET_PRIVATE(job->context);
+    g_queue_push_tail(priv->pending_callback_jobs, job);
+    callback_job_dispatch(job->context);
+
+    return MILTER_STATUS_PROGRESS;
+}
+
+static MilterStatus
+run_connect (SmfiCallbackJob *job)
+{
+    return cb_connect(callback_job_get_client_context(job),
+                      job->name,
+                      (struct sockaddr *)job->data, job->data_size,
+                      job->context);
+}
+
+static MilterStatus
+cb_threaded_connect (MilterClientContext *context, const gchar *host_name,
+                     struct sockaddr *address, socklen_t address_length,
+                     gpointer user_data)
+{
+    SmfiCallbackJob *job;
+
+    job = callback_job_new(user_data, run_connect, "connect-response");
+    job->name = g_strdup(host_name);
+    job->data = g_memdup(address, address_length);
+    job->data_size = address_length;
+    return callback_job_push(job);
+}
+
+static MilterStatus
+run_helo (SmfiCallbackJob *job)
+{
+    return cb_helo(callback_job_get_client_context(job), job->name,
+                   job->context);
+}
+
+static MilterStatus
+cb_threaded_helo (MilterClientContext *context, const gchar *fqdn,
+                  gpointer user_data)
+{
+    SmfiCallbackJob *job;
+
+    job = callback_job_new(user_data, run_helo, "helo-response");
+    job->name = g_strdup(fqdn);
+    return callback_job_push(job);
+}
+
+static MilterStatus
+run_envelope_from (SmfiCallbackJob *job)
+{
+    return cb_envelope_from(callback_job_get_client_context(job), job->name,
+                            job->context);
+}
+
+static MilterStatus
+cb_threaded_envelope_from (MilterClientContext *context, const gchar *from,
+                           gpointer user_data)
+{
+    SmfiCallbackJob *job;
+
+    job = callback_job_new(user_data, run_envelope_from,
+                           "envelope-from-response");
+    job->name = g_strdup(from);
+    return callback_job_push(job);
+}
+
+static MilterStatus
+run_envelope_recipient (SmfiCallbackJob *job)
+{
+    return cb_envelope_recipient(callback_job_get_client_context(job),
+                                 job->name, job->context);
+}
+
+static MilterStatus
+cb_threaded_envelope_recipient (MilterClientContext *context,
+                                const gchar *recipient,
+                                gpointer user_data)
+{
+    SmfiCallbackJob *job;
+
+    job = callback_job_new(user_data, run_envelope_recipient,
+                           "envelope-recipient-response");
+    job->name = g_strdup(recipient);
+    return callback_job_push(job);
+}
+
+static MilterStatus
+run_data (SmfiCallbackJob *job)
+{
+    return cb_data(callback_job_get_client_context(job), job->context);
+}
+
+static MilterStatus
+cb_threaded_data (MilterClientContext *context, gpointer user_data)
+{
+    return callback_job_push(callback_job_new(user_data, run_data,
+                                              "data-response"));
+}
+
+static MilterStatus
+run_unknown (SmfiCallbackJob *job)
+{
+    return cb_unknown(callback_job_get_client_context(job), job->name,
+                      job->context);
+}
+
+static MilterStatus
+cb_threaded_unknown (MilterClientContext *context, const gchar *command,
+                     gpointer user_data)
+{
+    SmfiCallbackJob *job;
+
+    job = callback_job_new(user_data, run_unknown, "unknown-response");
+    job->name = g_strdup(command);
+    return callback_job_push(job);
+}
+
+static MilterStatus
+run_header (SmfiCallbackJob *job)
+{
+    return cb_header(callback_job_get_client_context(job),
+                     job->name, job->value,
+                     job->context);
+}
+
+static MilterStatus
+cb_threaded_header (MilterClientContext *context,
+                    const gchar *name, const gchar *value,
+                    gpointer user_data)
+{
+    SmfiCallbackJob *job;
+
+    job = callback_job_new(user_data, run_header, "header-response");
+    job->name = g_strdup(name);
+    job->value = g_strdup(value);
+    return callback_job_push(job);
+}
+
+static MilterStatus
+run_end_of_header (SmfiCallbackJob *job)
+{
+    return cb_end_of_header(callback_job_get_client_context(job),
+                            job->context);
+}
+
+static MilterStatus
+cb_threaded_end_of_header (MilterClientContext *context, gpointer user_data)
+{
+    return callback_job_push(callback_job_new(user_data, run_end_of_header,
+                                              "end-of-header-response"));
+}
+
+static MilterStatus
+run_body (SmfiCallbackJob *job)
+{
+    return cb_body(callback_job_get_client_context(job),
+                   (const guchar *)job->data, job->data_size,
+                   job->context);
+}
+
+static MilterStatus
+cb_threaded_body (MilterClientContext *context, const guchar *chunk, gsize size,
+                  gpointer user_data)
+{
+    SmfiCallbackJob *job;
+
+    job = callback_job_new(user_data, run_body, "body-response");
+    job->data = g_memdup(chunk, size);
+    job->data_size = size;
+    return callback_job_push(job);
+}
+
+static MilterStatus
+run_end_of_message (SmfiCallbackJob *job)
+{
+    return cb_end_of_message(callback_job_get_client_context(job),
+                             job->data, job->data_size,
+                             job->context);
+}
+
+static MilterStatus
+cb_threaded_end_of_message (MilterClientContext *context,
+                            const gchar *chunk, gsize size,
+                            gpointer user_data)
+{
+    SmfiCallbackJob *job;
+
+    job = callback_job_new(user_data, run_end_of_message,
+                           "end-of-message-response");
+    if (chunk && size > 0) {
+        job->data = g_memdup(chunk, size);
+        job->data_size = size;
+    }
+    return callback_job_push(job);
+}
+
+static MilterStatus
+run_abort (SmfiCallbackJob *job)
+{
+    return cb_abort(callback_job_get_client_context(job), job->state,
+                    job->context);
+}
+
+static MilterStatus
+cb_threaded_abort (MilterClientContext *context, MilterClientContextState state,
+                   gpointer user_data)
+{
+    SmfiCallbackJob *job;
+
+    job = callback_job_new(user_data, run_abort, "abort-response");
+    job->state = state;
+    return callback_job_push(job);
+}
+
+static MilterStatus
+run_close (SmfiCallbackJob *job)
+{
+    if (filter_description->xxfi_close)
+        filter_description->xxfi_close(job->context);
+
+    return MILTER_STATUS_DEFAULT;
+}
+
+static void
+cb_threaded_finished (MilterFinishedEmittable *emittable, gpointer user_data)
+{
+    callback_job_push(callback_job_new(user_data, run_close, NULL));
+}
+
+static void
+callback_threads_free (void)
+{
+    if (callback_threads) {
+        g_thread_pool_free(callback_threads, FALSE, TRUE);
+        callback_threads = NULL;
+    }
+
+    if (operations) {
+        operations_process();
+        g_queue_free(operations);
+        operations = NULL;
+    }
+    operations_unwatch();
+    if (operations_notify_channel) {
+        g_io_channel_unref(operations_notify_channel);
+        operations_notify_channel = NULL;
+    }
+    if (operations_notify_fds[0] != -1) {
+        close(operations_notify_fds[0]);
+        close(operations_notify_fds[1]);
+        operations_notify_fds[0] = -1;
+        operations_notify_fds[1] = -1;
+    }
+    if (operations_mutex) {
+        g_mutex_free(operations_mutex);
+        operations_mutex = NULL;
+    }
+}
+
+static gboolean
+callback_threads_new (guint n_threads)
+{
+    GError *error = NULL;
+    gint i;
+
+    if (pipe(operations_notify_fds) == -1) {
+        milter_error("[libmilter][callback-thread][pipe][error] %s",
+                     g_strerror(errno));
+        operations_notify_fds[0] = -1;
+        operations_notify_fds[1] = -1;
+        return FALSE;
+    }
+    for (i = 0; i < 2; i++) {
+        fcntl(operations_notify_fds[i], F_SETFL,
+              fcntl(operations_notify_fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(operations_notify_fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    operations_notify_channel = g_io_channel_unix_new(operations_notify_fds[0]);
+    g_io_channel_set_encoding(operations_notify_channel, NULL, NULL);
+    operations_mutex = g_mutex_new();
+    operations = g_queue_new();
+
+    callback_threads = g_thread_pool_new(callback_job_run, NULL,
+                                         n_threads, FALSE, &error);
+    if (!callback_threads) {
+        milter_error("[libmilter][callback-thread][new][error] %s",
+                     error->message);
+        g_error_free(error);
+        callback_threads_free();
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void
+libmilter_compatible_set_n_callback_threads (guint n_threads)
+{
+    callback_threads_free();
+    n_callback_threads = 0;
+
+    if (n_threads == 0)
+        return;
+
+    if (callback_threads_new(n_threads))
+        n_callback_threads = n_threads;
+}
+
+guint
+libmilter_compatible_get_n_callback_threads (void)
+{
+    return n_callback_threads;
+}
+
 static void
 smfi_context_attach_to_client_context (SmfiContext *context)
 {
@@ -490,13 +1070,25 @@ smfi_context_attach_to_client_context (SmfiContext *context)
     priv = SMFI_CONTEXT_GET_PRIVATE(context);
     client_context = priv->client_context;
 
-#define CONNECT(name, smfi_name)                        \
-    if (filter_description->xxfi_ ## smfi_name)         \
-        g_signal_connect(client_context, #name,         \
-                         G_CALLBACK(cb_ ## name),       \
+    if (callback_threads) {
+        MilterEventLoop *loop;
+
+        loop = milter_agent_get_event_loop(MILTER_AGENT(client_context));
+        operations_watch(loop);
+    }
+
+    if (filter_description->xxfi_negotiate)
+        g_signal_connect(client_context, "negotiate",
+                         G_CALLBACK(cb_negotiate), context);
+
+#define CONNECT(name, smfi_name)                                \
+    if (filter_description->xxfi_ ## smfi_name)                 \
+        g_signal_connect(client_context, #name,                 \
+                         callback_threads ?                     \
+                         G_CALLBACK(cb_threaded_ ## name) :     \
+                         G_CALLBACK(cb_ ## name),               \
                          context)
 
-    CONNECT(negotiate, negotiate);
     CONNECT(connect, connect);
     CONNECT(helo, helo);
     CONNECT(envelope_from, envfrom);
@@ -512,7 +1104,10 @@ smfi_context_attach_to_client_context (SmfiContext *context)
 #undef CONNECT
 
     g_signal_connect(client_context, "finished",
-                     G_CALLBACK(cb_finished), context);
+                     callback_threads ?
+                     G_CALLBACK(cb_threaded_finished) :
+                     G_CALLBACK(cb_finished),
+                     context);
 }
 
 static void
@@ -527,9 +1122,14 @@ smfi_context_detach_from_client_context (SmfiContext *context)
 #define DISCONNECT(name)                                                \
     g_signal_handlers_disconnect_by_func(client_context,                \
                                          G_CALLBACK(cb_ ## name),       \
+                                         context);                      \
+    g_signal_handlers_disconnect_by_func(client_context,                \
+                                         G_CALLBACK(cb_threaded_ ## name), \
                                          context)
 
-    DISCONNECT(negotiate);
+    g_signal_handlers_disconnect_by_func(client_context,
+                                         G_CALLBACK(cb_negotiate),
+                                         context);
     DISCONNECT(connect);
     DISCONNECT(helo);
     DISCONNECT(envelope_from);
@@ -578,6 +1178,27 @@ setup_milter_client_event_loop_backend (MilterClient *client)
     milter_client_set_event_loop_backend(client, backend);
 }
 
+static void
+setup_callback_threads (void)
+{
+    const gchar *n_threads_env;
+    guint64 n_threads;
+    gchar *end = NULL;
+
+    n_threads_env = g_getenv("MILTER_N_CALLBACK_THREADS");
+    if (!n_threads_env)
+        return;
+
+    n_threads = g_ascii_strtoull(n_threads_env, &end, 10);
+    if (end == n_threads_env || *end != '\0' || n_threads > G_MAXINT) {
+        milter_error("invalid MILTER_N_CALLBACK_THREADS value: <%s>",
+                     n_threads_env);
+        return;
+    }
+
+    libmilter_compatible_set_n_callback_threads(n_threads);
+}
+
 static void
 setup_milter_client (MilterClient *client)
 {
@@ -602,6 +1223,7 @@ smfi_main (void)
         g_object_unref(client);
     client = milter_client_new();
     setup_milter_client(client);
+    setup_callback_threads();
     success = milter_client_run(client, &error);
     if (!success) {
         milter_error("failed to run main loop: %s", error->message);
@@ -810,18 +1432,18 @@ smfi_setmlreply (SMFICTX *context,
     return result;
 }
 
-int
-smfi_addheader (SMFICTX *context, char *name, char *value)
+static MilterClientContext *
+operation_get_client_context (SmfiOperation *operation)
 {
-    SmfiContextPrivate *priv;
-    GError *error = NULL;
+    return SMFI_CONTEXT_GET_PRIVATE(operation->context)->client_context;
+}
 
-    priv = SMFI_CONTEXT_GET_PRIVATE(context);
-    if (!priv->client_context)
-        return MI_FAILURE;
+static int
+add_header (MilterClientContext *context, const gchar *name, const gchar *value)
+{
+    GError *error = NULL;
 
-    if (milter_client_context_add_header(priv->client_context, name, value,
-                                         &error)) {
+    if (milter_client_context_add_header(context, name, value, &error)) {
         return MI_SUCCESS;
     } else {
         if (error) {
@@ -832,17 +1454,41 @@ smfi_addheader (SMFICTX *context, char *name, char *value)
     }
 }
 
+static void
+operation_add_header (SmfiOperation *operation)
+{
+    add_header(operation_get_client_context(operation),
+               operation->name, operation->value);
+}
+
 int
-smfi_chgheader (SMFICTX *context, char *name, int index, char *value)
+smfi_addheader (SMFICTX *context, char *name, char *value)
 {
     SmfiContextPrivate *priv;
-    GError *error = NULL;
 
     priv = SMFI_CONTEXT_GET_PRIVATE(context);
     if (!priv->client_context)
         return MI_FAILURE;
 
-    if (milter_client_context_change_header(priv->client_context,
+    if (priv->in_callback_thread) {
+        SmfiOperation *operation;
+
+        operation = operation_new(context, operation_add_header);
+        operation->name = g_strdup(name);
+        operation->value = g_strdup(value);
+        return operation_post(operation);
+    }
+
+    return add_header(priv->client_context, name, value);
+}
+
+static int
+change_header (MilterClientContext *context,
+               const gchar *name, gint index, const gchar *value)
+{
+    GError *error = NULL;
+
+    if (milter_client_context_change_header(context,
                                             name, index, value, &error)) {
         return MI_SUCCESS;
     } else {
@@ -854,17 +1500,42 @@ smfi_chgheader (SMFICTX *context, char *name, int index, char *value)
     }
 }
 
+static void
+operation_change_header (SmfiOperation *operation)
+{
+    change_header(operation_get_client_context(operation),
+                  operation->name, operation->index, operation->value);
+}
+
 int
-smfi_insheader (SMFICTX *context, int index, char *name, char *value)
+smfi_chgheader (SMFICTX *context, char *name, int index, char *value)
 {
     SmfiContextPrivate *priv;
-    GError *error = NULL;
 
     priv = SMFI_CONTEXT_GET_PRIVATE(context);
     if (!priv->client_context)
         return MI_FAILURE;
 
-    if (milter_client_context_insert_header(priv->client_context,
+    if (priv->in_callback_thread) {
+        SmfiOperation *operation;
+
+        operation = operation_new(context, operation_change_header);
+        operation->name = g_strdup(name);
+        operation->index = index;
+        operation->value = g_strdup(value);
+        return operation_post(operation);
+    }
+
+    return change_header(priv->client_context, name, index, value);
+}
+
+static int
+insert_header (MilterClientContext *context,
+               gint index, const gchar *name, const gchar *value)
+{
+    GError *error = NULL;
+
+    if (milter_client_context_insert_header(context,
                                             index, name, value, &error)) {
         return MI_SUCCESS;
     } else {
@@ -876,18 +1547,42 @@ smfi_insheader (SMFICTX *context, int index, char *name, char *value)
     }
 }
 
+static void
+operation_insert_header (SmfiOperation *operation)
+{
+    insert_header(operation_get_client_context(operation),
+                  operation->index, operation->name, operation->value);
+}
+
 int
-smfi_chgfrom (SMFICTX *context, char *mail, char *arguments)
+smfi_insheader (SMFICTX *context, int index, char *name, char *value)
 {
     SmfiContextPrivate *priv;
-    GError *error = NULL;
 
     priv = SMFI_CONTEXT_GET_PRIVATE(context);
     if (!priv->client_context)
         return MI_FAILURE;
 
-    if (milter_client_context_change_from(priv->client_context, mail, arguments,
-                                          &error)) {
+    if (priv->in_callback_thread) {
+        SmfiOperation *operation;
+
+        operation = operation_new(context, operation_insert_header);
+        operation->index = index;
+        operation->name = g_strdup(name);
+        operation->value = g_strdup(value);
+        return operation_post(operation);
+    }
+
+    return insert_header(priv->client_context, index, name, value);
+}
+
+static int
+change_from (MilterClientContext *context,
+             const gchar *mail, const gchar *arguments)
+{
+    GError *error = NULL;
+
+    if (milter_client_context_change_from(context, mail, arguments, &error)) {
         return MI_SUCCESS;
     } else {
         if (error) {
@@ -898,18 +1593,42 @@ smfi_chgfrom (SMFICTX *context, char *mail, char *arguments)
     }
 }
 
+static void
+operation_change_from (SmfiOperation *operation)
+{
+    change_from(operation_get_client_context(operation),
+                operation->name, operation->value);
+}
+
 int
-smfi_addrcpt (SMFICTX *context, char *recipient)
+smfi_chgfrom (SMFICTX *context, char *mail, char *arguments)
 {
     SmfiContextPrivate *priv;
-    GError *error = NULL;
 
     priv = SMFI_CONTEXT_GET_PRIVATE(context);
     if (!priv->client_context)
         return MI_FAILURE;
 
-    if (milter_client_context_add_recipient(priv->client_context,
-                                            recipient, NULL, &error)) {
+    if (priv->in_callback_thread) {
+        SmfiOperation *operation;
+
+        operation = operation_new(context, operation_change_from);
+        operation->name = g_strdup(mail);
+        operation->value = g_strdup(arguments);
+        return operation_post(operation);
+    }
+
+    return change_from(priv->client_context, mail, arguments);
+}
+
+static int
+add_recipient (MilterClientContext *context,
+               const gchar *recipient, const gchar *arguments)
+{
+    GError *error = NULL;
+
+    if (milter_client_context_add_recipient(context,
+                                            recipient, arguments, &error)) {
         return MI_SUCCESS;
     } else {
         if (error) {
@@ -920,48 +1639,86 @@ smfi_addrcpt (SMFICTX *context, char *recipient)
     }
 }
 
+static void
+operation_add_recipient (SmfiOperation *operation)
+{
+    add_recipient(operation_get_client_context(operation),
+                  operation->name, operation->value);
+}
+
+int
+smfi_addrcpt (SMFICTX *context, char *recipient)
+{
+    return smfi_addrcpt_par(context, recipient, NULL);
+}
+
 int
 smfi_addrcpt_par (SMFICTX *context, char *recipient, char *args)
 {
     SmfiContextPrivate *priv;
-    GError *error = NULL;
 
     priv = SMFI_CONTEXT_GET_PRIVATE(context);
     if (!priv->client_context)
         return MI_FAILURE;
 
-    if (milter_client_context_add_recipient(priv->client_context,
-                                            recipient, args, &error)) {
+    if (priv->in_callback_thread) {
+        SmfiOperation *operation;
+
+        operation = operation_new(context, operation_add_recipient);
+        operation->name = g_strdup(recipient);
+        operation->value = g_strdup(args);
+        return operation_post(operation);
+    }
+
+    return add_recipient(priv->client_context, recipient, args);
+}
+
+static int
+delete_recipient (MilterClientContext *context, const gchar *recipient)
+{
+    GError *error = NULL;
+
+    if (milter_client_context_delete_recipient(context, recipient, &error)) {
         return MI_SUCCESS;
     } else {
         if (error) {
-            milter_error("failed to add recipient: %s", error->message);
+            milter_error("failed to delete recipient: %s", error->message);
             g_error_free(error);
         }
         return MI_FAILURE;
     }
 }
 
+static void
+operation_delete_recipient (SmfiOperation *operation)
+{
+    delete_recipient(operation_get_client_context(operation), operation->name);
+}
+
 int
 smfi_delrcpt (SMFICTX *context, char *recipient)
 {
     SmfiContextPrivate *priv;
-    GError *error = NULL;
 
     priv = SMFI_CONTEXT_GET_PRIVATE(context);
     if (!priv->client_context)
         return MI_FAILURE;
 
-    if (milter_client_context_delete_recipient(priv->client_context, recipient,
-                                               &error)) {
-        return MI_SUCCESS;
-    } else {
-        if (error) {
-            milter_error("failed to delete recipient: %s", error->message);
-            g_error_free(error);
-        }
-        return MI_FAILURE;
+    if (priv->in_callback_thread) {
+        SmfiOperation *operation;
+
+        operation = operation_new(context, operation_delete_recipient);
+        operation->name = g_strdup(recipient);
+        return operation_post(operation);
     }
+
+    return delete_recipient(priv->client_context, recipient);
+}
+
+static void
+operation_progress (SmfiOperation *operation)
+{
+    milter_client_context_progress(operation_get_client_context(operation));
 }
 
 int
@@ -973,24 +1730,23 @@ smfi_progress (SMFICTX *context)
     if (!priv->client_context)
         return MI_FAILURE;
 
+    if (priv->in_callback_thread)
+        return operation_post(operation_new(context, operation_progress));
+
     if (milter_client_context_progress(priv->client_context))
         return MI_SUCCESS;
     else
         return MI_FAILURE;
 }
 
-int
-smfi_replacebody (SMFICTX *context, unsigned char *new_body, int new_body_size)
+static int
+replace_body (MilterClientContext *context,
+              const gchar *new_body, gsize new_body_size)
 {
-    SmfiContextPrivate *priv;
     GError *error = NULL;
 
-    priv = SMFI_CONTEXT_GET_PRIVATE(context);
-    if (!priv->client_context)
-        return MI_FAILURE;
-
-    if (milter_client_context_replace_body(priv->client_context,
-                                           (char *)new_body, new_body_size,
+    if (milter_client_context_replace_body(context,
+                                           new_body, new_body_size,
                                            &error)) {
         return MI_SUCCESS;
     } else {
@@ -1002,6 +1758,37 @@ smfi_replacebody (SMFICTX *context, unsigned char *new_body, int new_body_size)
     }
 }
 
+static void
+operation_replace_body (SmfiOperation *operation)
+{
+    replace_body(operation_get_client_context(operation),
+                 operation->value, operation->value_size);
+}
+
+int
+smfi_replacebody (SMFICTX *context, unsigned char *new_body, int new_body_size)
+{
+    SmfiContextPrivate *priv;
+
+    priv = SMFI_CONTEXT_GET_PRIVATE(context);
+    if (!priv->client_context)
+        return MI_FAILURE;
+
+    if (priv->in_callback_thread) {
+        SmfiOperation *operation;
+
+        if (!new_body || new_body_size < 0)
+            return MI_FAILURE;
+        operation = operation_new(context, operation_replace_body);
+        operation->value = g_memdup(new_body, new_body_size);
+        operation->value_size = new_body_size;
+        return operation_post(operation);
+    }
+
+    return replace_body(priv->client_context,
+                        (const gchar *)new_body, new_body_size);
+}
+
 int
 smfi_quarantine (SMFICTX *context, char *reason)
 {
@@ -1071,6 +1858,7 @@ libmilter_compatible_reset (void)
     listen_channel = NULL;
     listen_backlog = -1;
     timeout = 7210;
+    libmilter_compatible_set_n_callback_threads(0);
 }
 
 MilterStatus
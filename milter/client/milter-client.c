@@ -29,6 +29,9 @@
 #include <fcntl.h>
 
 #include <errno.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#  include <sys/eventfd.h>
+#endif
 
 #include <glib/gstdio.h>
 
@@ -103,7 +106,9 @@ struct _MilterClientPrivate
     guint suspend_time_on_unacceptable;
     guint max_connections;
     gboolean multi_thread_mode;
-    GThreadPool *worker_threads;
+    guint n_threads;
+    GPtrArray *event_loop_threads;
+    GMutex *sessions_mutex;
     struct {
         GIOChannel *control;
         guint n_process;
@@ -135,12 +140,28 @@ struct _MilterClientPrivate
     guint max_pending_finished_sessions;
 };
 
+typedef struct _EventLoopThread
+{
+    MilterClient *client;
+    guint id;
+    GThread *thread;
+    MilterEventLoop *loop;
+    gint notify_fds[2];
+    GIOChannel *notify_channel;
+    guint notify_watch_id;
+    GMutex *mutex;
+    GQueue *pending_channels;
+    gboolean quitting;
+    volatile gint n_sessions;
+} EventLoopThread;
+
 typedef struct _MilterClientProcessData
 {
     MilterClientPrivate *priv;
     MilterClient *client;
     MilterClientContext *context;
     gulong finished_handler_id;
+    EventLoopThread *event_loop_thread;
 } MilterClientProcessData;
 
 typedef gboolean (*AcceptConnectionFunction) (MilterClient *client, gint fd);
@@ -511,7 +532,9 @@ _milter_client_init (MilterClient *client)
         MILTER_CLIENT_DEFAULT_SUSPEND_TIME_ON_UNACCEPTABLE;
     priv->max_connections = MILTER_CLIENT_DEFAULT_MAX_CONNECTIONS;
     priv->multi_thread_mode = FALSE;
-    priv->worker_threads = NULL;
+    priv->n_threads = 0;
+    priv->event_loop_threads = NULL;
+    priv->sessions_mutex = g_mutex_new();
     priv->workers.n_process = 0;
     priv->workers.id = 0;
     priv->workers.control = NULL;
@@ -800,9 +823,11 @@ dispose (GObject *object)
         priv->default_unix_socket_group = NULL;
     }
 
-    if (priv->worker_threads) {
-        g_thread_pool_free(priv->worker_threads, TRUE, FALSE);
-        priv->worker_threads = NULL;
+    event_loop_threads_free(priv);
+
+    if (priv->sessions_mutex) {
+        g_mutex_free(priv->sessions_mutex);
+        priv->sessions_mutex = NULL;
     }
 
     dispose_address(priv);
@@ -1222,19 +1247,18 @@ milter_client_create_context (MilterClient *client)
 static gboolean
 milter_client_start_context (MilterClient *client,
                              MilterClientContext *context,
+                             MilterEventLoop *loop,
                              GIOChannel *channel,
                              MilterGenericSocketAddress *address,
                              GError **error)
 {
-    MilterClientPrivate *priv;
     MilterAgent *agent;
     MilterWriter *writer;
     MilterReader *reader;
 
     agent = MILTER_AGENT(context);
-    priv = MILTER_CLIENT_GET_PRIVATE(client);
 
-    milter_agent_set_event_loop(agent, priv->event_loop);
+    milter_agent_set_event_loop(agent, loop);
 
     writer = milter_writer_io_channel_new(channel);
     milter_agent_set_writer(agent, writer);
@@ -1277,6 +1301,7 @@ single_thread_client_channel_setup (MilterClient *client,
     data->priv = priv;
     data->client = client;
     data->context = context;
+    data->event_loop_thread = NULL;
 
     milter_debug("[%u] [client][single-thread][start]",
                  milter_agent_get_tag(agent));
@@ -1287,7 +1312,8 @@ single_thread_client_channel_setup (MilterClient *client,
 
     priv->processing_data = g_list_prepend(priv->processing_data, data);
 
-    if (milter_client_start_context(client, context, channel, address, &error)) {
+    if (milter_client_start_context(client, context, priv->event_loop,
+                                    channel, address, &error)) {
         g_signal_emit(client, signals[CONNECTION_ESTABLISHED], 0, context);
     } else {
         milter_error("[%u] [client][single-thread][start][error] %s",
@@ -1394,7 +1420,9 @@ accept_connection_fd (MilterClient *client, gint server_fd,
         return client_fd;
     }
 
+    g_mutex_lock(priv->sessions_mutex);
     milter_client_session_started(client);
+    g_mutex_unlock(priv->sessions_mutex);
     if (milter_need_debug_log()) {
         gchar *spec;
         spec = milter_connection_address_to_spec(&(address->address.base));
@@ -1546,55 +1574,368 @@ single_thread_start_accept (MilterClient *client, GError **error)
     return TRUE;
 }
 
+static gboolean
+event_loop_thread_notify (EventLoopThread *thread)
+{
+    gssize written_size;
+#ifdef HAVE_SYS_EVENTFD_H
+    guint64 n_notifications = 1;
+
+    written_size = write(thread->notify_fds[1],
+                         &n_notifications, sizeof(n_notifications));
+#else
+    gchar notification = '\0';
+
+    written_size = write(thread->notify_fds[1], &notification, 1);
+#endif
+    if (written_size == -1 && errno != EAGAIN) {
+        milter_error("[client][multi-thread][notify][error] %s",
+                     g_strerror(errno));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 static void
-multi_thread_process_client_channel (MilterClient *client, GIOChannel *channel,
-                                     MilterGenericSocketAddress *address,
-                                     socklen_t address_size)
+event_loop_thread_drain_notifications (EventLoopThread *thread)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    guint64 n_notifications;
+
+    if (read(thread->notify_fds[0],
+             &n_notifications, sizeof(n_notifications)) == -1 &&
+        errno != EAGAIN) {
+        milter_error("[client][multi-thread][drain][error] %s",
+                     g_strerror(errno));
+    }
+#else
+    gchar notifications[256];
+
+    while (read(thread->notify_fds[0],
+                notifications, sizeof(notifications)) > 0) {
+    }
+#endif
+}
+
+static void
+event_loop_thread_quit_if_idle (EventLoopThread *thread)
+{
+    gboolean quitting;
+
+    if (g_atomic_int_get(&(thread->n_sessions)) > 0)
+        return;
+
+    g_mutex_lock(thread->mutex);
+    quitting = thread->quitting;
+    g_mutex_unlock(thread->mutex);
+    if (quitting) {
+        milter_debug("[client][multi-thread][loop][quit] <%u>", thread->id);
+        milter_event_loop_quit(thread->loop);
+    }
+}
+
+static void
+multi_thread_cb_finished (MilterClientContext *context, gpointer _data)
 {
+    MilterClientProcessData *data = _data;
     MilterClientPrivate *priv;
+    EventLoopThread *thread;
+
+    priv = data->priv;
+    thread = data->event_loop_thread;
+
+    g_mutex_lock(priv->sessions_mutex);
+    finish_processing(data);
+    g_mutex_unlock(priv->sessions_mutex);
+
+    if (g_atomic_int_dec_and_test(&(thread->n_sessions)))
+        event_loop_thread_quit_if_idle(thread);
+}
+
+static void
+multi_thread_client_channel_setup (EventLoopThread *thread,
+                                   GIOChannel *channel,
+                                   MilterGenericSocketAddress *address)
+{
+    MilterClient *client;
+    MilterClientPrivate *priv;
+    MilterAgent *agent;
     MilterClientContext *context;
     MilterClientProcessData *data;
     GError *error = NULL;
 
+    client = thread->client;
     priv = MILTER_CLIENT_GET_PRIVATE(client);
 
     context = milter_client_create_context(client);
+    agent = MILTER_AGENT(context);
 
     data = g_new(MilterClientProcessData, 1);
     data->priv = priv;
     data->client = client;
     data->context = context;
-    data->finished_handler_id = 0;
+    data->event_loop_thread = thread;
 
+    milter_debug("[%u] [client][multi-thread][start] <%u>",
+                 milter_agent_get_tag(agent), thread->id);
+
+    data->finished_handler_id =
+        g_signal_connect(context, "finished",
+                         G_CALLBACK(multi_thread_cb_finished), data);
+
+    g_mutex_lock(priv->sessions_mutex);
     priv->processing_data = g_list_prepend(priv->processing_data, data);
-    if (milter_client_start_context(client, context, channel, address, &error)) {
-        g_thread_pool_push(priv->worker_threads, data, &error);
-        if (error) {
-            GError *client_error;
+    g_mutex_unlock(priv->sessions_mutex);
 
-            client_error = g_error_new(MILTER_CLIENT_ERROR,
-                                       MILTER_CLIENT_ERROR_THREAD,
-                                       "failed to push a data to thread pool: %s",
-                                       error->message);
-            g_error_free(error);
-            milter_error("[%u] [client][multi-thread][error] %s",
-                         milter_agent_get_tag(MILTER_AGENT(context)),
-                         client_error->message);
-            milter_error_emittable_emit(MILTER_ERROR_EMITTABLE(client),
-                                        client_error);
-            g_error_free(client_error);
-            milter_finished_emittable_emit(MILTER_FINISHED_EMITTABLE(context));
-        }
+    if (milter_client_start_context(client, context, thread->loop,
+                                    channel, address, &error)) {
+        g_signal_emit(client, signals[CONNECTION_ESTABLISHED], 0, context);
     } else {
         milter_error("[%u] [client][multi-thread][start][error] %s",
-                     milter_agent_get_tag(MILTER_AGENT(context)),
-                     error->message);
-        milter_error_emittable_emit(MILTER_ERROR_EMITTABLE(context), error);
+                     milter_agent_get_tag(agent), error->message);
+        milter_error_emittable_emit(MILTER_ERROR_EMITTABLE(agent), error);
         g_error_free(error);
         milter_finished_emittable_emit(MILTER_FINISHED_EMITTABLE(context));
     }
+}
 
-    g_io_channel_unref(channel);
+static gboolean
+event_loop_thread_cb_notified (GIOChannel *channel, GIOCondition condition,
+                               gpointer user_data)
+{
+    EventLoopThread *thread = user_data;
+
+    event_loop_thread_drain_notifications(thread);
+
+    while (TRUE) {
+        ClientChannelSetupData *setup_data;
+
+        g_mutex_lock(thread->mutex);
+        setup_data = g_queue_pop_head(thread->pending_channels);
+        g_mutex_unlock(thread->mutex);
+        if (!setup_data)
+            break;
+
+        multi_thread_client_channel_setup(thread,
+                                          setup_data->channel,
+                                          &(setup_data->address));
+        g_io_channel_unref(setup_data->channel);
+        g_free(setup_data);
+    }
+
+    event_loop_thread_quit_if_idle(thread);
+
+    return TRUE;
+}
+
+static void
+event_loop_thread_free (EventLoopThread *thread)
+{
+    ClientChannelSetupData *setup_data;
+
+    if (thread->notify_watch_id > 0)
+        milter_event_loop_remove(thread->loop, thread->notify_watch_id);
+    if (thread->notify_channel)
+        g_io_channel_unref(thread->notify_channel);
+    if (thread->notify_fds[0] != -1)
+        close(thread->notify_fds[0]);
+    if (thread->notify_fds[1] != -1 &&
+        thread->notify_fds[1] != thread->notify_fds[0])
+        close(thread->notify_fds[1]);
+
+    while ((setup_data = g_queue_pop_head(thread->pending_channels))) {
+        g_io_channel_unref(setup_data->channel);
+        g_free(setup_data);
+    }
+    g_queue_free(thread->pending_channels);
+    g_mutex_free(thread->mutex);
+
+    if (thread->loop)
+        g_object_unref(thread->loop);
+
+    g_free(thread);
+}
+
+static gboolean
+event_loop_thread_open_notify_fds (EventLoopThread *thread, GError **error)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    gint fd;
+
+    fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd == -1) {
+        g_set_error(error,
+                    MILTER_CLIENT_ERROR,
+                    MILTER_CLIENT_ERROR_THREAD,
+                    "failed to create eventfd for event loop thread: %s",
+                    g_strerror(errno));
+        return FALSE;
+    }
+    thread->notify_fds[0] = fd;
+    thread->notify_fds[1] = fd;
+#else
+    gint i;
+
+    if (pipe(thread->notify_fds) == -1) {
+        g_set_error(error,
+                    MILTER_CLIENT_ERROR,
+                    MILTER_CLIENT_ERROR_THREAD,
+                    "failed to create pipe for event loop thread: %s",
+                    g_strerror(errno));
+        return FALSE;
+    }
+    for (i = 0; i < 2; i++) {
+        fcntl(thread->notify_fds[i], F_SETFL,
+              fcntl(thread->notify_fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(thread->notify_fds[i], F_SETFD, FD_CLOEXEC);
+    }
+#endif
+
+    return TRUE;
+}
+
+static EventLoopThread *
+event_loop_thread_new (MilterClient *client, guint id, GError **error)
+{
+    EventLoopThread *thread;
+
+    thread = g_new0(EventLoopThread, 1);
+    thread->client = client;
+    thread->id = id;
+    thread->notify_fds[0] = -1;
+    thread->notify_fds[1] = -1;
+    thread->mutex = g_mutex_new();
+    thread->pending_channels = g_queue_new();
+    thread->quitting = FALSE;
+    thread->n_sessions = 0;
+
+    if (!event_loop_thread_open_notify_fds(thread, error)) {
+        event_loop_thread_free(thread);
+        return NULL;
+    }
+
+    thread->loop = milter_client_create_event_loop(client, FALSE);
+    thread->notify_channel = g_io_channel_unix_new(thread->notify_fds[0]);
+    g_io_channel_set_encoding(thread->notify_channel, NULL, NULL);
+    thread->notify_watch_id =
+        milter_event_loop_watch_io(thread->loop,
+                                   thread->notify_channel,
+                                   G_IO_IN | G_IO_PRI,
+                                   event_loop_thread_cb_notified,
+                                   thread);
+
+    return thread;
+}
+
+static gpointer
+event_loop_thread_run (gpointer data)
+{
+    EventLoopThread *thread = data;
+
+    milter_debug("[client][multi-thread][loop][run] <%u>", thread->id);
+    milter_event_loop_run(thread->loop);
+    milter_debug("[client][multi-thread][loop][end] <%u>", thread->id);
+
+    return NULL;
+}
+
+static void
+event_loop_threads_quit (MilterClientPrivate *priv)
+{
+    guint i;
+
+    if (!priv->event_loop_threads)
+        return;
+
+    for (i = 0; i < priv->event_loop_threads->len; i++) {
+        EventLoopThread *thread;
+
+        thread = g_ptr_array_index(priv->event_loop_threads, i);
+        g_mutex_lock(thread->mutex);
+        thread->quitting = TRUE;
+        g_mutex_unlock(thread->mutex);
+        event_loop_thread_notify(thread);
+    }
+}
+
+static void
+event_loop_threads_free (MilterClientPrivate *priv)
+{
+    guint i;
+
+    if (!priv->event_loop_threads)
+        return;
+
+    event_loop_threads_quit(priv);
+    for (i = 0; i < priv->event_loop_threads->len; i++) {
+        EventLoopThread *thread;
+
+        thread = g_ptr_array_index(priv->event_loop_threads, i);
+        if (thread->thread)
+            g_thread_join(thread->thread);
+        event_loop_thread_free(thread);
+    }
+    g_ptr_array_free(priv->event_loop_threads, TRUE);
+    priv->event_loop_threads = NULL;
+}
+
+static guint
+multi_thread_get_n_threads (MilterClient *client)
+{
+    guint n_threads;
+
+    n_threads = milter_client_get_n_threads(client);
+    if (n_threads == 0) {
+        glong n_processors = -1;
+#ifdef _SC_NPROCESSORS_ONLN
+        n_processors = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        if (n_processors > 0)
+            n_threads = n_processors;
+        else
+            n_threads = 1;
+    }
+
+    return n_threads;
+}
+
+static void
+multi_thread_process_client_channel (MilterClient *client, GIOChannel *channel,
+                                     MilterGenericSocketAddress *address,
+                                     socklen_t address_size)
+{
+    MilterClientPrivate *priv;
+    EventLoopThread *thread = NULL;
+    ClientChannelSetupData *setup_data;
+    gint min_n_sessions = G_MAXINT;
+    guint i;
+
+    priv = MILTER_CLIENT_GET_PRIVATE(client);
+
+    for (i = 0; i < priv->event_loop_threads->len; i++) {
+        EventLoopThread *candidate;
+        gint n_sessions;
+
+        candidate = g_ptr_array_index(priv->event_loop_threads, i);
+        n_sessions = g_atomic_int_get(&(candidate->n_sessions));
+        if (n_sessions < min_n_sessions) {
+            thread = candidate;
+            min_n_sessions = n_sessions;
+        }
+    }
+
+    setup_data = g_new(ClientChannelSetupData, 1);
+    setup_data->client = client;
+    setup_data->channel = channel;
+    memcpy(&(setup_data->address), address, address_size);
+    g_io_channel_ref(channel);
+
+    g_atomic_int_inc(&(thread->n_sessions));
+    g_mutex_lock(thread->mutex);
+    g_queue_push_tail(thread->pending_channels, setup_data);
+    g_mutex_unlock(thread->mutex);
+    event_loop_thread_notify(thread);
 }
 
 static gboolean
@@ -1631,83 +1972,49 @@ multi_thread_accept_watch_func (GIOChannel *channel, GIOCondition condition,
     return keep_callback;
 }
 
-static void
-multi_thread_cb_finished (MilterClientContext *context, gpointer _data)
-{
-    MilterClientProcessData *data = _data;
-
-    finish_processing(data);
-}
-
-static void
-multi_thread_process_client_channel_thread (gpointer data_, gpointer user_data)
-{
-    MilterAgent *agent;
-    MilterClientContext *context;
-    MilterClient *client = data_;
-    MilterClientProcessData *data = user_data;
-    MilterEventLoop *event_loop;
-    GError *error = NULL;
-
-    event_loop = milter_client_create_event_loop(client, FALSE);
-
-    context = MILTER_CLIENT_CONTEXT(data->context);
-    agent = MILTER_AGENT(context);
-    milter_debug("[%u] [client][multi-thread][start]",
-                 milter_agent_get_tag(agent));
-
-    data->finished_handler_id =
-        g_signal_connect(data->context, "finished",
-                         G_CALLBACK(multi_thread_cb_finished), data);
-
-    milter_agent_set_event_loop(agent, event_loop);
-    if (milter_agent_start(agent, &error)) {
-        g_signal_emit(client, signals[CONNECTION_ESTABLISHED], 0, context);
-        milter_event_loop_run(event_loop);
-    } else {
-        milter_error("[%u] [client][multi-thread][start][error] %s",
-                     milter_agent_get_tag(agent), error->message);
-        milter_error_emittable_emit(MILTER_ERROR_EMITTABLE(client),
-                                    error);
-        g_error_free(error);
-        milter_finished_emittable_emit(MILTER_FINISHED_EMITTABLE(context));
-    }
-
-    g_object_unref(event_loop);
-}
-
 static gboolean
 multi_thread_start_accept (MilterClient *client, GError **error)
 {
     MilterClientPrivate *priv;
-    gint max_threads = 10;
-    GError *local_error = NULL;
+    guint i, n_threads;
 
     priv = MILTER_CLIENT_GET_PRIVATE(client);
-    priv->worker_threads =
-        g_thread_pool_new(multi_thread_process_client_channel_thread,
-                          client,
-                          max_threads,
-                          FALSE,
-                          &local_error);
-    if (!priv->worker_threads) {
-        GError *client_error;
-        client_error = g_error_new(MILTER_CLIENT_ERROR,
-                                   MILTER_CLIENT_ERROR_THREAD,
-                                   "failed to create a thread pool "
-                                   "for processing accepted connection: %s",
-                                   local_error->message);
-        g_error_free(local_error);
-        milter_error("[client][multi-thread][accept][error] %s",
-                     client_error->message);
-        g_propagate_error(error, client_error);
-        return FALSE;
+
+    n_threads = multi_thread_get_n_threads(client);
+    priv->event_loop_threads = g_ptr_array_sized_new(n_threads);
+    for (i = 0; i < n_threads; i++) {
+        EventLoopThread *thread;
+        GError *local_error = NULL;
+
+        thread = event_loop_thread_new(client, i, &local_error);
+        if (thread) {
+            g_ptr_array_add(priv->event_loop_threads, thread);
+            thread->thread = g_thread_try_new("event_loop_thread",
+                                              event_loop_thread_run,
+                                              thread,
+                                              &local_error);
+        }
+        if (!thread || !thread->thread) {
+            GError *client_error;
+
+            client_error = g_error_new(MILTER_CLIENT_ERROR,
+                                       MILTER_CLIENT_ERROR_THREAD,
+                                       "failed to create an event loop thread "
+                                       "for processing accepted connection: %s",
+                                       local_error->message);
+            g_error_free(local_error);
+            milter_error("[client][multi-thread][accept][error] %s",
+                         client_error->message);
+            g_propagate_error(error, client_error);
+            event_loop_threads_free(priv);
+            return FALSE;
+        }
     }
+    milter_info("[client][multi-thread][run] <%u>", n_threads);
 
     milter_event_loop_run(priv->accept_loop);
 
-    g_thread_pool_free(priv->worker_threads, TRUE, TRUE);
-    priv->worker_threads = NULL;
+    event_loop_threads_free(priv);
 
     return TRUE;
 }
@@ -2531,7 +2838,7 @@ milter_client_shutdown (MilterClient *client)
             priv->listening_channel = NULL;
         }
 
-        if (priv->n_processing_sessions == 0)
+        if (priv->n_processing_sessions == 0 && priv->event_loop)
             milter_event_loop_quit(priv->event_loop);
     }
     g_mutex_unlock(priv->quit_mutex);
@@ -3316,6 +3623,30 @@ milter_client_get_worker_pids (MilterClient  *client)
     return klass->get_worker_pids(client);
 }
 
+gboolean
+milter_client_is_multi_thread_mode (MilterClient *client)
+{
+    return MILTER_CLIENT_GET_PRIVATE(client)->multi_thread_mode;
+}
+
+void
+milter_client_set_multi_thread_mode (MilterClient *client,
+                                     gboolean multi_thread_mode)
+{
+    MILTER_CLIENT_GET_PRIVATE(client)->multi_thread_mode = multi_thread_mode;
+}
+
+guint
+milter_client_get_n_threads (MilterClient *client)
+{
+    return MILTER_CLIENT_GET_PRIVATE(client)->n_threads;
+}
+
+void
+milter_client_set_n_threads (MilterClient *client, guint n_threads)
+{
+    MILTER_CLIENT_GET_PRIVATE(client)->n_threads = n_threads;
+}
 
 /*
 vi:ts=4:nowrap:ai:expandtab:sw=4
@@ -1049,6 +1049,67 @@ void                 milter_client_set_max_pending_finished_sessions
 
 GArray              *milter_client_get_worker_pids   (MilterClient  *client);
 
+/**
+ * milter_client_is_multi_thread_mode:
+ * @client: a %MilterClient.
+ *
+ * Gets whether @client processes sessions by event loop
+ * threads.
+ *
+ * Returns: %TRUE if @client is multi-thread mode.
+ *
+ * Since: 2.1.6
+ */
+gboolean             milter_client_is_multi_thread_mode
+                                                     (MilterClient  *client);
+
+/**
+ * milter_client_set_multi_thread_mode:
+ * @client: a %MilterClient.
+ * @multi_thread_mode: whether @client is multi-thread mode.
+ *
+ * Sets whether @client processes sessions by event loop
+ * threads. In multi-thread mode, the main thread only
+ * accepts connections and each accepted connection is
+ * passed to the event loop thread that has the fewest
+ * sessions. Each event loop thread processes many
+ * sessions. Callbacks are called in event loop threads.
+ *
+ * It is ignored when @client has worker processes.
+ *
+ * Since: 2.1.6
+ */
+void                 milter_client_set_multi_thread_mode
+                                                     (MilterClient  *client,
+                                                      gboolean       multi_thread_mode);
+
+/**
+ * milter_client_get_n_threads:
+ * @client: a %MilterClient.
+ *
+ * Gets the number of event loop threads in multi-thread
+ * mode.
+ *
+ * Returns: the number of event loop threads of @client.
+ *          0 means the number of online processors.
+ *
+ * Since: 2.1.6
+ */
+guint                milter_client_get_n_threads     (MilterClient  *client);
+
+/**
+ * milter_client_set_n_threads:
+ * @client: a %MilterClient.
+ * @n_threads: the number of event loop threads.
+ *
+ * Sets the number of event loop threads in multi-thread
+ * mode. 0 means the number of online processors.
+ *
+ * Since: 2.1.6
+ */
+void                 milter_client_set_n_threads     (MilterClient  *client,
+                                                      guint          n_threads);
+
 G_END_DECLS
 
 #endif /* __MILTER_CLIENT_CLIENT_H__ */
@@ -0,0 +1,394 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "../../config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "milter-capture.h"
+#include "milter-logger.h"
+#include "milter-core-internal.h"
+
+#define MAGIC "MLTRCAP1"
+#define MAGIC_SIZE 8
+#define RECORD_HEADER_SIZE (8 + 4 + 1 + 4)
+#define BUFFER_SIZE (64 * 1024)
+
+struct _MilterCaptureReader
+{
+    gchar *path;
+    FILE *file;
+    GString *chunk;
+};
+
+G_LOCK_DEFINE_STATIC(capture);
+static volatile gboolean active = FALSE;
+static gchar *path_template = NULL;
+static gsize max_size = 0;
+static gint fd = -1;
+static pid_t owner_pid = 0;
+static gsize written_size = 0;
+static GString *buffer = NULL;
+
+GQuark
+milter_capture_error_quark (void)
+{
+    return g_quark_from_static_string("milter-capture-error-quark");
+}
+
+static gchar *
+expand_path (const gchar *template, pid_t pid, gboolean owner)
+{
+    GString *path;
+    const gchar *current;
+
+    path = g_string_new(NULL);
+    for (current = template; *current; current++) {
+        if (current[0] == '%' && current[1] == 'p') {
+            g_string_append_printf(path, "%d", (gint)pid);
+            current++;
+        } else {
+            g_string_append_c(path, *current);
+        }
+    }
+    if (!owner && !strstr(template, "%p"))
+        g_string_append_printf(path, ".%d", (gint)pid);
+
+    return g_string_free(path, FALSE);
+}
+
+static gboolean
+open_file (gboolean owner, GError **error)
+{
+    gchar *path;
+
+    owner_pid = getpid();
+    path = expand_path(path_template, owner_pid, owner);
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+    if (fd == -1) {
+        g_set_error(error,
+                    MILTER_CAPTURE_ERROR,
+                    MILTER_CAPTURE_ERROR_IO_ERROR,
+                    "failed to open trace file: <%s>: %s",
+                    path, g_strerror(errno));
+        g_free(path);
+        return FALSE;
+    }
+    milter_info("[capture][start] <%s>", path);
+    g_free(path);
+
+    g_string_truncate(buffer, 0);
+    g_string_append_len(buffer, MAGIC, MAGIC_SIZE);
+    written_size = MAGIC_SIZE;
+
+    return TRUE;
+}
+
+static void
+write_buffer (void)
+{
+    gsize offset = 0;
+
+    while (offset < buffer->len) {
+        ssize_t size;
+
+        size = write(fd, buffer->str + offset, buffer->len - offset);
+        if (size == -1) {
+            if (errno == EINTR)
+                continue;
+            milter_error("[capture][write][error] %s: stop capturing",
+                         g_strerror(errno));
+            active = FALSE;
+            break;
+        }
+        offset += size;
+    }
+    g_string_truncate(buffer, 0);
+}
+
+static void
+close_file (void)
+{
+    if (fd == -1)
+        return;
+
+    if (owner_pid == getpid())
+        write_buffer();
+    close(fd);
+    fd = -1;
+    g_string_truncate(buffer, 0);
+}
+
+gboolean
+milter_capture_start (const gchar *path, gsize size, GError **error)
+{
+    gboolean success;
+
+    G_LOCK(capture);
+    active = FALSE;
+    close_file();
+    g_free(path_template);
+    path_template = g_strdup(path);
+    max_size = size;
+    if (!buffer)
+        buffer = g_string_sized_new(BUFFER_SIZE);
+    success = open_file(TRUE, error);
+    active = success;
+    G_UNLOCK(capture);
+
+    return success;
+}
+
+void
+milter_capture_stop (void)
+{
+    G_LOCK(capture);
+    active = FALSE;
+    close_file();
+    g_free(path_template);
+    path_template = NULL;
+    if (buffer) {
+        g_string_free(buffer, TRUE);
+        buffer = NULL;
+    }
+    G_UNLOCK(capture);
+}
+
+gboolean
+milter_capture_is_active (void)
+{
+    return active;
+}
+
+static void
+append_uint32 (guint32 value)
+{
+    value = GUINT32_TO_BE(value);
+    g_string_append_len(buffer, (const gchar *)&value, sizeof(value));
+}
+
+void
+milter_capture_record (guint tag,
+                       MilterCaptureDirection direction,
+                       const gchar *chunk,
+                       gsize chunk_size)
+{
+    GTimeVal time_value;
+    guint64 time;
+
+    if (!active)
+        return;
+
+    g_get_current_time(&time_value);
+    time = (guint64)time_value.tv_sec * G_USEC_PER_SEC + time_value.tv_usec;
+
+    G_LOCK(capture);
+    if (!active)
+        goto done;
+
+    if (owner_pid != getpid()) {
+        GError *error = NULL;
+
+        close(fd);
+        fd = -1;
+        if (!open_file(FALSE, &error)) {
+            milter_error("[capture][open][error] %s: stop capturing",
+                         error->message);
+            g_error_free(error);
+            active = FALSE;
+            goto done;
+        }
+    }
+
+    if (written_size + RECORD_HEADER_SIZE + chunk_size > max_size) {
+        milter_warning("[capture][limit] "
+                       "<%" G_GSIZE_FORMAT ">: stop capturing",
+                       max_size);
+        write_buffer();
+        active = FALSE;
+        goto done;
+    }
+
+    time = GUINT64_TO_BE(time);
+    g_string_append_len(buffer, (const gchar *)&time, sizeof(time));
+    append_uint32(tag);
+    g_string_append_c(buffer, (gchar)direction);
+    append_uint32(chunk_size);
+    g_string_append_len(buffer, chunk, chunk_size);
+    written_size += RECORD_HEADER_SIZE + chunk_size;
+
+    if (buffer->len >= BUFFER_SIZE)
+        write_buffer();
+
+done:
+    G_UNLOCK(capture);
+}
+
+void
+milter_capture_flush (void)
+{
+    G_LOCK(capture);
+    if (fd != -1 && owner_pid == getpid())
+        write_buffer();
+    G_UNLOCK(capture);
+}
+
+void
+milter_capture_internal_init (void)
+{
+    const gchar *path;
+    const gchar *max_size_env;
+    gsize size = MILTER_CAPTURE_DEFAULT_MAX_SIZE;
+    GError *error = NULL;
+
+    path = g_getenv("MILTER_CAPTURE_PATH");
+    if (!path || path[0] == '\0')
+        return;
+
+    max_size_env = g_getenv("MILTER_CAPTURE_MAX_SIZE");
+    if (max_size_env) {
+        guint64 value;
+        gchar *end = NULL;
+
+        value = g_ascii_strtoull(max_size_env, &end, 10);
+        if (end && end[0] == '\0' && value > 0) {
+            size = value;
+        } else {
+            milter_warning("[capture][max-size][invalid] <%s>", max_size_env);
+        }
+    }
+
+    if (!milter_capture_start(path, size, &error)) {
+        milter_error("[capture][start][error] %s", error->message);
+        g_error_free(error);
+    }
+}
+
+void
+milter_capture_internal_quit (void)
+{
+    milter_capture_stop();
+}
+
+MilterCaptureReader *
+milter_capture_reader_open (const gchar *path, GError **error)
+{
+    MilterCaptureReader *reader;
+    FILE *file;
+    gchar magic[MAGIC_SIZE];
+
+    file = fopen(path, "rb");
+    if (!file) {
+        g_set_error(error,
+                    MILTER_CAPTURE_ERROR,
+                    MILTER_CAPTURE_ERROR_IO_ERROR,
+                    "failed to open trace file: <%s>: %s",
+                    path, g_strerror(errno));
+        return NULL;
+    }
+
+    if (fread(magic, 1, MAGIC_SIZE, file) != MAGIC_SIZE ||
+        memcmp(magic, MAGIC, MAGIC_SIZE) != 0) {
+        g_set_error(error,
+                    MILTER_CAPTURE_ERROR,
+                    MILTER_CAPTURE_ERROR_INVALID_FORMAT,
+                    "not a trace file: <%s>", path);
+        fclose(file);
+        return NULL;
+    }
+
+    reader = g_new0(MilterCaptureReader, 1);
+    reader->path = g_strdup(path);
+    reader->file = file;
+    reader->chunk = g_string_new(NULL);
+
+    return reader;
+}
+
+gboolean
+milter_capture_reader_read (MilterCaptureReader *reader,
+                            MilterCaptureRecord *record,
+                            GError **error)
+{
+    guchar header[RECORD_HEADER_SIZE];
+    gsize size;
+    guint64 time;
+    guint32 value;
+
+    size = fread(header, 1, RECORD_HEADER_SIZE, reader->file);
+    if (size == 0 && feof(reader->file))
+        return FALSE;
+    if (size != RECORD_HEADER_SIZE) {
+        g_set_error(error,
+                    MILTER_CAPTURE_ERROR,
+                    MILTER_CAPTURE_ERROR_INVALID_FORMAT,
+                    "truncated record header: <%s>", reader->path);
+        return FALSE;
+    }
+
+    memcpy(&time, header, sizeof(time));
+    record->time = (gint64)GUINT64_FROM_BE(time);
+    memcpy(&value, header + 8, sizeof(value));
+    record->tag = GUINT32_FROM_BE(value);
+    record->direction = header[12];
+    memcpy(&value, header + 13, sizeof(value));
+    record->chunk_size = GUINT32_FROM_BE(value);
+
+    if (record->direction != MILTER_CAPTURE_DIRECTION_READ &&
+        record->direction != MILTER_CAPTURE_DIRECTION_WRITE) {
+        g_set_error(error,
+                    MILTER_CAPTURE_ERROR,
+                    MILTER_CAPTURE_ERROR_INVALID_FORMAT,
+                    "invalid direction: <%u>: <%s>",
+                    header[12], reader->path);
+        return FALSE;
+    }
+
+    g_string_set_size(reader->chunk, record->chunk_size);
+    if (fread(reader->chunk->str, 1, record->chunk_size, reader->file) !=
+        record->chunk_size) {
+        g_set_error(error,
+                    MILTER_CAPTURE_ERROR,
+                    MILTER_CAPTURE_ERROR_INVALID_FORMAT,
+                    "truncated record chunk: <%s>", reader->path);
+        return FALSE;
+    }
+    record->chunk = reader->chunk->str;
+
+    return TRUE;
+}
+
+void
+milter_capture_reader_close (MilterCaptureReader *reader)
+{
+    fclose(reader->file);
+    g_string_free(reader->chunk, TRUE);
+    g_free(reader->path);
+    g_free(reader);
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
@@ -0,0 +1,242 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __MILTER_CAPTURE_H__
+#define __MILTER_CAPTURE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * SECTION: milter-capture
+ * @title: Packet capture
+ * @short_description: Records milter traffic into a binary trace.
+ *
+ * The packet capture records all chunks that are read by
+ * %MilterReader and written by %MilterWriter with their
+ * time, tag and direction into a compact binary trace
+ * file. The trace can be replayed by milter-replay.
+ *
+ * The capture is started by milter_init() when
+ * MILTER_CAPTURE_PATH environment variable is set. "%p" in
+ * the path is replaced with the process ID. If a process
+ * that doesn't own the trace file records a chunk, e.g. a
+ * forked worker, ".PID" is appended to the path.
+ * MILTER_CAPTURE_MAX_SIZE environment variable limits the
+ * trace file size in bytes. Chunks are dropped after the
+ * limit is reached. The default is 104857600 (100MiB).
+ *
+ * The trace file starts with 8 bytes magic "MLTRCAP1".
+ * Each record has a 17 bytes header in network byte order:
+ * the time in microseconds since the Epoch (64 bits), the
+ * tag (32 bits), the direction (8 bits) and the size of
+ * the chunk (32 bits). The chunk follows the header.
+ */
+
+/**
+ * MILTER_CAPTURE_ERROR:
+ *
+ * Used to get the #GError quark for #MilterCapture errors.
+ *
+ * Since: 2.1.6
+ */
+#define MILTER_CAPTURE_ERROR           (milter_capture_error_quark())
+
+/**
+ * MILTER_CAPTURE_DEFAULT_MAX_SIZE:
+ *
+ * The default maximum size of a trace file in bytes.
+ *
+ * Since: 2.1.6
+ */
+#define MILTER_CAPTURE_DEFAULT_MAX_SIZE (100 * 1024 * 1024)
+
+/**
+ * MilterCaptureError:
+ * @MILTER_CAPTURE_ERROR_IO_ERROR: Indicates an I/O error.
+ * @MILTER_CAPTURE_ERROR_INVALID_FORMAT: Indicates that the
+ *                                       trace file is broken.
+ *
+ * These identify the error codes of the packet capture.
+ *
+ * Since: 2.1.6
+ */
+typedef enum
+{
+    MILTER_CAPTURE_ERROR_IO_ERROR,
+    MILTER_CAPTURE_ERROR_INVALID_FORMAT
+} MilterCaptureError;
+
+/**
+ * MilterCaptureDirection:
+ * @MILTER_CAPTURE_DIRECTION_READ: The chunk is read from
+ *                                 the peer.
+ * @MILTER_CAPTURE_DIRECTION_WRITE: The chunk is written to
+ *                                  the peer.
+ *
+ * These identify the direction of a captured chunk.
+ *
+ * Since: 2.1.6
+ */
+typedef enum
+{
+    MILTER_CAPTURE_DIRECTION_READ,
+    MILTER_CAPTURE_DIRECTION_WRITE
+} MilterCaptureDirection;
+
+typedef struct _MilterCaptureRecord MilterCaptureRecord;
+typedef struct _MilterCaptureReader MilterCaptureReader;
+
+/**
+ * MilterCaptureRecord:
+ * @time: the time in microseconds since the Epoch.
+ * @tag: the tag of the reader or writer.
+ * @direction: the direction of the chunk.
+ * @chunk: the chunk. It is valid until the next
+ *         milter_capture_reader_read() call.
+ * @chunk_size: the size of @chunk.
+ *
+ * A captured chunk.
+ *
+ * Since: 2.1.6
+ */
+struct _MilterCaptureRecord
+{
+    gint64 time;
+    guint tag;
+    MilterCaptureDirection direction;
+    const gchar *chunk;
+    gsize chunk_size;
+};
+
+GQuark           milter_capture_error_quark   (void);
+
+/**
+ * milter_capture_start:
+ * @path: the path of the trace file. "%p" is replaced
+ *        with the process ID.
+ * @max_size: the maximum size of the trace file in bytes.
+ * @error: return location for an error, or %NULL.
+ *
+ * Starts capturing into @path. The running capture is
+ * stopped.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise.
+ *
+ * Since: 2.1.6
+ */
+gboolean         milter_capture_start         (const gchar     *path,
+                                               gsize            max_size,
+                                               GError         **error);
+
+/**
+ * milter_capture_stop:
+ *
+ * Writes buffered records and stops capturing.
+ *
+ * Since: 2.1.6
+ */
+void             milter_capture_stop          (void);
+
+/**
+ * milter_capture_is_active:
+ *
+ * Returns: %TRUE if capturing, %FALSE otherwise.
+ *
+ * Since: 2.1.6
+ */
+gboolean         milter_capture_is_active     (void);
+
+/**
+ * milter_capture_record:
+ * @tag: the tag of the reader or writer.
+ * @direction: the direction of @chunk.
+ * @chunk: the chunk.
+ * @chunk_size: the size of @chunk.
+ *
+ * Records @chunk with the current time. Records are
+ * buffered and written by 64KiB. It does nothing if not
+ * capturing.
+ *
+ * Since: 2.1.6
+ */
+void             milter_capture_record        (guint                   tag,
+                                               MilterCaptureDirection  direction,
+                                               const gchar            *chunk,
+                                               gsize                   chunk_size);
+
+/**
+ * milter_capture_flush:
+ *
+ * Writes buffered records.
+ *
+ * Since: 2.1.6
+ */
+void             milter_capture_flush         (void);
+
+/**
+ * milter_capture_reader_open:
+ * @path: the path of the trace file.
+ * @error: return location for an error, or %NULL.
+ *
+ * Opens a trace file to read records.
+ *
+ * Returns: a new %MilterCaptureReader or %NULL on error.
+ *
+ * Since: 2.1.6
+ */
+MilterCaptureReader *milter_capture_reader_open
+                                              (const gchar     *path,
+                                               GError         **error);
+
+/**
+ * milter_capture_reader_read:
+ * @reader: a %MilterCaptureReader.
+ * @record: return location for the next record.
+ * @error: return location for an error, or %NULL.
+ *
+ * Reads the next record.
+ *
+ * Returns: %TRUE if a record is read, %FALSE on the end of
+ * the trace or error. @error is set on error.
+ *
+ * Since: 2.1.6
+ */
+gboolean         milter_capture_reader_read   (MilterCaptureReader *reader,
+                                               MilterCaptureRecord *record,
+                                               GError             **error);
+
+/**
+ * milter_capture_reader_close:
+ * @reader: a %MilterCaptureReader.
+ *
+ * Closes and frees @reader.
+ *
+ * Since: 2.1.6
+ */
+void             milter_capture_reader_close  (MilterCaptureReader *reader);
+
+G_END_DECLS
+
+#endif /* __MILTER_CAPTURE_H__ */
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
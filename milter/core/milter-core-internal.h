@@ -28,6 +28,8 @@ void milter_logger_internal_init     (void);
 void milter_logger_internal_quit     (void);
 void milter_agent_internal_init      (void);
 void milter_agent_internal_quit      (void);
+void milter_capture_internal_init    (void);
+void milter_capture_internal_quit    (void);
 
 G_END_DECLS
 
@@ -88,6 +88,8 @@ milter_init (void)
 
     milter_agent_internal_init();
 
+    milter_capture_internal_init();
+
     delegate_glib_log_handlers();
     milter_core_log_handler_id = MILTER_GLIB_LOG_DELEGATE("milter-core");
 }
@@ -98,6 +100,8 @@ milter_quit (void)
     if (!initialized)
         return;
 
+    milter_capture_internal_quit();
+
     milter_agent_internal_quit();
 
     remove_glib_log_handlers();
@@ -0,0 +1,235 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "../../config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+
+#include "milter-histogram.h"
+
+/*
+ * Values less than SUB_BUCKET_COUNT have their own
+ * buckets. Larger values are bucketed by their top
+ * SUB_BUCKET_BITS bits: each power of 2 range is split into
+ * SUB_BUCKET_HALF_COUNT buckets.
+ */
+#define SUB_BUCKET_BITS 8
+#define SUB_BUCKET_COUNT (1 << SUB_BUCKET_BITS)
+#define SUB_BUCKET_HALF_COUNT (SUB_BUCKET_COUNT / 2)
+
+struct _MilterHistogram
+{
+    guint64 highest_trackable_value;
+    guint n_counts;
+    guint64 *counts;
+    guint64 total_count;
+    guint64 min;
+    guint64 max;
+    gdouble sum;
+};
+
+static guint
+bit_length (guint64 value)
+{
+    guint length = 0;
+
+    while (value > 0) {
+        length++;
+        value >>= 1;
+    }
+
+    return length;
+}
+
+static guint
+bucket_index (guint64 value)
+{
+    guint shift;
+
+    if (value < SUB_BUCKET_COUNT)
+        return (guint)value;
+
+    shift = bit_length(value) - SUB_BUCKET_BITS;
+    return SUB_BUCKET_COUNT +
+        (shift - 1) * SUB_BUCKET_HALF_COUNT +
+        (guint)((value >> shift) - SUB_BUCKET_HALF_COUNT);
+}
+
+static guint64
+bucket_highest_value (guint index)
+{
+    guint shift;
+    guint64 sub_bucket;
+
+    if (index < SUB_BUCKET_COUNT)
+        return index;
+
+    shift = (index - SUB_BUCKET_COUNT) / SUB_BUCKET_HALF_COUNT + 1;
+    sub_bucket =
+        (index - SUB_BUCKET_COUNT) % SUB_BUCKET_HALF_COUNT +
+        SUB_BUCKET_HALF_COUNT;
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+MilterHistogram *
+milter_histogram_new (guint64 highest_trackable_value)
+{
+    MilterHistogram *histogram;
+
+    histogram = g_new0(MilterHistogram, 1);
+    histogram->highest_trackable_value = MAX(highest_trackable_value, 1);
+    histogram->n_counts =
+        bucket_index(histogram->highest_trackable_value) + 1;
+    histogram->counts = g_new0(guint64, histogram->n_counts);
+
+    return histogram;
+}
+
+void
+milter_histogram_free (MilterHistogram *histogram)
+{
+    g_free(histogram->counts);
+    g_free(histogram);
+}
+
+void
+milter_histogram_reset (MilterHistogram *histogram)
+{
+    memset(histogram->counts, 0, sizeof(guint64) * histogram->n_counts);
+    histogram->total_count = 0;
+    histogram->min = 0;
+    histogram->max = 0;
+    histogram->sum = 0.0;
+}
+
+void
+milter_histogram_record (MilterHistogram *histogram, guint64 value)
+{
+    if (value > histogram->highest_trackable_value)
+        value = histogram->highest_trackable_value;
+
+    histogram->counts[bucket_index(value)]++;
+    if (histogram->total_count == 0 || value < histogram->min)
+        histogram->min = value;
+    if (value > histogram->max)
+        histogram->max = value;
+    histogram->total_count++;
+    histogram->sum += value;
+}
+
+void
+milter_histogram_record_corrected (MilterHistogram *histogram,
+                                   guint64 value,
+                                   guint64 expected_interval)
+{
+    guint64 missing_value;
+
+    milter_histogram_record(histogram, value);
+    if (expected_interval == 0 || value <= expected_interval)
+        return;
+
+    for (missing_value = value - expected_interval;
+         missing_value >= expected_interval;
+         missing_value -= expected_interval) {
+        milter_histogram_record(histogram, missing_value);
+    }
+}
+
+void
+milter_histogram_merge (MilterHistogram *histogram, MilterHistogram *other)
+{
+    guint i;
+
+    if (other->total_count == 0)
+        return;
+
+    for (i = 0; i < other->n_counts; i++) {
+        guint index;
+
+        if (other->counts[i] == 0)
+            continue;
+        index = MIN(i, histogram->n_counts - 1);
+        histogram->counts[index] += other->counts[i];
+    }
+    if (histogram->total_count == 0 || other->min < histogram->min)
+        histogram->min = MIN(other->min, histogram->highest_trackable_value);
+    if (other->max > histogram->max)
+        histogram->max = MIN(other->max, histogram->highest_trackable_value);
+    histogram->total_count += other->total_count;
+    histogram->sum += other->sum;
+}
+
+guint64
+milter_histogram_get_count (MilterHistogram *histogram)
+{
+    return histogram->total_count;
+}
+
+guint64
+milter_histogram_get_min (MilterHistogram *histogram)
+{
+    return histogram->min;
+}
+
+guint64
+milter_histogram_get_max (MilterHistogram *histogram)
+{
+    return histogram->max;
+}
+
+gdouble
+milter_histogram_get_mean (MilterHistogram *histogram)
+{
+    if (histogram->total_count == 0)
+        return 0.0;
+
+    return histogram->sum / histogram->total_count;
+}
+
+guint64
+milter_histogram_get_value_at_percentile (MilterHistogram *histogram,
+                                          gdouble percentile)
+{
+    gdouble exact_target_count;
+    guint64 target_count, count = 0;
+    guint i;
+
+    if (histogram->total_count == 0)
+        return 0;
+
+    percentile = CLAMP(percentile, 0.0, 100.0);
+    exact_target_count = percentile / 100.0 * histogram->total_count;
+    target_count = (guint64)exact_target_count;
+    if (target_count < exact_target_count || target_count == 0)
+        target_count++;
+
+    for (i = 0; i < histogram->n_counts; i++) {
+        count += histogram->counts[i];
+        if (count >= target_count)
+            return MIN(bucket_highest_value(i), histogram->max);
+    }
+
+    return histogram->max;
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
@@ -0,0 +1,192 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __MILTER_HISTOGRAM_H__
+#define __MILTER_HISTOGRAM_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * SECTION: milter-histogram
+ * @title: MilterHistogram
+ * @short_description: High dynamic range histogram.
+ *
+ * The %MilterHistogram records non-negative integer values
+ * such as latencies in microseconds into log-linear
+ * buckets like HdrHistogram. Each bucket covers less than
+ * 1% of its values, so percentiles keep two significant
+ * digits for any value from 1 to the highest trackable
+ * value with fixed memory.
+ *
+ * %MilterHistogram isn't thread-safe.
+ */
+
+typedef struct _MilterHistogram MilterHistogram;
+
+/**
+ * milter_histogram_new:
+ * @highest_trackable_value: the highest value to be
+ *                           tracked. Larger values are
+ *                           counted as this value.
+ *
+ * Creates a new histogram.
+ *
+ * Returns: a new %MilterHistogram.
+ *
+ * Since: 2.1.6
+ */
+MilterHistogram *milter_histogram_new     (guint64          highest_trackable_value);
+
+/**
+ * milter_histogram_free:
+ * @histogram: a %MilterHistogram.
+ *
+ * Frees @histogram.
+ *
+ * Since: 2.1.6
+ */
+void             milter_histogram_free    (MilterHistogram *histogram);
+
+/**
+ * milter_histogram_reset:
+ * @histogram: a %MilterHistogram.
+ *
+ * Removes all recorded values.
+ *
+ * Since: 2.1.6
+ */
+void             milter_histogram_reset   (MilterHistogram *histogram);
+
+/**
+ * milter_histogram_record:
+ * @histogram: a %MilterHistogram.
+ * @value: the value to be recorded.
+ *
+ * Records @value.
+ *
+ * Since: 2.1.6
+ */
+void             milter_histogram_record  (MilterHistogram *histogram,
+                                           guint64          value);
+
+/**
+ * milter_histogram_record_corrected:
+ * @histogram: a %MilterHistogram.
+ * @value: the value to be recorded.
+ * @expected_interval: the expected interval between
+ *                     records.
+ *
+ * Records @value and values that would have been recorded
+ * while the recorder was blocked by @value. If @value is
+ * larger than @expected_interval, @value -
+ * @expected_interval, @value - 2 * @expected_interval, ...
+ * are also recorded. It corrects coordinated omission of a
+ * recorder that waits for each response before the next
+ * request. Only @value is recorded if @expected_interval
+ * is 0.
+ *
+ * Since: 2.1.6
+ */
+void             milter_histogram_record_corrected
+                                          (MilterHistogram *histogram,
+                                           guint64          value,
+                                           guint64          expected_interval);
+
+/**
+ * milter_histogram_merge:
+ * @histogram: a %MilterHistogram.
+ * @other: a %MilterHistogram to be merged.
+ *
+ * Adds all values recorded in @other to @histogram.
+ *
+ * Since: 2.1.6
+ */
+void             milter_histogram_merge   (MilterHistogram *histogram,
+                                           MilterHistogram *other);
+
+/**
+ * milter_histogram_get_count:
+ * @histogram: a %MilterHistogram.
+ *
+ * Returns: the number of recorded values.
+ *
+ * Since: 2.1.6
+ */
+guint64          milter_histogram_get_count
+                                          (MilterHistogram *histogram);
+
+/**
+ * milter_histogram_get_min:
+ * @histogram: a %MilterHistogram.
+ *
+ * Returns: the minimum recorded value or 0 if no value is
+ * recorded.
+ *
+ * Since: 2.1.6
+ */
+guint64          milter_histogram_get_min (MilterHistogram *histogram);
+
+/**
+ * milter_histogram_get_max:
+ * @histogram: a %MilterHistogram.
+ *
+ * Returns: the maximum recorded value or 0 if no value is
+ * recorded.
+ *
+ * Since: 2.1.6
+ */
+guint64          milter_histogram_get_max (MilterHistogram *histogram);
+
+/**
+ * milter_histogram_get_mean:
+ * @histogram: a %MilterHistogram.
+ *
+ * Returns: the mean of recorded values or 0.0 if no value
+ * is recorded.
+ *
+ * Since: 2.1.6
+ */
+gdouble          milter_histogram_get_mean
+                                          (MilterHistogram *histogram);
+
+/**
+ * milter_histogram_get_value_at_percentile:
+ * @histogram: a %MilterHistogram.
+ * @percentile: the percentile in [0.0, 100.0].
+ *
+ * Returns: the value that @percentile % of recorded values
+ * are less than or equal to. It is the highest value of
+ * the bucket that has the value. 0 is returned if no
+ * value is recorded.
+ *
+ * Since: 2.1.6
+ */
+guint64          milter_histogram_get_value_at_percentile
+                                          (MilterHistogram *histogram,
+                                           gdouble          percentile);
+
+G_END_DECLS
+
+#endif /* __MILTER_HISTOGRAM_H__ */
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
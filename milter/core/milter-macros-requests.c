@@ -252,6 +252,56 @@ milter_macros_requests_merge (MilterMacrosRequests *dest,
     milter_macros_requests_foreach(src, merge_requests, dest_symbols_table);
 }
 
+typedef struct _EqualData
+{
+    GHashTable *symbols_table;
+    gboolean equal;
+} EqualData;
+
+static void
+equal_requests (gpointer key, gpointer value, gpointer user_data)
+{
+    EqualData *data = user_data;
+    GList *symbols, *other_symbols;
+
+    if (!data->equal)
+        return;
+
+    other_symbols = g_hash_table_lookup(data->symbols_table, key);
+    for (symbols = value;
+         symbols && other_symbols;
+         symbols = g_list_next(symbols),
+             other_symbols = g_list_next(other_symbols)) {
+        if (!g_str_equal(symbols->data, other_symbols->data)) {
+            data->equal = FALSE;
+            return;
+        }
+    }
+    if (symbols || other_symbols)
+        data->equal = FALSE;
+}
+
+gboolean
+milter_macros_requests_equal (MilterMacrosRequests *requests1,
+                              MilterMacrosRequests *requests2)
+{
+    GHashTable *symbols_table1, *symbols_table2;
+    EqualData data;
+
+    symbols_table1 =
+        MILTER_MACROS_REQUESTS_GET_PRIVATE(requests1)->symbols_table;
+    symbols_table2 =
+        MILTER_MACROS_REQUESTS_GET_PRIVATE(requests2)->symbols_table;
+    if (g_hash_table_size(symbols_table1) != g_hash_table_size(symbols_table2))
+        return FALSE;
+
+    data.symbols_table = symbols_table2;
+    data.equal = TRUE;
+    g_hash_table_foreach(symbols_table1, equal_requests, &data);
+
+    return data.equal;
+}
+
 void
 milter_macros_requests_foreach (MilterMacrosRequests *requests,
                                 GHFunc func, gpointer user_data)
@@ -70,6 +70,8 @@ GHashTable           *milter_macros_requests_get_all_symbols
                                                       (MilterMacrosRequests *requests);
 void                  milter_macros_requests_merge    (MilterMacrosRequests *dest,
                                                        MilterMacrosRequests *src);
+gboolean              milter_macros_requests_equal    (MilterMacrosRequests *requests1,
+                                                       MilterMacrosRequests *requests2);
 void                  milter_macros_requests_foreach  (MilterMacrosRequests *requests,
                                                        GHFunc                func,
                                                        gpointer              user_data);
@@ -30,6 +30,7 @@
 #include "milter-logger.h"
 #include "milter-utils.h"
 #include "milter-marshalers.h"
+#include "milter-capture.h"
 
 #define MILTER_READER_GET_PRIVATE(obj)                  \
     (G_TYPE_INSTANCE_GET_PRIVATE((obj),                 \
@@ -177,6 +178,9 @@ read_from_channel (MilterReader *reader, GIOChannel *channel)
                          priv->tag, length,
                          (condition & G_IO_IN) ? "contain" : "empty");
         }
+        if (milter_capture_is_active())
+            milter_capture_record(priv->tag, MILTER_CAPTURE_DIRECTION_READ,
+                                  stream, length);
         g_signal_emit(reader, signals[FLOW], 0, stream, length);
     }
 
@@ -29,6 +29,7 @@
 #include "milter-writer.h"
 #include "milter-logger.h"
 #include "milter-utils.h"
+#include "milter-capture.h"
 
 #define MILTER_WRITER_GET_PRIVATE(obj)                  \
     (G_TYPE_INSTANCE_GET_PRIVATE((obj),                 \
@@ -458,6 +459,10 @@ milter_writer_write (MilterWriter *writer, const gchar *chunk, gsize chunk_size,
         return TRUE;
     }
 
+    if (milter_capture_is_active())
+        milter_capture_record(priv->tag, MILTER_CAPTURE_DIRECTION_WRITE,
+                              chunk, chunk_size);
+
     g_string_append_len(priv->buffer, chunk, chunk_size);
     if (priv->write_watch_id == 0) {
         priv->write_watch_id =
@@ -32,6 +32,10 @@
 #include <milter/manager/milter-manager-controller-context.h>
 #include <milter/manager/milter-manager-controller.h>
 #include <milter/manager/milter-manager-process-launcher.h>
+#include <milter/manager/milter-manager-dnsbl.h>
+#include <milter/manager/milter-manager-shared-cache.h>
+#include <milter/manager/milter-manager-network-table.h>
+#include <milter/manager/milter-manager-literal-matcher.h>
 #include <milter/manager/milter-manager-enum-types.h>
 #include <milter/manager/milter-manager.h>
 
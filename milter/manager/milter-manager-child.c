@@ -27,6 +27,7 @@
 #include <sys/wait.h>
 #include <string.h>
 #include <errno.h>
+#include <milter/core/milter-marshalers.h>
 #include "milter-manager-child.h"
 
 #define MILTER_MANAGER_CHILD_GET_PRIVATE(obj)                    \
@@ -44,6 +45,14 @@ struct _MilterManagerChildPrivate
     gboolean search_path;
     MilterStatus fallback_status;
     gboolean evaluation_mode;
+    gboolean bypassed;
+    gboolean queued;
+    gdouble queue_timeout;
+    MilterOption *cached_option;
+    MilterMacrosRequests *cached_macros_requests;
+    MilterManagerSharedCache *verdict_cache;
+    gdouble verdict_cache_ttl;
+    gdouble evaluation_sampling_rate;
 };
 
 enum
@@ -55,9 +64,21 @@ enum
     PROP_WORKING_DIRECTORY,
     PROP_SEARCH_PATH,
     PROP_FALLBACK_STATUS,
-    PROP_REPUTATION_MODE
+    PROP_REPUTATION_MODE,
+    PROP_BYPASSED,
+    PROP_QUEUED,
+    PROP_QUEUE_TIMEOUT
 };
 
+enum
+{
+    FAILOVER,
+    VERDICT_USED,
+    LAST_SIGNAL
+};
+
+static gint signals[LAST_SIGNAL] = {0};
+
 MILTER_DEFINE_ERROR_EMITTABLE_TYPE(MilterManagerChild,
                                    milter_manager_child,
                                    MILTER_TYPE_SERVER_CONTEXT);
@@ -135,6 +156,49 @@ milter_manager_child_class_init (MilterManagerChildClass *klass)
                                 G_PARAM_READWRITE);
     g_object_class_install_property(gobject_class, PROP_REPUTATION_MODE, spec);
 
+    spec = g_param_spec_boolean("bypassed",
+                                "Bypassed",
+                                "Whether the child is bypassed by "
+                                "the circuit breaker or not",
+                                FALSE,
+                                G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class, PROP_BYPASSED, spec);
+
+    spec = g_param_spec_boolean("queued",
+                                "Queued",
+                                "Whether the child waits for a free session "
+                                "slot of its egg or not",
+                                FALSE,
+                                G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class, PROP_QUEUED, spec);
+
+    spec = g_param_spec_double("queue-timeout",
+                               "Queue timeout",
+                               "The seconds to wait for a free session slot",
+                               0,
+                               G_MAXDOUBLE,
+                               0,
+                               G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class, PROP_QUEUE_TIMEOUT, spec);
+
+    signals[FAILOVER] =
+        g_signal_new("failover",
+                     G_TYPE_FROM_CLASS(klass),
+                     G_SIGNAL_RUN_LAST,
+                     0,
+                     g_signal_accumulator_true_handled, NULL,
+                     _milter_marshal_BOOLEAN__VOID,
+                     G_TYPE_BOOLEAN, 0);
+
+    signals[VERDICT_USED] =
+        g_signal_new("verdict-used",
+                     G_TYPE_FROM_CLASS(klass),
+                     G_SIGNAL_RUN_LAST,
+                     0,
+                     NULL, NULL,
+                     g_cclosure_marshal_VOID__STRING,
+                     G_TYPE_NONE, 1, G_TYPE_STRING);
+
     g_type_class_add_private(gobject_class,
                              sizeof(MilterManagerChildPrivate));
 }
@@ -152,6 +216,14 @@ milter_manager_child_init (MilterManagerChild *milter)
     priv->search_path = TRUE;
     priv->fallback_status = MILTER_STATUS_ACCEPT;
     priv->evaluation_mode = FALSE;
+    priv->bypassed = FALSE;
+    priv->queued = FALSE;
+    priv->queue_timeout = 0;
+    priv->cached_option = NULL;
+    priv->cached_macros_requests = NULL;
+    priv->verdict_cache = NULL;
+    priv->verdict_cache_ttl = 0.0;
+    priv->evaluation_sampling_rate = 1.0;
 }
 
 static void
@@ -181,6 +253,21 @@ dispose (GObject *object)
         priv->command_options = NULL;
     }
 
+    if (priv->cached_option) {
+        g_object_unref(priv->cached_option);
+        priv->cached_option = NULL;
+    }
+
+    if (priv->cached_macros_requests) {
+        g_object_unref(priv->cached_macros_requests);
+        priv->cached_macros_requests = NULL;
+    }
+
+    if (priv->verdict_cache) {
+        g_object_unref(priv->verdict_cache);
+        priv->verdict_cache = NULL;
+    }
+
     G_OBJECT_CLASS(milter_manager_child_parent_class)->dispose(object);
 }
 
@@ -223,6 +310,15 @@ set_property (GObject      *object,
     case PROP_REPUTATION_MODE:
         priv->evaluation_mode = g_value_get_boolean(value);
         break;
+    case PROP_BYPASSED:
+        priv->bypassed = g_value_get_boolean(value);
+        break;
+    case PROP_QUEUED:
+        priv->queued = g_value_get_boolean(value);
+        break;
+    case PROP_QUEUE_TIMEOUT:
+        priv->queue_timeout = g_value_get_double(value);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -260,6 +356,15 @@ get_property (GObject    *object,
     case PROP_REPUTATION_MODE:
         g_value_set_boolean(value, priv->evaluation_mode);
         break;
+    case PROP_BYPASSED:
+        g_value_set_boolean(value, priv->bypassed);
+        break;
+    case PROP_QUEUED:
+        g_value_set_boolean(value, priv->queued);
+        break;
+    case PROP_QUEUE_TIMEOUT:
+        g_value_set_double(value, priv->queue_timeout);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -332,6 +437,189 @@ milter_manager_child_is_evaluation_mode (MilterManagerChild *milter)
     return MILTER_MANAGER_CHILD_GET_PRIVATE(milter)->evaluation_mode;
 }
 
+void
+milter_manager_child_set_evaluation_sampling_rate (MilterManagerChild *milter,
+                                                   gdouble rate)
+{
+    MILTER_MANAGER_CHILD_GET_PRIVATE(milter)->evaluation_sampling_rate =
+        CLAMP(rate, 0.0, 1.0);
+}
+
+gdouble
+milter_manager_child_get_evaluation_sampling_rate (MilterManagerChild *milter)
+{
+    return MILTER_MANAGER_CHILD_GET_PRIVATE(milter)->evaluation_sampling_rate;
+}
+
+void
+milter_manager_child_set_bypassed (MilterManagerChild *milter,
+                                   gboolean bypassed)
+{
+    MilterManagerChildPrivate *priv;
+
+    priv = MILTER_MANAGER_CHILD_GET_PRIVATE(milter);
+    if (priv->bypassed == bypassed)
+        return;
+    priv->bypassed = bypassed;
+    g_object_notify(G_OBJECT(milter), "bypassed");
+}
+
+gboolean
+milter_manager_child_is_bypassed (MilterManagerChild *milter)
+{
+    return MILTER_MANAGER_CHILD_GET_PRIVATE(milter)->bypassed;
+}
+
+void
+milter_manager_child_set_queued (MilterManagerChild *milter,
+                                 gboolean queued)
+{
+    MilterManagerChildPrivate *priv;
+
+    priv = MILTER_MANAGER_CHILD_GET_PRIVATE(milter);
+    if (priv->queued == queued)
+        return;
+    priv->queued = queued;
+    g_object_notify(G_OBJECT(milter), "queued");
+}
+
+gboolean
+milter_manager_child_is_queued (MilterManagerChild *milter)
+{
+    return MILTER_MANAGER_CHILD_GET_PRIVATE(milter)->queued;
+}
+
+void
+milter_manager_child_set_queue_timeout (MilterManagerChild *milter,
+                                        gdouble timeout)
+{
+    MILTER_MANAGER_CHILD_GET_PRIVATE(milter)->queue_timeout = timeout;
+}
+
+gdouble
+milter_manager_child_get_queue_timeout (MilterManagerChild *milter)
+{
+    return MILTER_MANAGER_CHILD_GET_PRIVATE(milter)->queue_timeout;
+}
+
+/* Asks the egg to switch to another backend after a connection
+ * failure. TRUE means that the child should retry connecting. */
+gboolean
+milter_manager_child_failover (MilterManagerChild *milter)
+{
+    gboolean handled = FALSE;
+
+    g_signal_emit(milter, signals[FAILOVER], 0, &handled);
+    return handled;
+}
+
+void
+milter_manager_child_set_cached_negotiate_reply (MilterManagerChild *milter,
+                                                 MilterOption *option,
+                                                 MilterMacrosRequests *macros_requests)
+{
+    MilterManagerChildPrivate *priv;
+
+    priv = MILTER_MANAGER_CHILD_GET_PRIVATE(milter);
+
+    if (option)
+        g_object_ref(option);
+    if (priv->cached_option)
+        g_object_unref(priv->cached_option);
+    priv->cached_option = option;
+
+    if (macros_requests)
+        g_object_ref(macros_requests);
+    if (priv->cached_macros_requests)
+        g_object_unref(priv->cached_macros_requests);
+    priv->cached_macros_requests = macros_requests;
+}
+
+MilterOption *
+milter_manager_child_get_cached_option (MilterManagerChild *milter)
+{
+    return MILTER_MANAGER_CHILD_GET_PRIVATE(milter)->cached_option;
+}
+
+MilterMacrosRequests *
+milter_manager_child_get_cached_macros_requests (MilterManagerChild *milter)
+{
+    return MILTER_MANAGER_CHILD_GET_PRIVATE(milter)->cached_macros_requests;
+}
+
+void
+milter_manager_child_set_verdict_cache (MilterManagerChild *milter,
+                                        MilterManagerSharedCache *cache,
+                                        gdouble ttl)
+{
+    MilterManagerChildPrivate *priv;
+
+    priv = MILTER_MANAGER_CHILD_GET_PRIVATE(milter);
+
+    if (cache)
+        g_object_ref(cache);
+    if (priv->verdict_cache)
+        g_object_unref(priv->verdict_cache);
+    priv->verdict_cache = cache;
+    priv->verdict_cache_ttl = ttl;
+}
+
+MilterManagerSharedCache *
+milter_manager_child_get_verdict_cache (MilterManagerChild *milter)
+{
+    MilterManagerChildPrivate *priv;
+
+    priv = MILTER_MANAGER_CHILD_GET_PRIVATE(milter);
+    if (priv->verdict_cache_ttl <= 0.0)
+        return NULL;
+    return priv->verdict_cache;
+}
+
+gdouble
+milter_manager_child_get_verdict_cache_ttl (MilterManagerChild *milter)
+{
+    return MILTER_MANAGER_CHILD_GET_PRIVATE(milter)->verdict_cache_ttl;
+}
+
+gboolean
+milter_manager_child_store_verdict (MilterManagerChild *milter,
+                                    const gchar *key,
+                                    const gchar *verdict)
+{
+    MilterManagerSharedCache *cache;
+
+    cache = milter_manager_child_get_verdict_cache(milter);
+    if (!cache)
+        return FALSE;
+
+    if (!milter_manager_shared_cache_set(
+            cache, key, verdict, strlen(verdict),
+            MILTER_MANAGER_CHILD_GET_PRIVATE(milter)->verdict_cache_ttl))
+        return FALSE;
+
+    g_signal_emit(milter, signals[VERDICT_USED], 0, key);
+    return TRUE;
+}
+
+gchar *
+milter_manager_child_lookup_verdict (MilterManagerChild *milter,
+                                     const gchar *key)
+{
+    MilterManagerSharedCache *cache;
+    gchar *verdict = NULL;
+    gsize verdict_size;
+
+    cache = milter_manager_child_get_verdict_cache(milter);
+    if (!cache)
+        return NULL;
+
+    if (!milter_manager_shared_cache_get(cache, key, &verdict, &verdict_size))
+        return NULL;
+
+    g_signal_emit(milter, signals[VERDICT_USED], 0, key);
+    return verdict;
+}
+
 /*
 vi:ts=4:nowrap:ai:expandtab:sw=4
 */
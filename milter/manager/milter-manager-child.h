@@ -26,6 +26,7 @@
 #include <glib-object.h>
 
 #include <milter/server.h>
+#include <milter/manager/milter-manager-shared-cache.h>
 
 G_BEGIN_DECLS
 
@@ -82,6 +83,57 @@ void                  milter_manager_child_set_evaluation_mode
                                                         gboolean evaluation_mode);
 gboolean              milter_manager_child_is_evaluation_mode
                                                        (MilterManagerChild *milter);
+void                  milter_manager_child_set_evaluation_sampling_rate
+                                                       (MilterManagerChild *milter,
+                                                        gdouble rate);
+gdouble               milter_manager_child_get_evaluation_sampling_rate
+                                                       (MilterManagerChild *milter);
+
+void                  milter_manager_child_set_bypassed
+                                                       (MilterManagerChild *milter,
+                                                        gboolean bypassed);
+gboolean              milter_manager_child_is_bypassed
+                                                       (MilterManagerChild *milter);
+
+void                  milter_manager_child_set_queued
+                                                       (MilterManagerChild *milter,
+                                                        gboolean queued);
+gboolean              milter_manager_child_is_queued
+                                                       (MilterManagerChild *milter);
+void                  milter_manager_child_set_queue_timeout
+                                                       (MilterManagerChild *milter,
+                                                        gdouble timeout);
+gdouble               milter_manager_child_get_queue_timeout
+                                                       (MilterManagerChild *milter);
+
+gboolean              milter_manager_child_failover
+                                                       (MilterManagerChild *milter);
+
+void                  milter_manager_child_set_cached_negotiate_reply
+                                                       (MilterManagerChild *milter,
+                                                        MilterOption *option,
+                                                        MilterMacrosRequests *macros_requests);
+MilterOption         *milter_manager_child_get_cached_option
+                                                       (MilterManagerChild *milter);
+MilterMacrosRequests *milter_manager_child_get_cached_macros_requests
+                                                       (MilterManagerChild *milter);
+
+void                  milter_manager_child_set_verdict_cache
+                                                       (MilterManagerChild *milter,
+                                                        MilterManagerSharedCache *cache,
+                                                        gdouble ttl);
+MilterManagerSharedCache *
+                      milter_manager_child_get_verdict_cache
+                                                       (MilterManagerChild *milter);
+gdouble               milter_manager_child_get_verdict_cache_ttl
+                                                       (MilterManagerChild *milter);
+gboolean              milter_manager_child_store_verdict
+                                                       (MilterManagerChild *milter,
+                                                        const gchar *key,
+                                                        const gchar *verdict);
+gchar                *milter_manager_child_lookup_verdict
+                                                       (MilterManagerChild *milter,
+                                                        const gchar *key);
 
 #endif /* __MILTER_MANAGER_CHILD_H__ */
 
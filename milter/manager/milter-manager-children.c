@@ -23,6 +23,9 @@
 
 #include "milter-manager-children.h"
 
+#include <string.h>
+#include <arpa/inet.h>
+
 #include <glib/gstdio.h>
 #include "milter-manager-configuration.h"
 #include "milter/core.h"
@@ -86,6 +89,7 @@ struct _MilterManagerChildrenPrivate
     MilterHeaders *original_headers;
     MilterHeaders *headers;
     gint processing_header_index;
+    const GList *processing_header_node;
     GString *body;
     GIOChannel *body_file;
     gchar *body_file_name;
@@ -93,6 +97,10 @@ struct _MilterManagerChildrenPrivate
     gsize end_of_message_size;
     guint sending_body;
     guint sent_body_offset;
+    gsize body_size;
+    MilterServerContextState final_message_state;
+    MilterStatus final_message_status;
+    guint64 n_saved_body_bytes;
     gboolean replaced_body_for_each_child;
     gboolean replaced_body;
     gchar *change_from;
@@ -109,6 +117,27 @@ struct _MilterManagerChildrenPrivate
     MilterEventLoop *event_loop;
 
     guint lazy_reply_negotiate_id;
+
+    gboolean negotiate_replied_by_cache;
+    gboolean negotiate_cache_mismatched;
+    GHashTable *pending_connect_macros;
+    gboolean connect_pending;
+    gchar *pending_host_name;
+    struct sockaddr *pending_address;
+    socklen_t pending_address_length;
+
+    gchar *verdict_cache_address;
+    gchar *verdict_cache_fqdn;
+    gboolean skip_verdict_recording;
+    GList *deferred_children;
+    MilterOption *deferred_option;
+};
+
+typedef struct _VerdictCacheHit VerdictCacheHit;
+struct _VerdictCacheHit
+{
+    MilterServerContext *context;
+    gchar **verdict;
 };
 
 typedef struct _NegotiateData NegotiateData;
@@ -120,6 +149,7 @@ struct _NegotiateData
     gulong error_signal_id;
     gulong ready_signal_id;
     gulong connection_timeout_signal_id;
+    gulong queued_signal_id;
     gboolean is_retry;
 };
 
@@ -177,6 +207,8 @@ static void prepare_retry_establish_connection
                             MilterOption *option,
                             MilterManagerChildren *children,
                             gboolean is_retry);
+static gboolean failover_establish_connection
+                           (NegotiateData *data);
 static void remove_queue_in_negotiate
                            (MilterManagerChildren *children,
                             MilterManagerChild *child);
@@ -280,6 +312,7 @@ milter_manager_children_init (MilterManagerChildren *milter)
     priv->original_headers = NULL;
     priv->headers = NULL;
     priv->processing_header_index = 0;
+    priv->processing_header_node = NULL;
     priv->body = NULL;
     priv->body_file = NULL;
     priv->body_file_name = NULL;
@@ -287,6 +320,10 @@ milter_manager_children_init (MilterManagerChildren *milter)
     priv->end_of_message_size = 0;
     priv->sending_body = FALSE;
     priv->sent_body_offset = 0;
+    priv->body_size = 0;
+    priv->final_message_state = MILTER_SERVER_CONTEXT_STATE_START;
+    priv->final_message_status = MILTER_STATUS_NOT_CHANGE;
+    priv->n_saved_body_bytes = 0;
     priv->replaced_body = FALSE;
     priv->replaced_body_for_each_child = FALSE;
     priv->change_from = NULL;
@@ -312,6 +349,20 @@ milter_manager_children_init (MilterManagerChildren *milter)
     priv->event_loop = NULL;
 
     priv->lazy_reply_negotiate_id = 0;
+
+    priv->negotiate_replied_by_cache = FALSE;
+    priv->negotiate_cache_mismatched = FALSE;
+    priv->pending_connect_macros = NULL;
+    priv->connect_pending = FALSE;
+    priv->pending_host_name = NULL;
+    priv->pending_address = NULL;
+    priv->pending_address_length = 0;
+
+    priv->verdict_cache_address = NULL;
+    priv->verdict_cache_fqdn = NULL;
+    priv->skip_verdict_recording = FALSE;
+    priv->deferred_children = NULL;
+    priv->deferred_option = NULL;
 }
 
 static void
@@ -415,6 +466,7 @@ static void
 dispose_body_related_data (MilterManagerChildrenPrivate *priv)
 {
     priv->emitted_reply_for_message_oriented_command = FALSE;
+    priv->body_size = 0;
 
     if (priv->body) {
         g_string_free(priv->body, TRUE);
@@ -454,6 +506,9 @@ dispose_message_related_data (MilterManagerChildrenPrivate *priv)
 {
     dispose_pending_message_request(priv);
 
+    priv->final_message_state = MILTER_SERVER_CONTEXT_STATE_START;
+    priv->final_message_status = MILTER_STATUS_NOT_CHANGE;
+
     if (priv->command_waiting_child_queue) {
         g_list_free(priv->command_waiting_child_queue);
         priv->command_waiting_child_queue = NULL;
@@ -497,6 +552,27 @@ dispose_message_related_data (MilterManagerChildrenPrivate *priv)
     }
 }
 
+static void
+dispose_pending_connect (MilterManagerChildrenPrivate *priv)
+{
+    if (priv->pending_connect_macros) {
+        g_hash_table_unref(priv->pending_connect_macros);
+        priv->pending_connect_macros = NULL;
+    }
+
+    if (priv->pending_host_name) {
+        g_free(priv->pending_host_name);
+        priv->pending_host_name = NULL;
+    }
+
+    if (priv->pending_address) {
+        g_free(priv->pending_address);
+        priv->pending_address = NULL;
+    }
+    priv->pending_address_length = 0;
+    priv->connect_pending = FALSE;
+}
+
 static void
 dispose_smtp_client_address (MilterManagerChildrenPrivate *priv)
 {
@@ -505,6 +581,15 @@ dispose_smtp_client_address (MilterManagerChildrenPrivate *priv)
         priv->smtp_client_address = NULL;
     }
     priv->smtp_client_address_length = 0;
+
+    if (priv->verdict_cache_address) {
+        g_free(priv->verdict_cache_address);
+        priv->verdict_cache_address = NULL;
+    }
+    if (priv->verdict_cache_fqdn) {
+        g_free(priv->verdict_cache_fqdn);
+        priv->verdict_cache_fqdn = NULL;
+    }
 }
 
 static void
@@ -517,6 +602,7 @@ dispose (GObject *object)
     milter_debug("[%u] [children][dispose]", priv->tag);
 
     dispose_lazy_reply_negotiate_id(priv);
+    dispose_pending_connect(priv);
 
     if (priv->reply_queue) {
         g_queue_free(priv->reply_queue);
@@ -530,6 +616,16 @@ dispose (GObject *object)
 
     dispose_smtp_client_address(priv);
 
+    if (priv->deferred_children) {
+        g_list_free(priv->deferred_children);
+        priv->deferred_children = NULL;
+    }
+
+    if (priv->deferred_option) {
+        g_object_unref(priv->deferred_option);
+        priv->deferred_option = NULL;
+    }
+
     if (priv->configuration) {
         g_object_unref(priv->configuration);
         priv->configuration = NULL;
@@ -773,6 +869,29 @@ get_reply_status_for_state (MilterManagerChildren *children,
     return (MilterStatus)(GPOINTER_TO_INT(value));
 }
 
+static gboolean
+is_final_message_status (MilterServerContextState state, MilterStatus status)
+{
+    switch (state) {
+    case MILTER_SERVER_CONTEXT_STATE_HEADER:
+    case MILTER_SERVER_CONTEXT_STATE_END_OF_HEADER:
+    case MILTER_SERVER_CONTEXT_STATE_BODY:
+    case MILTER_SERVER_CONTEXT_STATE_END_OF_MESSAGE:
+        break;
+    default:
+        return FALSE;
+    }
+
+    switch (status) {
+    case MILTER_STATUS_REJECT:
+    case MILTER_STATUS_DISCARD:
+    case MILTER_STATUS_TEMPORARY_FAILURE:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
 static void
 compile_reply_status (MilterManagerChildren *children,
                       MilterServerContextState state,
@@ -786,6 +905,10 @@ compile_reply_status (MilterManagerChildren *children,
         g_hash_table_insert(priv->reply_statuses,
                             GINT_TO_POINTER(state),
                             GINT_TO_POINTER(status));
+        if (is_final_message_status(state, status)) {
+            priv->final_message_state = state;
+            priv->final_message_status = status;
+        }
     }
 }
 
@@ -807,6 +930,38 @@ cb_ready (MilterServerContext *context, gpointer user_data)
     g_hash_table_remove(priv->try_negotiate_ids, negotiate_data);
 }
 
+static gboolean
+is_cached_negotiate_reply (MilterManagerChild *child,
+                           MilterOption *option,
+                           MilterMacrosRequests *macros_requests)
+{
+    MilterOption *cached_option;
+    MilterMacrosRequests *cached_macros_requests, *requests;
+    gboolean equal;
+
+    cached_option = milter_manager_child_get_cached_option(child);
+    if (!cached_option || !milter_option_equal(cached_option, option))
+        return FALSE;
+
+    requests = milter_macros_requests_new();
+    if (macros_requests)
+        milter_macros_requests_merge(requests, macros_requests);
+    cached_macros_requests =
+        milter_manager_child_get_cached_macros_requests(child);
+    if (cached_macros_requests) {
+        equal = milter_macros_requests_equal(cached_macros_requests, requests);
+    } else {
+        MilterMacrosRequests *empty_requests;
+
+        empty_requests = milter_macros_requests_new();
+        equal = milter_macros_requests_equal(empty_requests, requests);
+        g_object_unref(empty_requests);
+    }
+    g_object_unref(requests);
+
+    return equal;
+}
+
 static void
 cb_negotiate_reply (MilterServerContext *context, MilterOption *option,
                     MilterMacrosRequests *macros_requests, gpointer user_data)
@@ -816,6 +971,23 @@ cb_negotiate_reply (MilterServerContext *context, MilterOption *option,
 
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
 
+    if (priv->negotiate_replied_by_cache) {
+        MilterManagerChild *child = MILTER_MANAGER_CHILD(context);
+
+        /* The cached reply is already merged into priv->option
+         * and may be sent to the MTA. */
+        if (!is_cached_negotiate_reply(child, option, macros_requests)) {
+            milter_warning("[%u] [children][negotiate][cache][mismatch] "
+                           "[%u] %s",
+                           priv->tag,
+                           milter_agent_get_tag(MILTER_AGENT(context)),
+                           milter_server_context_get_name(context));
+            priv->negotiate_cache_mismatched = TRUE;
+        }
+        remove_queue_in_negotiate(children, child);
+        return;
+    }
+
     if (macros_requests)
         milter_macros_requests_merge(priv->macros_requests, macros_requests);
 
@@ -888,6 +1060,11 @@ report_result (MilterManagerChildren *children,
     milter_statistics("[milter][end][%s][%s][%g](%u): %s",
                       last_state_name, statistic_status_name,
                       elapsed, tag, child_name);
+    if (milter_manager_child_is_evaluation_mode(MILTER_MANAGER_CHILD(context))) {
+        milter_statistics("[milter][evaluation][end][%s][%s][%g](%u): %s",
+                          last_state_name, statistic_status_name,
+                          elapsed, tag, child_name);
+    }
     g_free(status_name);
     g_free(state_name);
     g_free(last_state_name);
@@ -1181,6 +1358,8 @@ send_command_to_child (MilterManagerChildren *children,
             status = MILTER_STATUS_PROGRESS;
             if (!milter_server_context_need_reply(context,
                                                  priv->processing_state)) {
+                milter_server_context_set_state(context,
+                                                priv->processing_state);
                 g_signal_emit_by_name(context, "continue");
             }
         }
@@ -1190,6 +1369,7 @@ send_command_to_child (MilterManagerChildren *children,
         break;
     case MILTER_COMMAND_END_OF_MESSAGE:
         priv->processing_header_index = 0;
+        priv->processing_header_node = NULL;
         priv->processing_state = MILTER_SERVER_CONTEXT_STATE_END_OF_MESSAGE;
         if (milter_server_context_end_of_message(context,
                                                  priv->end_of_message_chunk,
@@ -1333,9 +1513,21 @@ send_first_command_to_next_child (MilterManagerChildren *children,
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
 
     priv->processing_header_index = 0;
+    priv->processing_header_node = NULL;
     priv->command_waiting_child_queue =
         g_list_remove(priv->command_waiting_child_queue, context);
 
+    if (priv->final_message_status != MILTER_STATUS_NOT_CHANGE) {
+        milter_debug("[%u] [children][early-termination] [%u] %s",
+                     priv->tag,
+                     milter_agent_get_tag(MILTER_AGENT(context)),
+                     milter_server_context_get_name(context));
+        emit_reply_for_message_oriented_command(children,
+                                                priv->final_message_state);
+        milter_manager_children_abort(children);
+        return MILTER_STATUS_PROGRESS;
+    }
+
     next_child = get_first_child_in_command_waiting_child_queue(children);
     if (!next_child) {
         emit_reply_for_message_oriented_command(children, priv->state);
@@ -1412,6 +1604,143 @@ cb_continue (MilterServerContext *context, gpointer user_data)
     handle_status(children, status);
 }
 
+static gchar *
+verdict_cache_address_new (const struct sockaddr *address)
+{
+    gchar ip_address_string[INET6_ADDRSTRLEN];
+
+    switch (address->sa_family) {
+    case AF_INET:
+        if (!inet_ntop(AF_INET, &((struct sockaddr_in *)address)->sin_addr,
+                       ip_address_string, sizeof(ip_address_string)))
+            return NULL;
+        break;
+    case AF_INET6:
+        if (!inet_ntop(AF_INET6, &((struct sockaddr_in6 *)address)->sin6_addr,
+                       ip_address_string, sizeof(ip_address_string)))
+            return NULL;
+        break;
+    default:
+        return NULL;
+    }
+
+    return g_strdup(ip_address_string);
+}
+
+static gchar *
+verdict_cache_key_new (MilterManagerChildrenPrivate *priv,
+                       MilterServerContext *context,
+                       MilterServerContextState state)
+{
+    const gchar *name;
+    gchar *key;
+
+    if (!priv->verdict_cache_address)
+        return NULL;
+
+    name = milter_server_context_get_name(context);
+    switch (state) {
+    case MILTER_SERVER_CONTEXT_STATE_CONNECT:
+        key = g_strdup_printf("verdict:connect:%s:%s",
+                              name ? name : "",
+                              priv->verdict_cache_address);
+        break;
+    case MILTER_SERVER_CONTEXT_STATE_HELO:
+        key = g_strdup_printf("verdict:helo:%s:%s:%s",
+                              name ? name : "",
+                              priv->verdict_cache_address,
+                              priv->verdict_cache_fqdn ?
+                                priv->verdict_cache_fqdn : "");
+        break;
+    default:
+        return NULL;
+    }
+
+    if (strlen(key) > MILTER_MANAGER_SHARED_CACHE_MAX_KEY_SIZE) {
+        g_free(key);
+        return NULL;
+    }
+
+    return key;
+}
+
+static void
+record_verdict (MilterManagerChildren *children,
+                MilterServerContext *context,
+                const gchar *verdict,
+                guint code,
+                const gchar *extended_code,
+                const gchar *message)
+{
+    MilterManagerChildrenPrivate *priv;
+    MilterManagerChild *child;
+    gchar *key, *value;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+    if (priv->skip_verdict_recording)
+        return;
+
+    child = MILTER_MANAGER_CHILD(context);
+    if (!milter_manager_child_get_verdict_cache(child))
+        return;
+
+    key = verdict_cache_key_new(priv, context,
+                                milter_server_context_get_state(context));
+    if (!key)
+        return;
+
+    if (code > 0) {
+        value = g_strdup_printf("%s\t%u\t%s\t%s",
+                                verdict,
+                                code,
+                                extended_code ? extended_code : "",
+                                message ? message : "");
+    } else {
+        value = g_strdup(verdict);
+    }
+    if (milter_manager_child_store_verdict(child, key, value)) {
+        milter_debug("[%u] [children][verdict-cache][store] <%s>: <%s>",
+                     priv->tag, key, verdict);
+    }
+    g_free(value);
+    g_free(key);
+}
+
+static gchar **
+lookup_verdict (MilterManagerChildren *children,
+                MilterServerContext *context,
+                MilterServerContextState state)
+{
+    MilterManagerChildrenPrivate *priv;
+    MilterManagerChild *child;
+    gchar *key, *value;
+    gchar **verdict = NULL;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+
+    child = MILTER_MANAGER_CHILD(context);
+    if (!milter_manager_child_get_verdict_cache(child))
+        return NULL;
+
+    key = verdict_cache_key_new(priv, context, state);
+    if (!key)
+        return NULL;
+
+    value = milter_manager_child_lookup_verdict(child, key);
+    if (value) {
+        verdict = g_strsplit(value, "\t", 4);
+        if (g_str_equal(verdict[0], "reply-code") &&
+            g_strv_length(verdict) != 4) {
+            g_strfreev(verdict);
+            verdict = NULL;
+        }
+        g_free(value);
+    }
+    g_free(key);
+
+    return verdict;
+}
+
 static void
 cb_temporary_failure (MilterServerContext *context, gpointer user_data)
 {
@@ -1424,6 +1753,8 @@ cb_temporary_failure (MilterServerContext *context, gpointer user_data)
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
     state = milter_server_context_get_state(context);
 
+    record_verdict(children, context, "temporary-failure", 0, NULL, NULL);
+
     evaluation_mode =
         milter_manager_child_is_evaluation_mode(MILTER_MANAGER_CHILD(context));
     if (evaluation_mode) {
@@ -1495,6 +1826,8 @@ cb_reject (MilterServerContext *context, gpointer user_data)
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
     state = milter_server_context_get_state(context);
 
+    record_verdict(children, context, "reject", 0, NULL, NULL);
+
     evaluation_mode =
         milter_manager_child_is_evaluation_mode(MILTER_MANAGER_CHILD(context));
     if (evaluation_mode) {
@@ -1562,6 +1895,7 @@ cb_reply_code (MilterServerContext *context,
 {
     MilterManagerChildren *children = user_data;
     MilterManagerChildrenPrivate *priv;
+    gboolean skip_verdict_recording;
 
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
 
@@ -1570,11 +1904,16 @@ cb_reply_code (MilterServerContext *context,
     priv->reply_extended_code = g_strdup(extended_code);
     priv->reply_message = g_strdup(message);
 
+    record_verdict(children, context, "reply-code",
+                   code, extended_code, message);
+    skip_verdict_recording = priv->skip_verdict_recording;
+    priv->skip_verdict_recording = TRUE;
     if ((priv->reply_code / 100) == 4) {
         cb_temporary_failure(context, user_data);
     } else {
         cb_reject(context, user_data);
     }
+    priv->skip_verdict_recording = skip_verdict_recording;
 }
 
 static void
@@ -1587,6 +1926,7 @@ cb_accept (MilterServerContext *context, gpointer user_data)
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
     state = milter_server_context_get_state(context);
 
+    record_verdict(children, context, "accept", 0, NULL, NULL);
     compile_reply_status(children, state, MILTER_STATUS_ACCEPT);
     switch (state) {
     case MILTER_SERVER_CONTEXT_STATE_CONNECT:
@@ -2613,6 +2953,8 @@ check_fallback_status_on_negotiate (MilterManagerChildren *children)
         context = MILTER_SERVER_CONTEXT(child);
         if (milter_server_context_is_negotiated(context))
             continue;
+        if (g_list_find(priv->deferred_children, child))
+            continue;
 
         fallback_status = milter_manager_child_get_fallback_status(child);
         if (milter_status_compare(status, fallback_status) < 0) {
@@ -2660,8 +3002,8 @@ check_fallback_status_on_negotiate (MilterManagerChildren *children)
         g_free(status_name);
 }
 
-static void
-reply_negotiate (MilterManagerChildren *children)
+static gboolean
+emit_negotiate_reply (MilterManagerChildren *children)
 {
     MilterManagerChildrenPrivate *priv;
 
@@ -2671,7 +3013,7 @@ reply_negotiate (MilterManagerChildren *children)
         milter_error("[%u] [children][error][negotiate][not-started]",
                      priv->tag);
         g_signal_emit_by_name(children, "abort");
-        return;
+        return FALSE;
     }
 
     if (!priv->negotiated) {
@@ -2687,7 +3029,67 @@ reply_negotiate (MilterManagerChildren *children)
     g_signal_emit_by_name(children, "negotiate-reply",
                           priv->option, priv->macros_requests);
 
-    check_fallback_status_on_negotiate(children);
+    return TRUE;
+}
+
+static void
+reply_negotiate (MilterManagerChildren *children)
+{
+    if (emit_negotiate_reply(children))
+        check_fallback_status_on_negotiate(children);
+}
+
+static void
+finish_negotiate_by_cache (MilterManagerChildren *children)
+{
+    MilterManagerChildrenPrivate *priv;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+
+    priv->negotiate_replied_by_cache = FALSE;
+    if (priv->lazy_reply_negotiate_id > 0) {
+        dispose_lazy_reply_negotiate_id(priv);
+        reply_negotiate(children);
+        return;
+    }
+
+    milter_debug("[%u] [children][negotiate][cache][done]", priv->tag);
+    if (!priv->negotiate_cache_mismatched)
+        check_fallback_status_on_negotiate(children);
+
+    if (priv->pending_connect_macros) {
+        GHashTable *macros;
+
+        macros = g_hash_table_ref(priv->pending_connect_macros);
+        milter_manager_children_define_macro(children,
+                                             MILTER_COMMAND_CONNECT,
+                                             macros);
+        g_hash_table_unref(macros);
+    }
+    if (priv->connect_pending) {
+        gchar *host_name;
+        struct sockaddr *address;
+        socklen_t address_length;
+
+        host_name = priv->pending_host_name;
+        address = priv->pending_address;
+        address_length = priv->pending_address_length;
+        priv->pending_host_name = NULL;
+        priv->pending_address = NULL;
+        dispose_pending_connect(priv);
+        if (!milter_manager_children_connect(children, host_name,
+                                             address, address_length)) {
+            MilterStatus status;
+
+            status = milter_manager_configuration_get_fallback_status(
+                priv->configuration);
+            g_signal_emit_by_name(children, status_to_signal_name(status));
+        }
+        g_free(host_name);
+        g_free(address);
+    } else {
+        dispose_pending_connect(priv);
+    }
 }
 
 static void
@@ -2705,7 +3107,10 @@ remove_queue_in_negotiate (MilterManagerChildren *children,
                  milter_server_context_get_name(context));
     g_queue_remove(priv->reply_queue, child);
     if (!priv->finished && g_queue_is_empty(priv->reply_queue)) {
-        reply_negotiate(children);
+        if (priv->negotiate_replied_by_cache)
+            finish_negotiate_by_cache(children);
+        else
+            reply_negotiate(children);
     }
 }
 
@@ -2727,6 +3132,9 @@ cb_connection_timeout (MilterServerContext *context, gpointer user_data)
     NegotiateData *data = user_data;
     MilterManagerChildrenPrivate *priv;
 
+    if (failover_establish_connection(data))
+        return;
+
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(data->children);
     milter_error("[%u] [children][timeout][connection] [%u] %s",
                  priv->tag,
@@ -2743,6 +3151,12 @@ cb_connection_error (MilterErrorEmittable *emittable, GError *error, gpointer us
     MilterManagerChildrenPrivate *priv;
     gboolean privilege;
 
+    if (g_error_matches(error,
+                        MILTER_SERVER_CONTEXT_ERROR,
+                        MILTER_SERVER_CONTEXT_ERROR_CONNECTION_FAILURE) &&
+        failover_establish_connection(data))
+        return;
+
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(data->children);
     context = MILTER_SERVER_CONTEXT(data->child);
     milter_error("[%u] [children][error][connection] [%u] %s: %s",
@@ -2823,6 +3237,8 @@ negotiate_data_free (NegotiateData *data)
         g_signal_handler_disconnect(data->child, data->error_signal_id);
     if (data->ready_signal_id > 0)
         g_signal_handler_disconnect(data->child, data->ready_signal_id);
+    if (data->queued_signal_id > 0)
+        g_signal_handler_disconnect(data->child, data->queued_signal_id);
 
     g_object_unref(data->child);
     g_object_unref(data->option);
@@ -2888,85 +3304,330 @@ prepare_retry_establish_connection (MilterManagerChild *child,
                         negotiate_data, negotiate_timeout_id);
 }
 
-static void
-prepare_negotiate (MilterManagerChild *child,
-                   MilterOption *option,
-                   MilterManagerChildren *children,
-                   gboolean is_retry)
+static gboolean
+failover_establish_connection (NegotiateData *data)
 {
     MilterManagerChildrenPrivate *priv;
+    MilterManagerChild *child;
+    MilterOption *option;
+    MilterManagerChildren *children;
     NegotiateData *negotiate_data;
+    NegotiateTimeoutID *negotiate_timeout_id;
+    guint idle_id;
+
+    if (!milter_manager_child_failover(data->child))
+        return FALSE;
 
+    children = data->children;
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+    child = g_object_ref(data->child);
+    option = g_object_ref(data->option);
+    milter_info("[%u] [children][connection][failover] [%u] %s",
+                priv->tag,
+                milter_agent_get_tag(MILTER_AGENT(child)),
+                milter_server_context_get_name(MILTER_SERVER_CONTEXT(child)));
+    g_hash_table_remove(priv->try_negotiate_ids, data);
 
-    negotiate_data = negotiate_data_new(children, child, option, is_retry);
-    g_hash_table_insert(priv->try_negotiate_ids, negotiate_data, NULL);
+    negotiate_data = negotiate_data_new(children, child, option, TRUE);
+    idle_id = milter_event_loop_add_idle(priv->event_loop,
+                                         retry_establish_connection,
+                                         negotiate_data);
+    negotiate_timeout_id =
+        negotiate_timeout_id_new(priv->event_loop, idle_id);
+    g_hash_table_insert(priv->try_negotiate_ids,
+                        negotiate_data, negotiate_timeout_id);
+
+    g_object_unref(option);
+    g_object_unref(child);
+
+    return TRUE;
 }
 
 static gboolean
-child_establish_connection (MilterManagerChild *child,
-                            MilterOption *option,
-                            MilterManagerChildren *children,
-                            gboolean is_retry)
+cb_idle_bypass_child (gpointer user_data)
 {
+    NegotiateData *data = user_data;
     MilterManagerChildrenPrivate *priv;
     MilterServerContext *context;
-    GError *error = NULL;
-
-    context = MILTER_SERVER_CONTEXT(child);
-    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
-
-    if (!milter_server_context_establish_connection(context, &error)) {
-        milter_error("[%u] [children][error][connection] [%u] %s: %s",
-                     priv->tag,
-                     milter_agent_get_tag(MILTER_AGENT(context)),
-                     error->message,
-                     milter_server_context_get_name(context));
-        milter_error_emittable_emit(MILTER_ERROR_EMITTABLE(children),
-                                    error);
-
-        g_error_free(error);
-        if (is_retry) {
-            remove_queue_in_negotiate(children, child);
-            expire_child(children, context);
-        } else {
-            prepare_retry_establish_connection(child, option, children, TRUE);
-        }
-        return FALSE;
-    }
 
-    prepare_negotiate(child, option, children, is_retry);
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(data->children);
+    context = MILTER_SERVER_CONTEXT(data->child);
+    milter_info("[%u] [children][circuit-breaker][bypass] [%u] %s",
+                priv->tag,
+                milter_agent_get_tag(MILTER_AGENT(context)),
+                milter_server_context_get_name(context));
+    clear_try_negotiate_data(data);
 
-    return TRUE;
+    return FALSE;
 }
 
-static MilterCommand
-get_next_command (MilterManagerChildren *children,
-                  MilterServerContext *context,
-                  MilterServerContextState state)
+static void
+prepare_bypass_child (MilterManagerChild *child,
+                      MilterOption *option,
+                      MilterManagerChildren *children)
 {
     MilterManagerChildrenPrivate *priv;
-    GList *node;
-    MilterCommand current_command;
+    NegotiateData *negotiate_data;
+    NegotiateTimeoutID *negotiate_timeout_id;
+    guint idle_id;
 
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
 
-    current_command = state_to_command(state);
-
-    node = g_list_find(priv->command_queue, GINT_TO_POINTER(current_command));
-    if (!node || !g_list_next(node))
-        return -1;
+    negotiate_data = negotiate_data_new(children, child, option, FALSE);
+    idle_id = milter_event_loop_add_idle(priv->event_loop,
+                                         cb_idle_bypass_child,
+                                         negotiate_data);
+    negotiate_timeout_id =
+        negotiate_timeout_id_new(priv->event_loop, idle_id);
 
-    node = g_list_next(node);
-    return fetch_first_command_for_child_in_queue(context, &node);
+    g_hash_table_insert(priv->try_negotiate_ids,
+                        negotiate_data, negotiate_timeout_id);
 }
 
-static MilterStatus
-send_next_command (MilterManagerChildren *children,
-                   MilterServerContext *context,
-                   MilterServerContextState processing_state)
+static gboolean
+cb_idle_defer_child (gpointer user_data)
 {
-    MilterCommand next_command;
+    NegotiateData *data = user_data;
+    MilterManagerChildrenPrivate *priv;
+    MilterServerContext *context;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(data->children);
+    context = MILTER_SERVER_CONTEXT(data->child);
+    milter_debug("[%u] [children][verdict-cache][defer] [%u] %s",
+                 priv->tag,
+                 milter_agent_get_tag(MILTER_AGENT(context)),
+                 milter_server_context_get_name(context));
+    priv->deferred_children = g_list_append(priv->deferred_children,
+                                            data->child);
+    remove_queue_in_negotiate(data->children, data->child);
+    g_hash_table_remove(priv->try_negotiate_ids, data);
+
+    return FALSE;
+}
+
+/* A child that has a verdict cache or is sampled by the client
+ * address doesn't need to be connected while the negotiation
+ * is replied by cache. It is connected at connect only when
+ * it is sampled and its verdict isn't cached. */
+static gboolean
+is_deferrable_child (MilterManagerChildren *children,
+                     MilterManagerChild *child)
+{
+    MilterManagerChildrenPrivate *priv;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+    if (!priv->negotiate_replied_by_cache)
+        return FALSE;
+    if (milter_manager_child_get_verdict_cache(child))
+        return TRUE;
+    if (milter_manager_child_is_evaluation_mode(child) &&
+        milter_manager_child_get_evaluation_sampling_rate(child) < 1.0)
+        return TRUE;
+
+    return FALSE;
+}
+
+static void
+prepare_deferred_child (MilterManagerChild *child,
+                        MilterOption *option,
+                        MilterManagerChildren *children)
+{
+    MilterManagerChildrenPrivate *priv;
+    NegotiateData *negotiate_data;
+    NegotiateTimeoutID *negotiate_timeout_id;
+    guint idle_id;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+
+    if (!priv->deferred_option)
+        priv->deferred_option = milter_option_copy(option);
+
+    negotiate_data = negotiate_data_new(children, child, option, FALSE);
+    idle_id = milter_event_loop_add_idle(priv->event_loop,
+                                         cb_idle_defer_child,
+                                         negotiate_data);
+    negotiate_timeout_id =
+        negotiate_timeout_id_new(priv->event_loop, idle_id);
+
+    g_hash_table_insert(priv->try_negotiate_ids,
+                        negotiate_data, negotiate_timeout_id);
+}
+
+static void
+negotiate_child (MilterManagerChildren *children,
+                 MilterManagerChild *child,
+                 MilterOption *option)
+{
+    MilterManagerChildrenPrivate *priv;
+    gboolean privilege;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+    privilege =
+        milter_manager_configuration_is_privilege_mode(priv->configuration);
+    if (!child_establish_connection(child, option, children, FALSE)) {
+        if (privilege &&
+            milter_manager_children_start_child(children, child)) {
+            prepare_retry_establish_connection(child, option, children,
+                                               FALSE);
+        }
+    }
+}
+
+static void
+cb_queued_notify (GObject *object, GParamSpec *pspec, gpointer user_data)
+{
+    NegotiateData *data = user_data;
+    MilterManagerChildren *children;
+    MilterManagerChild *child;
+    MilterOption *option;
+    MilterManagerChildrenPrivate *priv;
+
+    child = MILTER_MANAGER_CHILD(object);
+    if (milter_manager_child_is_queued(child))
+        return;
+
+    children = data->children;
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+    milter_debug("[%u] [children][queue][dequeued] [%u] %s",
+                 priv->tag,
+                 milter_agent_get_tag(MILTER_AGENT(child)),
+                 milter_server_context_get_name(MILTER_SERVER_CONTEXT(child)));
+
+    g_object_ref(child);
+    option = g_object_ref(data->option);
+    g_hash_table_remove(priv->try_negotiate_ids, data);
+    negotiate_child(children, child, option);
+    g_object_unref(option);
+    g_object_unref(child);
+}
+
+static gboolean
+cb_queue_timeout (gpointer user_data)
+{
+    NegotiateData *data = user_data;
+    MilterManagerChildrenPrivate *priv;
+    MilterServerContext *context;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(data->children);
+    context = MILTER_SERVER_CONTEXT(data->child);
+    milter_warning("[%u] [children][queue][timeout] [%u] %s",
+                   priv->tag,
+                   milter_agent_get_tag(MILTER_AGENT(context)),
+                   milter_server_context_get_name(context));
+    milter_manager_child_set_bypassed(data->child, TRUE);
+    clear_try_negotiate_data(data);
+
+    return FALSE;
+}
+
+static void
+prepare_queued_child (MilterManagerChild *child,
+                      MilterOption *option,
+                      MilterManagerChildren *children)
+{
+    MilterManagerChildrenPrivate *priv;
+    NegotiateData *negotiate_data;
+    NegotiateTimeoutID *negotiate_timeout_id;
+    guint timeout_id;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+
+    negotiate_data = negotiate_data_new(children, child, option, FALSE);
+    negotiate_data->queued_signal_id =
+        g_signal_connect(child, "notify::queued",
+                         G_CALLBACK(cb_queued_notify),
+                         negotiate_data);
+    timeout_id =
+        milter_event_loop_add_timeout(priv->event_loop,
+                                      milter_manager_child_get_queue_timeout(child),
+                                      cb_queue_timeout,
+                                      negotiate_data);
+    negotiate_timeout_id =
+        negotiate_timeout_id_new(priv->event_loop, timeout_id);
+
+    g_hash_table_insert(priv->try_negotiate_ids,
+                        negotiate_data, negotiate_timeout_id);
+}
+
+static void
+prepare_negotiate (MilterManagerChild *child,
+                   MilterOption *option,
+                   MilterManagerChildren *children,
+                   gboolean is_retry)
+{
+    MilterManagerChildrenPrivate *priv;
+    NegotiateData *negotiate_data;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+
+    negotiate_data = negotiate_data_new(children, child, option, is_retry);
+    g_hash_table_insert(priv->try_negotiate_ids, negotiate_data, NULL);
+}
+
+static gboolean
+child_establish_connection (MilterManagerChild *child,
+                            MilterOption *option,
+                            MilterManagerChildren *children,
+                            gboolean is_retry)
+{
+    MilterManagerChildrenPrivate *priv;
+    MilterServerContext *context;
+    GError *error = NULL;
+
+    context = MILTER_SERVER_CONTEXT(child);
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+
+    if (!milter_server_context_establish_connection(context, &error)) {
+        milter_error("[%u] [children][error][connection] [%u] %s: %s",
+                     priv->tag,
+                     milter_agent_get_tag(MILTER_AGENT(context)),
+                     error->message,
+                     milter_server_context_get_name(context));
+        milter_error_emittable_emit(MILTER_ERROR_EMITTABLE(children),
+                                    error);
+
+        g_error_free(error);
+        if (is_retry) {
+            remove_queue_in_negotiate(children, child);
+            expire_child(children, context);
+        } else {
+            prepare_retry_establish_connection(child, option, children, TRUE);
+        }
+        return FALSE;
+    }
+
+    prepare_negotiate(child, option, children, is_retry);
+
+    return TRUE;
+}
+
+static MilterCommand
+get_next_command (MilterManagerChildren *children,
+                  MilterServerContext *context,
+                  MilterServerContextState state)
+{
+    MilterManagerChildrenPrivate *priv;
+    GList *node;
+    MilterCommand current_command;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+
+    current_command = state_to_command(state);
+
+    node = g_list_find(priv->command_queue, GINT_TO_POINTER(current_command));
+    if (!node || !g_list_next(node))
+        return -1;
+
+    node = g_list_next(node);
+    return fetch_first_command_for_child_in_queue(context, &node);
+}
+
+static MilterStatus
+send_next_command (MilterManagerChildren *children,
+                   MilterServerContext *context,
+                   MilterServerContextState processing_state)
+{
+    MilterCommand next_command;
 
     next_command = get_next_command(children, context, processing_state);
     if (next_command == -1)
@@ -3079,6 +3740,78 @@ cb_idle_reply_negotiate_on_no_child (gpointer user_data)
     return FALSE;
 }
 
+static gboolean
+cb_idle_reply_negotiate_by_cache (gpointer user_data)
+{
+    MilterManagerChildren *children = user_data;
+    MilterManagerChildrenPrivate *priv;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+    priv->lazy_reply_negotiate_id = 0;
+    milter_debug("[%u] [children][negotiate][cache][reply]", priv->tag);
+    emit_negotiate_reply(children);
+
+    return FALSE;
+}
+
+/* Replies the negotiation with the cached negotiation
+ * results of children before they reply. Commands from the
+ * MTA are held until all children reply. */
+static gboolean
+prepare_negotiate_reply_by_cache (MilterManagerChildren *children)
+{
+    MilterManagerChildrenPrivate *priv;
+    GList *node;
+    gboolean have_child = FALSE;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+
+    if (!priv->option)
+        return FALSE;
+
+    for (node = priv->milters; node; node = g_list_next(node)) {
+        MilterManagerChild *child = node->data;
+
+        if (milter_manager_child_is_bypassed(child))
+            continue;
+        if (!milter_manager_child_get_cached_option(child))
+            return FALSE;
+        have_child = TRUE;
+    }
+    if (!have_child)
+        return FALSE;
+
+    for (node = priv->milters; node; node = g_list_next(node)) {
+        MilterManagerChild *child = node->data;
+        MilterOption *option;
+        MilterMacrosRequests *macros_requests;
+
+        if (milter_manager_child_is_bypassed(child))
+            continue;
+
+        option = milter_manager_child_get_cached_option(child);
+        macros_requests = milter_manager_child_get_cached_macros_requests(child);
+        if (macros_requests)
+            milter_macros_requests_merge(priv->macros_requests,
+                                         macros_requests);
+        milter_option_merge(priv->option, option);
+        priv->requested_yes_steps |= milter_option_get_step_yes(option);
+    }
+    priv->negotiated = TRUE;
+    priv->negotiate_replied_by_cache = TRUE;
+    priv->negotiate_cache_mismatched = FALSE;
+
+    dispose_lazy_reply_negotiate_id(priv);
+    priv->lazy_reply_negotiate_id =
+        milter_event_loop_add_idle_full(priv->event_loop,
+                                        G_PRIORITY_DEFAULT,
+                                        cb_idle_reply_negotiate_by_cache,
+                                        children,
+                                        NULL);
+
+    return TRUE;
+}
+
 gboolean
 milter_manager_children_negotiate (MilterManagerChildren *children,
                                    MilterOption          *option,
@@ -3087,7 +3820,6 @@ milter_manager_children_negotiate (MilterManagerChildren *children,
     GList *node, *copied_milters;
     MilterManagerChildrenPrivate *priv;
     gboolean success = TRUE;
-    gboolean privilege;
 
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
 
@@ -3116,26 +3848,34 @@ milter_manager_children_negotiate (MilterManagerChildren *children,
         return success;
     }
 
-    privilege =
-        milter_manager_configuration_is_privilege_mode(priv->configuration);
-
     init_reply_queue(children, MILTER_SERVER_CONTEXT_STATE_NEGOTIATE);
     for (node = priv->milters; node; node = g_list_next(node)) {
         MilterManagerChild *child = MILTER_MANAGER_CHILD(node->data);
         g_queue_push_tail(priv->reply_queue, child);
     }
 
+    prepare_negotiate_reply_by_cache(children);
+
     copied_milters = g_list_copy(priv->milters);
     for (node = copied_milters; node; node = g_list_next(node)) {
         MilterManagerChild *child = MILTER_MANAGER_CHILD(node->data);
 
-        if (!child_establish_connection(child, option, children, FALSE)) {
-            if (privilege &&
-                milter_manager_children_start_child(children, child)) {
-                prepare_retry_establish_connection(child, option, children,
-                                                   FALSE);
-            }
+        if (milter_manager_child_is_bypassed(child)) {
+            prepare_bypass_child(child, option, children);
+            continue;
         }
+
+        if (milter_manager_child_is_queued(child)) {
+            prepare_queued_child(child, option, children);
+            continue;
+        }
+
+        if (is_deferrable_child(children, child)) {
+            prepare_deferred_child(child, option, children);
+            continue;
+        }
+
+        negotiate_child(children, child, option);
     }
     g_list_free(copied_milters);
 
@@ -3152,6 +3892,25 @@ milter_manager_children_define_macro (MilterManagerChildren *children,
 
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
 
+    if (command == MILTER_COMMAND_CONNECT &&
+        (priv->negotiate_replied_by_cache || priv->deferred_children)) {
+        GHashTableIter iter;
+        gpointer key, value;
+
+        if (priv->pending_connect_macros)
+            g_hash_table_unref(priv->pending_connect_macros);
+        priv->pending_connect_macros =
+            g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+        if (macros) {
+            g_hash_table_iter_init(&iter, macros);
+            while (g_hash_table_iter_next(&iter, &key, &value)) {
+                g_hash_table_insert(priv->pending_connect_macros,
+                                    g_strdup(key), g_strdup(value));
+            }
+        }
+        return TRUE;
+    }
+
     for (node = priv->milters; node; node = g_list_next(node)) {
         MilterManagerChild *child = node->data;
         MilterServerContext *context;
@@ -3255,13 +4014,256 @@ milter_manager_children_check_processing_message (MilterManagerChildren *childre
     return FALSE;
 }
 
+static void
+reply_by_verdict_cache (MilterManagerChildren *children,
+                        MilterServerContextState state,
+                        GList *hits)
+{
+    MilterManagerChildrenPrivate *priv;
+    GList *node;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+
+    priv->skip_verdict_recording = TRUE;
+    for (node = hits; node; node = g_list_next(node)) {
+        VerdictCacheHit *hit = node->data;
+        gchar **verdict = hit->verdict;
+
+        milter_server_context_set_state(hit->context, state);
+        if (g_str_equal(verdict[0], "reply-code")) {
+            cb_reply_code(hit->context,
+                          (guint)g_ascii_strtoull(verdict[1], NULL, 10),
+                          verdict[2][0] ? verdict[2] : NULL,
+                          verdict[3][0] ? verdict[3] : NULL,
+                          children);
+        } else if (g_str_equal(verdict[0], "reject")) {
+            cb_reject(hit->context, children);
+        } else if (g_str_equal(verdict[0], "temporary-failure")) {
+            cb_temporary_failure(hit->context, children);
+        } else {
+            cb_accept(hit->context, children);
+        }
+        /* A deferred child isn't connected. So nobody else
+         * finishes it. */
+        if (!milter_server_context_is_negotiated(hit->context))
+            milter_finished_emittable_emit(
+                MILTER_FINISHED_EMITTABLE(hit->context));
+        g_strfreev(verdict);
+        g_free(hit);
+    }
+    priv->skip_verdict_recording = FALSE;
+    g_list_free(hits);
+}
+
+static gboolean
+is_evaluation_sampled (MilterManagerChildren *children,
+                       MilterServerContext *context)
+{
+    MilterManagerChildrenPrivate *priv;
+    MilterManagerChild *child;
+    gdouble rate;
+    gboolean sampled;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+
+    child = MILTER_MANAGER_CHILD(context);
+    if (!milter_manager_child_is_evaluation_mode(child))
+        return TRUE;
+
+    rate = milter_manager_child_get_evaluation_sampling_rate(child);
+    if (rate >= 1.0)
+        return TRUE;
+
+    if (priv->verdict_cache_address) {
+        sampled = (g_str_hash(priv->verdict_cache_address) % 10000) < rate * 10000;
+    } else {
+        sampled = g_random_double() < rate;
+    }
+
+    return sampled;
+}
+
+/* Children that aren't sampled are removed from the children
+ * without any reply. So they don't affect the reply status and
+ * the fallback status. */
+static void
+remove_unsampled_children (MilterManagerChildren *children)
+{
+    MilterManagerChildrenPrivate *priv;
+    GList *node, *copied_milters;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+
+    copied_milters = g_list_copy(priv->milters);
+    for (node = copied_milters; node; node = g_list_next(node)) {
+        MilterServerContext *context = node->data;
+
+        if (milter_server_context_is_quitted(context))
+            continue;
+        if (is_evaluation_sampled(children, context))
+            continue;
+
+        milter_debug("[%u] [children][evaluation][unsampled] [%u] %s",
+                     priv->tag,
+                     milter_agent_get_tag(MILTER_AGENT(context)),
+                     milter_server_context_get_name(context));
+        teardown_server_context_signals(MILTER_MANAGER_CHILD(context),
+                                        children);
+        priv->deferred_children = g_list_remove(priv->deferred_children,
+                                                context);
+        priv->milters = g_list_remove(priv->milters, context);
+        if (milter_server_context_is_negotiated(context))
+            milter_server_context_quit(context);
+        g_object_unref(context);
+    }
+    g_list_free(copied_milters);
+}
+
+static gboolean
+is_verdict_cache_hit (GList *hits, MilterServerContext *context)
+{
+    GList *node;
+
+    for (node = hits; node; node = g_list_next(node)) {
+        VerdictCacheHit *hit = node->data;
+        if (hit->context == context)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static GList *
+collect_verdict_cache_hit (MilterManagerChildren *children,
+                           GList *hits,
+                           MilterServerContext *context,
+                           MilterServerContextState state)
+{
+    VerdictCacheHit *hit;
+    gchar **verdict;
+
+    verdict = lookup_verdict(children, context, state);
+    if (!verdict)
+        return hits;
+
+    hit = g_new0(VerdictCacheHit, 1);
+    hit->context = context;
+    hit->verdict = verdict;
+    return g_list_append(hits, hit);
+}
+
+static void
+verdict_cache_hits_free (GList *hits)
+{
+    GList *node;
+
+    for (node = hits; node; node = g_list_next(node)) {
+        VerdictCacheHit *hit = node->data;
+
+        g_strfreev(hit->verdict);
+        g_free(hit);
+    }
+    g_list_free(hits);
+}
+
+static void
+hold_connect (MilterManagerChildrenPrivate *priv,
+              const gchar *host_name,
+              struct sockaddr *address,
+              socklen_t address_length)
+{
+    g_free(priv->pending_host_name);
+    g_free(priv->pending_address);
+    priv->pending_host_name = g_strdup(host_name);
+    priv->pending_address = g_memdup(address, address_length);
+    priv->pending_address_length = address_length;
+    priv->connect_pending = TRUE;
+}
+
+static void
+negotiate_deferred_children (MilterManagerChildren *children)
+{
+    MilterManagerChildrenPrivate *priv;
+    GList *node, *deferred_children;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+
+    milter_debug("[%u] [children][verdict-cache][miss][negotiate] %u",
+                 priv->tag, g_list_length(priv->deferred_children));
+
+    deferred_children = priv->deferred_children;
+    priv->deferred_children = NULL;
+
+    init_reply_queue(children, MILTER_SERVER_CONTEXT_STATE_NEGOTIATE);
+    for (node = deferred_children; node; node = g_list_next(node)) {
+        g_queue_push_tail(priv->reply_queue, node->data);
+    }
+    priv->negotiate_replied_by_cache = TRUE;
+    for (node = deferred_children; node; node = g_list_next(node)) {
+        negotiate_child(children,
+                        MILTER_MANAGER_CHILD(node->data),
+                        priv->deferred_option);
+    }
+    g_list_free(deferred_children);
+}
+
+/* Deferred children are never connected when all of them
+ * have a cached verdict for the client. Otherwise they are
+ * connected and negotiated, and the connect is held until
+ * they reply the negotiation. */
+static gboolean
+collect_deferred_verdict_cache_hits (MilterManagerChildren *children,
+                                     GList **hits)
+{
+    MilterManagerChildrenPrivate *priv;
+    GList *node, *deferred_hits = NULL;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+
+    for (node = priv->deferred_children; node; node = g_list_next(node)) {
+        MilterServerContext *context = node->data;
+
+        deferred_hits =
+            collect_verdict_cache_hit(children, deferred_hits, context,
+                                      MILTER_SERVER_CONTEXT_STATE_CONNECT);
+        if (!is_verdict_cache_hit(deferred_hits, context)) {
+            verdict_cache_hits_free(deferred_hits);
+            negotiate_deferred_children(children);
+            return FALSE;
+        }
+    }
+
+    milter_debug("[%u] [children][verdict-cache][hit][deferred] %u",
+                 priv->tag, g_list_length(deferred_hits));
+    for (node = priv->deferred_children; node; node = g_list_next(node)) {
+        setup_server_context_signals(children,
+                                     MILTER_SERVER_CONTEXT(node->data));
+    }
+    g_list_free(priv->deferred_children);
+    priv->deferred_children = NULL;
+    *hits = g_list_concat(*hits, deferred_hits);
+
+    if (priv->pending_connect_macros) {
+        GHashTable *macros;
+
+        macros = priv->pending_connect_macros;
+        priv->pending_connect_macros = NULL;
+        milter_manager_children_define_macro(children,
+                                             MILTER_COMMAND_CONNECT,
+                                             macros);
+        g_hash_table_unref(macros);
+    }
+
+    return TRUE;
+}
+
 gboolean
 milter_manager_children_connect (MilterManagerChildren *children,
                                  const gchar           *host_name,
                                  struct sockaddr       *address,
                                  socklen_t              address_length)
 {
-    GList *child, *targets;
+    GList *child, *targets, *hits = NULL;
     MilterManagerChildrenPrivate *priv;
     gboolean success = FALSE;
     gint n_queued_milters;
@@ -3269,12 +4271,43 @@ milter_manager_children_connect (MilterManagerChildren *children,
 
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
 
+    if (priv->negotiate_replied_by_cache) {
+        milter_debug("[%u] [children][connect][pending]", priv->tag);
+        hold_connect(priv, host_name, address, address_length);
+        return TRUE;
+    }
+
+    if (priv->negotiate_cache_mismatched) {
+        milter_info("[%u] [children][connect][cache][mismatch] "
+                    "temporary-failure",
+                    priv->tag);
+        g_signal_emit_by_name(children, "temporary-failure");
+        return TRUE;
+    }
+
     dispose_smtp_client_address(priv);
     priv->smtp_client_address = g_memdup(address, address_length);
     priv->smtp_client_address_length = address_length;
+    priv->verdict_cache_address = verdict_cache_address_new(address);
 
-    if (!milter_manager_children_check_alive(children))
+    remove_unsampled_children(children);
+    if (!priv->milters) {
+        milter_debug("[%u] [children][evaluation][unsampled][all]", priv->tag);
+        g_signal_emit_by_name(children, "accept");
+        return TRUE;
+    }
+
+    if (priv->deferred_children &&
+        !collect_deferred_verdict_cache_hits(children, &hits)) {
+        milter_debug("[%u] [children][connect][pending]", priv->tag);
+        hold_connect(priv, host_name, address, address_length);
+        return TRUE;
+    }
+
+    if (!milter_manager_children_check_alive(children)) {
+        verdict_cache_hits_free(hits);
         return FALSE;
+    }
 
     init_reply_queue(children, state);
     for (child = priv->milters; child; child = g_list_next(child)) {
@@ -3288,6 +4321,16 @@ milter_manager_children_connect (MilterManagerChildren *children,
     targets = g_list_copy(priv->reply_queue->head);
     for (child = targets; child; child = g_list_next(child)) {
         MilterServerContext *context = MILTER_SERVER_CONTEXT(child->data);
+        if (is_verdict_cache_hit(hits, context))
+            continue;
+        hits = collect_verdict_cache_hit(children, hits, context, state);
+    }
+    for (child = targets; child; child = g_list_next(child)) {
+        MilterServerContext *context = MILTER_SERVER_CONTEXT(child->data);
+        if (is_verdict_cache_hit(hits, context)) {
+            success = TRUE;
+            continue;
+        }
         if (milter_server_context_connect(context,
                                           host_name,
                                           address,
@@ -3296,14 +4339,17 @@ milter_manager_children_connect (MilterManagerChildren *children,
         }
     }
     milter_debug("[%u] [children][connect][sent] %d",
-                 priv->tag, n_queued_milters);
+                 priv->tag, n_queued_milters - g_list_length(hits));
     for (child = targets; child; child = g_list_next(child)) {
         MilterServerContext *context = MILTER_SERVER_CONTEXT(child->data);
+        if (is_verdict_cache_hit(hits, context))
+            continue;
         if (!milter_server_context_need_reply(context, state)) {
             cb_continue(context, children);
         }
     }
     g_list_free(targets);
+    reply_by_verdict_cache(children, state, hits);
 
     return success;
 }
@@ -3312,7 +4358,7 @@ gboolean
 milter_manager_children_helo (MilterManagerChildren *children,
                               const gchar           *fqdn)
 {
-    GList *child, *targets;
+    GList *child, *targets, *hits = NULL;
     MilterManagerChildrenPrivate *priv;
     gboolean success = FALSE;
     gint n_queued_milters;
@@ -3323,6 +4369,9 @@ milter_manager_children_helo (MilterManagerChildren *children,
 
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
 
+    g_free(priv->verdict_cache_fqdn);
+    priv->verdict_cache_fqdn = g_strdup(fqdn);
+
     init_reply_queue(children, state);
     for (child = priv->milters; child; child = g_list_next(child)) {
         MilterServerContext *context = MILTER_SERVER_CONTEXT(child->data);
@@ -3335,18 +4384,29 @@ milter_manager_children_helo (MilterManagerChildren *children,
     targets = g_list_copy(priv->reply_queue->head);
     for (child = targets; child; child = g_list_next(child)) {
         MilterServerContext *context = MILTER_SERVER_CONTEXT(child->data);
+        hits = collect_verdict_cache_hit(children, hits, context, state);
+    }
+    for (child = targets; child; child = g_list_next(child)) {
+        MilterServerContext *context = MILTER_SERVER_CONTEXT(child->data);
+        if (is_verdict_cache_hit(hits, context)) {
+            success = TRUE;
+            continue;
+        }
         if (milter_server_context_helo(context, fqdn))
             success = TRUE;
     }
     milter_debug("[%u] [children][helo][sent] %d",
-                 priv->tag, n_queued_milters);
+                 priv->tag, n_queued_milters - g_list_length(hits));
     for (child = targets; child; child = g_list_next(child)) {
         MilterServerContext *context = MILTER_SERVER_CONTEXT(child->data);
+        if (is_verdict_cache_hit(hits, context))
+            continue;
         if (!milter_server_context_need_reply(context, state)) {
             cb_continue(context, children);
         }
     }
     g_list_free(targets);
+    reply_by_verdict_cache(children, state, hits);
 
     return success;
 }
@@ -3540,41 +4600,84 @@ milter_manager_children_unknown (MilterManagerChildren *children,
     return success;
 }
 
+static MilterHeader *
+next_processing_header (MilterManagerChildrenPrivate *priv)
+{
+    const GList *node;
+
+    if (!priv->headers)
+        return NULL;
+
+    if (priv->processing_header_node)
+        node = g_list_next(priv->processing_header_node);
+    else
+        node = g_list_nth((GList *)milter_headers_get_list(priv->headers),
+                          priv->processing_header_index);
+    if (!node)
+        return NULL;
+
+    priv->processing_header_node = node;
+    priv->processing_header_index++;
+    return node->data;
+}
+
+static gboolean
+send_header_to_child (MilterManagerChildren *children,
+                      MilterServerContext *context,
+                      MilterHeader *header)
+{
+    gint value_offset = 0;
+
+    if (need_header_value_leading_space_conversion(children, context)) {
+        if (header->value && header->value[0] == ' ')
+            value_offset = 1;
+    }
+
+    return milter_server_context_header(context,
+                                        header->name,
+                                        header->value + value_offset);
+}
+
 static MilterStatus
 send_next_header_to_child (MilterManagerChildren *children, MilterServerContext *context)
 {
     MilterManagerChildrenPrivate *priv;
+    MilterManagerChild *child;
     MilterHeader *header;
-    gint value_offset = 0;
 
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
     priv->processing_state = MILTER_SERVER_CONTEXT_STATE_HEADER;
+    child = MILTER_MANAGER_CHILD(context);
 
-    priv->processing_header_index++;
-    header = milter_headers_get_nth_header(priv->headers,
-                                           priv->processing_header_index);
+    header = next_processing_header(priv);
     if (!header)
         return MILTER_STATUS_NOT_CHANGE;
 
-    if (need_header_value_leading_space_conversion(children, context)) {
-        if (header->value && header->value[0] == ' ')
-            value_offset = 1;
+    if (milter_server_context_need_reply(context, priv->processing_state)) {
+        if (!send_header_to_child(children, context, header))
+            return milter_manager_child_get_fallback_status(child);
+        return MILTER_STATUS_PROGRESS;
     }
 
-    if (milter_server_context_header(context,
-                                     header->name,
-                                     header->value + value_offset)) {
-        MilterStatus status = MILTER_STATUS_PROGRESS;
-        if (!milter_server_context_need_reply(context, priv->processing_state)) {
-            g_signal_emit_by_name(context, "continue");
-        }
-        return status;
-    } else {
-        MilterManagerChild *child;
+    /* The child doesn't reply to headers. We write all the
+     * remaining headers at once and emit "continue" only
+     * once. */
+    do {
+        if (!send_header_to_child(children, context, header))
+            return milter_manager_child_get_fallback_status(child);
+        if (milter_server_context_get_status(context) == MILTER_STATUS_STOP)
+            return MILTER_STATUS_PROGRESS;
+    } while ((header = next_processing_header(priv)));
 
-        child = MILTER_MANAGER_CHILD(context);
-        return milter_manager_child_get_fallback_status(child);
-    }
+    milter_debug("[%u] [children][header][burst] [%u] <%d> %s",
+                 priv->tag,
+                 milter_agent_get_tag(MILTER_AGENT(context)),
+                 priv->processing_header_index,
+                 milter_server_context_get_name(context));
+    milter_server_context_set_state(context,
+                                    MILTER_SERVER_CONTEXT_STATE_HEADER);
+    g_signal_emit_by_name(context, "continue");
+    return MILTER_STATUS_PROGRESS;
 }
 
 static gboolean
@@ -3761,6 +4864,7 @@ write_body (MilterManagerChildren *children,
 
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
 
+    priv->body_size += size;
     if (priv->body_file)
         return write_body_to_file(children, chunk, size);
     else
@@ -3849,6 +4953,7 @@ init_child_for_body_file (MilterManagerChildren *children,
     GError *error = NULL;
 
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+    priv->sent_body_offset = 0;
     if (!priv->body_file)
         return MILTER_STATUS_NOT_CHANGE;
 
@@ -3923,6 +5028,7 @@ send_body_to_child_file (MilterManagerChildren *children,
         break;
     case G_IO_STATUS_NORMAL:
         if (milter_server_context_body(context, buffer, read_size)) {
+            priv->sent_body_offset += read_size;
             status = MILTER_STATUS_PROGRESS;
         } else {
             status = milter_manager_child_get_fallback_status(child);
@@ -4046,6 +5152,7 @@ milter_manager_children_end_of_message (MilterManagerChildren *children,
     init_command_waiting_child_queue(children, MILTER_COMMAND_END_OF_MESSAGE);
 
     priv->processing_header_index = 0;
+    priv->processing_header_node = NULL;
     if (!priv->headers)
         priv->headers = milter_headers_new();
     if (!priv->original_headers)
@@ -4074,6 +5181,7 @@ milter_manager_children_quit (MilterManagerChildren *children)
 
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
 
+    dispose_pending_connect(priv);
     set_state(children, MILTER_SERVER_CONTEXT_STATE_QUIT);
     for (child = priv->milters; child; child = g_list_next(child)) {
         MilterServerContext *context;
@@ -4098,6 +5206,50 @@ milter_manager_children_quit (MilterManagerChildren *children)
     return success;
 }
 
+static void
+count_saved_body_bytes (MilterManagerChildren *children)
+{
+    MilterManagerChildrenPrivate *priv;
+    GList *node;
+    guint64 n_bytes = 0;
+
+    priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
+
+    if (priv->body_size == 0)
+        return;
+
+    for (node = priv->command_waiting_child_queue;
+         node;
+         node = g_list_next(node)) {
+        MilterServerContext *context = node->data;
+
+        if (milter_server_context_is_quitted(context) ||
+            milter_server_context_get_skip_body(context) ||
+            milter_server_context_is_enable_step(context, MILTER_STEP_NO_BODY))
+            continue;
+
+        if (node == priv->command_waiting_child_queue) {
+            /* The first child is processing the message. */
+            if (priv->sending_body)
+                n_bytes += priv->body_size -
+                    MIN(priv->sent_body_offset, priv->body_size);
+            else if (milter_server_context_get_state(context) <
+                     MILTER_SERVER_CONTEXT_STATE_BODY)
+                n_bytes += priv->body_size;
+        } else {
+            n_bytes += priv->body_size;
+        }
+    }
+
+    if (n_bytes == 0)
+        return;
+
+    priv->n_saved_body_bytes += n_bytes;
+    milter_statistics("[session][early-termination][saved-body]"
+                      "[%" G_GUINT64_FORMAT "](%u)",
+                      n_bytes, priv->tag);
+}
+
 gboolean
 milter_manager_children_abort (MilterManagerChildren *children)
 {
@@ -4107,6 +5259,10 @@ milter_manager_children_abort (MilterManagerChildren *children)
 
     priv = MILTER_MANAGER_CHILDREN_GET_PRIVATE(children);
 
+    dispose_pending_connect(priv);
+    count_saved_body_bytes(children);
+    priv->sending_body = FALSE;
+    priv->sent_body_offset = 0;
     set_state(children, MILTER_SERVER_CONTEXT_STATE_ABORT);
     for (child = priv->milters; child; child = g_list_next(child)) {
         MilterServerContext *context = MILTER_SERVER_CONTEXT(child->data);
@@ -4252,6 +5408,12 @@ milter_manager_children_get_option (MilterManagerChildren *children)
     return MILTER_MANAGER_CHILDREN_GET_PRIVATE(children)->option;
 }
 
+guint64
+milter_manager_children_get_n_saved_body_bytes (MilterManagerChildren *children)
+{
+    return MILTER_MANAGER_CHILDREN_GET_PRIVATE(children)->n_saved_body_bytes;
+}
+
 /*
 vi:ts=4:nowrap:ai:expandtab:sw=4
 */
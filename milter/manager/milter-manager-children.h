@@ -141,6 +141,8 @@ gboolean               milter_manager_children_get_smtp_client_address
 
 
 MilterOption          *milter_manager_children_get_option   (MilterManagerChildren *children);
+guint64                milter_manager_children_get_n_saved_body_bytes
+                                                            (MilterManagerChildren *children);
 
 gboolean               milter_manager_children_is_waiting_reply
                                                             (MilterManagerChildren *children);
@@ -24,6 +24,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <string.h>
 
 #include <glib/gstdio.h>
 
@@ -37,6 +38,12 @@
 #define DEFAULT_FALLBACK_STATUS_AT_DISCONNECT MILTER_STATUS_TEMPORARY_FAILURE
 #define DEFAULT_MAINTENANCE_INTERVAL 10
 #define DEFAULT_CONNECTION_CHECK_INTERVAL 0
+#define DEFAULT_SHARED_CACHE_SIZE 8192
+
+#define SNAPSHOT_MAGIC "MMCONFIG"
+#define SNAPSHOT_MAGIC_SIZE (sizeof(SNAPSHOT_MAGIC) - 1)
+#define SNAPSHOT_FORMAT_VERSION 3
+#define SNAPSHOT_TYPE "(usa(sxxxt)a(ssi)a{sv}a(sasa{sv}))"
 
 #define MILTER_MANAGER_CONFIGURATION_GET_PRIVATE(obj)                   \
     (G_TYPE_INSTANCE_GET_PRIVATE((obj),                                 \
@@ -82,6 +89,9 @@ struct _MilterManagerConfigurationPrivate
     gchar *syslog_facility;
     guint chunk_size;
     guint max_pending_finished_sessions;
+    guint shared_cache_size;
+    MilterManagerSharedCache *shared_cache;
+    gchar *snapshot_path;
 };
 
 enum
@@ -119,7 +129,8 @@ enum
     PROP_USE_SYSLOG,
     PROP_SYSLOG_FACILITY,
     PROP_CHUNK_SIZE,
-    PROP_MAX_PENDING_FINISHED_SESSIONS
+    PROP_MAX_PENDING_FINISHED_SESSIONS,
+    PROP_SHARED_CACHE_SIZE
 };
 
 enum
@@ -466,6 +477,15 @@ milter_manager_configuration_class_init (MilterManagerConfigurationClass *klass)
                                     PROP_MAX_PENDING_FINISHED_SESSIONS,
                                     spec);
 
+    spec = g_param_spec_uint("shared-cache-size",
+                             "Shared cache size",
+                             "The number of entries of the cache "
+                             "shared by workers",
+                             0, G_MAXUINT, DEFAULT_SHARED_CACHE_SIZE,
+                             G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class, PROP_SHARED_CACHE_SIZE,
+                                    spec);
+
     signals[CONNECTED] =
         g_signal_new("connected",
                      G_TYPE_FROM_CLASS(klass),
@@ -520,6 +540,9 @@ milter_manager_configuration_init (MilterManagerConfiguration *configuration)
     priv->syslog_facility = NULL;
     priv->chunk_size = MILTER_CHUNK_SIZE;
     priv->max_pending_finished_sessions = 0;
+    priv->shared_cache_size = DEFAULT_SHARED_CACHE_SIZE;
+    priv->shared_cache = NULL;
+    priv->snapshot_path = NULL;
 
     config_dir_env = g_getenv("MILTER_MANAGER_CONFIG_DIR");
     if (config_dir_env)
@@ -556,6 +579,16 @@ dispose (GObject *object)
         priv->locations = NULL;
     }
 
+    if (priv->shared_cache) {
+        g_object_unref(priv->shared_cache);
+        priv->shared_cache = NULL;
+    }
+
+    if (priv->snapshot_path) {
+        g_free(priv->snapshot_path);
+        priv->snapshot_path = NULL;
+    }
+
     G_OBJECT_CLASS(milter_manager_configuration_parent_class)->dispose(object);
 }
 
@@ -697,6 +730,10 @@ set_property (GObject      *object,
         milter_manager_configuration_set_max_pending_finished_sessions(
             config, g_value_get_uint(value));
         break;
+    case PROP_SHARED_CACHE_SIZE:
+        milter_manager_configuration_set_shared_cache_size(
+            config, g_value_get_uint(value));
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -812,6 +849,9 @@ get_property (GObject    *object,
     case PROP_MAX_PENDING_FINISHED_SESSIONS:
         g_value_set_uint(value, priv->max_pending_finished_sessions);
         break;
+    case PROP_SHARED_CACHE_SIZE:
+        g_value_set_uint(value, priv->shared_cache_size);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -1138,16 +1178,76 @@ milter_manager_configuration_load_custom_if_exist (MilterManagerConfiguration *c
     return FALSE;
 }
 
+static gboolean
+reload_snapshot (MilterManagerConfiguration *configuration)
+{
+    MilterManagerConfigurationPrivate *priv;
+    GTimer *timer;
+    GError *error = NULL;
+
+    priv = MILTER_MANAGER_CONFIGURATION_GET_PRIVATE(configuration);
+    if (!priv->snapshot_path)
+        return FALSE;
+
+    timer = g_timer_new();
+    if (!milter_manager_configuration_load_snapshot(configuration,
+                                                    priv->snapshot_path,
+                                                    &error)) {
+        milter_debug("[configuration][reload][snapshot][skip] %s",
+                     error->message);
+        g_error_free(error);
+        g_timer_destroy(timer);
+        return FALSE;
+    }
+    milter_info("[configuration][reload][snapshot] <%s>: %gs",
+                priv->snapshot_path,
+                g_timer_elapsed(timer, NULL));
+    g_timer_destroy(timer);
+
+    return TRUE;
+}
+
+static void
+save_snapshot_on_reload (MilterManagerConfiguration *configuration)
+{
+    MilterManagerConfigurationPrivate *priv;
+    GError *error = NULL;
+
+    priv = MILTER_MANAGER_CONFIGURATION_GET_PRIVATE(configuration);
+    if (!priv->snapshot_path)
+        return;
+
+    if (!milter_manager_configuration_is_snapshot_available(configuration)) {
+        milter_debug("[configuration][reload][snapshot][unavailable] <%s>",
+                     priv->snapshot_path);
+        return;
+    }
+
+    if (!milter_manager_configuration_save_snapshot(configuration,
+                                                    priv->snapshot_path,
+                                                    &error)) {
+        milter_warning("[configuration][reload][snapshot][save][error] %s",
+                       error->message);
+        g_error_free(error);
+    }
+}
+
 gboolean
 milter_manager_configuration_reload (MilterManagerConfiguration *configuration,
                                      GError **error)
 {
     GError *local_error = NULL;
+    GTimer *timer;
+
+    if (reload_snapshot(configuration))
+        return TRUE;
 
+    timer = g_timer_new();
     if (!milter_manager_configuration_clear(configuration, &local_error)) {
         milter_error("[configuration][load][clear][error] <%s>: %s",
                      CONFIG_FILE_NAME, local_error->message);
         g_propagate_error(error, local_error);
+        g_timer_destroy(timer);
         return FALSE;
     }
 
@@ -1156,6 +1256,7 @@ milter_manager_configuration_reload (MilterManagerConfiguration *configuration,
         milter_error("[configuration][load][error] <%s>: %s",
                      CONFIG_FILE_NAME, local_error->message);
         g_propagate_error(error, local_error);
+        g_timer_destroy(timer);
         return FALSE;
     }
 
@@ -1164,8 +1265,15 @@ milter_manager_configuration_reload (MilterManagerConfiguration *configuration,
         milter_error("[configuration][load][custom][error] <%s>: %s",
                      CUSTOM_CONFIG_FILE_NAME, local_error->message);
         g_propagate_error(error, local_error);
+        g_timer_destroy(timer);
         return FALSE;
     }
+    milter_info("[configuration][reload][load] <%s>: %gs",
+                CONFIG_FILE_NAME,
+                g_timer_elapsed(timer, NULL));
+    g_timer_destroy(timer);
+
+    save_snapshot_on_reload(configuration);
 
     return TRUE;
 }
@@ -1715,9 +1823,11 @@ milter_manager_configuration_setup_children (MilterManagerConfiguration *configu
 {
     GList *node;
     MilterManagerConfigurationPrivate *priv;
+    MilterEventLoop *loop = NULL;
 
     priv = MILTER_MANAGER_CONFIGURATION_GET_PRIVATE(configuration);
 
+    g_object_get(children, "event-loop", &loop, NULL);
     for (node = priv->eggs; node; node = g_list_next(node)) {
         MilterManagerChild *child;
         MilterManagerEgg *egg = node->data;
@@ -1725,6 +1835,8 @@ milter_manager_configuration_setup_children (MilterManagerConfiguration *configu
         if (!milter_manager_egg_is_enabled(egg))
             continue;
 
+        milter_manager_egg_set_shared_cache(egg, priv->shared_cache);
+        milter_manager_egg_set_event_loop(egg, loop);
         child = milter_manager_egg_hatch(egg);
         if (child) {
             milter_manager_children_add_child(children, child);
@@ -1734,6 +1846,8 @@ milter_manager_configuration_setup_children (MilterManagerConfiguration *configu
             g_object_unref(child);
         }
     }
+    if (loop)
+        g_object_unref(loop);
 }
 
 MilterStatus
@@ -1950,6 +2064,7 @@ clear_manager (MilterManagerConfigurationPrivate *priv)
     priv->default_packet_buffer_size = 0;
     priv->chunk_size = MILTER_CHUNK_SIZE;
     priv->max_pending_finished_sessions = 0;
+    priv->shared_cache_size = DEFAULT_SHARED_CACHE_SIZE;
 }
 
 static void
@@ -2434,6 +2549,740 @@ milter_manager_configuration_set_max_pending_finished_sessions (MilterManagerCon
     priv->max_pending_finished_sessions = n_sessions;
 }
 
+guint
+milter_manager_configuration_get_shared_cache_size (MilterManagerConfiguration *configuration)
+{
+    MilterManagerConfigurationPrivate *priv;
+
+    priv = MILTER_MANAGER_CONFIGURATION_GET_PRIVATE(configuration);
+    return priv->shared_cache_size;
+}
+
+void
+milter_manager_configuration_set_shared_cache_size (MilterManagerConfiguration *configuration,
+                                                    guint                       n_entries)
+{
+    MilterManagerConfigurationPrivate *priv;
+
+    priv = MILTER_MANAGER_CONFIGURATION_GET_PRIVATE(configuration);
+    priv->shared_cache_size = n_entries;
+}
+
+MilterManagerSharedCache *
+milter_manager_configuration_get_shared_cache (MilterManagerConfiguration *configuration)
+{
+    MilterManagerConfigurationPrivate *priv;
+
+    priv = MILTER_MANAGER_CONFIGURATION_GET_PRIVATE(configuration);
+    return priv->shared_cache;
+}
+
+gboolean
+milter_manager_configuration_create_shared_cache (MilterManagerConfiguration *configuration,
+                                                  GError                    **error)
+{
+    MilterManagerConfigurationPrivate *priv;
+
+    priv = MILTER_MANAGER_CONFIGURATION_GET_PRIVATE(configuration);
+    if (priv->shared_cache)
+        return TRUE;
+    if (priv->shared_cache_size == 0)
+        return TRUE;
+
+    priv->shared_cache = milter_manager_shared_cache_new(priv->shared_cache_size,
+                                                         error);
+    return priv->shared_cache != NULL;
+}
+
+const gchar *
+milter_manager_configuration_get_snapshot_path (MilterManagerConfiguration *configuration)
+{
+    return MILTER_MANAGER_CONFIGURATION_GET_PRIVATE(configuration)->snapshot_path;
+}
+
+void
+milter_manager_configuration_set_snapshot_path (MilterManagerConfiguration *configuration,
+                                                const gchar *path)
+{
+    MilterManagerConfigurationPrivate *priv;
+
+    priv = MILTER_MANAGER_CONFIGURATION_GET_PRIVATE(configuration);
+    if (priv->snapshot_path)
+        g_free(priv->snapshot_path);
+    priv->snapshot_path = g_strdup(path);
+}
+
+static gboolean
+has_signal_handler (gpointer instance)
+{
+    GType type;
+
+    for (type = G_TYPE_FROM_INSTANCE(instance);
+         type != 0;
+         type = g_type_parent(type)) {
+        guint *signal_ids;
+        guint i, n_signal_ids;
+        gboolean found = FALSE;
+
+        signal_ids = g_signal_list_ids(type, &n_signal_ids);
+        for (i = 0; i < n_signal_ids && !found; i++) {
+            found = g_signal_has_handler_pending(instance, signal_ids[i],
+                                                 0, TRUE);
+        }
+        g_free(signal_ids);
+        if (found)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+gboolean
+milter_manager_configuration_is_snapshot_available (MilterManagerConfiguration *configuration)
+{
+    MilterManagerConfigurationPrivate *priv;
+    MilterManagerConfigurationClass *configuration_class;
+    GList *node;
+
+    priv = MILTER_MANAGER_CONFIGURATION_GET_PRIVATE(configuration);
+
+    if (has_signal_handler(configuration))
+        return FALSE;
+
+    for (node = priv->eggs; node; node = g_list_next(node)) {
+        MilterManagerEgg *egg = node->data;
+
+        if (has_signal_handler(egg))
+            return FALSE;
+        if (milter_manager_egg_get_applicable_conditions(egg))
+            return FALSE;
+    }
+
+    configuration_class = MILTER_MANAGER_CONFIGURATION_GET_CLASS(configuration);
+    if (configuration_class->is_snapshot_available)
+        return configuration_class->is_snapshot_available(configuration);
+
+    return TRUE;
+}
+
+static GVariant *
+value_to_variant (const GValue *value)
+{
+    switch (G_TYPE_FUNDAMENTAL(G_VALUE_TYPE(value))) {
+    case G_TYPE_BOOLEAN:
+        return g_variant_new_boolean(g_value_get_boolean(value));
+    case G_TYPE_INT:
+        return g_variant_new_int32(g_value_get_int(value));
+    case G_TYPE_UINT:
+        return g_variant_new_uint32(g_value_get_uint(value));
+    case G_TYPE_DOUBLE:
+        return g_variant_new_double(g_value_get_double(value));
+    case G_TYPE_ENUM:
+        return g_variant_new_int32(g_value_get_enum(value));
+    case G_TYPE_FLAGS:
+        return g_variant_new_uint32(g_value_get_flags(value));
+    case G_TYPE_STRING:
+    {
+        const gchar *string;
+
+        string = g_value_get_string(value);
+        return g_variant_new_maybe(G_VARIANT_TYPE_STRING,
+                                   string ? g_variant_new_string(string) : NULL);
+    }
+    default:
+        return NULL;
+    }
+}
+
+static gboolean
+variant_to_value (GVariant *variant, GValue *value)
+{
+    switch (G_TYPE_FUNDAMENTAL(G_VALUE_TYPE(value))) {
+    case G_TYPE_BOOLEAN:
+        if (!g_variant_is_of_type(variant, G_VARIANT_TYPE_BOOLEAN))
+            return FALSE;
+        g_value_set_boolean(value, g_variant_get_boolean(variant));
+        return TRUE;
+    case G_TYPE_INT:
+        if (!g_variant_is_of_type(variant, G_VARIANT_TYPE_INT32))
+            return FALSE;
+        g_value_set_int(value, g_variant_get_int32(variant));
+        return TRUE;
+    case G_TYPE_UINT:
+        if (!g_variant_is_of_type(variant, G_VARIANT_TYPE_UINT32))
+            return FALSE;
+        g_value_set_uint(value, g_variant_get_uint32(variant));
+        return TRUE;
+    case G_TYPE_DOUBLE:
+        if (!g_variant_is_of_type(variant, G_VARIANT_TYPE_DOUBLE))
+            return FALSE;
+        g_value_set_double(value, g_variant_get_double(variant));
+        return TRUE;
+    case G_TYPE_ENUM:
+        if (!g_variant_is_of_type(variant, G_VARIANT_TYPE_INT32))
+            return FALSE;
+        g_value_set_enum(value, g_variant_get_int32(variant));
+        return TRUE;
+    case G_TYPE_FLAGS:
+        if (!g_variant_is_of_type(variant, G_VARIANT_TYPE_UINT32))
+            return FALSE;
+        g_value_set_flags(value, g_variant_get_uint32(variant));
+        return TRUE;
+    case G_TYPE_STRING:
+    {
+        GVariant *string;
+
+        if (!g_variant_is_of_type(variant, G_VARIANT_TYPE("ms")))
+            return FALSE;
+        string = g_variant_get_maybe(variant);
+        if (string) {
+            g_value_set_string(value, g_variant_get_string(string, NULL));
+            g_variant_unref(string);
+        } else {
+            g_value_set_string(value, NULL);
+        }
+        return TRUE;
+    }
+    default:
+        return FALSE;
+    }
+}
+
+static void
+add_snapshot_properties (GVariantBuilder *builder, GObject *object)
+{
+    GParamSpec **specs;
+    guint i, n_specs;
+
+    specs = g_object_class_list_properties(G_OBJECT_GET_CLASS(object),
+                                           &n_specs);
+    for (i = 0; i < n_specs; i++) {
+        GParamSpec *spec = specs[i];
+        GValue value = {0,};
+        GVariant *variant;
+
+        if ((spec->flags & G_PARAM_READWRITE) != G_PARAM_READWRITE)
+            continue;
+        if (spec->flags & G_PARAM_CONSTRUCT_ONLY)
+            continue;
+
+        g_value_init(&value, spec->value_type);
+        g_object_get_property(object, spec->name, &value);
+        variant = value_to_variant(&value);
+        g_value_unset(&value);
+        if (variant)
+            g_variant_builder_add(builder, "{sv}", spec->name, variant);
+    }
+    g_free(specs);
+}
+
+static gboolean
+set_snapshot_properties (GObject *object, GVariant *properties,
+                         const gchar *path, GError **error)
+{
+    GVariantIter iter;
+    const gchar *name;
+    GVariant *variant;
+
+    g_variant_iter_init(&iter, properties);
+    while (g_variant_iter_next(&iter, "{&sv}", &name, &variant)) {
+        GParamSpec *spec;
+        GValue value = {0,};
+
+        spec = g_object_class_find_property(G_OBJECT_GET_CLASS(object), name);
+        if (spec && !(spec->flags & G_PARAM_WRITABLE)) {
+            g_variant_unref(variant);
+            continue;
+        }
+
+        if (spec) {
+            g_value_init(&value, spec->value_type);
+            if (!variant_to_value(variant, &value)) {
+                g_value_unset(&value);
+                spec = NULL;
+            }
+        }
+        g_variant_unref(variant);
+        if (!spec) {
+            g_set_error(error,
+                        MILTER_MANAGER_CONFIGURATION_ERROR,
+                        MILTER_MANAGER_CONFIGURATION_ERROR_INVALID_SNAPSHOT,
+                        "invalid property in snapshot: <%s>: <%s>: <%s>",
+                        path, G_OBJECT_TYPE_NAME(object), name);
+            return FALSE;
+        }
+        g_object_set_property(object, name, &value);
+        g_value_unset(&value);
+    }
+
+    return TRUE;
+}
+
+typedef struct _SnapshotInputStatus SnapshotInputStatus;
+struct _SnapshotInputStatus
+{
+    gint64 mtime;
+    gint64 mtime_nsec;
+    gint64 size;
+    guint64 inode;
+};
+
+/* st_mtime has only one-second resolution. An input that is
+ * changed in the same second as the snapshot is saved is
+ * detected by the nanoseconds part, size and inode. */
+static void
+get_snapshot_input_status (const gchar *path, SnapshotInputStatus *input_status)
+{
+    struct stat status;
+
+    if (g_stat(path, &status) != 0) {
+        input_status->mtime = -1;
+        input_status->mtime_nsec = -1;
+        input_status->size = -1;
+        input_status->inode = 0;
+        return;
+    }
+
+    input_status->mtime = (gint64)status.st_mtime;
+#if defined(HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC)
+    input_status->mtime_nsec = (gint64)status.st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC_TV_NSEC)
+    input_status->mtime_nsec = (gint64)status.st_mtimespec.tv_nsec;
+#else
+    input_status->mtime_nsec = 0;
+#endif
+    input_status->size = (gint64)status.st_size;
+    input_status->inode = (guint64)status.st_ino;
+}
+
+static void
+collect_snapshot_inputs_in_directory (GHashTable *inputs,
+                                      const gchar *directory,
+                                      const gchar *snapshot_path,
+                                      gboolean recursive)
+{
+    GDir *dir;
+    const gchar *name;
+
+    dir = g_dir_open(directory, 0, NULL);
+    if (!dir)
+        return;
+
+    while ((name = g_dir_read_name(dir))) {
+        gchar *path;
+
+        path = g_build_filename(directory, name, NULL);
+        if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+            if (recursive)
+                collect_snapshot_inputs_in_directory(inputs, path,
+                                                     snapshot_path, FALSE);
+            g_free(path);
+        } else if (g_str_equal(path, snapshot_path)) {
+            g_free(path);
+        } else {
+            g_hash_table_insert(inputs, path, NULL);
+        }
+    }
+    g_dir_close(dir);
+}
+
+static GHashTable *
+collect_snapshot_directory_inputs (MilterManagerConfiguration *configuration,
+                                   const gchar *snapshot_path)
+{
+    MilterManagerConfigurationPrivate *priv;
+    GHashTable *inputs;
+    GList *node;
+
+    priv = MILTER_MANAGER_CONFIGURATION_GET_PRIVATE(configuration);
+    inputs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    for (node = priv->load_paths; node; node = g_list_next(node)) {
+        const gchar *dir = node->data;
+
+        collect_snapshot_inputs_in_directory(inputs, dir, snapshot_path, TRUE);
+    }
+
+    return inputs;
+}
+
+static GHashTable *
+collect_snapshot_inputs (MilterManagerConfiguration *configuration,
+                         const gchar *snapshot_path)
+{
+    MilterManagerConfigurationPrivate *priv;
+    GHashTable *inputs;
+    GList *node;
+
+    priv = MILTER_MANAGER_CONFIGURATION_GET_PRIVATE(configuration);
+    inputs = collect_snapshot_directory_inputs(configuration, snapshot_path);
+    for (node = priv->load_paths; node; node = g_list_next(node)) {
+        const gchar *dir = node->data;
+
+        g_hash_table_insert(inputs,
+                            g_build_filename(dir, CONFIG_FILE_NAME, NULL),
+                            NULL);
+        g_hash_table_insert(inputs,
+                            g_build_filename(dir, CUSTOM_CONFIG_FILE_NAME, NULL),
+                            NULL);
+    }
+    if (priv->custom_configuration_directory) {
+        g_hash_table_insert(inputs,
+                            g_build_filename(priv->custom_configuration_directory,
+                                             CUSTOM_CONFIG_FILE_NAME,
+                                             NULL),
+                            NULL);
+    }
+
+    if (priv->locations) {
+        GHashTableIter iter;
+        gpointer location;
+
+        g_hash_table_iter_init(&iter, priv->locations);
+        while (g_hash_table_iter_next(&iter, NULL, &location)) {
+            const gchar *file;
+
+            file = g_dataset_get_data(location, "file");
+            if (file)
+                g_hash_table_insert(inputs, g_strdup(file), NULL);
+        }
+    }
+
+    return inputs;
+}
+
+gboolean
+milter_manager_configuration_save_snapshot (MilterManagerConfiguration *configuration,
+                                            const gchar *path,
+                                            GError **error)
+{
+    MilterManagerConfigurationPrivate *priv;
+    GVariantBuilder inputs_builder, locations_builder, properties_builder;
+    GVariantBuilder eggs_builder;
+    GHashTable *inputs;
+    GHashTableIter iter;
+    gpointer key, value;
+    GList *node;
+    GVariant *snapshot;
+    GString *content;
+    GError *local_error = NULL;
+
+    priv = MILTER_MANAGER_CONFIGURATION_GET_PRIVATE(configuration);
+
+    if (!milter_manager_configuration_is_snapshot_available(configuration)) {
+        g_set_error(error,
+                    MILTER_MANAGER_CONFIGURATION_ERROR,
+                    MILTER_MANAGER_CONFIGURATION_ERROR_SNAPSHOT_UNAVAILABLE,
+                    "configuration that uses applicable conditions, "
+                    "hooks or signal handlers can't be saved as snapshot: <%s>",
+                    path);
+        return FALSE;
+    }
+
+    g_variant_builder_init(&inputs_builder, G_VARIANT_TYPE("a(sxxxt)"));
+    inputs = collect_snapshot_inputs(configuration, path);
+    g_hash_table_iter_init(&iter, inputs);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        const gchar *input = key;
+        SnapshotInputStatus status;
+
+        get_snapshot_input_status(input, &status);
+        g_variant_builder_add(&inputs_builder, "(sxxxt)",
+                              input,
+                              status.mtime,
+                              status.mtime_nsec,
+                              status.size,
+                              status.inode);
+    }
+    g_hash_table_unref(inputs);
+
+    g_variant_builder_init(&locations_builder, G_VARIANT_TYPE("a(ssi)"));
+    if (priv->locations) {
+        g_hash_table_iter_init(&iter, priv->locations);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            const gchar *file;
+            gint line;
+
+            file = g_dataset_get_data(value, "file");
+            if (!file)
+                continue;
+            line = GPOINTER_TO_INT(g_dataset_get_data(value, "line"));
+            g_variant_builder_add(&locations_builder, "(ssi)", key, file, line);
+        }
+    }
+
+    g_variant_builder_init(&properties_builder, G_VARIANT_TYPE("a{sv}"));
+    add_snapshot_properties(&properties_builder, G_OBJECT(configuration));
+
+    g_variant_builder_init(&eggs_builder, G_VARIANT_TYPE("a(sasa{sv})"));
+    for (node = priv->eggs; node; node = g_list_next(node)) {
+        MilterManagerEgg *egg = node->data;
+        GVariantBuilder connection_specs_builder;
+        GVariantBuilder egg_properties_builder;
+        GList *connection_specs, *spec_node;
+
+        g_variant_builder_init(&connection_specs_builder,
+                               G_VARIANT_TYPE_STRING_ARRAY);
+        connection_specs = milter_manager_egg_get_connection_specs(egg);
+        for (spec_node = connection_specs;
+             spec_node;
+             spec_node = g_list_next(spec_node)) {
+            g_variant_builder_add(&connection_specs_builder, "s",
+                                  spec_node->data);
+        }
+        g_list_free(connection_specs);
+
+        g_variant_builder_init(&egg_properties_builder,
+                               G_VARIANT_TYPE("a{sv}"));
+        add_snapshot_properties(&egg_properties_builder, G_OBJECT(egg));
+        g_variant_builder_add(&eggs_builder, "(s@as@a{sv})",
+                              milter_manager_egg_get_name(egg),
+                              g_variant_builder_end(&connection_specs_builder),
+                              g_variant_builder_end(&egg_properties_builder));
+    }
+
+    snapshot = g_variant_new("(us@a(sxxxt)@a(ssi)@a{sv}@a(sasa{sv}))",
+                             SNAPSHOT_FORMAT_VERSION,
+                             VERSION,
+                             g_variant_builder_end(&inputs_builder),
+                             g_variant_builder_end(&locations_builder),
+                             g_variant_builder_end(&properties_builder),
+                             g_variant_builder_end(&eggs_builder));
+    g_variant_ref_sink(snapshot);
+
+    content = g_string_new_len(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+    g_string_append_len(content,
+                        g_variant_get_data(snapshot),
+                        g_variant_get_size(snapshot));
+    g_variant_unref(snapshot);
+
+    if (!g_file_set_contents(path, content->str, content->len, &local_error)) {
+        g_set_error(error,
+                    MILTER_MANAGER_CONFIGURATION_ERROR,
+                    MILTER_MANAGER_CONFIGURATION_ERROR_SAVE,
+                    "failed to save snapshot: <%s>: %s",
+                    path, local_error->message);
+        g_error_free(local_error);
+        g_string_free(content, TRUE);
+        return FALSE;
+    }
+    milter_debug("[configuration][snapshot][save] <%s>: <%" G_GSIZE_FORMAT ">",
+                 path, content->len);
+    g_string_free(content, TRUE);
+
+    return TRUE;
+}
+
+static gboolean
+check_snapshot_inputs (MilterManagerConfiguration *configuration,
+                       const gchar *path,
+                       GVariant *inputs,
+                       GError **error)
+{
+    GHashTable *current_inputs;
+    GVariantIter iter;
+    const gchar *input;
+    SnapshotInputStatus saved_status;
+    gboolean fresh = TRUE;
+
+    current_inputs = collect_snapshot_directory_inputs(configuration, path);
+    g_variant_iter_init(&iter, inputs);
+    while (fresh && g_variant_iter_next(&iter, "(&sxxxt)",
+                                        &input,
+                                        &(saved_status.mtime),
+                                        &(saved_status.mtime_nsec),
+                                        &(saved_status.size),
+                                        &(saved_status.inode))) {
+        SnapshotInputStatus status;
+
+        g_hash_table_remove(current_inputs, input);
+        get_snapshot_input_status(input, &status);
+        if (status.mtime != saved_status.mtime ||
+            status.mtime_nsec != saved_status.mtime_nsec ||
+            status.size != saved_status.size ||
+            status.inode != saved_status.inode) {
+            g_set_error(error,
+                        MILTER_MANAGER_CONFIGURATION_ERROR,
+                        MILTER_MANAGER_CONFIGURATION_ERROR_STALE_SNAPSHOT,
+                        "<%s> is changed after snapshot is saved: <%s>",
+                        input, path);
+            fresh = FALSE;
+        }
+    }
+
+    if (fresh && g_hash_table_size(current_inputs) > 0) {
+        GHashTableIter current_iter;
+        gpointer new_input;
+
+        g_hash_table_iter_init(&current_iter, current_inputs);
+        g_hash_table_iter_next(&current_iter, &new_input, NULL);
+        g_set_error(error,
+                    MILTER_MANAGER_CONFIGURATION_ERROR,
+                    MILTER_MANAGER_CONFIGURATION_ERROR_STALE_SNAPSHOT,
+                    "<%s> is added after snapshot is saved: <%s>",
+                    (const gchar *)new_input, path);
+        fresh = FALSE;
+    }
+    g_hash_table_unref(current_inputs);
+
+    return fresh;
+}
+
+static gboolean
+apply_snapshot (MilterManagerConfiguration *configuration,
+                const gchar *path,
+                GVariant *locations,
+                GVariant *properties,
+                GVariant *eggs,
+                GError **error)
+{
+    GVariantIter iter;
+    const gchar *key, *file, *name;
+    gint line;
+    GVariant *connection_specs, *egg_properties;
+
+    if (!milter_manager_configuration_clear(configuration, error))
+        return FALSE;
+
+    if (!set_snapshot_properties(G_OBJECT(configuration), properties,
+                                 path, error))
+        return FALSE;
+
+    g_variant_iter_init(&iter, locations);
+    while (g_variant_iter_next(&iter, "(&s&si)", &key, &file, &line)) {
+        milter_manager_configuration_set_location(configuration,
+                                                  key, file, line);
+    }
+
+    g_variant_iter_init(&iter, eggs);
+    while (g_variant_iter_next(&iter, "(&s@as@a{sv})",
+                               &name, &connection_specs, &egg_properties)) {
+        MilterManagerEgg *egg;
+        GVariantIter specs_iter;
+        const gchar *connection_spec;
+        gboolean success;
+
+        egg = milter_manager_egg_new(name);
+        success = set_snapshot_properties(G_OBJECT(egg), egg_properties,
+                                          path, error);
+        g_variant_iter_init(&specs_iter, connection_specs);
+        while (success &&
+               g_variant_iter_next(&specs_iter, "&s", &connection_spec)) {
+            GError *local_error = NULL;
+
+            success = milter_manager_egg_add_connection_spec(egg,
+                                                             connection_spec,
+                                                             &local_error);
+            if (!success) {
+                g_set_error(error,
+                            MILTER_MANAGER_CONFIGURATION_ERROR,
+                            MILTER_MANAGER_CONFIGURATION_ERROR_INVALID_SNAPSHOT,
+                            "invalid connection spec in snapshot: "
+                            "<%s>: <%s>: %s",
+                            path, name, local_error->message);
+                g_error_free(local_error);
+            }
+        }
+        g_variant_unref(connection_specs);
+        g_variant_unref(egg_properties);
+        if (success)
+            milter_manager_configuration_add_egg(configuration, egg);
+        g_object_unref(egg);
+        if (!success)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+gboolean
+milter_manager_configuration_load_snapshot (MilterManagerConfiguration *configuration,
+                                            const gchar *path,
+                                            GError **error)
+{
+    gchar *content;
+    gsize length;
+    gpointer data;
+    gsize size;
+    GVariant *snapshot;
+    guint32 format_version;
+    const gchar *version;
+    GVariant *inputs, *locations, *properties, *eggs;
+    gboolean success = FALSE;
+    GError *local_error = NULL;
+
+    if (!g_file_get_contents(path, &content, &length, &local_error)) {
+        g_set_error(error,
+                    MILTER_MANAGER_CONFIGURATION_ERROR,
+                    g_error_matches(local_error,
+                                    G_FILE_ERROR, G_FILE_ERROR_NOENT) ?
+                      MILTER_MANAGER_CONFIGURATION_ERROR_NOT_EXIST :
+                      MILTER_MANAGER_CONFIGURATION_ERROR_INVALID_SNAPSHOT,
+                    "failed to read snapshot: <%s>: %s",
+                    path, local_error->message);
+        g_error_free(local_error);
+        return FALSE;
+    }
+
+    if (length < SNAPSHOT_MAGIC_SIZE ||
+        memcmp(content, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) != 0) {
+        g_set_error(error,
+                    MILTER_MANAGER_CONFIGURATION_ERROR,
+                    MILTER_MANAGER_CONFIGURATION_ERROR_INVALID_SNAPSHOT,
+                    "not configuration snapshot: <%s>", path);
+        g_free(content);
+        return FALSE;
+    }
+
+    size = length - SNAPSHOT_MAGIC_SIZE;
+    data = g_memdup(content + SNAPSHOT_MAGIC_SIZE, size);
+    g_free(content);
+    snapshot = g_variant_new_from_data(G_VARIANT_TYPE(SNAPSHOT_TYPE),
+                                       data, size, FALSE,
+                                       g_free, data);
+    g_variant_ref_sink(snapshot);
+    if (!g_variant_is_normal_form(snapshot)) {
+        g_set_error(error,
+                    MILTER_MANAGER_CONFIGURATION_ERROR,
+                    MILTER_MANAGER_CONFIGURATION_ERROR_INVALID_SNAPSHOT,
+                    "broken configuration snapshot: <%s>", path);
+        g_variant_unref(snapshot);
+        return FALSE;
+    }
+
+    g_variant_get(snapshot, "(u&s@a(sxxxt)@a(ssi)@a{sv}@a(sasa{sv}))",
+                  &format_version, &version,
+                  &inputs, &locations, &properties, &eggs);
+    if (format_version != SNAPSHOT_FORMAT_VERSION) {
+        g_set_error(error,
+                    MILTER_MANAGER_CONFIGURATION_ERROR,
+                    MILTER_MANAGER_CONFIGURATION_ERROR_STALE_SNAPSHOT,
+                    "snapshot format version is different: <%s>: <%u>: "
+                    "expected: <%u>",
+                    path, format_version, SNAPSHOT_FORMAT_VERSION);
+    } else if (!g_str_equal(version, VERSION)) {
+        g_set_error(error,
+                    MILTER_MANAGER_CONFIGURATION_ERROR,
+                    MILTER_MANAGER_CONFIGURATION_ERROR_STALE_SNAPSHOT,
+                    "snapshot is saved by different milter manager: "
+                    "<%s>: <%s>: expected: <%s>",
+                    path, version, VERSION);
+    } else if (check_snapshot_inputs(configuration, path, inputs, error)) {
+        success = apply_snapshot(configuration, path,
+                                 locations, properties, eggs,
+                                 error);
+    }
+    g_variant_unref(inputs);
+    g_variant_unref(locations);
+    g_variant_unref(properties);
+    g_variant_unref(eggs);
+    g_variant_unref(snapshot);
+
+    if (success)
+        milter_debug("[configuration][snapshot][load] <%s>", path);
+
+    return success;
+}
+
 /*
 vi:ts=4:nowrap:ai:expandtab:sw=4
 */
@@ -25,6 +25,7 @@
 #include <milter/manager/milter-manager-objects.h>
 #include <milter/manager/milter-manager-child.h>
 #include <milter/manager/milter-manager-egg.h>
+#include <milter/manager/milter-manager-shared-cache.h>
 
 G_BEGIN_DECLS
 
@@ -42,7 +43,10 @@ typedef enum
     MILTER_MANAGER_CONFIGURATION_ERROR_NOT_IMPLEMENTED,
     MILTER_MANAGER_CONFIGURATION_ERROR_NOT_EXIST,
     MILTER_MANAGER_CONFIGURATION_ERROR_UNKNOWN,
-    MILTER_MANAGER_CONFIGURATION_ERROR_SAVE
+    MILTER_MANAGER_CONFIGURATION_ERROR_SAVE,
+    MILTER_MANAGER_CONFIGURATION_ERROR_SNAPSHOT_UNAVAILABLE,
+    MILTER_MANAGER_CONFIGURATION_ERROR_INVALID_SNAPSHOT,
+    MILTER_MANAGER_CONFIGURATION_ERROR_STALE_SNAPSHOT
 } MilterManagerConfigurationError;
 
 typedef struct _MilterManagerConfigurationClass MilterManagerConfigurationClass;
@@ -77,6 +81,8 @@ struct _MilterManagerConfigurationClass
     gboolean     (*clear)         (MilterManagerConfiguration *configuration,
                                    GError                    **error);
     GPid         (*fork)          (MilterManagerConfiguration *configuration);
+    gboolean     (*is_snapshot_available)
+                                  (MilterManagerConfiguration *configuration);
 };
 
 GQuark        milter_manager_configuration_error_quark (void);
@@ -396,6 +402,124 @@ void          milter_manager_configuration_set_max_pending_finished_sessions
                                      (MilterManagerConfiguration *configuration,
                                       guint                       n_sessions);
 
+guint         milter_manager_configuration_get_shared_cache_size
+                                     (MilterManagerConfiguration *configuration);
+void          milter_manager_configuration_set_shared_cache_size
+                                     (MilterManagerConfiguration *configuration,
+                                      guint                       n_entries);
+
+/**
+ * milter_manager_configuration_get_shared_cache:
+ * @configuration: a %MilterManagerConfiguration.
+ *
+ * Returns: the cache shared by worker processes or %NULL
+ * if it isn't created yet or it's disabled.
+ *
+ * Since: 2.1.6
+ */
+MilterManagerSharedCache *
+              milter_manager_configuration_get_shared_cache
+                                     (MilterManagerConfiguration *configuration);
+
+/**
+ * milter_manager_configuration_create_shared_cache:
+ * @configuration: a %MilterManagerConfiguration.
+ * @error: return location for an error, or %NULL.
+ *
+ * Creates the cache shared by worker processes with
+ * "shared-cache-size" entries. It must be called before
+ * worker processes are forked. The created cache is kept
+ * across reloading. It does nothing if the cache is
+ * already created or "shared-cache-size" is 0.
+ *
+ * Returns: %TRUE on success.
+ *
+ * Since: 2.1.6
+ */
+gboolean      milter_manager_configuration_create_shared_cache
+                                     (MilterManagerConfiguration *configuration,
+                                      GError                    **error);
+
+const gchar  *milter_manager_configuration_get_snapshot_path
+                                     (MilterManagerConfiguration *configuration);
+
+/**
+ * milter_manager_configuration_set_snapshot_path:
+ * @configuration: a %MilterManagerConfiguration.
+ * @path: the path of configuration snapshot or %NULL.
+ *
+ * Sets the path of configuration snapshot. If it is set,
+ * milter_manager_configuration_reload() loads configuration
+ * from the snapshot when no configuration file is changed
+ * after the snapshot is saved. Otherwise, it loads
+ * configuration files and saves a new snapshot. The path
+ * isn't cleared by milter_manager_configuration_clear().
+ *
+ * Since: 2.1.6
+ */
+void          milter_manager_configuration_set_snapshot_path
+                                     (MilterManagerConfiguration *configuration,
+                                      const gchar                *path);
+
+/**
+ * milter_manager_configuration_is_snapshot_available:
+ * @configuration: a %MilterManagerConfiguration.
+ *
+ * Returns whether the current configuration can be saved
+ * as a snapshot. Configurations that use codes such as
+ * applicable conditions and hooks aren't available because
+ * a snapshot only has values.
+ *
+ * Returns: %TRUE if the current configuration can be saved
+ *          as a snapshot.
+ *
+ * Since: 2.1.6
+ */
+gboolean      milter_manager_configuration_is_snapshot_available
+                                     (MilterManagerConfiguration *configuration);
+
+/**
+ * milter_manager_configuration_save_snapshot:
+ * @configuration: a %MilterManagerConfiguration.
+ * @path: the path to save snapshot.
+ * @error: return location for an error, or %NULL.
+ *
+ * Saves values of the current configuration, milters and
+ * modification times, sizes and inodes of configuration files
+ * to @path.
+ *
+ * Returns: %TRUE on success.
+ *
+ * Since: 2.1.6
+ */
+gboolean      milter_manager_configuration_save_snapshot
+                                     (MilterManagerConfiguration *configuration,
+                                      const gchar                *path,
+                                      GError                    **error);
+
+/**
+ * milter_manager_configuration_load_snapshot:
+ * @configuration: a %MilterManagerConfiguration.
+ * @path: the path of snapshot.
+ * @error: return location for an error, or %NULL.
+ *
+ * Replaces the current configuration with the snapshot
+ * saved by milter_manager_configuration_save_snapshot().
+ * It fails with
+ * %MILTER_MANAGER_CONFIGURATION_ERROR_STALE_SNAPSHOT
+ * without changing the current configuration if any
+ * configuration file is changed after the snapshot is
+ * saved.
+ *
+ * Returns: %TRUE on success.
+ *
+ * Since: 2.1.6
+ */
+gboolean      milter_manager_configuration_load_snapshot
+                                     (MilterManagerConfiguration *configuration,
+                                      const gchar                *path,
+                                      GError                    **error);
+
 G_END_DECLS
 
 #endif /* __MILTER_MANAGER_CONFIGURATION_H__ */
@@ -22,6 +22,7 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <string.h>
+#include <unistd.h>
 
 #include "milter-manager-controller-context.h"
 #include "milter-manager-enum-types.h"
@@ -211,10 +212,116 @@ cb_decoder_reload (MilterManagerControlCommandDecoder *decoder,
     }
 }
 
+static void
+collect_egg_latencies (MilterManagerEgg *egg, GPid pid, GString *status)
+{
+    MilterServerContextState state;
+
+    for (state = MILTER_SERVER_CONTEXT_STATE_START;
+         state <= MILTER_SERVER_CONTEXT_STATE_END_OF_MESSAGE;
+         state++) {
+        MilterManagerEggLatencySummary summary;
+
+        if (!milter_manager_egg_get_latency_summary(egg, pid, state, &summary))
+            continue;
+        if (summary.count == 0)
+            continue;
+        g_string_append_printf(status,
+                               "latency: %s: %s: %d: "
+                               "count=%" G_GUINT64_FORMAT " "
+                               "mean=%g p50=%g p90=%g p99=%g max=%g\n",
+                               milter_manager_egg_get_name(egg),
+                               milter_manager_egg_latency_stage_name(state),
+                               pid == 0 ? (gint)getpid() : (gint)pid,
+                               summary.count,
+                               summary.mean,
+                               summary.p50,
+                               summary.p90,
+                               summary.p99,
+                               summary.max);
+    }
+}
+
+static void
+collect_egg_circuit (MilterManagerEgg *egg, GPid pid, GString *status)
+{
+    MilterManagerEggCircuitSummary summary;
+    gchar *state_name;
+
+    if (milter_manager_egg_get_circuit_breaker_threshold(egg) <= 0)
+        return;
+    if (!milter_manager_egg_get_circuit_summary(egg, pid, &summary))
+        return;
+
+    state_name =
+        milter_utils_get_enum_nick_name(MILTER_TYPE_MANAGER_EGG_CIRCUIT_STATE,
+                                        summary.state);
+    g_string_append_printf(status,
+                           "circuit-breaker: %s: %d: "
+                           "state=%s successes=%u failures=%u\n",
+                           milter_manager_egg_get_name(egg),
+                           pid == 0 ? (gint)getpid() : (gint)pid,
+                           state_name,
+                           summary.n_successes,
+                           summary.n_failures);
+    g_free(state_name);
+}
+
+static void
+collect_egg_sessions (MilterManagerEgg *egg, GPid pid, GString *status)
+{
+    MilterManagerEggSessionSummary summary;
+
+    if (milter_manager_egg_get_max_concurrent_sessions(egg) == 0)
+        return;
+    if (!milter_manager_egg_get_session_summary(egg, pid, &summary))
+        return;
+
+    g_string_append_printf(status,
+                           "sessions: %s: %d: "
+                           "active=%u queued=%u shed=%u\n",
+                           milter_manager_egg_get_name(egg),
+                           pid == 0 ? (gint)getpid() : (gint)pid,
+                           summary.n_active_sessions,
+                           summary.n_queued_sessions,
+                           summary.n_shed_sessions);
+}
+
+static void
+collect_egg_status (MilterManagerEgg *egg, GPid pid, GString *status)
+{
+    collect_egg_latencies(egg, pid, status);
+    collect_egg_circuit(egg, pid, status);
+    collect_egg_sessions(egg, pid, status);
+}
+
 static void
 collect_status (MilterManagerControllerContext *context, GString *status)
 {
-    g_string_append(status, "FIXME");
+    MilterManagerControllerContextPrivate *priv;
+    MilterManagerConfiguration *config;
+    GArray *worker_pids;
+    const GList *node;
+
+    priv = MILTER_MANAGER_CONTROLLER_CONTEXT_GET_PRIVATE(context);
+    config = milter_manager_get_configuration(priv->manager);
+    worker_pids = milter_client_get_worker_pids(MILTER_CLIENT(priv->manager));
+    for (node = milter_manager_configuration_get_eggs(config);
+         node;
+         node = g_list_next(node)) {
+        MilterManagerEgg *egg = node->data;
+
+        collect_egg_status(egg, 0, status);
+        if (worker_pids) {
+            guint i;
+
+            for (i = 0; i < worker_pids->len; i++) {
+                collect_egg_status(egg,
+                                   g_array_index(worker_pids, GPid, i),
+                                   status);
+            }
+        }
+    }
 }
 
 static void
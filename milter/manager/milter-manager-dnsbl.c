@@ -0,0 +1,1384 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "../../config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "milter-manager-dnsbl.h"
+
+#define RESOLV_CONF_PATH "/etc/resolv.conf"
+
+#define DNS_HEADER_SIZE 12
+#define DNS_MAX_PACKET_SIZE 512
+#define DNS_FLAG_RESPONSE 0x8000
+#define DNS_FLAG_RECURSION_DESIRED 0x0100
+#define DNS_RCODE_MASK 0x000f
+#define DNS_RCODE_NO_ERROR 0
+#define DNS_RCODE_NAME_ERROR 3
+#define DNS_TYPE_A 1
+#define DNS_TYPE_SOA 6
+#define DNS_CLASS_IN 1
+
+#define MAX_CACHE_ENTRIES 65536
+#define SHARED_CACHE_KEY_PREFIX "dnsbl:"
+
+#define MILTER_MANAGER_DNSBL_GET_PRIVATE(obj)                   \
+    (G_TYPE_INSTANCE_GET_PRIVATE((obj),                         \
+                                 MILTER_TYPE_MANAGER_DNSBL,     \
+                                 MilterManagerDNSBLPrivate))
+
+typedef struct _MilterManagerDNSBLPrivate MilterManagerDNSBLPrivate;
+struct _MilterManagerDNSBLPrivate
+{
+    MilterEventLoop *loop;
+    GList *services;
+    GList *name_servers;
+    gboolean default_name_servers_loaded;
+    gdouble timeout;
+    guint n_retries;
+    guint negative_cache_ttl;
+    guint max_cache_ttl;
+    GHashTable *cache;
+    MilterManagerSharedCache *shared_cache;
+    GHashTable *queries;
+};
+
+typedef struct _Service Service;
+struct _Service
+{
+    gchar *zone;
+    gboolean match_any;
+    guint32 network;
+    guint32 mask;
+};
+
+typedef struct _NameServer NameServer;
+struct _NameServer
+{
+    gchar *spec;
+    struct sockaddr *address;
+    socklen_t address_length;
+};
+
+typedef struct _CacheEntry CacheEntry;
+struct _CacheEntry
+{
+    gboolean listed;
+    gdouble expire_time;
+};
+
+typedef struct _Lookup Lookup;
+struct _Lookup
+{
+    MilterManagerDNSBL *dnsbl;
+    guint n_pending;
+    gboolean done;
+    MilterManagerDNSBLCheckFunc callback;
+    gpointer user_data;
+    GDestroyNotify notify;
+};
+
+typedef struct _Query Query;
+struct _Query
+{
+    MilterManagerDNSBL *dnsbl;
+    gchar *name;
+    Service *service;
+    GList *lookups;
+    guint16 id;
+    guchar packet[DNS_MAX_PACKET_SIZE];
+    gsize packet_size;
+    gint domain;
+    GIOChannel *channel;
+    guint watch_id;
+    guint timeout_id;
+    guint n_sent;
+};
+
+enum
+{
+    PROP_0,
+    PROP_EVENT_LOOP
+};
+
+G_DEFINE_TYPE(MilterManagerDNSBL, milter_manager_dnsbl, G_TYPE_OBJECT)
+
+static void dispose        (GObject         *object);
+static void set_property   (GObject         *object,
+                            guint            prop_id,
+                            const GValue    *value,
+                            GParamSpec      *pspec);
+static void get_property   (GObject         *object,
+                            guint            prop_id,
+                            GValue          *value,
+                            GParamSpec      *pspec);
+
+static void query_free     (Query           *query);
+
+static void
+milter_manager_dnsbl_class_init (MilterManagerDNSBLClass *klass)
+{
+    GObjectClass *gobject_class;
+    GParamSpec *spec;
+
+    gobject_class = G_OBJECT_CLASS(klass);
+
+    gobject_class->dispose      = dispose;
+    gobject_class->set_property = set_property;
+    gobject_class->get_property = get_property;
+
+    spec = g_param_spec_object("event-loop",
+                               "Event Loop",
+                               "The event loop of the DNSBL",
+                               MILTER_TYPE_EVENT_LOOP,
+                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+    g_object_class_install_property(gobject_class, PROP_EVENT_LOOP, spec);
+
+    g_type_class_add_private(gobject_class,
+                             sizeof(MilterManagerDNSBLPrivate));
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+    g_slice_free(CacheEntry, entry);
+}
+
+static void
+milter_manager_dnsbl_init (MilterManagerDNSBL *dnsbl)
+{
+    MilterManagerDNSBLPrivate *priv;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl);
+    priv->loop = NULL;
+    priv->services = NULL;
+    priv->name_servers = NULL;
+    priv->default_name_servers_loaded = FALSE;
+    priv->timeout = MILTER_MANAGER_DNSBL_DEFAULT_TIMEOUT;
+    priv->n_retries = MILTER_MANAGER_DNSBL_DEFAULT_N_RETRIES;
+    priv->negative_cache_ttl = MILTER_MANAGER_DNSBL_DEFAULT_NEGATIVE_CACHE_TTL;
+    priv->max_cache_ttl = MILTER_MANAGER_DNSBL_DEFAULT_MAX_CACHE_TTL;
+    priv->cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                        g_free,
+                                        (GDestroyNotify)cache_entry_free);
+    priv->shared_cache = NULL;
+    priv->queries = g_hash_table_new(g_str_hash, g_str_equal);
+}
+
+static Service *
+service_new (const gchar *zone)
+{
+    Service *service;
+
+    service = g_slice_new0(Service);
+    service->zone = g_strdup(zone);
+    service->match_any = TRUE;
+
+    return service;
+}
+
+static Service *
+service_copy (Service *service)
+{
+    Service *copied_service;
+
+    copied_service = service_new(service->zone);
+    copied_service->match_any = service->match_any;
+    copied_service->network = service->network;
+    copied_service->mask = service->mask;
+
+    return copied_service;
+}
+
+static void
+service_free (Service *service)
+{
+    g_free(service->zone);
+    g_slice_free(Service, service);
+}
+
+static gboolean
+service_match (Service *service, guint32 answer)
+{
+    if (service->match_any)
+        return TRUE;
+
+    return (answer & service->mask) == service->network;
+}
+
+static void
+name_server_free (NameServer *name_server)
+{
+    g_free(name_server->spec);
+    g_free(name_server->address);
+    g_slice_free(NameServer, name_server);
+}
+
+static void
+dispose_queries (MilterManagerDNSBLPrivate *priv)
+{
+    GList *queries, *node;
+
+    queries = g_hash_table_get_values(priv->queries);
+    g_hash_table_remove_all(priv->queries);
+    for (node = queries; node; node = g_list_next(node)) {
+        query_free(node->data);
+    }
+    g_list_free(queries);
+}
+
+static void
+dispose (GObject *object)
+{
+    MilterManagerDNSBLPrivate *priv;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(object);
+
+    if (priv->queries) {
+        dispose_queries(priv);
+        g_hash_table_unref(priv->queries);
+        priv->queries = NULL;
+    }
+
+    if (priv->cache) {
+        g_hash_table_unref(priv->cache);
+        priv->cache = NULL;
+    }
+
+    if (priv->shared_cache) {
+        g_object_unref(priv->shared_cache);
+        priv->shared_cache = NULL;
+    }
+
+    if (priv->services) {
+        g_list_foreach(priv->services, (GFunc)service_free, NULL);
+        g_list_free(priv->services);
+        priv->services = NULL;
+    }
+
+    if (priv->name_servers) {
+        g_list_foreach(priv->name_servers, (GFunc)name_server_free, NULL);
+        g_list_free(priv->name_servers);
+        priv->name_servers = NULL;
+    }
+
+    if (priv->loop) {
+        g_object_unref(priv->loop);
+        priv->loop = NULL;
+    }
+
+    G_OBJECT_CLASS(milter_manager_dnsbl_parent_class)->dispose(object);
+}
+
+static void
+set_property (GObject      *object,
+              guint         prop_id,
+              const GValue *value,
+              GParamSpec   *pspec)
+{
+    MilterManagerDNSBLPrivate *priv;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(object);
+    switch (prop_id) {
+    case PROP_EVENT_LOOP:
+        if (priv->loop)
+            g_object_unref(priv->loop);
+        priv->loop = g_value_dup_object(value);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+static void
+get_property (GObject    *object,
+              guint       prop_id,
+              GValue     *value,
+              GParamSpec *pspec)
+{
+    MilterManagerDNSBLPrivate *priv;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(object);
+    switch (prop_id) {
+    case PROP_EVENT_LOOP:
+        g_value_set_object(value, priv->loop);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+GQuark
+milter_manager_dnsbl_error_quark (void)
+{
+    return g_quark_from_static_string("milter-manager-dnsbl-error-quark");
+}
+
+MilterManagerDNSBL *
+milter_manager_dnsbl_new (MilterEventLoop *loop)
+{
+    return g_object_new(MILTER_TYPE_MANAGER_DNSBL,
+                        "event-loop", loop,
+                        NULL);
+}
+
+static gboolean
+parse_expected_answer (Service *service, const gchar *expected_answer,
+                       GError **error)
+{
+    gchar **components;
+    struct in_addr address;
+    guint prefix_length = 32;
+    gboolean success = TRUE;
+
+    components = g_strsplit(expected_answer, "/", 2);
+    if (inet_pton(AF_INET, components[0], &address) != 1) {
+        success = FALSE;
+    } else if (components[1]) {
+        gchar *end = NULL;
+        guint64 parsed_length;
+
+        parsed_length = g_ascii_strtoull(components[1], &end, 10);
+        if (end == components[1] || *end != '\0' || parsed_length > 32)
+            success = FALSE;
+        else
+            prefix_length = parsed_length;
+    }
+    g_strfreev(components);
+
+    if (!success) {
+        g_set_error(error,
+                    MILTER_MANAGER_DNSBL_ERROR,
+                    MILTER_MANAGER_DNSBL_ERROR_INVALID_EXPECTED_ANSWER,
+                    "expected answer should be IPv4 address or network: <%s>",
+                    expected_answer);
+        return FALSE;
+    }
+
+    service->match_any = FALSE;
+    if (prefix_length == 0)
+        service->mask = 0;
+    else
+        service->mask = 0xffffffff << (32 - prefix_length);
+    service->network = ntohl(address.s_addr) & service->mask;
+
+    return TRUE;
+}
+
+gboolean
+milter_manager_dnsbl_add_service (MilterManagerDNSBL *dnsbl,
+                                  const gchar *zone,
+                                  const gchar *expected_answer,
+                                  GError **error)
+{
+    MilterManagerDNSBLPrivate *priv;
+    Service *service;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl);
+
+    service = service_new(zone);
+    if (expected_answer &&
+        !parse_expected_answer(service, expected_answer, error)) {
+        service_free(service);
+        return FALSE;
+    }
+
+    priv->services = g_list_append(priv->services, service);
+    return TRUE;
+}
+
+void
+milter_manager_dnsbl_clear_services (MilterManagerDNSBL *dnsbl)
+{
+    MilterManagerDNSBLPrivate *priv;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl);
+    g_list_foreach(priv->services, (GFunc)service_free, NULL);
+    g_list_free(priv->services);
+    priv->services = NULL;
+}
+
+static NameServer *
+name_server_new (const gchar *spec, GError **error)
+{
+    NameServer *name_server;
+    struct sockaddr *address = NULL;
+    socklen_t address_length = 0;
+    gint domain;
+    struct in_addr address_inet;
+    struct in6_addr address_inet6;
+
+    if (inet_pton(AF_INET, spec, &address_inet) == 1) {
+        struct sockaddr_in *address_in;
+
+        address_in = g_new0(struct sockaddr_in, 1);
+        address_in->sin_family = AF_INET;
+        address_in->sin_port = htons(53);
+        address_in->sin_addr = address_inet;
+        address = (struct sockaddr *)address_in;
+        address_length = sizeof(*address_in);
+    } else if (inet_pton(AF_INET6, spec, &address_inet6) == 1) {
+        struct sockaddr_in6 *address_in6;
+
+        address_in6 = g_new0(struct sockaddr_in6, 1);
+        address_in6->sin6_family = AF_INET6;
+        address_in6->sin6_port = htons(53);
+        address_in6->sin6_addr = address_inet6;
+        address = (struct sockaddr *)address_in6;
+        address_length = sizeof(*address_in6);
+    } else {
+        GError *parse_error = NULL;
+
+        if (!milter_connection_parse_spec(spec, &domain,
+                                          &address, &address_length,
+                                          &parse_error)) {
+            milter_utils_set_error_with_sub_error(
+                error,
+                MILTER_MANAGER_DNSBL_ERROR,
+                MILTER_MANAGER_DNSBL_ERROR_INVALID_NAME_SERVER,
+                parse_error,
+                "invalid name server: <%s>", spec);
+            return NULL;
+        }
+        if (domain != AF_INET && domain != AF_INET6) {
+            g_free(address);
+            g_set_error(error,
+                        MILTER_MANAGER_DNSBL_ERROR,
+                        MILTER_MANAGER_DNSBL_ERROR_INVALID_NAME_SERVER,
+                        "name server should be IPv4 or IPv6 address: <%s>",
+                        spec);
+            return NULL;
+        }
+    }
+
+    name_server = g_slice_new0(NameServer);
+    name_server->spec = g_strdup(spec);
+    name_server->address = address;
+    name_server->address_length = address_length;
+
+    return name_server;
+}
+
+gboolean
+milter_manager_dnsbl_add_name_server (MilterManagerDNSBL *dnsbl,
+                                      const gchar *spec,
+                                      GError **error)
+{
+    MilterManagerDNSBLPrivate *priv;
+    NameServer *name_server;
+
+    name_server = name_server_new(spec, error);
+    if (!name_server)
+        return FALSE;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl);
+    priv->name_servers = g_list_append(priv->name_servers, name_server);
+    return TRUE;
+}
+
+void
+milter_manager_dnsbl_clear_name_servers (MilterManagerDNSBL *dnsbl)
+{
+    MilterManagerDNSBLPrivate *priv;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl);
+    g_list_foreach(priv->name_servers, (GFunc)name_server_free, NULL);
+    g_list_free(priv->name_servers);
+    priv->name_servers = NULL;
+    priv->default_name_servers_loaded = FALSE;
+}
+
+static void
+load_default_name_servers (MilterManagerDNSBL *dnsbl)
+{
+    MilterManagerDNSBLPrivate *priv;
+    gchar *content = NULL;
+    gchar **lines, **line;
+    GError *error = NULL;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl);
+    if (priv->name_servers || priv->default_name_servers_loaded)
+        return;
+    priv->default_name_servers_loaded = TRUE;
+
+    if (!g_file_get_contents(RESOLV_CONF_PATH, &content, NULL, &error)) {
+        milter_debug("[dnsbl][name-server][load][error] %s", error->message);
+        g_error_free(error);
+        content = NULL;
+    }
+
+    if (content) {
+        lines = g_strsplit(content, "\n", -1);
+        for (line = lines; *line; line++) {
+            gchar **fields;
+
+            fields = g_strsplit_set(g_strstrip(*line), " \t", -1);
+            if (fields[0] && g_str_equal(fields[0], "nameserver")) {
+                gchar **field;
+
+                for (field = fields + 1; *field; field++) {
+                    if ((*field)[0] == '\0')
+                        continue;
+                    if (!milter_manager_dnsbl_add_name_server(dnsbl, *field,
+                                                              &error)) {
+                        milter_debug("[dnsbl][name-server][load][error] %s",
+                                     error->message);
+                        g_clear_error(&error);
+                    }
+                    break;
+                }
+            }
+            g_strfreev(fields);
+        }
+        g_strfreev(lines);
+        g_free(content);
+    }
+
+    if (!priv->name_servers)
+        milter_manager_dnsbl_add_name_server(dnsbl, "127.0.0.1", NULL);
+}
+
+void
+milter_manager_dnsbl_set_timeout (MilterManagerDNSBL *dnsbl, gdouble timeout)
+{
+    MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl)->timeout = timeout;
+}
+
+gdouble
+milter_manager_dnsbl_get_timeout (MilterManagerDNSBL *dnsbl)
+{
+    return MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl)->timeout;
+}
+
+void
+milter_manager_dnsbl_set_n_retries (MilterManagerDNSBL *dnsbl, guint n_retries)
+{
+    MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl)->n_retries = n_retries;
+}
+
+guint
+milter_manager_dnsbl_get_n_retries (MilterManagerDNSBL *dnsbl)
+{
+    return MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl)->n_retries;
+}
+
+void
+milter_manager_dnsbl_set_negative_cache_ttl (MilterManagerDNSBL *dnsbl,
+                                             guint ttl)
+{
+    MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl)->negative_cache_ttl = ttl;
+}
+
+guint
+milter_manager_dnsbl_get_negative_cache_ttl (MilterManagerDNSBL *dnsbl)
+{
+    return MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl)->negative_cache_ttl;
+}
+
+void
+milter_manager_dnsbl_set_max_cache_ttl (MilterManagerDNSBL *dnsbl, guint ttl)
+{
+    MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl)->max_cache_ttl = ttl;
+}
+
+guint
+milter_manager_dnsbl_get_max_cache_ttl (MilterManagerDNSBL *dnsbl)
+{
+    return MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl)->max_cache_ttl;
+}
+
+void
+milter_manager_dnsbl_set_shared_cache (MilterManagerDNSBL *dnsbl,
+                                       MilterManagerSharedCache *cache)
+{
+    MilterManagerDNSBLPrivate *priv;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl);
+    if (priv->shared_cache == cache)
+        return;
+
+    if (priv->shared_cache)
+        g_object_unref(priv->shared_cache);
+    priv->shared_cache = cache;
+    if (priv->shared_cache)
+        g_object_ref(priv->shared_cache);
+}
+
+MilterManagerSharedCache *
+milter_manager_dnsbl_get_shared_cache (MilterManagerDNSBL *dnsbl)
+{
+    return MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl)->shared_cache;
+}
+
+static gdouble
+current_time (void)
+{
+    GTimeVal time_value;
+
+    g_get_current_time(&time_value);
+    return time_value.tv_sec + time_value.tv_usec / (gdouble)G_USEC_PER_SEC;
+}
+
+static gchar *
+reverse_address (struct sockaddr *address, socklen_t address_length)
+{
+    struct sockaddr_in *address_in;
+    guint8 *bytes;
+
+    if (!address ||
+        address->sa_family != AF_INET ||
+        address_length < sizeof(struct sockaddr_in))
+        return NULL;
+
+    address_in = (struct sockaddr_in *)address;
+    bytes = (guint8 *)&(address_in->sin_addr.s_addr);
+    return g_strdup_printf("%u.%u.%u.%u",
+                           bytes[3], bytes[2], bytes[1], bytes[0]);
+}
+
+static gboolean
+cache_lookup (MilterManagerDNSBLPrivate *priv, const gchar *name,
+              gdouble now, gboolean *listed)
+{
+    CacheEntry *entry;
+
+    entry = g_hash_table_lookup(priv->cache, name);
+    if (entry && entry->expire_time <= now) {
+        g_hash_table_remove(priv->cache, name);
+        entry = NULL;
+    }
+
+    if (entry) {
+        *listed = entry->listed;
+        return TRUE;
+    }
+
+    if (priv->shared_cache) {
+        gchar *key, *value = NULL;
+        gboolean found;
+
+        key = g_strconcat(SHARED_CACHE_KEY_PREFIX, name, NULL);
+        found = milter_manager_shared_cache_get(priv->shared_cache, key,
+                                                &value, NULL);
+        g_free(key);
+        if (found) {
+            *listed = (value[0] == '1');
+            g_free(value);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean
+cb_remove_expired_entry (gpointer key, gpointer value, gpointer user_data)
+{
+    CacheEntry *entry = value;
+    gdouble *now = user_data;
+
+    return entry->expire_time <= *now;
+}
+
+static void
+cache_store (MilterManagerDNSBLPrivate *priv, const gchar *name,
+             gboolean listed, guint32 ttl)
+{
+    CacheEntry *entry;
+    gdouble now;
+
+    if (ttl > priv->max_cache_ttl)
+        ttl = priv->max_cache_ttl;
+    if (ttl == 0)
+        return;
+
+    now = current_time();
+    if (g_hash_table_size(priv->cache) >= MAX_CACHE_ENTRIES) {
+        g_hash_table_foreach_remove(priv->cache, cb_remove_expired_entry, &now);
+        if (g_hash_table_size(priv->cache) >= MAX_CACHE_ENTRIES)
+            g_hash_table_remove_all(priv->cache);
+    }
+
+    entry = g_slice_new(CacheEntry);
+    entry->listed = listed;
+    entry->expire_time = now + ttl;
+    g_hash_table_replace(priv->cache, g_strdup(name), entry);
+
+    if (priv->shared_cache) {
+        gchar *key;
+
+        key = g_strconcat(SHARED_CACHE_KEY_PREFIX, name, NULL);
+        milter_manager_shared_cache_set(priv->shared_cache, key,
+                                        listed ? "1" : "0", 1, ttl);
+        g_free(key);
+    }
+}
+
+static Lookup *
+lookup_new (MilterManagerDNSBL *dnsbl,
+            MilterManagerDNSBLCheckFunc callback,
+            gpointer user_data,
+            GDestroyNotify notify)
+{
+    Lookup *lookup;
+
+    lookup = g_slice_new0(Lookup);
+    lookup->dnsbl = g_object_ref(dnsbl);
+    lookup->n_pending = 0;
+    lookup->done = FALSE;
+    lookup->callback = callback;
+    lookup->user_data = user_data;
+    lookup->notify = notify;
+
+    return lookup;
+}
+
+static void
+lookup_finish (Lookup *lookup, gboolean listed, const gchar *zone)
+{
+    if (lookup->done)
+        return;
+
+    lookup->done = TRUE;
+    if (lookup->callback)
+        lookup->callback(lookup->dnsbl, listed, zone, lookup->user_data);
+    if (lookup->notify)
+        lookup->notify(lookup->user_data);
+    lookup->user_data = NULL;
+}
+
+static void
+lookup_receive (Lookup *lookup, gboolean listed, const gchar *zone)
+{
+    if (listed)
+        lookup_finish(lookup, TRUE, zone);
+
+    lookup->n_pending--;
+    if (lookup->n_pending > 0)
+        return;
+
+    lookup_finish(lookup, FALSE, NULL);
+    g_object_unref(lookup->dnsbl);
+    g_slice_free(Lookup, lookup);
+}
+
+static void
+query_free (Query *query)
+{
+    MilterManagerDNSBLPrivate *priv;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(query->dnsbl);
+    if (query->watch_id > 0 && priv->loop)
+        milter_event_loop_remove(priv->loop, query->watch_id);
+    if (query->timeout_id > 0 && priv->loop)
+        milter_event_loop_remove(priv->loop, query->timeout_id);
+    if (query->channel)
+        g_io_channel_unref(query->channel);
+    g_list_free(query->lookups);
+    service_free(query->service);
+    g_free(query->name);
+    g_slice_free(Query, query);
+}
+
+static void
+query_finish (Query *query, gboolean listed, gboolean cacheable, guint32 ttl)
+{
+    MilterManagerDNSBL *dnsbl;
+    MilterManagerDNSBLPrivate *priv;
+    GList *lookups, *node;
+    gchar *zone;
+
+    dnsbl = g_object_ref(query->dnsbl);
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl);
+
+    milter_debug("[dnsbl][query][finish] <%s>: listed=<%s> ttl=<%u>%s",
+                 query->name,
+                 listed ? "true" : "false",
+                 ttl,
+                 cacheable ? "" : " (not cached)");
+
+    g_hash_table_remove(priv->queries, query->name);
+    if (cacheable)
+        cache_store(priv, query->name, listed, ttl);
+
+    lookups = query->lookups;
+    query->lookups = NULL;
+    zone = g_strdup(query->service->zone);
+    query_free(query);
+
+    for (node = lookups; node; node = g_list_next(node)) {
+        lookup_receive(node->data, listed, zone);
+    }
+    g_list_free(lookups);
+    g_free(zone);
+    g_object_unref(dnsbl);
+}
+
+static gboolean
+encode_query (Query *query)
+{
+    guchar *packet = query->packet;
+    gsize offset;
+    gchar **labels, **label;
+    gboolean success = TRUE;
+
+    memset(packet, 0, DNS_HEADER_SIZE);
+    packet[0] = query->id >> 8;
+    packet[1] = query->id & 0xff;
+    packet[2] = DNS_FLAG_RECURSION_DESIRED >> 8;
+    packet[3] = DNS_FLAG_RECURSION_DESIRED & 0xff;
+    packet[5] = 1;
+    offset = DNS_HEADER_SIZE;
+
+    labels = g_strsplit(query->name, ".", -1);
+    for (label = labels; *label; label++) {
+        gsize length;
+
+        length = strlen(*label);
+        if (length == 0)
+            continue;
+        if (length > 63 || offset + 1 + length + 5 > DNS_MAX_PACKET_SIZE) {
+            success = FALSE;
+            break;
+        }
+        packet[offset++] = length;
+        memcpy(packet + offset, *label, length);
+        offset += length;
+    }
+    g_strfreev(labels);
+    if (!success)
+        return FALSE;
+
+    packet[offset++] = 0;
+    packet[offset++] = 0;
+    packet[offset++] = DNS_TYPE_A;
+    packet[offset++] = 0;
+    packet[offset++] = DNS_CLASS_IN;
+    query->packet_size = offset;
+
+    return TRUE;
+}
+
+#define READ_UINT16(data, offset)                               \
+    (((guint16)(data)[(offset)] << 8) | (data)[(offset) + 1])
+#define READ_UINT32(data, offset)                               \
+    (((guint32)READ_UINT16((data), (offset)) << 16) |           \
+     READ_UINT16((data), (offset) + 2))
+
+static gboolean
+skip_name (const guchar *data, gsize size, gsize *offset)
+{
+    while (*offset < size) {
+        guint8 length = data[*offset];
+
+        if ((length & 0xc0) == 0xc0) {
+            *offset += 2;
+            return *offset <= size;
+        } else if (length == 0) {
+            (*offset)++;
+            return TRUE;
+        } else {
+            *offset += 1 + length;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean
+read_question_name (const guchar *data, gsize size, gsize *offset,
+                    GString *name)
+{
+    while (*offset < size) {
+        guint8 length = data[*offset];
+
+        if (length == 0) {
+            (*offset)++;
+            return TRUE;
+        }
+        if ((length & 0xc0) != 0 || *offset + 1 + length > size)
+            return FALSE;
+        if (name->len > 0)
+            g_string_append_c(name, '.');
+        g_string_append_len(name, (const gchar *)data + *offset + 1, length);
+        *offset += 1 + length;
+    }
+
+    return FALSE;
+}
+
+typedef enum
+{
+    RESPONSE_INVALID,
+    RESPONSE_ANSWERED,
+    RESPONSE_FAILED
+} ResponseType;
+
+static ResponseType
+parse_response (Query *query, const guchar *data, gsize size,
+                gboolean *listed, guint32 *ttl)
+{
+    MilterManagerDNSBLPrivate *priv;
+    guint16 flags, n_questions, n_answers, n_authorities;
+    guint rcode;
+    gsize offset;
+    GString *question_name;
+    gboolean same_question;
+    gboolean have_address = FALSE;
+    guint32 address_ttl = G_MAXUINT32;
+    guint32 negative_ttl;
+    guint i;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(query->dnsbl);
+
+    if (size < DNS_HEADER_SIZE)
+        return RESPONSE_INVALID;
+    if (READ_UINT16(data, 0) != query->id)
+        return RESPONSE_INVALID;
+    flags = READ_UINT16(data, 2);
+    if (!(flags & DNS_FLAG_RESPONSE))
+        return RESPONSE_INVALID;
+    n_questions = READ_UINT16(data, 4);
+    n_answers = READ_UINT16(data, 6);
+    n_authorities = READ_UINT16(data, 8);
+    if (n_questions != 1)
+        return RESPONSE_INVALID;
+
+    offset = DNS_HEADER_SIZE;
+    question_name = g_string_new(NULL);
+    same_question = read_question_name(data, size, &offset, question_name) &&
+        g_ascii_strcasecmp(question_name->str, query->name) == 0;
+    g_string_free(question_name, TRUE);
+    if (!same_question)
+        return RESPONSE_INVALID;
+    offset += 4;
+    if (offset > size)
+        return RESPONSE_INVALID;
+
+    rcode = flags & DNS_RCODE_MASK;
+    if (rcode != DNS_RCODE_NO_ERROR && rcode != DNS_RCODE_NAME_ERROR)
+        return RESPONSE_FAILED;
+
+    *listed = FALSE;
+    for (i = 0; i < n_answers; i++) {
+        guint16 type, klass, data_length;
+        guint32 record_ttl;
+
+        if (!skip_name(data, size, &offset) || offset + 10 > size)
+            return RESPONSE_INVALID;
+        type = READ_UINT16(data, offset);
+        klass = READ_UINT16(data, offset + 2);
+        record_ttl = READ_UINT32(data, offset + 4);
+        data_length = READ_UINT16(data, offset + 8);
+        offset += 10;
+        if (offset + data_length > size)
+            return RESPONSE_INVALID;
+
+        if (type == DNS_TYPE_A && klass == DNS_CLASS_IN && data_length == 4) {
+            have_address = TRUE;
+            address_ttl = MIN(address_ttl, record_ttl);
+            if (service_match(query->service, READ_UINT32(data, offset)))
+                *listed = TRUE;
+        }
+        offset += data_length;
+    }
+
+    if (have_address) {
+        *ttl = address_ttl;
+        return RESPONSE_ANSWERED;
+    }
+
+    negative_ttl = priv->negative_cache_ttl;
+    for (i = 0; i < n_authorities; i++) {
+        guint16 type, data_length;
+        guint32 record_ttl;
+        gsize data_offset;
+
+        if (!skip_name(data, size, &offset) || offset + 10 > size)
+            break;
+        type = READ_UINT16(data, offset);
+        record_ttl = READ_UINT32(data, offset + 4);
+        data_length = READ_UINT16(data, offset + 8);
+        offset += 10;
+        if (offset + data_length > size)
+            break;
+
+        data_offset = offset;
+        if (type == DNS_TYPE_SOA &&
+            skip_name(data, offset + data_length, &data_offset) &&
+            skip_name(data, offset + data_length, &data_offset) &&
+            data_offset + 20 <= offset + data_length) {
+            guint32 minimum;
+
+            minimum = READ_UINT32(data, data_offset + 16);
+            negative_ttl = MIN(negative_ttl, MIN(record_ttl, minimum));
+            break;
+        }
+        offset += data_length;
+    }
+    *ttl = negative_ttl;
+
+    return RESPONSE_ANSWERED;
+}
+
+static NameServer *
+query_get_name_server (Query *query)
+{
+    MilterManagerDNSBLPrivate *priv;
+    guint n_name_servers;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(query->dnsbl);
+    n_name_servers = g_list_length(priv->name_servers);
+    if (n_name_servers == 0)
+        return NULL;
+    return g_list_nth_data(priv->name_servers,
+                           (query->n_sent - 1) % n_name_servers);
+}
+
+static gboolean cb_query_readable (GIOChannel *channel,
+                                   GIOCondition condition,
+                                   gpointer data);
+
+static gboolean
+query_open_socket (Query *query, gint domain)
+{
+    MilterManagerDNSBLPrivate *priv;
+    gint fd;
+
+    if (query->channel && query->domain == domain)
+        return TRUE;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(query->dnsbl);
+    if (query->watch_id > 0) {
+        milter_event_loop_remove(priv->loop, query->watch_id);
+        query->watch_id = 0;
+    }
+    if (query->channel) {
+        g_io_channel_unref(query->channel);
+        query->channel = NULL;
+    }
+
+    fd = socket(domain, SOCK_DGRAM, 0);
+    if (fd == -1) {
+        milter_error("[dnsbl][query][socket][error] <%s>: %s",
+                     query->name, g_strerror(errno));
+        return FALSE;
+    }
+
+    query->domain = domain;
+    query->channel = g_io_channel_unix_new(fd);
+    g_io_channel_set_close_on_unref(query->channel, TRUE);
+    g_io_channel_set_encoding(query->channel, NULL, NULL);
+    g_io_channel_set_flags(query->channel, G_IO_FLAG_NONBLOCK, NULL);
+    query->watch_id = milter_event_loop_watch_io(priv->loop,
+                                                 query->channel,
+                                                 G_IO_IN | G_IO_PRI |
+                                                 G_IO_ERR | G_IO_HUP |
+                                                 G_IO_NVAL,
+                                                 cb_query_readable,
+                                                 query);
+
+    return TRUE;
+}
+
+static gboolean
+query_send (Query *query)
+{
+    NameServer *name_server;
+    ssize_t written_size;
+
+    query->n_sent++;
+    name_server = query_get_name_server(query);
+    if (!name_server)
+        return FALSE;
+
+    if (!query_open_socket(query, name_server->address->sa_family))
+        return FALSE;
+
+    milter_debug("[dnsbl][query][send] <%s>: <%s> [%u]",
+                 query->name, name_server->spec, query->n_sent);
+    written_size = sendto(g_io_channel_unix_get_fd(query->channel),
+                          query->packet, query->packet_size, 0,
+                          name_server->address, name_server->address_length);
+    if (written_size == -1) {
+        milter_error("[dnsbl][query][send][error] <%s>: <%s>: %s",
+                     query->name, name_server->spec, g_strerror(errno));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+query_retry (Query *query)
+{
+    MilterManagerDNSBLPrivate *priv;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(query->dnsbl);
+    while (query->n_sent <= priv->n_retries) {
+        if (query_send(query))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static gboolean
+cb_query_readable (GIOChannel *channel, GIOCondition condition, gpointer data)
+{
+    Query *query = data;
+    guchar response[DNS_MAX_PACKET_SIZE];
+    ssize_t read_size;
+    gboolean listed = FALSE;
+    guint32 ttl = 0;
+
+    if (!(condition & (G_IO_IN | G_IO_PRI))) {
+        gchar *message;
+
+        message = milter_utils_inspect_io_condition_error(condition);
+        milter_error("[dnsbl][query][read][error] <%s>: %s",
+                     query->name, message);
+        g_free(message);
+        query->watch_id = 0;
+        query_finish(query, FALSE, FALSE, 0);
+        return FALSE;
+    }
+
+    read_size = recv(g_io_channel_unix_get_fd(channel),
+                     response, sizeof(response), 0);
+    if (read_size == -1) {
+        if (errno == EAGAIN || errno == EINTR)
+            return TRUE;
+        milter_debug("[dnsbl][query][read][error] <%s>: %s",
+                     query->name, g_strerror(errno));
+        if (query_retry(query))
+            return TRUE;
+        query->watch_id = 0;
+        query_finish(query, FALSE, FALSE, 0);
+        return FALSE;
+    }
+
+    switch (parse_response(query, response, read_size, &listed, &ttl)) {
+    case RESPONSE_INVALID:
+        milter_debug("[dnsbl][query][read][invalid] <%s>", query->name);
+        return TRUE;
+    case RESPONSE_FAILED:
+        milter_debug("[dnsbl][query][read][failed] <%s>", query->name);
+        if (query_retry(query))
+            return TRUE;
+        query->watch_id = 0;
+        query_finish(query, FALSE, FALSE, 0);
+        return FALSE;
+    case RESPONSE_ANSWERED:
+        break;
+    }
+
+    query->watch_id = 0;
+    query_finish(query, listed, TRUE, ttl);
+    return FALSE;
+}
+
+static gboolean
+cb_query_timeout (gpointer data)
+{
+    Query *query = data;
+
+    milter_debug("[dnsbl][query][timeout] <%s> [%u]",
+                 query->name, query->n_sent);
+    if (query_retry(query))
+        return TRUE;
+
+    query->timeout_id = 0;
+    query_finish(query, FALSE, FALSE, 0);
+    return FALSE;
+}
+
+static void
+query_start (MilterManagerDNSBL *dnsbl, Service *service, const gchar *name,
+             Lookup *lookup)
+{
+    MilterManagerDNSBLPrivate *priv;
+    Query *query;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl);
+
+    lookup->n_pending++;
+    query = g_hash_table_lookup(priv->queries, name);
+    if (query) {
+        milter_debug("[dnsbl][query][join] <%s>", name);
+        query->lookups = g_list_prepend(query->lookups, lookup);
+        return;
+    }
+
+    query = g_slice_new0(Query);
+    query->dnsbl = dnsbl;
+    query->name = g_strdup(name);
+    query->service = service_copy(service);
+    query->lookups = g_list_prepend(NULL, lookup);
+    query->id = g_random_int_range(0, G_MAXUINT16 + 1);
+    g_hash_table_insert(priv->queries, query->name, query);
+
+    if (!encode_query(query) || !priv->loop || !query_retry(query)) {
+        query_finish(query, FALSE, FALSE, 0);
+        return;
+    }
+
+    query->timeout_id =
+        milter_event_loop_add_timeout(priv->loop,
+                                      priv->timeout / (priv->n_retries + 1),
+                                      cb_query_timeout,
+                                      query);
+}
+
+void
+milter_manager_dnsbl_check (MilterManagerDNSBL *dnsbl,
+                            struct sockaddr *address,
+                            socklen_t address_length,
+                            MilterManagerDNSBLCheckFunc callback,
+                            gpointer user_data,
+                            GDestroyNotify notify)
+{
+    MilterManagerDNSBLPrivate *priv;
+    Lookup *lookup;
+    gchar *reversed_address;
+    GList *node;
+    GList *targets = NULL;
+    gdouble now;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl);
+
+    lookup = lookup_new(dnsbl, callback, user_data, notify);
+    lookup->n_pending++;
+
+    reversed_address = reverse_address(address, address_length);
+    if (!reversed_address) {
+        lookup_receive(lookup, FALSE, NULL);
+        return;
+    }
+
+    now = current_time();
+    for (node = priv->services; node; node = g_list_next(node)) {
+        Service *service = node->data;
+        gchar *name;
+        gboolean listed = FALSE;
+
+        name = g_strdup_printf("%s.%s", reversed_address, service->zone);
+        if (cache_lookup(priv, name, now, &listed)) {
+            milter_debug("[dnsbl][cache][hit] <%s>: listed=<%s>",
+                         name, listed ? "true" : "false");
+            g_free(name);
+            if (listed) {
+                lookup_finish(lookup, TRUE, service->zone);
+                break;
+            }
+        } else {
+            targets = g_list_prepend(targets, service);
+            targets = g_list_prepend(targets, name);
+        }
+    }
+    g_free(reversed_address);
+
+    if (targets && !lookup->done)
+        load_default_name_servers(dnsbl);
+
+    for (node = targets; node; node = g_list_next(g_list_next(node))) {
+        gchar *name = node->data;
+        Service *service = g_list_next(node)->data;
+
+        if (!lookup->done)
+            query_start(dnsbl, service, name, lookup);
+        g_free(name);
+    }
+    g_list_free(targets);
+
+    lookup_receive(lookup, FALSE, NULL);
+}
+
+gboolean
+milter_manager_dnsbl_lookup_cache (MilterManagerDNSBL *dnsbl,
+                                   struct sockaddr *address,
+                                   socklen_t address_length,
+                                   gboolean *listed)
+{
+    MilterManagerDNSBLPrivate *priv;
+    gchar *reversed_address;
+    GList *node;
+    gdouble now;
+    gboolean all_cached = TRUE;
+
+    priv = MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl);
+
+    reversed_address = reverse_address(address, address_length);
+    if (!reversed_address) {
+        if (listed)
+            *listed = FALSE;
+        return TRUE;
+    }
+
+    now = current_time();
+    for (node = priv->services; node; node = g_list_next(node)) {
+        Service *service = node->data;
+        gchar *name;
+        gboolean cached, service_listed = FALSE;
+
+        name = g_strdup_printf("%s.%s", reversed_address, service->zone);
+        cached = cache_lookup(priv, name, now, &service_listed);
+        g_free(name);
+        if (cached && service_listed) {
+            g_free(reversed_address);
+            if (listed)
+                *listed = TRUE;
+            return TRUE;
+        }
+        if (!cached)
+            all_cached = FALSE;
+    }
+    g_free(reversed_address);
+
+    if (all_cached && listed)
+        *listed = FALSE;
+    return all_cached;
+}
+
+void
+milter_manager_dnsbl_clear_cache (MilterManagerDNSBL *dnsbl)
+{
+    g_hash_table_remove_all(MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl)->cache);
+}
+
+guint
+milter_manager_dnsbl_get_n_pending_queries (MilterManagerDNSBL *dnsbl)
+{
+    return g_hash_table_size(MILTER_MANAGER_DNSBL_GET_PRIVATE(dnsbl)->queries);
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
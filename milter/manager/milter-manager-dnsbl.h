@@ -0,0 +1,217 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __MILTER_MANAGER_DNSBL_H__
+#define __MILTER_MANAGER_DNSBL_H__
+
+#include <glib-object.h>
+
+#include <milter/core.h>
+#include <milter/manager/milter-manager-shared-cache.h>
+
+G_BEGIN_DECLS
+
+/**
+ * SECTION: milter-manager-dnsbl
+ * @title: MilterManagerDNSBL
+ * @short_description: Asynchronous DNS-based blackhole list lookup.
+ *
+ * The %MilterManagerDNSBL looks up an IPv4 address in
+ * DNS-based blackhole lists without blocking the event
+ * loop. Queries for all registered zones are sent in
+ * parallel over UDP and answers are cached until their TTL
+ * is expired.
+ */
+
+#define MILTER_MANAGER_DNSBL_ERROR           (milter_manager_dnsbl_error_quark())
+
+#define MILTER_TYPE_MANAGER_DNSBL            (milter_manager_dnsbl_get_type())
+#define MILTER_MANAGER_DNSBL(obj)            (G_TYPE_CHECK_INSTANCE_CAST((obj), MILTER_TYPE_MANAGER_DNSBL, MilterManagerDNSBL))
+#define MILTER_MANAGER_DNSBL_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST((klass), MILTER_TYPE_MANAGER_DNSBL, MilterManagerDNSBLClass))
+#define MILTER_MANAGER_IS_DNSBL(obj)         (G_TYPE_CHECK_INSTANCE_TYPE((obj), MILTER_TYPE_MANAGER_DNSBL))
+#define MILTER_MANAGER_IS_DNSBL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), MILTER_TYPE_MANAGER_DNSBL))
+#define MILTER_MANAGER_DNSBL_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS((obj), MILTER_TYPE_MANAGER_DNSBL, MilterManagerDNSBLClass))
+
+#define MILTER_MANAGER_DNSBL_DEFAULT_TIMEOUT            5.0
+#define MILTER_MANAGER_DNSBL_DEFAULT_N_RETRIES          1
+#define MILTER_MANAGER_DNSBL_DEFAULT_NEGATIVE_CACHE_TTL 300
+#define MILTER_MANAGER_DNSBL_DEFAULT_MAX_CACHE_TTL      3600
+
+typedef enum
+{
+    MILTER_MANAGER_DNSBL_ERROR_INVALID_NAME_SERVER,
+    MILTER_MANAGER_DNSBL_ERROR_INVALID_EXPECTED_ANSWER
+} MilterManagerDNSBLError;
+
+typedef struct _MilterManagerDNSBL         MilterManagerDNSBL;
+typedef struct _MilterManagerDNSBLClass    MilterManagerDNSBLClass;
+
+struct _MilterManagerDNSBL
+{
+    GObject object;
+};
+
+struct _MilterManagerDNSBLClass
+{
+    GObjectClass parent_class;
+};
+
+/**
+ * MilterManagerDNSBLCheckFunc:
+ * @dnsbl: a %MilterManagerDNSBL.
+ * @listed: %TRUE if the checked address is listed.
+ * @zone: the zone that lists the address or %NULL.
+ * @user_data: the data passed to milter_manager_dnsbl_check().
+ *
+ * The callback that receives the result of
+ * milter_manager_dnsbl_check().
+ */
+typedef void (*MilterManagerDNSBLCheckFunc) (MilterManagerDNSBL *dnsbl,
+                                             gboolean            listed,
+                                             const gchar        *zone,
+                                             gpointer            user_data);
+
+GQuark               milter_manager_dnsbl_error_quark (void);
+GType                milter_manager_dnsbl_get_type    (void) G_GNUC_CONST;
+
+MilterManagerDNSBL  *milter_manager_dnsbl_new         (MilterEventLoop *loop);
+
+/**
+ * milter_manager_dnsbl_add_service:
+ * @dnsbl: a %MilterManagerDNSBL.
+ * @zone: the zone of the list. e.g. "zen.spamhaus.org".
+ * @expected_answer: the address or the network in CIDR
+ *                   notation that means "listed". e.g.
+ *                   "127.0.0.10/31". %NULL means that any
+ *                   answer is "listed".
+ * @error: return location for an error, or %NULL.
+ *
+ * Registers a DNS-based blackhole list.
+ *
+ * Returns: %TRUE on success.
+ */
+gboolean             milter_manager_dnsbl_add_service (MilterManagerDNSBL *dnsbl,
+                                                       const gchar        *zone,
+                                                       const gchar        *expected_answer,
+                                                       GError            **error);
+void                 milter_manager_dnsbl_clear_services
+                                                      (MilterManagerDNSBL *dnsbl);
+
+/**
+ * milter_manager_dnsbl_add_name_server:
+ * @dnsbl: a %MilterManagerDNSBL.
+ * @name_server: the IP address of a name server or
+ *               connection spec such as "inet:53@127.0.0.1".
+ * @error: return location for an error, or %NULL.
+ *
+ * Adds a name server to be queried. Name servers in
+ * /etc/resolv.conf are used if no name server is added.
+ *
+ * Returns: %TRUE on success.
+ */
+gboolean             milter_manager_dnsbl_add_name_server
+                                                      (MilterManagerDNSBL *dnsbl,
+                                                       const gchar        *name_server,
+                                                       GError            **error);
+void                 milter_manager_dnsbl_clear_name_servers
+                                                      (MilterManagerDNSBL *dnsbl);
+
+void                 milter_manager_dnsbl_set_timeout (MilterManagerDNSBL *dnsbl,
+                                                       gdouble             timeout);
+gdouble              milter_manager_dnsbl_get_timeout (MilterManagerDNSBL *dnsbl);
+void                 milter_manager_dnsbl_set_n_retries
+                                                      (MilterManagerDNSBL *dnsbl,
+                                                       guint               n_retries);
+guint                milter_manager_dnsbl_get_n_retries
+                                                      (MilterManagerDNSBL *dnsbl);
+void                 milter_manager_dnsbl_set_negative_cache_ttl
+                                                      (MilterManagerDNSBL *dnsbl,
+                                                       guint               ttl);
+guint                milter_manager_dnsbl_get_negative_cache_ttl
+                                                      (MilterManagerDNSBL *dnsbl);
+void                 milter_manager_dnsbl_set_max_cache_ttl
+                                                      (MilterManagerDNSBL *dnsbl,
+                                                       guint               ttl);
+guint                milter_manager_dnsbl_get_max_cache_ttl
+                                                      (MilterManagerDNSBL *dnsbl);
+
+/**
+ * milter_manager_dnsbl_set_shared_cache:
+ * @dnsbl: a %MilterManagerDNSBL.
+ * @cache: a %MilterManagerSharedCache or %NULL.
+ *
+ * Uses @cache to share results with other worker
+ * processes. Results are still cached in @dnsbl too.
+ *
+ * Since: 2.1.6
+ */
+void                 milter_manager_dnsbl_set_shared_cache
+                                                      (MilterManagerDNSBL *dnsbl,
+                                                       MilterManagerSharedCache *cache);
+MilterManagerSharedCache *
+                     milter_manager_dnsbl_get_shared_cache
+                                                      (MilterManagerDNSBL *dnsbl);
+
+/**
+ * milter_manager_dnsbl_check:
+ * @dnsbl: a %MilterManagerDNSBL.
+ * @address: the address to be checked.
+ * @address_length: the length of @address.
+ * @callback: the function to receive the result.
+ * @user_data: the data passed to @callback.
+ * @notify: the function to free @user_data or %NULL.
+ *
+ * Checks whether @address is listed in any registered
+ * list. @callback is called exactly once. It is called
+ * before this function returns when the result is known
+ * from the cache or @address isn't an IPv4 address.
+ */
+void                 milter_manager_dnsbl_check       (MilterManagerDNSBL *dnsbl,
+                                                       struct sockaddr    *address,
+                                                       socklen_t           address_length,
+                                                       MilterManagerDNSBLCheckFunc callback,
+                                                       gpointer            user_data,
+                                                       GDestroyNotify      notify);
+
+/**
+ * milter_manager_dnsbl_lookup_cache:
+ * @dnsbl: a %MilterManagerDNSBL.
+ * @address: the address to be checked.
+ * @address_length: the length of @address.
+ * @listed: return location for the result.
+ *
+ * Looks up the result of @address only from the cache.
+ *
+ * Returns: %TRUE if the result is known without any query.
+ */
+gboolean             milter_manager_dnsbl_lookup_cache(MilterManagerDNSBL *dnsbl,
+                                                       struct sockaddr    *address,
+                                                       socklen_t           address_length,
+                                                       gboolean           *listed);
+void                 milter_manager_dnsbl_clear_cache (MilterManagerDNSBL *dnsbl);
+guint                milter_manager_dnsbl_get_n_pending_queries
+                                                      (MilterManagerDNSBL *dnsbl);
+
+G_END_DECLS
+
+#endif /* __MILTER_MANAGER_DNSBL_H__ */
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
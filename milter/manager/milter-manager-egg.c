@@ -21,6 +21,13 @@
 #  include "../../config.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+
 #include <milter/core/milter-marshalers.h>
 #include "milter-manager-egg.h"
 #include "milter-manager-enum-types.h"
@@ -35,11 +42,54 @@
 #define DEFAULT_END_OF_MESSAGE_TIMEOUT \
     (MILTER_SERVER_CONTEXT_DEFAULT_END_OF_MESSAGE_TIMEOUT - TIMEOUT_LEEWAY)
 
+#define LATENCY_HIGHEST_TRACKABLE_VALUE (G_GUINT64_CONSTANT(600) * G_USEC_PER_SEC)
+#define LATENCY_PUBLISH_INTERVAL G_USEC_PER_SEC
+#define N_LATENCY_STAGES (MILTER_SERVER_CONTEXT_STATE_END_OF_MESSAGE + 1)
+#define ADAPTIVE_TIMEOUT_MINIMUM_COUNT 100
+#define CIRCUIT_SUMMARY_TTL 3600
+#define SESSION_SUMMARY_TTL 3600
+#define BACKEND_LATENCY_WEIGHT 0.2
+#define SESSION_RATE_WEIGHT 0.2
+#define WARM_CONNECTION_HORIZON 1.0
+#define WARM_CONNECTION_MAX_AGE (G_GINT64_CONSTANT(60) * G_USEC_PER_SEC)
+#define WARM_CONNECTION_REFILL_INTERVAL 1.0
+
 #define MILTER_MANAGER_EGG_GET_PRIVATE(obj)                     \
     (G_TYPE_INSTANCE_GET_PRIVATE((obj),                         \
                                  MILTER_TYPE_MANAGER_EGG,       \
                                  MilterManagerEggPrivate))
 
+typedef struct _Backend Backend;
+struct _Backend
+{
+    gchar *spec;
+    guint n_outstanding;
+    guint64 n_sessions;
+    guint64 n_failures;
+    guint n_consecutive_failures;
+    gdouble latency;
+    gint64 ejected_time;
+    gint domain;
+    struct sockaddr *address;
+    socklen_t address_length;
+    GQueue *warm_connections;
+};
+
+typedef struct _WarmConnection WarmConnection;
+struct _WarmConnection
+{
+    gint fd;
+    pid_t pid;
+    gint64 created_time;
+};
+
+typedef struct _BackendSession BackendSession;
+struct _BackendSession
+{
+    Backend *backend;
+    guint n_tries;
+};
+
 typedef struct _MilterManagerEggPrivate MilterManagerEggPrivate;
 struct _MilterManagerEggPrivate
 {
@@ -57,6 +107,62 @@ struct _MilterManagerEggPrivate
     GList *applicable_conditions;
     MilterStatus fallback_status;
     gboolean evaluation_mode;
+    gdouble evaluation_sampling_rate;
+    gboolean evaluation_sampling_by_client_address;
+    gdouble latency_window;
+    gint64 latency_window_start;
+    gint64 latency_published_time;
+    MilterHistogram *latencies[N_LATENCY_STAGES];
+    MilterManagerSharedCache *shared_cache;
+    gboolean summary_publish_failed;
+    gdouble circuit_breaker_threshold;
+    guint circuit_breaker_minimum_requests;
+    gdouble circuit_breaker_window;
+    gdouble circuit_breaker_open_time;
+    gdouble circuit_breaker_latency_threshold;
+    MilterManagerEggCircuitState circuit_state;
+    gint64 circuit_changed_time;
+    gint64 circuit_window_start;
+    gint64 circuit_probe_time;
+    gint64 circuit_published_time;
+    guint circuit_n_successes;
+    guint circuit_n_failures;
+    gboolean adaptive_timeout;
+    gdouble adaptive_timeout_percentile;
+    gdouble adaptive_timeout_factor;
+    gdouble adaptive_timeout_minimum;
+    gdouble adaptive_latencies[N_LATENCY_STAGES];
+    guint64 end_of_message_body_size;
+    guint64 n_end_of_messages;
+    gdouble adaptive_mean_body_size;
+    guint max_concurrent_sessions;
+    guint max_queued_sessions;
+    gdouble queue_timeout;
+    MilterStatus shed_status;
+    GList *active_children;
+    guint n_active_sessions;
+    GQueue *queued_children;
+    guint n_shed_sessions;
+    GList *backends;
+    GHashTable *backend_sessions;
+    guint backend_ejection_failures;
+    gdouble backend_ejection_time;
+    guint max_warm_connections;
+    gint64 last_hatched_time;
+    gdouble session_rate;
+    guint n_warm_connection_hits;
+    guint n_warm_connection_misses;
+    MilterEventLoop *event_loop;
+    guint warm_connection_refill_id;
+    guint warm_connection_idle_id;
+    gboolean negotiate_cache;
+    gdouble verdict_cache_ttl;
+    guint verdict_cache_size;
+    GQueue *cached_verdict_keys;
+    GHashTable *cached_verdict_key_links;
+    gboolean verdict_cache_disabled_reported;
+    MilterOption *cached_option;
+    MilterMacrosRequests *cached_macros_requests;
 };
 
 enum
@@ -74,7 +180,29 @@ enum
     PROP_COMMAND,
     PROP_COMMAND_OPTIONS,
     PROP_FALLBACK_STATUS,
-    PROP_REPUTATION_MODE
+    PROP_REPUTATION_MODE,
+    PROP_LATENCY_WINDOW,
+    PROP_CIRCUIT_BREAKER_THRESHOLD,
+    PROP_CIRCUIT_BREAKER_MINIMUM_REQUESTS,
+    PROP_CIRCUIT_BREAKER_WINDOW,
+    PROP_CIRCUIT_BREAKER_OPEN_TIME,
+    PROP_CIRCUIT_BREAKER_LATENCY_THRESHOLD,
+    PROP_ADAPTIVE_TIMEOUT,
+    PROP_ADAPTIVE_TIMEOUT_PERCENTILE,
+    PROP_ADAPTIVE_TIMEOUT_FACTOR,
+    PROP_ADAPTIVE_TIMEOUT_MINIMUM,
+    PROP_MAX_CONCURRENT_SESSIONS,
+    PROP_MAX_QUEUED_SESSIONS,
+    PROP_QUEUE_TIMEOUT,
+    PROP_SHED_STATUS,
+    PROP_BACKEND_EJECTION_FAILURES,
+    PROP_BACKEND_EJECTION_TIME,
+    PROP_MAX_WARM_CONNECTIONS,
+    PROP_NEGOTIATE_CACHE,
+    PROP_VERDICT_CACHE_TTL,
+    PROP_VERDICT_CACHE_SIZE,
+    PROP_EVALUATION_SAMPLING_RATE,
+    PROP_EVALUATION_SAMPLING_BY_CLIENT_ADDRESS
 };
 
 enum
@@ -99,6 +227,20 @@ static void get_property   (GObject         *object,
                             guint            prop_id,
                             GValue          *value,
                             GParamSpec      *pspec);
+static gboolean need_bypass (MilterManagerEgg *egg);
+static gboolean sample_evaluation (MilterManagerEgg *egg);
+static gdouble effective_connection_timeout (MilterManagerEggPrivate *priv);
+static gdouble effective_reading_timeout (MilterManagerEggPrivate *priv);
+static void admit_session (MilterManagerEgg *egg, MilterManagerChild *child);
+static void cb_child_weak_notify (gpointer data, GObject *where_the_object_was);
+static void unwatch_session (MilterManagerEgg *egg, MilterManagerChild *child);
+static void clear_backends (MilterManagerEgg *egg);
+static void clear_negotiate_cache (MilterManagerEggPrivate *priv);
+static void stop_warm_connection_refill (MilterManagerEggPrivate *priv);
+static gboolean is_ejected_backend (MilterManagerEggPrivate *priv,
+                                    Backend *backend,
+                                    gint64 now);
+static gint64 get_current_time (void);
 
 static void
 milter_manager_egg_class_init (MilterManagerEggClass *klass)
@@ -216,6 +358,253 @@ milter_manager_egg_class_init (MilterManagerEggClass *klass)
                                 G_PARAM_READWRITE);
     g_object_class_install_property(gobject_class, PROP_REPUTATION_MODE, spec);
 
+    spec = g_param_spec_double("evaluation-sampling-rate",
+                               "Evaluation sampling rate",
+                               "The rate of sessions processed by "
+                               "the milter on evaluation mode",
+                               0.0,
+                               1.0,
+                               1.0,
+                               G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class,
+                                    PROP_EVALUATION_SAMPLING_RATE,
+                                    spec);
+
+    spec = g_param_spec_boolean("evaluation-sampling-by-client-address",
+                                "Evaluation sampling by client address",
+                                "Whether sessions on evaluation mode are "
+                                "sampled by the SMTP client address or "
+                                "at random",
+                                FALSE,
+                                G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class,
+                                    PROP_EVALUATION_SAMPLING_BY_CLIENT_ADDRESS,
+                                    spec);
+
+    spec = g_param_spec_double("latency-window",
+                               "Latency window",
+                               "The seconds to reset latency histograms. "
+                               "0 means that they are never reset.",
+                               0,
+                               G_MAXDOUBLE,
+                               MILTER_MANAGER_EGG_DEFAULT_LATENCY_WINDOW,
+                               G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class, PROP_LATENCY_WINDOW, spec);
+
+    spec = g_param_spec_double("circuit-breaker-threshold",
+                               "Circuit breaker threshold",
+                               "The failure ratio to open the circuit. "
+                               "0 means that the circuit breaker is disabled.",
+                               0,
+                               1,
+                               0,
+                               G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class,
+                                    PROP_CIRCUIT_BREAKER_THRESHOLD,
+                                    spec);
+
+    spec = g_param_spec_uint("circuit-breaker-minimum-requests",
+                             "Circuit breaker minimum requests",
+                             "The number of results in a window required "
+                             "to open the circuit",
+                             1,
+                             G_MAXUINT,
+                             MILTER_MANAGER_EGG_DEFAULT_CIRCUIT_BREAKER_MINIMUM_REQUESTS,
+                             G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class,
+                                    PROP_CIRCUIT_BREAKER_MINIMUM_REQUESTS,
+                                    spec);
+
+    spec = g_param_spec_double("circuit-breaker-window",
+                               "Circuit breaker window",
+                               "The seconds to reset failure counts",
+                               0,
+                               G_MAXDOUBLE,
+                               MILTER_MANAGER_EGG_DEFAULT_CIRCUIT_BREAKER_WINDOW,
+                               G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class,
+                                    PROP_CIRCUIT_BREAKER_WINDOW,
+                                    spec);
+
+    spec = g_param_spec_double("circuit-breaker-open-time",
+                               "Circuit breaker open time",
+                               "The seconds to bypass the milter before "
+                               "probing it",
+                               0,
+                               G_MAXDOUBLE,
+                               MILTER_MANAGER_EGG_DEFAULT_CIRCUIT_BREAKER_OPEN_TIME,
+                               G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class,
+                                    PROP_CIRCUIT_BREAKER_OPEN_TIME,
+                                    spec);
+
+    spec = g_param_spec_double("circuit-breaker-latency-threshold",
+                               "Circuit breaker latency threshold",
+                               "The seconds of a reply that is counted as "
+                               "failure. 0 means that slow replies aren't "
+                               "counted as failure.",
+                               0,
+                               G_MAXDOUBLE,
+                               0,
+                               G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class,
+                                    PROP_CIRCUIT_BREAKER_LATENCY_THRESHOLD,
+                                    spec);
+
+    spec = g_param_spec_boolean("adaptive-timeout",
+                                "Adaptive timeout",
+                                "Whether timeouts are derived from "
+                                "observed latency or not",
+                                FALSE,
+                                G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class, PROP_ADAPTIVE_TIMEOUT, spec);
+
+    spec = g_param_spec_double("adaptive-timeout-percentile",
+                               "Adaptive timeout percentile",
+                               "The percentile of observed latency "
+                               "used for adaptive timeouts",
+                               0,
+                               100,
+                               MILTER_MANAGER_EGG_DEFAULT_ADAPTIVE_TIMEOUT_PERCENTILE,
+                               G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class,
+                                    PROP_ADAPTIVE_TIMEOUT_PERCENTILE,
+                                    spec);
+
+    spec = g_param_spec_double("adaptive-timeout-factor",
+                               "Adaptive timeout factor",
+                               "The factor applied to the percentile of "
+                               "observed latency",
+                               0,
+                               G_MAXDOUBLE,
+                               MILTER_MANAGER_EGG_DEFAULT_ADAPTIVE_TIMEOUT_FACTOR,
+                               G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class,
+                                    PROP_ADAPTIVE_TIMEOUT_FACTOR,
+                                    spec);
+
+    spec = g_param_spec_double("adaptive-timeout-minimum",
+                               "Adaptive timeout minimum",
+                               "The minimum seconds of adaptive timeouts",
+                               0,
+                               G_MAXDOUBLE,
+                               MILTER_MANAGER_EGG_DEFAULT_ADAPTIVE_TIMEOUT_MINIMUM,
+                               G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class,
+                                    PROP_ADAPTIVE_TIMEOUT_MINIMUM,
+                                    spec);
+
+    spec = g_param_spec_uint("max-concurrent-sessions",
+                             "Max concurrent sessions",
+                             "The maximum number of concurrent sessions "
+                             "to the milter. 0 means unlimited.",
+                             0,
+                             G_MAXUINT,
+                             0,
+                             G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class,
+                                    PROP_MAX_CONCURRENT_SESSIONS,
+                                    spec);
+
+    spec = g_param_spec_uint("max-queued-sessions",
+                             "Max queued sessions",
+                             "The maximum number of sessions that wait "
+                             "for a free session slot",
+                             0,
+                             G_MAXUINT,
+                             0,
+                             G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class,
+                                    PROP_MAX_QUEUED_SESSIONS,
+                                    spec);
+
+    spec = g_param_spec_double("queue-timeout",
+                               "Queue timeout",
+                               "The seconds to wait for a free session slot. "
+                               "It is capped to "
+                               G_STRINGIFY(MILTER_MANAGER_EGG_MAXIMUM_QUEUE_TIMEOUT)
+                               " seconds",
+                               0,
+                               G_MAXDOUBLE,
+                               MILTER_MANAGER_EGG_DEFAULT_QUEUE_TIMEOUT,
+                               G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class, PROP_QUEUE_TIMEOUT, spec);
+
+    spec = g_param_spec_enum("shed-status",
+                             "Shed status",
+                             "The status of shed sessions. "
+                             "MILTER_STATUS_DEFAULT means fallback status.",
+                             MILTER_TYPE_STATUS,
+                             MILTER_STATUS_DEFAULT,
+                             G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class, PROP_SHED_STATUS, spec);
+
+    spec = g_param_spec_uint("backend-ejection-failures",
+                             "Backend ejection failures",
+                             "The number of consecutive failures "
+                             "to eject a backend",
+                             1,
+                             G_MAXUINT,
+                             MILTER_MANAGER_EGG_DEFAULT_BACKEND_EJECTION_FAILURES,
+                             G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class,
+                                    PROP_BACKEND_EJECTION_FAILURES,
+                                    spec);
+
+    spec = g_param_spec_double("backend-ejection-time",
+                               "Backend ejection time",
+                               "The seconds to eject a backend",
+                               0,
+                               G_MAXDOUBLE,
+                               MILTER_MANAGER_EGG_DEFAULT_BACKEND_EJECTION_TIME,
+                               G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class,
+                                    PROP_BACKEND_EJECTION_TIME,
+                                    spec);
+
+    spec = g_param_spec_uint("max-warm-connections",
+                             "Max warm connections",
+                             "The maximum number of connected sockets "
+                             "kept for new sessions. 0 disables it.",
+                             0,
+                             G_MAXUINT,
+                             0,
+                             G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class,
+                                    PROP_MAX_WARM_CONNECTIONS,
+                                    spec);
+
+    spec = g_param_spec_boolean("negotiate-cache",
+                                "Negotiate cache",
+                                "Whether the negotiation result of "
+                                "the last session is used to reply "
+                                "negotiation early or not",
+                                FALSE,
+                                G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class, PROP_NEGOTIATE_CACHE, spec);
+
+    spec = g_param_spec_double("verdict-cache-ttl",
+                               "Verdict cache TTL",
+                               "The TTL in seconds of cached connect and "
+                               "HELO verdicts. 0 disables the cache",
+                               0,
+                               G_MAXDOUBLE,
+                               0,
+                               G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class, PROP_VERDICT_CACHE_TTL,
+                                    spec);
+
+    spec = g_param_spec_uint("verdict-cache-size",
+                             "Verdict cache size",
+                             "The max number of cached verdicts of the "
+                             "milter. 0 means no limit",
+                             0,
+                             G_MAXUINT,
+                             MILTER_MANAGER_EGG_DEFAULT_VERDICT_CACHE_SIZE,
+                             G_PARAM_READWRITE);
+    g_object_class_install_property(gobject_class, PROP_VERDICT_CACHE_SIZE,
+                                    spec);
+
     signals[HATCHED] =
         g_signal_new("hatched",
                      G_TYPE_FROM_CLASS(klass),
@@ -259,6 +648,73 @@ milter_manager_egg_init (MilterManagerEgg *egg)
     priv->applicable_conditions = NULL;
     priv->fallback_status = MILTER_STATUS_ACCEPT;
     priv->evaluation_mode = FALSE;
+    priv->evaluation_sampling_rate = 1.0;
+    priv->evaluation_sampling_by_client_address = FALSE;
+    priv->latency_window = MILTER_MANAGER_EGG_DEFAULT_LATENCY_WINDOW;
+    priv->latency_window_start = 0;
+    priv->latency_published_time = 0;
+    memset(priv->latencies, 0, sizeof(priv->latencies));
+    priv->shared_cache = NULL;
+    priv->summary_publish_failed = FALSE;
+    priv->circuit_breaker_threshold = 0.0;
+    priv->circuit_breaker_minimum_requests =
+        MILTER_MANAGER_EGG_DEFAULT_CIRCUIT_BREAKER_MINIMUM_REQUESTS;
+    priv->circuit_breaker_window =
+        MILTER_MANAGER_EGG_DEFAULT_CIRCUIT_BREAKER_WINDOW;
+    priv->circuit_breaker_open_time =
+        MILTER_MANAGER_EGG_DEFAULT_CIRCUIT_BREAKER_OPEN_TIME;
+    priv->circuit_breaker_latency_threshold = 0.0;
+    priv->circuit_state = MILTER_MANAGER_EGG_CIRCUIT_CLOSED;
+    priv->circuit_changed_time = 0;
+    priv->circuit_window_start = 0;
+    priv->circuit_probe_time = 0;
+    priv->circuit_published_time = 0;
+    priv->circuit_n_successes = 0;
+    priv->circuit_n_failures = 0;
+    priv->adaptive_timeout = FALSE;
+    priv->adaptive_timeout_percentile =
+        MILTER_MANAGER_EGG_DEFAULT_ADAPTIVE_TIMEOUT_PERCENTILE;
+    priv->adaptive_timeout_factor =
+        MILTER_MANAGER_EGG_DEFAULT_ADAPTIVE_TIMEOUT_FACTOR;
+    priv->adaptive_timeout_minimum =
+        MILTER_MANAGER_EGG_DEFAULT_ADAPTIVE_TIMEOUT_MINIMUM;
+    memset(priv->adaptive_latencies, 0, sizeof(priv->adaptive_latencies));
+    priv->end_of_message_body_size = 0;
+    priv->n_end_of_messages = 0;
+    priv->adaptive_mean_body_size = 0.0;
+    priv->max_concurrent_sessions = 0;
+    priv->max_queued_sessions = 0;
+    priv->queue_timeout = MILTER_MANAGER_EGG_DEFAULT_QUEUE_TIMEOUT;
+    priv->shed_status = MILTER_STATUS_DEFAULT;
+    priv->active_children = NULL;
+    priv->n_active_sessions = 0;
+    priv->queued_children = g_queue_new();
+    priv->n_shed_sessions = 0;
+    priv->backends = NULL;
+    priv->backend_sessions = g_hash_table_new_full(g_direct_hash,
+                                                   g_direct_equal,
+                                                   NULL,
+                                                   g_free);
+    priv->backend_ejection_failures =
+        MILTER_MANAGER_EGG_DEFAULT_BACKEND_EJECTION_FAILURES;
+    priv->backend_ejection_time =
+        MILTER_MANAGER_EGG_DEFAULT_BACKEND_EJECTION_TIME;
+    priv->max_warm_connections = 0;
+    priv->last_hatched_time = 0;
+    priv->session_rate = 0;
+    priv->n_warm_connection_hits = 0;
+    priv->n_warm_connection_misses = 0;
+    priv->event_loop = NULL;
+    priv->warm_connection_refill_id = 0;
+    priv->warm_connection_idle_id = 0;
+    priv->negotiate_cache = FALSE;
+    priv->verdict_cache_ttl = 0.0;
+    priv->verdict_cache_size = MILTER_MANAGER_EGG_DEFAULT_VERDICT_CACHE_SIZE;
+    priv->cached_verdict_keys = g_queue_new();
+    priv->cached_verdict_key_links = g_hash_table_new(g_str_hash, g_str_equal);
+    priv->verdict_cache_disabled_reported = FALSE;
+    priv->cached_option = NULL;
+    priv->cached_macros_requests = NULL;
 }
 
 static void
@@ -266,6 +722,7 @@ dispose (GObject *object)
 {
     MilterManagerEgg *egg;
     MilterManagerEggPrivate *priv;
+    guint i;
 
     egg = MILTER_MANAGER_EGG(object);
     priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
@@ -302,6 +759,66 @@ dispose (GObject *object)
 
     milter_manager_egg_clear_applicable_conditions(egg);
 
+    for (i = 0; i < N_LATENCY_STAGES; i++) {
+        if (priv->latencies[i]) {
+            milter_histogram_free(priv->latencies[i]);
+            priv->latencies[i] = NULL;
+        }
+    }
+
+    if (priv->active_children) {
+        GList *node;
+
+        for (node = priv->active_children; node; node = g_list_next(node)) {
+            unwatch_session(egg, node->data);
+        }
+        g_list_free(priv->active_children);
+        priv->active_children = NULL;
+        priv->n_active_sessions = 0;
+    }
+
+    if (priv->queued_children) {
+        GList *node;
+
+        for (node = priv->queued_children->head;
+             node;
+             node = g_list_next(node)) {
+            unwatch_session(egg, node->data);
+        }
+        g_queue_free(priv->queued_children);
+        priv->queued_children = NULL;
+    }
+
+    stop_warm_connection_refill(priv);
+    if (priv->event_loop) {
+        g_object_unref(priv->event_loop);
+        priv->event_loop = NULL;
+    }
+
+    if (priv->backend_sessions) {
+        clear_backends(egg);
+        g_hash_table_unref(priv->backend_sessions);
+        priv->backend_sessions = NULL;
+    }
+
+    if (priv->shared_cache) {
+        g_object_unref(priv->shared_cache);
+        priv->shared_cache = NULL;
+    }
+
+    clear_negotiate_cache(priv);
+
+    if (priv->cached_verdict_key_links) {
+        g_hash_table_unref(priv->cached_verdict_key_links);
+        priv->cached_verdict_key_links = NULL;
+    }
+
+    if (priv->cached_verdict_keys) {
+        g_queue_foreach(priv->cached_verdict_keys, (GFunc)g_free, NULL);
+        g_queue_free(priv->cached_verdict_keys);
+        priv->cached_verdict_keys = NULL;
+    }
+
     G_OBJECT_CLASS(milter_manager_egg_parent_class)->dispose(object);
 }
 
@@ -356,6 +873,90 @@ set_property (GObject      *object,
     case PROP_REPUTATION_MODE:
         milter_manager_egg_set_evaluation_mode(egg, g_value_get_boolean(value));
         break;
+    case PROP_EVALUATION_SAMPLING_RATE:
+        milter_manager_egg_set_evaluation_sampling_rate(
+            egg, g_value_get_double(value));
+        break;
+    case PROP_EVALUATION_SAMPLING_BY_CLIENT_ADDRESS:
+        milter_manager_egg_set_evaluation_sampling_by_client_address(
+            egg, g_value_get_boolean(value));
+        break;
+    case PROP_LATENCY_WINDOW:
+        milter_manager_egg_set_latency_window(egg, g_value_get_double(value));
+        break;
+    case PROP_CIRCUIT_BREAKER_THRESHOLD:
+        milter_manager_egg_set_circuit_breaker_threshold(
+            egg, g_value_get_double(value));
+        break;
+    case PROP_CIRCUIT_BREAKER_MINIMUM_REQUESTS:
+        milter_manager_egg_set_circuit_breaker_minimum_requests(
+            egg, g_value_get_uint(value));
+        break;
+    case PROP_CIRCUIT_BREAKER_WINDOW:
+        milter_manager_egg_set_circuit_breaker_window(
+            egg, g_value_get_double(value));
+        break;
+    case PROP_CIRCUIT_BREAKER_OPEN_TIME:
+        milter_manager_egg_set_circuit_breaker_open_time(
+            egg, g_value_get_double(value));
+        break;
+    case PROP_CIRCUIT_BREAKER_LATENCY_THRESHOLD:
+        milter_manager_egg_set_circuit_breaker_latency_threshold(
+            egg, g_value_get_double(value));
+        break;
+    case PROP_ADAPTIVE_TIMEOUT:
+        milter_manager_egg_set_adaptive_timeout(egg,
+                                                g_value_get_boolean(value));
+        break;
+    case PROP_ADAPTIVE_TIMEOUT_PERCENTILE:
+        milter_manager_egg_set_adaptive_timeout_percentile(
+            egg, g_value_get_double(value));
+        break;
+    case PROP_ADAPTIVE_TIMEOUT_FACTOR:
+        milter_manager_egg_set_adaptive_timeout_factor(
+            egg, g_value_get_double(value));
+        break;
+    case PROP_ADAPTIVE_TIMEOUT_MINIMUM:
+        milter_manager_egg_set_adaptive_timeout_minimum(
+            egg, g_value_get_double(value));
+        break;
+    case PROP_MAX_CONCURRENT_SESSIONS:
+        milter_manager_egg_set_max_concurrent_sessions(
+            egg, g_value_get_uint(value));
+        break;
+    case PROP_MAX_QUEUED_SESSIONS:
+        milter_manager_egg_set_max_queued_sessions(egg,
+                                                   g_value_get_uint(value));
+        break;
+    case PROP_QUEUE_TIMEOUT:
+        milter_manager_egg_set_queue_timeout(egg, g_value_get_double(value));
+        break;
+    case PROP_SHED_STATUS:
+        milter_manager_egg_set_shed_status(egg, g_value_get_enum(value));
+        break;
+    case PROP_BACKEND_EJECTION_FAILURES:
+        milter_manager_egg_set_backend_ejection_failures(
+            egg, g_value_get_uint(value));
+        break;
+    case PROP_BACKEND_EJECTION_TIME:
+        milter_manager_egg_set_backend_ejection_time(
+            egg, g_value_get_double(value));
+        break;
+    case PROP_MAX_WARM_CONNECTIONS:
+        milter_manager_egg_set_max_warm_connections(
+            egg, g_value_get_uint(value));
+        break;
+    case PROP_NEGOTIATE_CACHE:
+        milter_manager_egg_set_negotiate_cache(egg, g_value_get_boolean(value));
+        break;
+    case PROP_VERDICT_CACHE_TTL:
+        milter_manager_egg_set_verdict_cache_ttl(egg,
+                                                 g_value_get_double(value));
+        break;
+    case PROP_VERDICT_CACHE_SIZE:
+        milter_manager_egg_set_verdict_cache_size(egg,
+                                                  g_value_get_uint(value));
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -411,6 +1012,73 @@ get_property (GObject    *object,
     case PROP_REPUTATION_MODE:
         g_value_set_boolean(value, priv->evaluation_mode);
         break;
+    case PROP_EVALUATION_SAMPLING_RATE:
+        g_value_set_double(value, priv->evaluation_sampling_rate);
+        break;
+    case PROP_EVALUATION_SAMPLING_BY_CLIENT_ADDRESS:
+        g_value_set_boolean(value,
+                            priv->evaluation_sampling_by_client_address);
+        break;
+    case PROP_LATENCY_WINDOW:
+        g_value_set_double(value, priv->latency_window);
+        break;
+    case PROP_CIRCUIT_BREAKER_THRESHOLD:
+        g_value_set_double(value, priv->circuit_breaker_threshold);
+        break;
+    case PROP_CIRCUIT_BREAKER_MINIMUM_REQUESTS:
+        g_value_set_uint(value, priv->circuit_breaker_minimum_requests);
+        break;
+    case PROP_CIRCUIT_BREAKER_WINDOW:
+        g_value_set_double(value, priv->circuit_breaker_window);
+        break;
+    case PROP_CIRCUIT_BREAKER_OPEN_TIME:
+        g_value_set_double(value, priv->circuit_breaker_open_time);
+        break;
+    case PROP_CIRCUIT_BREAKER_LATENCY_THRESHOLD:
+        g_value_set_double(value, priv->circuit_breaker_latency_threshold);
+        break;
+    case PROP_ADAPTIVE_TIMEOUT:
+        g_value_set_boolean(value, priv->adaptive_timeout);
+        break;
+    case PROP_ADAPTIVE_TIMEOUT_PERCENTILE:
+        g_value_set_double(value, priv->adaptive_timeout_percentile);
+        break;
+    case PROP_ADAPTIVE_TIMEOUT_FACTOR:
+        g_value_set_double(value, priv->adaptive_timeout_factor);
+        break;
+    case PROP_ADAPTIVE_TIMEOUT_MINIMUM:
+        g_value_set_double(value, priv->adaptive_timeout_minimum);
+        break;
+    case PROP_MAX_CONCURRENT_SESSIONS:
+        g_value_set_uint(value, priv->max_concurrent_sessions);
+        break;
+    case PROP_MAX_QUEUED_SESSIONS:
+        g_value_set_uint(value, priv->max_queued_sessions);
+        break;
+    case PROP_QUEUE_TIMEOUT:
+        g_value_set_double(value, priv->queue_timeout);
+        break;
+    case PROP_SHED_STATUS:
+        g_value_set_enum(value, priv->shed_status);
+        break;
+    case PROP_BACKEND_EJECTION_FAILURES:
+        g_value_set_uint(value, priv->backend_ejection_failures);
+        break;
+    case PROP_BACKEND_EJECTION_TIME:
+        g_value_set_double(value, priv->backend_ejection_time);
+        break;
+    case PROP_MAX_WARM_CONNECTIONS:
+        g_value_set_uint(value, priv->max_warm_connections);
+        break;
+    case PROP_NEGOTIATE_CACHE:
+        g_value_set_boolean(value, priv->negotiate_cache);
+        break;
+    case PROP_VERDICT_CACHE_TTL:
+        g_value_set_double(value, priv->verdict_cache_ttl);
+        break;
+    case PROP_VERDICT_CACHE_SIZE:
+        g_value_set_uint(value, priv->verdict_cache_size);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -431,305 +1099,2501 @@ milter_manager_egg_new (const gchar *name)
                         NULL);
 }
 
-static MilterManagerChild *
-hatch (const gchar *first_name, ...)
+static void
+warm_connection_free (WarmConnection *connection)
 {
-    MilterManagerChild *child;
-    va_list args;
+    close(connection->fd);
+    g_free(connection);
+}
 
-    va_start(args, first_name);
-    child = milter_manager_child_new_va_list(first_name, args);
-    va_end(args);
+static Backend *
+backend_new (const gchar *spec)
+{
+    Backend *backend;
+
+    backend = g_new0(Backend, 1);
+    backend->spec = g_strdup(spec);
+    backend->domain = PF_UNSPEC;
+    if (!milter_connection_parse_spec(spec,
+                                      &(backend->domain),
+                                      &(backend->address),
+                                      &(backend->address_length),
+                                      NULL))
+        backend->address = NULL;
+    backend->warm_connections = g_queue_new();
+
+    return backend;
+}
 
-    return child;
+static void
+backend_free (Backend *backend)
+{
+    g_queue_foreach(backend->warm_connections,
+                    (GFunc)warm_connection_free, NULL);
+    g_queue_free(backend->warm_connections);
+    g_free(backend->address);
+    g_free(backend->spec);
+    g_free(backend);
 }
 
-MilterManagerChild *
-milter_manager_egg_hatch (MilterManagerEgg *egg)
+static void
+open_warm_connection (Backend *backend)
 {
-    MilterManagerChild *child;
-    MilterManagerEggPrivate *priv;
+    WarmConnection *connection;
+    gint fd;
+
+    fd = socket(backend->domain, SOCK_STREAM, 0);
+    if (fd == -1) {
+        milter_debug("[egg][warm-connection][socket][error] <%s>: %s",
+                     backend->spec, g_strerror(errno));
+        return;
+    }
 
-    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1 ||
+        (connect(fd, backend->address, backend->address_length) == -1 &&
+         errno != EINPROGRESS)) {
+        milter_debug("[egg][warm-connection][connect][error] <%s>: %s",
+                     backend->spec, g_strerror(errno));
+        close(fd);
+        return;
+    }
 
-    child = hatch("name", priv->name,
-                  "connection-timeout", priv->connection_timeout,
-                  "writing-timeout", priv->writing_timeout,
-                  "reading-timeout", priv->reading_timeout,
-                  "end-of-message-timeout", priv->end_of_message_timeout,
-                  "user-name", priv->user_name,
-                  "command", priv->command,
-                  "command-options", priv->command_options,
-                  "fallback-status", priv->fallback_status,
-                  "evaluation-mode", priv->evaluation_mode,
-                  NULL);
+    connection = g_new0(WarmConnection, 1);
+    connection->fd = fd;
+    connection->pid = getpid();
+    connection->created_time = get_current_time();
+    g_queue_push_tail(backend->warm_connections, connection);
+}
 
-    if (priv->connection_spec) {
-        GError *error = NULL;
-        MilterServerContext *context;
+typedef enum {
+    WARM_CONNECTION_READY,
+    WARM_CONNECTION_CONNECTING,
+    WARM_CONNECTION_BROKEN
+} WarmConnectionState;
 
-        context = MILTER_SERVER_CONTEXT(child);
-        if (milter_server_context_set_connection_spec(context,
-                                                      priv->connection_spec,
-                                                      &error)) {
-            g_signal_emit(egg, signals[HATCHED], 0, child);
-        } else {
-            milter_error("[egg][error] invalid connection spec: %s: %s",
-                         error->message,
-                         priv->name ? priv->name : "(null)");
-            g_error_free(error);
+static WarmConnectionState
+check_warm_connection (WarmConnection *connection, gint64 now)
+{
+    struct pollfd poll_fd;
+    gint socket_errno = 0;
+    socklen_t option_length;
+    gchar buffer;
+
+    if (connection->pid != getpid() ||
+        now - connection->created_time > WARM_CONNECTION_MAX_AGE)
+        return WARM_CONNECTION_BROKEN;
+
+    poll_fd.fd = connection->fd;
+    poll_fd.events = POLLOUT;
+    poll_fd.revents = 0;
+    if (poll(&poll_fd, 1, 0) == -1)
+        return WARM_CONNECTION_BROKEN;
+    if (poll_fd.revents & (POLLERR | POLLHUP | POLLNVAL))
+        return WARM_CONNECTION_BROKEN;
+    if (!(poll_fd.revents & POLLOUT))
+        return WARM_CONNECTION_CONNECTING;
+
+    option_length = sizeof(socket_errno);
+    if (getsockopt(connection->fd, SOL_SOCKET, SO_ERROR,
+                   &socket_errno, &option_length) == -1 ||
+        socket_errno != 0)
+        return WARM_CONNECTION_BROKEN;
+
+    /* The peer must not have sent anything, EOF included. */
+    if (recv(connection->fd, &buffer, 1, MSG_PEEK) != -1 ||
+        (errno != EAGAIN && errno != EWOULDBLOCK))
+        return WARM_CONNECTION_BROKEN;
+
+    return WARM_CONNECTION_READY;
+}
+
+static gint
+take_warm_connection (MilterManagerEggPrivate *priv, Backend *backend)
+{
+    WarmConnection *connection;
+    gint64 now;
+
+    now = get_current_time();
+    while ((connection = g_queue_peek_head(backend->warm_connections))) {
+        WarmConnectionState state;
+        gint fd;
+
+        state = check_warm_connection(connection, now);
+        if (state == WARM_CONNECTION_CONNECTING)
+            break;
+
+        g_queue_pop_head(backend->warm_connections);
+        if (state == WARM_CONNECTION_BROKEN) {
+            warm_connection_free(connection);
+            continue;
         }
-    } else {
-        milter_error("[egg][error] must set connection spec: %s",
-                     priv->name ? priv->name : "(null)");
-        g_object_unref(child);
-        child = NULL;
+
+        fd = connection->fd;
+        g_free(connection);
+        priv->n_warm_connection_hits++;
+        return fd;
     }
 
-    return child;
+    priv->n_warm_connection_misses++;
+    return -1;
 }
 
-void
-milter_manager_egg_set_name (MilterManagerEgg *egg, const gchar *name)
+static void
+update_session_rate (MilterManagerEggPrivate *priv)
 {
-    MilterManagerEggPrivate *priv;
+    gint64 now;
 
-    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
-    if (priv->name)
-        g_free(priv->name);
-    priv->name = g_strdup(name);
-}
+    now = get_current_time();
+    if (priv->last_hatched_time > 0 && now > priv->last_hatched_time) {
+        gdouble rate;
 
-const gchar *
-milter_manager_egg_get_name (MilterManagerEgg *egg)
-{
-    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->name;
+        rate = G_USEC_PER_SEC / (gdouble)(now - priv->last_hatched_time);
+        priv->session_rate += (rate - priv->session_rate) * SESSION_RATE_WEIGHT;
+    }
+    priv->last_hatched_time = now;
 }
 
-void
-milter_manager_egg_set_description (MilterManagerEgg *egg,
-                                    const gchar *description)
+/* The rate is updated only on hatch. While no session arrives,
+ * the rate can't be more than one session per idle time. */
+static gdouble
+current_session_rate (MilterManagerEggPrivate *priv, gint64 now)
 {
-    MilterManagerEggPrivate *priv;
+    if (priv->last_hatched_time > 0 && now > priv->last_hatched_time) {
+        gdouble idle_rate;
 
-    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
-    if (priv->description)
-        g_free(priv->description);
-    priv->description = g_strdup(description);
+        idle_rate = G_USEC_PER_SEC / (gdouble)(now - priv->last_hatched_time);
+        return MIN(priv->session_rate, idle_rate);
+    }
+
+    return priv->session_rate;
 }
 
-const gchar *
-milter_manager_egg_get_description (MilterManagerEgg *egg)
+/* Keeps one more socket than sessions expected within
+ * WARM_CONNECTION_HORIZON seconds. */
+static guint
+warm_connection_target (MilterManagerEggPrivate *priv)
 {
-    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->description;
+    gdouble rate;
+    guint target;
+
+    rate = current_session_rate(priv, get_current_time());
+    target = (guint)(rate * WARM_CONNECTION_HORIZON) + 1;
+    return MIN(target, priv->max_warm_connections);
 }
 
-void
-milter_manager_egg_set_enabled (MilterManagerEgg *egg, gboolean enabled)
+static void
+refill_warm_connections (MilterManagerEggPrivate *priv, Backend *backend)
 {
-    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->enabled = enabled;
+    guint target;
+
+    target = warm_connection_target(priv);
+    while (g_queue_get_length(backend->warm_connections) < target) {
+        guint length;
+
+        length = g_queue_get_length(backend->warm_connections);
+        open_warm_connection(backend);
+        if (g_queue_get_length(backend->warm_connections) == length)
+            break;
+    }
+}
+
+static void
+expire_warm_connections (Backend *backend, gint64 now)
+{
+    GList *node, *next_node;
+
+    for (node = backend->warm_connections->head; node; node = next_node) {
+        WarmConnection *connection = node->data;
+
+        next_node = g_list_next(node);
+        if (check_warm_connection(connection, now) != WARM_CONNECTION_BROKEN)
+            continue;
+        g_queue_delete_link(backend->warm_connections, node);
+        warm_connection_free(connection);
+    }
+}
+
+static void
+refill_all_warm_connections (MilterManagerEggPrivate *priv)
+{
+    GList *node;
+    gint64 now;
+
+    now = get_current_time();
+    for (node = priv->backends; node; node = g_list_next(node)) {
+        Backend *backend = node->data;
+
+        if (!backend->address)
+            continue;
+        expire_warm_connections(backend, now);
+        if (is_ejected_backend(priv, backend, now))
+            continue;
+        refill_warm_connections(priv, backend);
+    }
+}
+
+static gboolean
+cb_refill_warm_connections (gpointer user_data)
+{
+    MilterManagerEgg *egg = user_data;
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (priv->max_warm_connections == 0) {
+        priv->warm_connection_refill_id = 0;
+        return FALSE;
+    }
+
+    refill_all_warm_connections(priv);
+    return TRUE;
+}
+
+static gboolean
+cb_idle_refill_warm_connections (gpointer user_data)
+{
+    MilterManagerEgg *egg = user_data;
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    priv->warm_connection_idle_id = 0;
+    if (priv->max_warm_connections > 0)
+        refill_all_warm_connections(priv);
+    return FALSE;
+}
+
+static void
+request_warm_connection_refill (MilterManagerEggPrivate *priv, gpointer egg)
+{
+    if (priv->warm_connection_idle_id > 0)
+        return;
+
+    priv->warm_connection_idle_id =
+        milter_event_loop_add_idle(priv->event_loop,
+                                   cb_idle_refill_warm_connections,
+                                   egg);
+}
+
+/* Sockets are refilled on the event loop so that they are
+ * ready after idle periods and the hatch path doesn't connect
+ * them. The timer also replaces sockets that are too old. */
+static void
+start_warm_connection_refill (MilterManagerEgg *egg)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (!priv->event_loop || priv->max_warm_connections == 0)
+        return;
+
+    if (priv->warm_connection_refill_id == 0) {
+        priv->warm_connection_refill_id =
+            milter_event_loop_add_timeout(priv->event_loop,
+                                          WARM_CONNECTION_REFILL_INTERVAL,
+                                          cb_refill_warm_connections,
+                                          egg);
+    }
+    request_warm_connection_refill(priv, egg);
+}
+
+static void
+stop_warm_connection_refill (MilterManagerEggPrivate *priv)
+{
+    if (!priv->event_loop)
+        return;
+
+    if (priv->warm_connection_refill_id > 0) {
+        milter_event_loop_remove(priv->event_loop,
+                                 priv->warm_connection_refill_id);
+        priv->warm_connection_refill_id = 0;
+    }
+    if (priv->warm_connection_idle_id > 0) {
+        milter_event_loop_remove(priv->event_loop,
+                                 priv->warm_connection_idle_id);
+        priv->warm_connection_idle_id = 0;
+    }
+}
+
+static void
+prepare_warm_connection (MilterManagerEgg *egg,
+                         MilterServerContext *context,
+                         Backend *backend)
+{
+    MilterManagerEggPrivate *priv;
+    gint fd;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (!backend->address)
+        return;
+
+    update_session_rate(priv);
+    fd = take_warm_connection(priv, backend);
+    if (fd != -1)
+        milter_server_context_set_connected_fd(context, fd);
+    if (priv->event_loop) {
+        start_warm_connection_refill(egg);
+    } else {
+        refill_warm_connections(priv, backend);
+    }
+}
+
+static void
+clear_negotiate_cache (MilterManagerEggPrivate *priv)
+{
+    if (priv->cached_option) {
+        g_object_unref(priv->cached_option);
+        priv->cached_option = NULL;
+    }
+
+    if (priv->cached_macros_requests) {
+        g_object_unref(priv->cached_macros_requests);
+        priv->cached_macros_requests = NULL;
+    }
+}
+
+/* Verdicts of the milter are kept within verdict_cache_size by
+ * removing the least recently used ones from the shared cache.
+ * Only verdicts used by this process are counted. */
+static void
+expire_cached_verdicts (MilterManagerEggPrivate *priv)
+{
+    if (priv->verdict_cache_size == 0)
+        return;
+
+    while (g_queue_get_length(priv->cached_verdict_keys) >
+           priv->verdict_cache_size) {
+        gchar *key;
+
+        key = g_queue_pop_tail(priv->cached_verdict_keys);
+        g_hash_table_remove(priv->cached_verdict_key_links, key);
+        if (priv->shared_cache)
+            milter_manager_shared_cache_remove(priv->shared_cache, key);
+        milter_debug("[egg][verdict-cache][expire] <%s>: %s",
+                     key, priv->name ? priv->name : "(null)");
+        g_free(key);
+    }
+}
+
+static void
+cb_verdict_used (MilterManagerEgg *egg,
+                 const gchar *key,
+                 MilterManagerChild *child)
+{
+    MilterManagerEggPrivate *priv;
+    GList *link;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+
+    link = g_hash_table_lookup(priv->cached_verdict_key_links, key);
+    if (link) {
+        g_queue_unlink(priv->cached_verdict_keys, link);
+        g_queue_push_head_link(priv->cached_verdict_keys, link);
+        return;
+    }
+
+    g_queue_push_head(priv->cached_verdict_keys, g_strdup(key));
+    link = g_queue_peek_head_link(priv->cached_verdict_keys);
+    g_hash_table_insert(priv->cached_verdict_key_links, link->data, link);
+    expire_cached_verdicts(priv);
+}
+
+static void
+cb_negotiate_reply (MilterManagerEgg *egg,
+                    MilterOption *option,
+                    MilterMacrosRequests *macros_requests,
+                    MilterServerContext *context)
+{
+    MilterManagerEggPrivate *priv;
+    MilterMacrosRequests *requests;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+
+    requests = milter_macros_requests_new();
+    if (macros_requests)
+        milter_macros_requests_merge(requests, macros_requests);
+
+    if (priv->cached_option) {
+        if (milter_option_equal(priv->cached_option, option) &&
+            milter_macros_requests_equal(priv->cached_macros_requests,
+                                         requests)) {
+            g_object_unref(requests);
+            return;
+        }
+        milter_info("[egg][negotiate-cache][invalidate] %s",
+                    priv->name ? priv->name : "(null)");
+        clear_negotiate_cache(priv);
+        g_object_unref(requests);
+        return;
+    }
+
+    priv->cached_option = milter_option_copy(option);
+    priv->cached_macros_requests = requests;
+}
+
+static void
+log_warm_connections (MilterManagerEggPrivate *priv)
+{
+    GList *node;
+    guint n_connections = 0;
+
+    if (priv->max_warm_connections == 0)
+        return;
+
+    for (node = priv->backends; node; node = g_list_next(node)) {
+        Backend *backend = node->data;
+        n_connections += g_queue_get_length(backend->warm_connections);
+    }
+    milter_statistics("[egg][warm-connection][%s] "
+                      "connections=%u hits=%u misses=%u rate=%g",
+                      priv->name ? priv->name : "(null)",
+                      n_connections,
+                      priv->n_warm_connection_hits,
+                      priv->n_warm_connection_misses,
+                      priv->session_rate);
+    priv->n_warm_connection_hits = 0;
+    priv->n_warm_connection_misses = 0;
+}
+
+static void
+cb_backend_child_weak_notify (gpointer data, GObject *where_the_object_was)
+{
+    MilterManagerEgg *egg = data;
+    MilterManagerEggPrivate *priv;
+    BackendSession *session;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    session = g_hash_table_lookup(priv->backend_sessions, where_the_object_was);
+    if (!session)
+        return;
+
+    session->backend->n_outstanding--;
+    g_hash_table_remove(priv->backend_sessions, where_the_object_was);
+}
+
+static void
+clear_backends (MilterManagerEgg *egg)
+{
+    MilterManagerEggPrivate *priv;
+    GHashTableIter iter;
+    gpointer child;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    g_hash_table_iter_init(&iter, priv->backend_sessions);
+    while (g_hash_table_iter_next(&iter, &child, NULL)) {
+        g_object_weak_unref(child, cb_backend_child_weak_notify, egg);
+    }
+    g_hash_table_remove_all(priv->backend_sessions);
+
+    g_list_foreach(priv->backends, (GFunc)backend_free, NULL);
+    g_list_free(priv->backends);
+    priv->backends = NULL;
+}
+
+static gboolean
+is_ejected_backend (MilterManagerEggPrivate *priv, Backend *backend, gint64 now)
+{
+    return backend->ejected_time > 0 &&
+        now - backend->ejected_time <
+        priv->backend_ejection_time * G_USEC_PER_SEC;
+}
+
+static gboolean
+is_better_backend (Backend *backend, Backend *current)
+{
+    if (!current)
+        return TRUE;
+    if (backend->n_outstanding != current->n_outstanding)
+        return backend->n_outstanding < current->n_outstanding;
+    return backend->latency < current->latency;
+}
+
+/* Picks the backend with the least outstanding sessions. The
+ * lower latency wins a tie. All backends are candidates if all
+ * of them are ejected and no backend is excluded. */
+static Backend *
+choose_backend (MilterManagerEggPrivate *priv, Backend *excluded)
+{
+    GList *node;
+    Backend *chosen = NULL;
+    gint64 now;
+
+    now = get_current_time();
+    for (node = priv->backends; node; node = g_list_next(node)) {
+        Backend *backend = node->data;
+
+        if (backend == excluded || is_ejected_backend(priv, backend, now))
+            continue;
+        if (is_better_backend(backend, chosen))
+            chosen = backend;
+    }
+
+    if (!chosen && !excluded) {
+        for (node = priv->backends; node; node = g_list_next(node)) {
+            if (is_better_backend(node->data, chosen))
+                chosen = node->data;
+        }
+    }
+
+    return chosen;
+}
+
+static void
+start_backend_session (MilterManagerEgg *egg,
+                       MilterManagerChild *child,
+                       Backend *backend)
+{
+    MilterManagerEggPrivate *priv;
+    BackendSession *session;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    session = g_new0(BackendSession, 1);
+    session->backend = backend;
+    session->n_tries = 1;
+    backend->n_outstanding++;
+    backend->n_sessions++;
+    g_hash_table_insert(priv->backend_sessions, child, session);
+    g_object_weak_ref(G_OBJECT(child), cb_backend_child_weak_notify, egg);
+}
+
+static void
+record_backend_result (MilterManagerEgg *egg,
+                       MilterServerContext *context,
+                       gboolean success,
+                       gdouble elapsed)
+{
+    MilterManagerEggPrivate *priv;
+    BackendSession *session;
+    Backend *backend;
+    const gchar *name;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    session = g_hash_table_lookup(priv->backend_sessions, context);
+    if (!session)
+        return;
+
+    backend = session->backend;
+    name = priv->name ? priv->name : "(null)";
+    if (success) {
+        if (backend->latency == 0)
+            backend->latency = elapsed;
+        else
+            backend->latency +=
+                (elapsed - backend->latency) * BACKEND_LATENCY_WEIGHT;
+        backend->n_consecutive_failures = 0;
+        if (backend->ejected_time > 0) {
+            backend->ejected_time = 0;
+            milter_info("[egg][backend][restore] <%s>: %s",
+                        backend->spec, name);
+            milter_statistics("[egg][backend][restore]: %s: %s",
+                              name, backend->spec);
+        }
+        return;
+    }
+
+    backend->n_failures++;
+    backend->n_consecutive_failures++;
+    if (backend->n_consecutive_failures >= priv->backend_ejection_failures &&
+        !is_ejected_backend(priv, backend, get_current_time())) {
+        backend->ejected_time = get_current_time();
+        milter_warning("[egg][backend][eject] <%s>: failures=<%u>: %s",
+                       backend->spec, backend->n_consecutive_failures, name);
+        milter_statistics("[egg][backend][eject]: %s: %s",
+                          name, backend->spec);
+    }
+}
+
+/* Called by MilterManagerChildren through the "failover" signal
+ * when connecting to the current backend fails or times out. The
+ * failure is recorded here so that it is counted for the backend
+ * that failed, not for the next one. */
+static gboolean
+cb_failover (MilterManagerEgg *egg, MilterServerContext *context)
+{
+    MilterManagerEggPrivate *priv;
+    BackendSession *session;
+    Backend *backend;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    session = g_hash_table_lookup(priv->backend_sessions, context);
+    if (!session)
+        return FALSE;
+
+    record_backend_result(egg, context, FALSE, 0);
+    if (session->n_tries >= g_list_length(priv->backends))
+        return FALSE;
+
+    backend = choose_backend(priv, session->backend);
+    if (!backend)
+        return FALSE;
+    if (!milter_server_context_set_connection_spec(context, backend->spec,
+                                                   NULL))
+        return FALSE;
+
+    milter_info("[egg][backend][failover] <%s> -> <%s>: %s",
+                session->backend->spec,
+                backend->spec,
+                priv->name ? priv->name : "(null)");
+    session->backend->n_outstanding--;
+    backend->n_outstanding++;
+    backend->n_sessions++;
+    session->backend = backend;
+    session->n_tries++;
+
+    return TRUE;
+}
+
+static void
+log_backends (MilterManagerEggPrivate *priv)
+{
+    GList *node;
+    gint64 now;
+
+    if (!priv->backends || !priv->backends->next)
+        return;
+
+    now = get_current_time();
+    for (node = priv->backends; node; node = g_list_next(node)) {
+        Backend *backend = node->data;
+
+        milter_statistics("[egg][backend][%s][%s] "
+                          "outstanding=%u "
+                          "sessions=%" G_GUINT64_FORMAT " "
+                          "failures=%" G_GUINT64_FORMAT " "
+                          "latency=%g ejected=%s",
+                          priv->name ? priv->name : "(null)",
+                          backend->spec,
+                          backend->n_outstanding,
+                          backend->n_sessions,
+                          backend->n_failures,
+                          backend->latency,
+                          is_ejected_backend(priv, backend, now) ?
+                          "true" : "false");
+    }
+}
+
+static void
+cb_replied (MilterManagerEgg *egg,
+            MilterServerContextState state,
+            gdouble elapsed,
+            MilterServerContext *context)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    milter_manager_egg_record_latency(egg, state, elapsed);
+    record_backend_result(egg, context, TRUE, elapsed);
+    if (state == MILTER_SERVER_CONTEXT_STATE_END_OF_MESSAGE) {
+        MilterMessageResult *result;
+
+        result = milter_server_context_get_message_result(context);
+        if (result) {
+            priv->end_of_message_body_size +=
+                milter_message_result_get_body_size(result);
+            priv->n_end_of_messages++;
+        }
+    }
+    if (priv->circuit_breaker_latency_threshold > 0 &&
+        elapsed > priv->circuit_breaker_latency_threshold) {
+        milter_manager_egg_record_circuit_result(egg, FALSE, "slow");
+    } else {
+        milter_manager_egg_record_circuit_result(egg, TRUE, NULL);
+    }
+}
+
+static void
+cb_timeout (MilterManagerEgg *egg, MilterServerContext *context)
+{
+    milter_manager_egg_record_circuit_result(egg, FALSE, "timeout");
+    record_backend_result(egg, context, FALSE, 0);
+}
+
+static void
+cb_connection_timeout (MilterManagerEgg *egg, MilterServerContext *context)
+{
+    milter_manager_egg_record_circuit_result(egg, FALSE, "timeout");
+}
+
+static void
+cb_error (MilterManagerEgg *egg, GError *error, MilterServerContext *context)
+{
+    milter_manager_egg_record_circuit_result(egg, FALSE, "error");
+    if (!g_error_matches(error,
+                         MILTER_SERVER_CONTEXT_ERROR,
+                         MILTER_SERVER_CONTEXT_ERROR_CONNECTION_FAILURE))
+        record_backend_result(egg, context, FALSE, 0);
+}
+
+static gboolean
+cb_stop_on_end_of_message (MilterManagerEgg *egg,
+                           const gchar *chunk,
+                           gsize size,
+                           MilterServerContext *context)
+{
+    MilterMessageResult *result;
+    guint64 body_size = 0;
+    gdouble timeout;
+
+    result = milter_server_context_get_message_result(context);
+    if (result)
+        body_size = milter_message_result_get_body_size(result);
+    timeout =
+        milter_manager_egg_get_effective_end_of_message_timeout(egg, body_size);
+    milter_debug("[%u] [egg][adaptive-timeout][end-of-message] "
+                 "<%g>: body-size=<%" G_GUINT64_FORMAT ">: %s",
+                 milter_agent_get_tag(MILTER_AGENT(context)),
+                 timeout,
+                 body_size,
+                 milter_server_context_get_name(context));
+    milter_server_context_set_end_of_message_timeout(context, timeout);
+
+    return FALSE;
+}
+
+static MilterManagerChild *
+hatch (const gchar *first_name, ...)
+{
+    MilterManagerChild *child;
+    va_list args;
+
+    va_start(args, first_name);
+    child = milter_manager_child_new_va_list(first_name, args);
+    va_end(args);
+
+    return child;
+}
+
+MilterManagerChild *
+milter_manager_egg_hatch (MilterManagerEgg *egg)
+{
+    MilterManagerChild *child;
+    MilterManagerEggPrivate *priv;
+    const gchar *connection_spec;
+    Backend *backend = NULL;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+
+    /* Sampling is decided first because need_bypass() may take
+     * the probe of the half-open circuit. */
+    if (!sample_evaluation(egg))
+        return NULL;
+
+    connection_spec = priv->connection_spec;
+    if (priv->backends && priv->backends->next) {
+        backend = choose_backend(priv, NULL);
+        connection_spec = backend->spec;
+    }
+
+    child = hatch("name", priv->name,
+                  "connection-timeout", effective_connection_timeout(priv),
+                  "writing-timeout", priv->writing_timeout,
+                  "reading-timeout", effective_reading_timeout(priv),
+                  "end-of-message-timeout", priv->end_of_message_timeout,
+                  "user-name", priv->user_name,
+                  "command", priv->command,
+                  "command-options", priv->command_options,
+                  "fallback-status", priv->fallback_status,
+                  "evaluation-mode", priv->evaluation_mode,
+                  "bypassed", need_bypass(egg),
+                  NULL);
+
+    if (priv->connection_spec) {
+        GError *error = NULL;
+        MilterServerContext *context;
+
+        context = MILTER_SERVER_CONTEXT(child);
+        g_signal_connect_object(child, "replied",
+                                G_CALLBACK(cb_replied), egg,
+                                G_CONNECT_SWAPPED);
+        g_signal_connect_object(child, "connection-timeout",
+                                G_CALLBACK(cb_connection_timeout), egg,
+                                G_CONNECT_SWAPPED);
+        g_signal_connect_object(child, "writing-timeout",
+                                G_CALLBACK(cb_timeout), egg,
+                                G_CONNECT_SWAPPED);
+        g_signal_connect_object(child, "reading-timeout",
+                                G_CALLBACK(cb_timeout), egg,
+                                G_CONNECT_SWAPPED);
+        g_signal_connect_object(child, "end-of-message-timeout",
+                                G_CALLBACK(cb_timeout), egg,
+                                G_CONNECT_SWAPPED);
+        g_signal_connect_object(child, "error",
+                                G_CALLBACK(cb_error), egg,
+                                G_CONNECT_SWAPPED);
+        if (backend)
+            g_signal_connect_object(child, "failover",
+                                    G_CALLBACK(cb_failover), egg,
+                                    G_CONNECT_SWAPPED);
+        if (priv->adaptive_timeout)
+            g_signal_connect_object(child, "stop-on-end-of-message",
+                                    G_CALLBACK(cb_stop_on_end_of_message), egg,
+                                    G_CONNECT_SWAPPED);
+        if (priv->negotiate_cache) {
+            g_signal_connect_object(child, "negotiate-reply",
+                                    G_CALLBACK(cb_negotiate_reply), egg,
+                                    G_CONNECT_SWAPPED);
+            if (priv->cached_option)
+                milter_manager_child_set_cached_negotiate_reply(
+                    child,
+                    priv->cached_option,
+                    priv->cached_macros_requests);
+        }
+        if (priv->evaluation_mode &&
+            priv->evaluation_sampling_by_client_address)
+            milter_manager_child_set_evaluation_sampling_rate(
+                child, priv->evaluation_sampling_rate);
+        if (priv->verdict_cache_ttl > 0.0) {
+            if (priv->shared_cache) {
+                milter_manager_child_set_verdict_cache(child,
+                                                       priv->shared_cache,
+                                                       priv->verdict_cache_ttl);
+                g_signal_connect_object(child, "verdict-used",
+                                        G_CALLBACK(cb_verdict_used), egg,
+                                        G_CONNECT_SWAPPED);
+            } else if (!priv->verdict_cache_disabled_reported) {
+                milter_warning("[egg][verdict-cache][disabled] "
+                               "shared cache isn't available: "
+                               "manager.shared_cache_size must not be 0: %s",
+                               priv->name ? priv->name : "(null)");
+                priv->verdict_cache_disabled_reported = TRUE;
+            }
+        }
+        if (milter_server_context_set_connection_spec(context,
+                                                      connection_spec,
+                                                      &error)) {
+            if (!milter_manager_child_is_bypassed(child))
+                admit_session(egg, child);
+            if (backend && !milter_manager_child_is_bypassed(child))
+                start_backend_session(egg, child, backend);
+            if (priv->max_warm_connections > 0 &&
+                !milter_manager_child_is_bypassed(child) &&
+                !milter_manager_child_is_queued(child))
+                prepare_warm_connection(egg, context,
+                                        backend ? backend :
+                                        priv->backends->data);
+            g_signal_emit(egg, signals[HATCHED], 0, child);
+        } else {
+            milter_error("[egg][error] invalid connection spec: %s: %s",
+                         error->message,
+                         priv->name ? priv->name : "(null)");
+            g_error_free(error);
+        }
+    } else {
+        milter_error("[egg][error] must set connection spec: %s",
+                     priv->name ? priv->name : "(null)");
+        g_object_unref(child);
+        child = NULL;
+    }
+
+    return child;
+}
+
+void
+milter_manager_egg_set_name (MilterManagerEgg *egg, const gchar *name)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (priv->name)
+        g_free(priv->name);
+    priv->name = g_strdup(name);
+}
+
+const gchar *
+milter_manager_egg_get_name (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->name;
+}
+
+void
+milter_manager_egg_set_description (MilterManagerEgg *egg,
+                                    const gchar *description)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (priv->description)
+        g_free(priv->description);
+    priv->description = g_strdup(description);
+}
+
+const gchar *
+milter_manager_egg_get_description (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->description;
+}
+
+void
+milter_manager_egg_set_enabled (MilterManagerEgg *egg, gboolean enabled)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->enabled = enabled;
+}
+
+gboolean
+milter_manager_egg_is_enabled (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->enabled;
+}
+
+static gboolean
+validate_connection_spec (MilterManagerEggPrivate *priv,
+                          const gchar *spec, GError **error)
+{
+    GError *spec_error = NULL;
+    gboolean success = TRUE;
+    gint domain;
+    struct sockaddr *address = NULL;
+    socklen_t address_length;
+
+    if (spec)
+        success = milter_connection_parse_spec(spec,
+                                               &domain,
+                                               &address,
+                                               &address_length,
+                                               &spec_error);
+
+    if (address)
+        g_free(address);
+
+    if (!success) {
+        GError *wrapped_error = NULL;
+
+        milter_utils_set_error_with_sub_error(&wrapped_error,
+                                              MILTER_MANAGER_EGG_ERROR,
+                                              MILTER_MANAGER_EGG_ERROR_INVALID,
+                                              spec_error,
+                                              "<%s>: invalid connection spec",
+                                              priv->name ? priv->name : "(null)");
+        milter_error("[egg][error][set-spec] %s", wrapped_error->message);
+        if (error)
+            *error = g_error_copy(wrapped_error);
+        g_error_free(wrapped_error);
+    }
+
+    return success;
+}
+
+gboolean
+milter_manager_egg_set_connection_spec (MilterManagerEgg *egg,
+                                        const gchar *spec, GError **error)
+
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+
+    if (!validate_connection_spec(priv, spec, error))
+        return FALSE;
+
+    if (priv->connection_spec)
+        g_free(priv->connection_spec);
+    priv->connection_spec = g_strdup(spec);
+
+    clear_backends(egg);
+    if (spec)
+        priv->backends = g_list_append(priv->backends, backend_new(spec));
+
+    return TRUE;
+}
+
+gboolean
+milter_manager_egg_add_connection_spec (MilterManagerEgg *egg,
+                                        const gchar *spec, GError **error)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+
+    if (!priv->connection_spec)
+        return milter_manager_egg_set_connection_spec(egg, spec, error);
+
+    if (!validate_connection_spec(priv, spec, error))
+        return FALSE;
+
+    priv->backends = g_list_append(priv->backends, backend_new(spec));
+
+    return TRUE;
+}
+
+GList *
+milter_manager_egg_get_connection_specs (MilterManagerEgg *egg)
+{
+    MilterManagerEggPrivate *priv;
+    GList *specs = NULL, *node;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    for (node = priv->backends; node; node = g_list_next(node)) {
+        Backend *backend = node->data;
+        specs = g_list_prepend(specs, backend->spec);
+    }
+
+    return g_list_reverse(specs);
+}
+
+void
+milter_manager_egg_set_backend_ejection_failures (MilterManagerEgg *egg,
+                                                  guint n_failures)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->backend_ejection_failures =
+        n_failures;
+}
+
+guint
+milter_manager_egg_get_backend_ejection_failures (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->backend_ejection_failures;
+}
+
+void
+milter_manager_egg_set_backend_ejection_time (MilterManagerEgg *egg,
+                                              gdouble           time)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->backend_ejection_time = time;
+}
+
+gdouble
+milter_manager_egg_get_backend_ejection_time (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->backend_ejection_time;
+}
+
+void
+milter_manager_egg_set_max_warm_connections (MilterManagerEgg *egg,
+                                             guint n_connections)
+{
+    MilterManagerEggPrivate *priv;
+    GList *node;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    priv->max_warm_connections = n_connections;
+    for (node = priv->backends; node; node = g_list_next(node)) {
+        Backend *backend = node->data;
+
+        while (g_queue_get_length(backend->warm_connections) > n_connections) {
+            warm_connection_free(g_queue_pop_tail(backend->warm_connections));
+        }
+    }
+    if (n_connections == 0)
+        stop_warm_connection_refill(priv);
+    else
+        start_warm_connection_refill(egg);
+}
+
+guint
+milter_manager_egg_get_max_warm_connections (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->max_warm_connections;
+}
+
+void
+milter_manager_egg_set_negotiate_cache (MilterManagerEgg *egg,
+                                        gboolean          cache)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    priv->negotiate_cache = cache;
+    if (!cache)
+        clear_negotiate_cache(priv);
+}
+
+gboolean
+milter_manager_egg_get_negotiate_cache (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->negotiate_cache;
+}
+
+MilterOption *
+milter_manager_egg_get_cached_option (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->cached_option;
+}
+
+void
+milter_manager_egg_set_verdict_cache_ttl (MilterManagerEgg *egg,
+                                          gdouble           ttl)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->verdict_cache_ttl = MAX(ttl, 0.0);
+}
+
+gdouble
+milter_manager_egg_get_verdict_cache_ttl (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->verdict_cache_ttl;
+}
+
+void
+milter_manager_egg_set_verdict_cache_size (MilterManagerEgg *egg,
+                                           guint             size)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    priv->verdict_cache_size = size;
+    expire_cached_verdicts(priv);
+}
+
+guint
+milter_manager_egg_get_verdict_cache_size (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->verdict_cache_size;
+}
+
+guint
+milter_manager_egg_get_n_cached_verdicts (MilterManagerEgg *egg)
+{
+    return g_queue_get_length(
+        MILTER_MANAGER_EGG_GET_PRIVATE(egg)->cached_verdict_keys);
+}
+
+guint
+milter_manager_egg_get_n_warm_connections (MilterManagerEgg *egg)
+{
+    MilterManagerEggPrivate *priv;
+    GList *node;
+    guint n_connections = 0;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    for (node = priv->backends; node; node = g_list_next(node)) {
+        Backend *backend = node->data;
+        n_connections += g_queue_get_length(backend->warm_connections);
+    }
+
+    return n_connections;
+}
+
+gboolean
+milter_manager_egg_get_backend_summary (MilterManagerEgg *egg,
+                                        const gchar *spec,
+                                        MilterManagerEggBackendSummary *summary)
+{
+    MilterManagerEggPrivate *priv;
+    GList *node;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    for (node = priv->backends; node; node = g_list_next(node)) {
+        Backend *backend = node->data;
+
+        if (!g_str_equal(backend->spec, spec))
+            continue;
+
+        summary->n_outstanding_sessions = backend->n_outstanding;
+        summary->n_sessions = backend->n_sessions;
+        summary->n_failures = backend->n_failures;
+        summary->latency = backend->latency;
+        summary->ejected =
+            is_ejected_backend(priv, backend, get_current_time());
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+const gchar *
+milter_manager_egg_get_connection_spec (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->connection_spec;
+}
+
+void
+milter_manager_egg_set_connection_timeout (MilterManagerEgg *egg,
+                                           gdouble connection_timeout)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    priv->connection_timeout = connection_timeout;
+}
+
+gdouble
+milter_manager_egg_get_connection_timeout (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->connection_timeout;
+}
+
+void
+milter_manager_egg_set_writing_timeout (MilterManagerEgg *egg,
+                                        gdouble writing_timeout)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    priv->writing_timeout = writing_timeout;
+}
+
+gdouble
+milter_manager_egg_get_writing_timeout (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->writing_timeout;
+}
+
+void
+milter_manager_egg_set_reading_timeout (MilterManagerEgg *egg,
+                                        gdouble reading_timeout)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    priv->reading_timeout = reading_timeout;
+}
+
+gdouble
+milter_manager_egg_get_reading_timeout (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->reading_timeout;
+}
+
+void
+milter_manager_egg_set_end_of_message_timeout (MilterManagerEgg *egg,
+                                               gdouble end_of_message_timeout)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    priv->end_of_message_timeout = end_of_message_timeout;
+}
+
+gdouble
+milter_manager_egg_get_end_of_message_timeout (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->end_of_message_timeout;
+}
+
+void
+milter_manager_egg_set_user_name (MilterManagerEgg *egg,
+                                  const gchar *user_name)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (priv->user_name)
+        g_free(priv->user_name);
+    priv->user_name = g_strdup(user_name);
+}
+
+const gchar *
+milter_manager_egg_get_user_name (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->user_name;
+}
+
+void
+milter_manager_egg_set_command (MilterManagerEgg *egg,
+                                const gchar *command)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (priv->command)
+        g_free(priv->command);
+    priv->command = g_strdup(command);
+}
+
+const gchar *
+milter_manager_egg_get_command (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->command;
+}
+
+void
+milter_manager_egg_set_command_options (MilterManagerEgg *egg,
+                                        const gchar *command_options)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (priv->command_options)
+        g_free(priv->command_options);
+    priv->command_options = g_strdup(command_options);
+}
+
+const gchar *
+milter_manager_egg_get_command_options (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->command_options;
+}
+
+void
+milter_manager_egg_set_fallback_status (MilterManagerEgg *egg,
+                                        MilterStatus      status)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->fallback_status = status;
+}
+
+MilterStatus
+milter_manager_egg_get_fallback_status (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->fallback_status;
+}
+
+void
+milter_manager_egg_set_evaluation_mode (MilterManagerEgg *egg,
+                                        gboolean          evaluation_mode)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->evaluation_mode = evaluation_mode;
 }
 
 gboolean
-milter_manager_egg_is_enabled (MilterManagerEgg *egg)
+milter_manager_egg_is_evaluation_mode (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->evaluation_mode;
+}
+
+void
+milter_manager_egg_set_evaluation_sampling_rate (MilterManagerEgg *egg,
+                                                 gdouble           rate)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->evaluation_sampling_rate =
+        CLAMP(rate, 0.0, 1.0);
+}
+
+gdouble
+milter_manager_egg_get_evaluation_sampling_rate (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->evaluation_sampling_rate;
+}
+
+void
+milter_manager_egg_set_evaluation_sampling_by_client_address (MilterManagerEgg *egg,
+                                                              gboolean          by_client_address)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->evaluation_sampling_by_client_address =
+        by_client_address;
+}
+
+gboolean
+milter_manager_egg_is_evaluation_sampling_by_client_address (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->evaluation_sampling_by_client_address;
+}
+
+void
+milter_manager_egg_set_latency_window (MilterManagerEgg *egg,
+                                       gdouble           window)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->latency_window = window;
+}
+
+gdouble
+milter_manager_egg_get_latency_window (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->latency_window;
+}
+
+void
+milter_manager_egg_set_shared_cache (MilterManagerEgg *egg,
+                                     MilterManagerSharedCache *cache)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (priv->shared_cache == cache)
+        return;
+
+    if (priv->shared_cache)
+        g_object_unref(priv->shared_cache);
+    priv->shared_cache = cache;
+    if (priv->shared_cache)
+        g_object_ref(priv->shared_cache);
+}
+
+MilterManagerSharedCache *
+milter_manager_egg_get_shared_cache (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->shared_cache;
+}
+
+void
+milter_manager_egg_set_event_loop (MilterManagerEgg *egg,
+                                   MilterEventLoop  *loop)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (priv->event_loop == loop)
+        return;
+
+    stop_warm_connection_refill(priv);
+    if (priv->event_loop)
+        g_object_unref(priv->event_loop);
+    priv->event_loop = loop;
+    if (priv->event_loop)
+        g_object_ref(priv->event_loop);
+    start_warm_connection_refill(egg);
+}
+
+MilterEventLoop *
+milter_manager_egg_get_event_loop (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->event_loop;
+}
+
+void
+milter_manager_egg_set_circuit_breaker_threshold (MilterManagerEgg *egg,
+                                                  gdouble           threshold)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->circuit_breaker_threshold = threshold;
+}
+
+gdouble
+milter_manager_egg_get_circuit_breaker_threshold (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->circuit_breaker_threshold;
+}
+
+void
+milter_manager_egg_set_circuit_breaker_minimum_requests (MilterManagerEgg *egg,
+                                                         guint n_requests)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->circuit_breaker_minimum_requests =
+        n_requests;
+}
+
+guint
+milter_manager_egg_get_circuit_breaker_minimum_requests (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->circuit_breaker_minimum_requests;
+}
+
+void
+milter_manager_egg_set_circuit_breaker_window (MilterManagerEgg *egg,
+                                               gdouble           window)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->circuit_breaker_window = window;
+}
+
+gdouble
+milter_manager_egg_get_circuit_breaker_window (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->circuit_breaker_window;
+}
+
+void
+milter_manager_egg_set_circuit_breaker_open_time (MilterManagerEgg *egg,
+                                                  gdouble           open_time)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->circuit_breaker_open_time = open_time;
+}
+
+gdouble
+milter_manager_egg_get_circuit_breaker_open_time (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->circuit_breaker_open_time;
+}
+
+void
+milter_manager_egg_set_circuit_breaker_latency_threshold (MilterManagerEgg *egg,
+                                                          gdouble threshold)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->circuit_breaker_latency_threshold =
+        threshold;
+}
+
+gdouble
+milter_manager_egg_get_circuit_breaker_latency_threshold (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->circuit_breaker_latency_threshold;
+}
+
+void
+milter_manager_egg_set_adaptive_timeout (MilterManagerEgg *egg,
+                                         gboolean          adaptive)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->adaptive_timeout = adaptive;
+}
+
+gboolean
+milter_manager_egg_is_adaptive_timeout (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->adaptive_timeout;
+}
+
+void
+milter_manager_egg_set_adaptive_timeout_percentile (MilterManagerEgg *egg,
+                                                    gdouble percentile)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->adaptive_timeout_percentile =
+        percentile;
+}
+
+gdouble
+milter_manager_egg_get_adaptive_timeout_percentile (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->adaptive_timeout_percentile;
+}
+
+void
+milter_manager_egg_set_adaptive_timeout_factor (MilterManagerEgg *egg,
+                                                gdouble           factor)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->adaptive_timeout_factor = factor;
+}
+
+gdouble
+milter_manager_egg_get_adaptive_timeout_factor (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->adaptive_timeout_factor;
+}
+
+void
+milter_manager_egg_set_adaptive_timeout_minimum (MilterManagerEgg *egg,
+                                                 gdouble           minimum)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->adaptive_timeout_minimum = minimum;
+}
+
+gdouble
+milter_manager_egg_get_adaptive_timeout_minimum (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->adaptive_timeout_minimum;
+}
+
+void
+milter_manager_egg_set_max_concurrent_sessions (MilterManagerEgg *egg,
+                                                guint             n_sessions)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->max_concurrent_sessions = n_sessions;
+}
+
+guint
+milter_manager_egg_get_max_concurrent_sessions (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->max_concurrent_sessions;
+}
+
+void
+milter_manager_egg_set_max_queued_sessions (MilterManagerEgg *egg,
+                                            guint             n_sessions)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->max_queued_sessions = n_sessions;
+}
+
+guint
+milter_manager_egg_get_max_queued_sessions (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->max_queued_sessions;
+}
+
+void
+milter_manager_egg_set_queue_timeout (MilterManagerEgg *egg,
+                                      gdouble           timeout)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (timeout > MILTER_MANAGER_EGG_MAXIMUM_QUEUE_TIMEOUT) {
+        milter_warning("[egg][queue-timeout][capped] <%g> -> <%g>: %s",
+                       timeout,
+                       MILTER_MANAGER_EGG_MAXIMUM_QUEUE_TIMEOUT,
+                       priv->name ? priv->name : "(null)");
+        timeout = MILTER_MANAGER_EGG_MAXIMUM_QUEUE_TIMEOUT;
+    }
+    priv->queue_timeout = timeout;
+}
+
+gdouble
+milter_manager_egg_get_queue_timeout (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->queue_timeout;
+}
+
+void
+milter_manager_egg_set_shed_status (MilterManagerEgg *egg,
+                                    MilterStatus      status)
+{
+    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->shed_status = status;
+}
+
+MilterStatus
+milter_manager_egg_get_shed_status (MilterManagerEgg *egg)
+{
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->shed_status;
+}
+
+const gchar *
+milter_manager_egg_latency_stage_name (MilterServerContextState state)
+{
+    switch (state) {
+    case MILTER_SERVER_CONTEXT_STATE_START:
+        return "establish";
+    case MILTER_SERVER_CONTEXT_STATE_NEGOTIATE:
+        return "negotiate";
+    case MILTER_SERVER_CONTEXT_STATE_CONNECT:
+        return "connect";
+    case MILTER_SERVER_CONTEXT_STATE_HELO:
+        return "helo";
+    case MILTER_SERVER_CONTEXT_STATE_ENVELOPE_FROM:
+        return "envelope-from";
+    case MILTER_SERVER_CONTEXT_STATE_ENVELOPE_RECIPIENT:
+        return "envelope-recipient";
+    case MILTER_SERVER_CONTEXT_STATE_DATA:
+        return "data";
+    case MILTER_SERVER_CONTEXT_STATE_UNKNOWN:
+        return "unknown";
+    case MILTER_SERVER_CONTEXT_STATE_HEADER:
+        return "header";
+    case MILTER_SERVER_CONTEXT_STATE_END_OF_HEADER:
+        return "end-of-header";
+    case MILTER_SERVER_CONTEXT_STATE_BODY:
+        return "body";
+    case MILTER_SERVER_CONTEXT_STATE_END_OF_MESSAGE:
+        return "end-of-message";
+    default:
+        return NULL;
+    }
+}
+
+static gint64
+get_current_time (void)
+{
+    GTimeVal time_value;
+
+    g_get_current_time(&time_value);
+    return (gint64)time_value.tv_sec * G_USEC_PER_SEC + time_value.tv_usec;
+}
+
+static void
+summarize_latency (MilterManagerEggPrivate *priv,
+                   MilterHistogram *histogram,
+                   MilterManagerEggLatencySummary *summary)
+{
+#define TO_SECONDS(usec) ((usec) / (gdouble)G_USEC_PER_SEC)
+    summary->window_start = priv->latency_window_start;
+    summary->count = milter_histogram_get_count(histogram);
+    summary->mean = TO_SECONDS(milter_histogram_get_mean(histogram));
+    summary->p50 =
+        TO_SECONDS(milter_histogram_get_value_at_percentile(histogram, 50.0));
+    summary->p90 =
+        TO_SECONDS(milter_histogram_get_value_at_percentile(histogram, 90.0));
+    summary->p99 =
+        TO_SECONDS(milter_histogram_get_value_at_percentile(histogram, 99.0));
+    summary->max = TO_SECONDS(milter_histogram_get_max(histogram));
+#undef TO_SECONDS
+}
+
+/* Summaries are pinned so that cached DNSBL results or verdicts
+ * never evict them. If there is no room for them, the controller
+ * just doesn't report them. It is logged only once until they
+ * can be published again. */
+static void
+publish_summary (MilterManagerEggPrivate *priv,
+                 const gchar *key,
+                 gconstpointer summary,
+                 gsize summary_size,
+                 gdouble ttl)
+{
+    if (milter_manager_shared_cache_set_pinned(priv->shared_cache, key,
+                                               summary, summary_size,
+                                               ttl)) {
+        priv->summary_publish_failed = FALSE;
+        return;
+    }
+
+    if (!priv->summary_publish_failed)
+        milter_warning("[egg][statistics][publish][error] <%s>: "
+                       "no room in the shared cache: <%s>",
+                       priv->name ? priv->name : "", key);
+    priv->summary_publish_failed = TRUE;
+}
+
+static gchar *
+latency_key (MilterManagerEggPrivate *priv,
+             pid_t pid,
+             MilterServerContextState state)
+{
+    return g_strdup_printf("latency:%d:%s:%s",
+                           (gint)pid,
+                           priv->name ? priv->name : "",
+                           milter_manager_egg_latency_stage_name(state));
+}
+
+static void
+publish_latencies (MilterManagerEggPrivate *priv)
+{
+    guint i;
+    gdouble ttl;
+
+    if (!priv->shared_cache)
+        return;
+
+    ttl = priv->latency_window > 0 ? priv->latency_window * 2 : 3600;
+    for (i = 0; i < N_LATENCY_STAGES; i++) {
+        MilterManagerEggLatencySummary summary;
+        gchar *key;
+
+        if (!priv->latencies[i])
+            continue;
+
+        summarize_latency(priv, priv->latencies[i], &summary);
+        key = latency_key(priv, getpid(), i);
+        publish_summary(priv, key, &summary, sizeof(summary), ttl);
+        g_free(key);
+    }
+}
+
+/* The latency of the current window is used once it has enough
+ * samples. The latency of the previous window is used until then. */
+static gdouble
+adaptive_latency (MilterManagerEggPrivate *priv,
+                  MilterServerContextState state)
+{
+    MilterHistogram *histogram;
+    guint64 latency;
+
+    histogram = priv->latencies[state];
+    if (!histogram ||
+        milter_histogram_get_count(histogram) < ADAPTIVE_TIMEOUT_MINIMUM_COUNT)
+        return priv->adaptive_latencies[state];
+
+    latency =
+        milter_histogram_get_value_at_percentile(histogram,
+                                                 priv->adaptive_timeout_percentile);
+    return (gdouble)latency / G_USEC_PER_SEC;
+}
+
+static gdouble
+adapt_timeout (MilterManagerEggPrivate *priv, gdouble latency, gdouble timeout)
+{
+    gdouble adapted_timeout;
+
+    if (!priv->adaptive_timeout || latency <= 0)
+        return timeout;
+
+    adapted_timeout = latency * priv->adaptive_timeout_factor;
+    return CLAMP(adapted_timeout,
+                 MIN(priv->adaptive_timeout_minimum, timeout),
+                 timeout);
+}
+
+static gdouble
+effective_connection_timeout (MilterManagerEggPrivate *priv)
+{
+    return adapt_timeout(priv,
+                         adaptive_latency(priv,
+                                          MILTER_SERVER_CONTEXT_STATE_START),
+                         priv->connection_timeout);
+}
+
+static gdouble
+effective_reading_timeout (MilterManagerEggPrivate *priv)
+{
+    MilterServerContextState state;
+    gdouble max_latency = 0;
+
+    for (state = MILTER_SERVER_CONTEXT_STATE_NEGOTIATE;
+         state < MILTER_SERVER_CONTEXT_STATE_END_OF_MESSAGE;
+         state++) {
+        if (!milter_manager_egg_latency_stage_name(state))
+            continue;
+        max_latency = MAX(max_latency, adaptive_latency(priv, state));
+    }
+
+    return adapt_timeout(priv, max_latency, priv->reading_timeout);
+}
+
+static gdouble
+mean_body_size (MilterManagerEggPrivate *priv)
 {
-    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->enabled;
+    if (priv->n_end_of_messages >= ADAPTIVE_TIMEOUT_MINIMUM_COUNT)
+        return (gdouble)priv->end_of_message_body_size /
+            priv->n_end_of_messages;
+
+    return priv->adaptive_mean_body_size;
 }
 
-gboolean
-milter_manager_egg_set_connection_spec (MilterManagerEgg *egg,
-                                        const gchar *spec, GError **error)
+static gdouble
+effective_end_of_message_timeout (MilterManagerEggPrivate *priv,
+                                  guint64 body_size)
+{
+    gdouble latency, mean_size;
+
+    latency =
+        adaptive_latency(priv, MILTER_SERVER_CONTEXT_STATE_END_OF_MESSAGE);
+    mean_size = mean_body_size(priv);
+    if (mean_size > 0 && body_size > mean_size)
+        latency *= body_size / mean_size;
+
+    return adapt_timeout(priv, latency, priv->end_of_message_timeout);
+}
+
+static void
+log_adaptive_timeouts (MilterManagerEggPrivate *priv)
+{
+    if (!priv->adaptive_timeout)
+        return;
+
+    milter_statistics("[egg][adaptive-timeout][%s] "
+                      "connection=%g reading=%g end-of-message=%g "
+                      "mean-body-size=%g",
+                      priv->name ? priv->name : "(null)",
+                      effective_connection_timeout(priv),
+                      effective_reading_timeout(priv),
+                      effective_end_of_message_timeout(priv, 0),
+                      mean_body_size(priv));
+}
+
+static void
+log_latencies (MilterManagerEggPrivate *priv)
+{
+    guint i;
+
+    if (!milter_need_log(MILTER_LOG_LEVEL_STATISTICS))
+        return;
+
+    for (i = 0; i < N_LATENCY_STAGES; i++) {
+        MilterManagerEggLatencySummary summary;
+
+        if (!priv->latencies[i])
+            continue;
+
+        summarize_latency(priv, priv->latencies[i], &summary);
+        if (summary.count == 0)
+            continue;
+        milter_statistics("[egg][latency][%s][%s] "
+                          "count=%" G_GUINT64_FORMAT " "
+                          "mean=%g p50=%g p90=%g p99=%g max=%g",
+                          priv->name ? priv->name : "(null)",
+                          milter_manager_egg_latency_stage_name(i),
+                          summary.count,
+                          summary.mean,
+                          summary.p50,
+                          summary.p90,
+                          summary.p99,
+                          summary.max);
+    }
+    log_adaptive_timeouts(priv);
+    log_backends(priv);
+    log_warm_connections(priv);
+}
 
+void
+milter_manager_egg_reset_latencies (MilterManagerEgg *egg)
 {
     MilterManagerEggPrivate *priv;
-    GError *spec_error = NULL;
-    gboolean success = TRUE;
-    gint domain;
-    struct sockaddr *address = NULL;
-    socklen_t address_length;
+    guint i;
 
     priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    for (i = 0; i < N_LATENCY_STAGES; i++) {
+        if (!priv->latencies[i])
+            continue;
+        priv->adaptive_latencies[i] = adaptive_latency(priv, i);
+        milter_histogram_reset(priv->latencies[i]);
+    }
+    priv->adaptive_mean_body_size = mean_body_size(priv);
+    priv->end_of_message_body_size = 0;
+    priv->n_end_of_messages = 0;
+    priv->latency_window_start = get_current_time();
+    publish_latencies(priv);
+}
 
-    if (spec)
-        success = milter_connection_parse_spec(spec,
-                                               &domain,
-                                               &address,
-                                               &address_length,
-                                               &spec_error);
-
-    if (address)
-        g_free(address);
+void
+milter_manager_egg_record_latency (MilterManagerEgg *egg,
+                                   MilterServerContextState state,
+                                   gdouble elapsed)
+{
+    MilterManagerEggPrivate *priv;
+    gint64 now;
 
-    if (success) {
-        if (priv->connection_spec)
-            g_free(priv->connection_spec);
-        priv->connection_spec = g_strdup(spec);
-    } else {
-        GError *wrapped_error = NULL;
+    if (!milter_manager_egg_latency_stage_name(state))
+        return;
 
-        milter_utils_set_error_with_sub_error(&wrapped_error,
-                                              MILTER_MANAGER_EGG_ERROR,
-                                              MILTER_MANAGER_EGG_ERROR_INVALID,
-                                              spec_error,
-                                              "<%s>: invalid connection spec",
-                                              priv->name ? priv->name : "(null)");
-        milter_error("[egg][error][set-spec] %s", wrapped_error->message);
-        if (error)
-            *error = g_error_copy(wrapped_error);
-        g_error_free(wrapped_error);
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    now = get_current_time();
+    if (priv->latency_window_start == 0) {
+        priv->latency_window_start = now;
+    } else if (priv->latency_window > 0 &&
+               now - priv->latency_window_start >=
+               priv->latency_window * G_USEC_PER_SEC) {
+        log_latencies(priv);
+        milter_manager_egg_reset_latencies(egg);
     }
 
-    return success;
+    if (!priv->latencies[state])
+        priv->latencies[state] =
+            milter_histogram_new(LATENCY_HIGHEST_TRACKABLE_VALUE);
+    milter_histogram_record(priv->latencies[state],
+                            (guint64)(MAX(elapsed, 0.0) * G_USEC_PER_SEC));
+
+    if (now - priv->latency_published_time >= LATENCY_PUBLISH_INTERVAL) {
+        publish_latencies(priv);
+        priv->latency_published_time = now;
+    }
 }
 
-const gchar *
-milter_manager_egg_get_connection_spec (MilterManagerEgg *egg)
+MilterHistogram *
+milter_manager_egg_get_latency_histogram (MilterManagerEgg *egg,
+                                          MilterServerContextState state)
 {
-    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->connection_spec;
+    if (!milter_manager_egg_latency_stage_name(state))
+        return NULL;
+
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->latencies[state];
 }
 
-void
-milter_manager_egg_set_connection_timeout (MilterManagerEgg *egg,
-                                           gdouble connection_timeout)
+gboolean
+milter_manager_egg_get_latency_summary (MilterManagerEgg *egg,
+                                        pid_t pid,
+                                        MilterServerContextState state,
+                                        MilterManagerEggLatencySummary *summary)
 {
     MilterManagerEggPrivate *priv;
+    gchar *key;
+    gchar *value = NULL;
+    gsize value_size = 0;
+    gboolean found;
+
+    if (!milter_manager_egg_latency_stage_name(state))
+        return FALSE;
 
     priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
-    priv->connection_timeout = connection_timeout;
+    if (pid == 0 || pid == getpid()) {
+        if (!priv->latencies[state])
+            return FALSE;
+        summarize_latency(priv, priv->latencies[state], summary);
+        return TRUE;
+    }
+
+    if (!priv->shared_cache)
+        return FALSE;
+
+    key = latency_key(priv, pid, state);
+    found = milter_manager_shared_cache_get(priv->shared_cache, key,
+                                            &value, &value_size);
+    g_free(key);
+    if (found && value_size == sizeof(*summary))
+        memcpy(summary, value, sizeof(*summary));
+    else
+        found = FALSE;
+    g_free(value);
+
+    return found;
 }
 
 gdouble
-milter_manager_egg_get_connection_timeout (MilterManagerEgg *egg)
+milter_manager_egg_get_effective_connection_timeout (MilterManagerEgg *egg)
 {
-    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->connection_timeout;
+    return effective_connection_timeout(MILTER_MANAGER_EGG_GET_PRIVATE(egg));
 }
 
-void
-milter_manager_egg_set_writing_timeout (MilterManagerEgg *egg,
-                                        gdouble writing_timeout)
+gdouble
+milter_manager_egg_get_effective_reading_timeout (MilterManagerEgg *egg)
+{
+    return effective_reading_timeout(MILTER_MANAGER_EGG_GET_PRIVATE(egg));
+}
+
+gdouble
+milter_manager_egg_get_effective_end_of_message_timeout (MilterManagerEgg *egg,
+                                                         guint64 body_size)
+{
+    return effective_end_of_message_timeout(MILTER_MANAGER_EGG_GET_PRIVATE(egg),
+                                            body_size);
+}
+
+static gchar *
+circuit_key (MilterManagerEggPrivate *priv, pid_t pid)
+{
+    return g_strdup_printf("circuit:%d:%s",
+                           (gint)pid,
+                           priv->name ? priv->name : "");
+}
+
+static void
+summarize_circuit (MilterManagerEggPrivate *priv,
+                   MilterManagerEggCircuitSummary *summary)
+{
+    summary->state = priv->circuit_state;
+    summary->changed_time = priv->circuit_changed_time;
+    summary->n_successes = priv->circuit_n_successes;
+    summary->n_failures = priv->circuit_n_failures;
+}
+
+static void
+publish_circuit (MilterManagerEggPrivate *priv, gint64 now)
+{
+    MilterManagerEggCircuitSummary summary;
+    gchar *key;
+
+    if (!priv->shared_cache)
+        return;
+
+    summarize_circuit(priv, &summary);
+    key = circuit_key(priv, getpid());
+    publish_summary(priv, key, &summary, sizeof(summary),
+                    CIRCUIT_SUMMARY_TTL);
+    g_free(key);
+    priv->circuit_published_time = now;
+}
+
+static void
+reset_circuit_counts (MilterManagerEggPrivate *priv, gint64 now)
+{
+    priv->circuit_window_start = now;
+    priv->circuit_n_successes = 0;
+    priv->circuit_n_failures = 0;
+}
+
+static void
+change_circuit_state (MilterManagerEggPrivate *priv,
+                      MilterManagerEggCircuitState state,
+                      gint64 now,
+                      const gchar *reason)
+{
+    gchar *previous_state_name, *state_name;
+    const gchar *name;
+
+    name = priv->name ? priv->name : "(null)";
+    previous_state_name =
+        milter_utils_get_enum_nick_name(MILTER_TYPE_MANAGER_EGG_CIRCUIT_STATE,
+                                        priv->circuit_state);
+    state_name =
+        milter_utils_get_enum_nick_name(MILTER_TYPE_MANAGER_EGG_CIRCUIT_STATE,
+                                        state);
+    if (state == MILTER_MANAGER_EGG_CIRCUIT_OPEN) {
+        milter_warning("[egg][circuit][%s] <%s> -> <%s>: "
+                       "successes=<%u> failures=<%u> reason=<%s>: %s",
+                       state_name, previous_state_name, state_name,
+                       priv->circuit_n_successes, priv->circuit_n_failures,
+                       reason ? reason : "", name);
+    } else {
+        milter_info("[egg][circuit][%s] <%s> -> <%s>: %s",
+                    state_name, previous_state_name, state_name, name);
+    }
+    milter_statistics("[egg][circuit][%s]: %s", state_name, name);
+    g_free(previous_state_name);
+    g_free(state_name);
+
+    priv->circuit_state = state;
+    priv->circuit_changed_time = now;
+    switch (state) {
+    case MILTER_MANAGER_EGG_CIRCUIT_HALF_OPEN:
+        priv->circuit_probe_time = now;
+        break;
+    case MILTER_MANAGER_EGG_CIRCUIT_CLOSED:
+        reset_circuit_counts(priv, now);
+        /* FALLTHROUGH */
+    default:
+        priv->circuit_probe_time = 0;
+        break;
+    }
+    publish_circuit(priv, now);
+}
+
+static gboolean
+sample_evaluation (MilterManagerEgg *egg)
 {
     MilterManagerEggPrivate *priv;
 
     priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
-    priv->writing_timeout = writing_timeout;
+    if (!priv->evaluation_mode)
+        return TRUE;
+    /* Sessions are sampled by MilterManagerChildren on connect
+     * because the client address isn't known yet. */
+    if (priv->evaluation_sampling_by_client_address)
+        return TRUE;
+    if (priv->evaluation_sampling_rate >= 1.0)
+        return TRUE;
+    if (g_random_double() < priv->evaluation_sampling_rate)
+        return TRUE;
+
+    milter_debug("[egg][evaluation][unsampled] %s",
+                 priv->name ? priv->name : "(null)");
+    return FALSE;
 }
 
-gdouble
-milter_manager_egg_get_writing_timeout (MilterManagerEgg *egg)
+static gboolean
+need_bypass (MilterManagerEgg *egg)
 {
-    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->writing_timeout;
+    MilterManagerEggPrivate *priv;
+    gint64 now, open_time;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (priv->circuit_breaker_threshold <= 0)
+        return FALSE;
+
+    now = get_current_time();
+    open_time = priv->circuit_breaker_open_time * G_USEC_PER_SEC;
+    switch (priv->circuit_state) {
+    case MILTER_MANAGER_EGG_CIRCUIT_OPEN:
+        if (now - priv->circuit_changed_time < open_time)
+            return TRUE;
+        change_circuit_state(priv, MILTER_MANAGER_EGG_CIRCUIT_HALF_OPEN,
+                             now, NULL);
+        return FALSE;
+    case MILTER_MANAGER_EGG_CIRCUIT_HALF_OPEN:
+        /* Only one session probes the milter. Another session
+         * probes it when the probe doesn't report any result. */
+        if (now - priv->circuit_probe_time < open_time)
+            return TRUE;
+        priv->circuit_probe_time = now;
+        return FALSE;
+    default:
+        return FALSE;
+    }
 }
 
 void
-milter_manager_egg_set_reading_timeout (MilterManagerEgg *egg,
-                                        gdouble reading_timeout)
+milter_manager_egg_record_circuit_result (MilterManagerEgg *egg,
+                                          gboolean          success,
+                                          const gchar      *reason)
 {
     MilterManagerEggPrivate *priv;
+    gint64 now;
+    guint n_results;
 
     priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
-    priv->reading_timeout = reading_timeout;
+    if (priv->circuit_breaker_threshold <= 0)
+        return;
+
+    now = get_current_time();
+    switch (priv->circuit_state) {
+    case MILTER_MANAGER_EGG_CIRCUIT_OPEN:
+        return;
+    case MILTER_MANAGER_EGG_CIRCUIT_HALF_OPEN:
+        change_circuit_state(priv,
+                             success ?
+                             MILTER_MANAGER_EGG_CIRCUIT_CLOSED :
+                             MILTER_MANAGER_EGG_CIRCUIT_OPEN,
+                             now, reason);
+        return;
+    default:
+        break;
+    }
+
+    if (priv->circuit_window_start == 0 ||
+        (priv->circuit_breaker_window > 0 &&
+         now - priv->circuit_window_start >=
+         priv->circuit_breaker_window * G_USEC_PER_SEC)) {
+        reset_circuit_counts(priv, now);
+    }
+
+    if (success) {
+        priv->circuit_n_successes++;
+    } else {
+        priv->circuit_n_failures++;
+        n_results = priv->circuit_n_successes + priv->circuit_n_failures;
+        if (n_results >= priv->circuit_breaker_minimum_requests &&
+            priv->circuit_n_failures >=
+            priv->circuit_breaker_threshold * n_results) {
+            change_circuit_state(priv, MILTER_MANAGER_EGG_CIRCUIT_OPEN,
+                                 now, reason);
+            return;
+        }
+    }
+
+    if (now - priv->circuit_published_time >= LATENCY_PUBLISH_INTERVAL)
+        publish_circuit(priv, now);
 }
 
-gdouble
-milter_manager_egg_get_reading_timeout (MilterManagerEgg *egg)
+MilterManagerEggCircuitState
+milter_manager_egg_get_circuit_state (MilterManagerEgg *egg)
 {
-    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->reading_timeout;
+    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->circuit_state;
 }
 
-void
-milter_manager_egg_set_end_of_message_timeout (MilterManagerEgg *egg,
-                                               gdouble end_of_message_timeout)
+gboolean
+milter_manager_egg_get_circuit_summary (MilterManagerEgg *egg,
+                                        pid_t pid,
+                                        MilterManagerEggCircuitSummary *summary)
 {
     MilterManagerEggPrivate *priv;
+    gchar *key;
+    gchar *value = NULL;
+    gsize value_size = 0;
+    gboolean found;
 
     priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
-    priv->end_of_message_timeout = end_of_message_timeout;
+    if (pid == 0 || pid == getpid()) {
+        summarize_circuit(priv, summary);
+        return TRUE;
+    }
+
+    if (!priv->shared_cache)
+        return FALSE;
+
+    key = circuit_key(priv, pid);
+    found = milter_manager_shared_cache_get(priv->shared_cache, key,
+                                            &value, &value_size);
+    g_free(key);
+    if (found && value_size == sizeof(*summary))
+        memcpy(summary, value, sizeof(*summary));
+    else
+        found = FALSE;
+    g_free(value);
+
+    return found;
 }
 
-gdouble
-milter_manager_egg_get_end_of_message_timeout (MilterManagerEgg *egg)
+static gchar *
+session_key (MilterManagerEggPrivate *priv, pid_t pid)
 {
-    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->end_of_message_timeout;
+    return g_strdup_printf("session:%d:%s",
+                           (gint)pid,
+                           priv->name ? priv->name : "");
 }
 
-void
-milter_manager_egg_set_user_name (MilterManagerEgg *egg,
-                                  const gchar *user_name)
+static void
+summarize_sessions (MilterManagerEggPrivate *priv,
+                    MilterManagerEggSessionSummary *summary)
+{
+    summary->n_active_sessions = priv->n_active_sessions;
+    summary->n_queued_sessions = g_queue_get_length(priv->queued_children);
+    summary->n_shed_sessions = priv->n_shed_sessions;
+}
+
+static void
+publish_sessions (MilterManagerEggPrivate *priv)
+{
+    MilterManagerEggSessionSummary summary;
+    gchar *key;
+
+    if (!priv->shared_cache)
+        return;
+
+    summarize_sessions(priv, &summary);
+    key = session_key(priv, getpid());
+    publish_summary(priv, key, &summary, sizeof(summary),
+                    SESSION_SUMMARY_TTL);
+    g_free(key);
+}
+
+static void
+shed_session (MilterManagerEgg *egg,
+              MilterManagerChild *child,
+              const gchar *reason)
 {
     MilterManagerEggPrivate *priv;
+    const gchar *name;
 
     priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
-    if (priv->user_name)
-        g_free(priv->user_name);
-    priv->user_name = g_strdup(user_name);
+    name = priv->name ? priv->name : "(null)";
+    priv->n_shed_sessions++;
+    if (priv->shed_status != MILTER_STATUS_DEFAULT)
+        g_object_set(child, "fallback-status", priv->shed_status, NULL);
+    milter_manager_child_set_bypassed(child, TRUE);
+
+    milter_warning("[egg][shed][%s] active=<%u> queued=<%u> shed=<%u>: %s",
+                   reason,
+                   priv->n_active_sessions,
+                   g_queue_get_length(priv->queued_children),
+                   priv->n_shed_sessions,
+                   name);
+    milter_statistics("[egg][shed][%s]: %s", reason, name);
+    publish_sessions(priv);
 }
 
-const gchar *
-milter_manager_egg_get_user_name (MilterManagerEgg *egg)
+static void cb_session_child_finished (MilterFinishedEmittable *emittable,
+                                       gpointer user_data);
+static void cb_session_child_error (MilterErrorEmittable *emittable,
+                                    GError *error,
+                                    gpointer user_data);
+static void cb_session_child_state_transited (MilterServerContext *context,
+                                              MilterServerContextState state,
+                                              gpointer user_data);
+
+static void
+watch_session (MilterManagerEgg *egg, MilterManagerChild *child)
 {
-    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->user_name;
+    g_object_weak_ref(G_OBJECT(child), cb_child_weak_notify, egg);
+    g_signal_connect_object(child, "finished",
+                            G_CALLBACK(cb_session_child_finished), egg, 0);
+    g_signal_connect_object(child, "error",
+                            G_CALLBACK(cb_session_child_error), egg, 0);
+    g_signal_connect_object(child, "state-transited",
+                            G_CALLBACK(cb_session_child_state_transited), egg,
+                            0);
 }
 
-void
-milter_manager_egg_set_command (MilterManagerEgg *egg,
-                                const gchar *command)
+static void
+unwatch_session (MilterManagerEgg *egg, MilterManagerChild *child)
+{
+    g_object_weak_unref(G_OBJECT(child), cb_child_weak_notify, egg);
+    g_signal_handlers_disconnect_by_func(child,
+                                         G_CALLBACK(cb_session_child_finished),
+                                         egg);
+    g_signal_handlers_disconnect_by_func(child,
+                                         G_CALLBACK(cb_session_child_error),
+                                         egg);
+    g_signal_handlers_disconnect_by_func(
+        child, G_CALLBACK(cb_session_child_state_transited), egg);
+}
+
+static void
+cb_queued_child_bypassed (GObject *object, GParamSpec *pspec, gpointer user_data)
 {
+    MilterManagerEgg *egg = user_data;
     MilterManagerEggPrivate *priv;
+    MilterManagerChild *child;
+
+    child = MILTER_MANAGER_CHILD(object);
+    if (!milter_manager_child_is_bypassed(child))
+        return;
 
     priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
-    if (priv->command)
-        g_free(priv->command);
-    priv->command = g_strdup(command);
+    if (!g_queue_remove(priv->queued_children, child))
+        return;
+
+    g_signal_handlers_disconnect_by_func(child,
+                                         G_CALLBACK(cb_queued_child_bypassed),
+                                         egg);
+    unwatch_session(egg, child);
+    shed_session(egg, child, "timeout");
 }
 
-const gchar *
-milter_manager_egg_get_command (MilterManagerEgg *egg)
+static void
+activate_session (MilterManagerEggPrivate *priv, MilterManagerChild *child)
 {
-    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->command;
+    priv->active_children = g_list_prepend(priv->active_children, child);
+    priv->n_active_sessions++;
 }
 
-void
-milter_manager_egg_set_command_options (MilterManagerEgg *egg,
-                                        const gchar *command_options)
+static void
+dequeue_sessions (MilterManagerEgg *egg)
 {
     MilterManagerEggPrivate *priv;
 
     priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
-    if (priv->command_options)
-        g_free(priv->command_options);
-    priv->command_options = g_strdup(command_options);
+    while (priv->n_active_sessions < priv->max_concurrent_sessions &&
+           !g_queue_is_empty(priv->queued_children)) {
+        MilterManagerChild *child;
+
+        child = g_queue_pop_head(priv->queued_children);
+        g_signal_handlers_disconnect_by_func(child,
+                                             G_CALLBACK(cb_queued_child_bypassed),
+                                             egg);
+        activate_session(priv, child);
+        milter_manager_child_set_queued(child, FALSE);
+    }
+    publish_sessions(priv);
 }
 
-const gchar *
-milter_manager_egg_get_command_options (MilterManagerEgg *egg)
+static void
+remove_session (MilterManagerEgg *egg, gpointer child)
 {
-    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->command_options;
+    MilterManagerEggPrivate *priv;
+    GList *node;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (g_queue_remove(priv->queued_children, child)) {
+        publish_sessions(priv);
+        return;
+    }
+
+    node = g_list_find(priv->active_children, child);
+    if (!node)
+        return;
+    priv->active_children = g_list_delete_link(priv->active_children, node);
+    priv->n_active_sessions--;
+    dequeue_sessions(egg);
 }
 
-void
-milter_manager_egg_set_fallback_status (MilterManagerEgg *egg,
-                                        MilterStatus      status)
+/* The slot is released when the child's session ends even if
+ * someone still has a reference of the child. The weak
+ * reference is for a child that is disposed without them. */
+static void
+release_session (MilterManagerEgg *egg, MilterManagerChild *child)
 {
-    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->fallback_status = status;
+    g_signal_handlers_disconnect_by_func(child,
+                                         G_CALLBACK(cb_queued_child_bypassed),
+                                         egg);
+    unwatch_session(egg, child);
+    remove_session(egg, child);
 }
 
-MilterStatus
-milter_manager_egg_get_fallback_status (MilterManagerEgg *egg)
+static void
+cb_session_child_finished (MilterFinishedEmittable *emittable,
+                           gpointer user_data)
 {
-    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->fallback_status;
+    release_session(user_data, MILTER_MANAGER_CHILD(emittable));
 }
 
-void
-milter_manager_egg_set_evaluation_mode (MilterManagerEgg *egg,
-                                        gboolean          evaluation_mode)
+static void
+cb_session_child_error (MilterErrorEmittable *emittable,
+                        GError *error,
+                        gpointer user_data)
 {
-    MILTER_MANAGER_EGG_GET_PRIVATE(egg)->evaluation_mode = evaluation_mode;
+    release_session(user_data, MILTER_MANAGER_CHILD(emittable));
+}
+
+static void
+cb_session_child_state_transited (MilterServerContext *context,
+                                  MilterServerContextState state,
+                                  gpointer user_data)
+{
+    if (state == MILTER_SERVER_CONTEXT_STATE_QUIT)
+        release_session(user_data, MILTER_MANAGER_CHILD(context));
+}
+
+static void
+cb_child_weak_notify (gpointer data, GObject *where_the_object_was)
+{
+    remove_session(data, where_the_object_was);
+}
+
+static void
+admit_session (MilterManagerEgg *egg, MilterManagerChild *child)
+{
+    MilterManagerEggPrivate *priv;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (priv->max_concurrent_sessions == 0)
+        return;
+
+    if (priv->n_active_sessions < priv->max_concurrent_sessions) {
+        activate_session(priv, child);
+        watch_session(egg, child);
+        publish_sessions(priv);
+        return;
+    }
+
+    if (g_queue_get_length(priv->queued_children) <
+        priv->max_queued_sessions) {
+        g_queue_push_tail(priv->queued_children, child);
+        watch_session(egg, child);
+        milter_manager_child_set_queue_timeout(child, priv->queue_timeout);
+        milter_manager_child_set_queued(child, TRUE);
+        g_signal_connect_object(child, "notify::bypassed",
+                                G_CALLBACK(cb_queued_child_bypassed), egg,
+                                0);
+        milter_debug("[egg][queue] active=<%u> queued=<%u>: %s",
+                     priv->n_active_sessions,
+                     g_queue_get_length(priv->queued_children),
+                     priv->name ? priv->name : "(null)");
+        publish_sessions(priv);
+        return;
+    }
+
+    shed_session(egg, child, "full");
 }
 
 gboolean
-milter_manager_egg_is_evaluation_mode (MilterManagerEgg *egg)
+milter_manager_egg_get_session_summary (MilterManagerEgg *egg,
+                                        pid_t pid,
+                                        MilterManagerEggSessionSummary *summary)
 {
-    return MILTER_MANAGER_EGG_GET_PRIVATE(egg)->evaluation_mode;
+    MilterManagerEggPrivate *priv;
+    gchar *key;
+    gchar *value = NULL;
+    gsize value_size = 0;
+    gboolean found;
+
+    priv = MILTER_MANAGER_EGG_GET_PRIVATE(egg);
+    if (pid == 0 || pid == getpid()) {
+        summarize_sessions(priv, summary);
+        return TRUE;
+    }
+
+    if (!priv->shared_cache)
+        return FALSE;
+
+    key = session_key(priv, pid);
+    found = milter_manager_shared_cache_get(priv->shared_cache, key,
+                                            &value, &value_size);
+    g_free(key);
+    if (found && value_size == sizeof(*summary))
+        memcpy(summary, value, sizeof(*summary));
+    else
+        found = FALSE;
+    g_free(value);
+
+    return found;
 }
 
 void
@@ -793,9 +3657,22 @@ milter_manager_egg_merge (MilterManagerEgg *egg,
     const GList *node;
 
     connection_spec = milter_manager_egg_get_connection_spec(other_egg);
-    if (connection_spec &&
-        !milter_manager_egg_set_connection_spec(egg, connection_spec, error))
-        return FALSE;
+    if (connection_spec) {
+        GList *specs;
+
+        if (!milter_manager_egg_set_connection_spec(egg, connection_spec,
+                                                    error))
+            return FALSE;
+        specs = milter_manager_egg_get_connection_specs(other_egg);
+        for (node = g_list_next(specs); node; node = g_list_next(node)) {
+            if (!milter_manager_egg_add_connection_spec(egg, node->data,
+                                                        error)) {
+                g_list_free(specs);
+                return FALSE;
+            }
+        }
+        g_list_free(specs);
+    }
 
 #define MERGE_TIMEOUT(name)                                     \
     milter_manager_egg_set_ ## name ## _timeout(                \
@@ -815,6 +3692,71 @@ milter_manager_egg_merge (MilterManagerEgg *egg,
 
     milter_manager_egg_set_enabled(egg,
                                    milter_manager_egg_is_enabled(other_egg));
+    milter_manager_egg_set_latency_window(
+        egg,
+        milter_manager_egg_get_latency_window(other_egg));
+
+#define MERGE_CIRCUIT_BREAKER(name)                             \
+    milter_manager_egg_set_circuit_breaker_ ## name(            \
+        egg,                                                    \
+        milter_manager_egg_get_circuit_breaker_ ## name(other_egg))
+
+    MERGE_CIRCUIT_BREAKER(threshold);
+    MERGE_CIRCUIT_BREAKER(minimum_requests);
+    MERGE_CIRCUIT_BREAKER(window);
+    MERGE_CIRCUIT_BREAKER(open_time);
+    MERGE_CIRCUIT_BREAKER(latency_threshold);
+
+#undef MERGE_CIRCUIT_BREAKER
+
+    milter_manager_egg_set_adaptive_timeout(
+        egg,
+        milter_manager_egg_is_adaptive_timeout(other_egg));
+    milter_manager_egg_set_adaptive_timeout_percentile(
+        egg,
+        milter_manager_egg_get_adaptive_timeout_percentile(other_egg));
+    milter_manager_egg_set_adaptive_timeout_factor(
+        egg,
+        milter_manager_egg_get_adaptive_timeout_factor(other_egg));
+    milter_manager_egg_set_adaptive_timeout_minimum(
+        egg,
+        milter_manager_egg_get_adaptive_timeout_minimum(other_egg));
+    milter_manager_egg_set_max_concurrent_sessions(
+        egg,
+        milter_manager_egg_get_max_concurrent_sessions(other_egg));
+    milter_manager_egg_set_max_queued_sessions(
+        egg,
+        milter_manager_egg_get_max_queued_sessions(other_egg));
+    milter_manager_egg_set_queue_timeout(
+        egg,
+        milter_manager_egg_get_queue_timeout(other_egg));
+    milter_manager_egg_set_shed_status(
+        egg,
+        milter_manager_egg_get_shed_status(other_egg));
+    milter_manager_egg_set_backend_ejection_failures(
+        egg,
+        milter_manager_egg_get_backend_ejection_failures(other_egg));
+    milter_manager_egg_set_backend_ejection_time(
+        egg,
+        milter_manager_egg_get_backend_ejection_time(other_egg));
+    milter_manager_egg_set_max_warm_connections(
+        egg,
+        milter_manager_egg_get_max_warm_connections(other_egg));
+    milter_manager_egg_set_negotiate_cache(
+        egg,
+        milter_manager_egg_get_negotiate_cache(other_egg));
+    milter_manager_egg_set_verdict_cache_ttl(
+        egg,
+        milter_manager_egg_get_verdict_cache_ttl(other_egg));
+    milter_manager_egg_set_verdict_cache_size(
+        egg,
+        milter_manager_egg_get_verdict_cache_size(other_egg));
+    milter_manager_egg_set_evaluation_sampling_rate(
+        egg,
+        milter_manager_egg_get_evaluation_sampling_rate(other_egg));
+    milter_manager_egg_set_evaluation_sampling_by_client_address(
+        egg,
+        milter_manager_egg_is_evaluation_sampling_by_client_address(other_egg));
 
     user_name = milter_manager_egg_get_user_name(other_egg);
     if (user_name)
@@ -27,6 +27,7 @@
 #include <milter/manager/milter-manager-objects.h>
 #include <milter/manager/milter-manager-child.h>
 #include <milter/manager/milter-manager-applicable-condition.h>
+#include <milter/manager/milter-manager-shared-cache.h>
 
 G_BEGIN_DECLS
 
@@ -44,7 +45,34 @@ typedef enum
     MILTER_MANAGER_EGG_ERROR_INVALID
 } MilterManagerEggError;
 
+typedef enum
+{
+    MILTER_MANAGER_EGG_CIRCUIT_CLOSED,
+    MILTER_MANAGER_EGG_CIRCUIT_OPEN,
+    MILTER_MANAGER_EGG_CIRCUIT_HALF_OPEN
+} MilterManagerEggCircuitState;
+
+#define MILTER_MANAGER_EGG_DEFAULT_LATENCY_WINDOW 60.0
+#define MILTER_MANAGER_EGG_DEFAULT_CIRCUIT_BREAKER_MINIMUM_REQUESTS 20
+#define MILTER_MANAGER_EGG_DEFAULT_CIRCUIT_BREAKER_WINDOW 60.0
+#define MILTER_MANAGER_EGG_DEFAULT_CIRCUIT_BREAKER_OPEN_TIME 30.0
+#define MILTER_MANAGER_EGG_DEFAULT_ADAPTIVE_TIMEOUT_PERCENTILE 99.0
+#define MILTER_MANAGER_EGG_DEFAULT_ADAPTIVE_TIMEOUT_FACTOR 3.0
+#define MILTER_MANAGER_EGG_DEFAULT_ADAPTIVE_TIMEOUT_MINIMUM 1.0
+#define MILTER_MANAGER_EGG_DEFAULT_QUEUE_TIMEOUT 5.0
+/* The MTA is waiting for the negotiate reply while a session
+ * is queued. Sendmail waits for it 10 seconds by default. Half
+ * of it is left for connecting and negotiating with the child. */
+#define MILTER_MANAGER_EGG_MAXIMUM_QUEUE_TIMEOUT 5.0
+#define MILTER_MANAGER_EGG_DEFAULT_BACKEND_EJECTION_FAILURES 3
+#define MILTER_MANAGER_EGG_DEFAULT_BACKEND_EJECTION_TIME 30.0
+#define MILTER_MANAGER_EGG_DEFAULT_VERDICT_CACHE_SIZE 1000
+
 typedef struct _MilterManagerEggClass    MilterManagerEggClass;
+typedef struct _MilterManagerEggLatencySummary MilterManagerEggLatencySummary;
+typedef struct _MilterManagerEggCircuitSummary MilterManagerEggCircuitSummary;
+typedef struct _MilterManagerEggSessionSummary MilterManagerEggSessionSummary;
+typedef struct _MilterManagerEggBackendSummary MilterManagerEggBackendSummary;
 
 struct _MilterManagerEgg
 {
@@ -62,6 +90,41 @@ struct _MilterManagerEggClass
                      guint               indent);
 };
 
+struct _MilterManagerEggLatencySummary
+{
+    gint64 window_start;
+    guint64 count;
+    gdouble mean;
+    gdouble p50;
+    gdouble p90;
+    gdouble p99;
+    gdouble max;
+};
+
+struct _MilterManagerEggCircuitSummary
+{
+    MilterManagerEggCircuitState state;
+    gint64 changed_time;
+    guint n_successes;
+    guint n_failures;
+};
+
+struct _MilterManagerEggSessionSummary
+{
+    guint n_active_sessions;
+    guint n_queued_sessions;
+    guint n_shed_sessions;
+};
+
+struct _MilterManagerEggBackendSummary
+{
+    guint n_outstanding_sessions;
+    guint64 n_sessions;
+    guint64 n_failures;
+    gdouble latency;
+    gboolean ejected;
+};
+
 GQuark              milter_manager_egg_error_quark (void);
 
 GType               milter_manager_egg_get_type (void) G_GNUC_CONST;
@@ -87,6 +150,12 @@ gboolean            milter_manager_egg_set_connection_spec
                                                 (MilterManagerEgg *egg,
                                                  const gchar *connection_spec,
                                                  GError      **error);
+gboolean            milter_manager_egg_add_connection_spec
+                                                (MilterManagerEgg *egg,
+                                                 const gchar *connection_spec,
+                                                 GError **error);
+GList              *milter_manager_egg_get_connection_specs
+                                                (MilterManagerEgg *egg);
 const gchar        *milter_manager_egg_get_connection_spec
                                                 (MilterManagerEgg *egg);
 void                milter_manager_egg_set_connection_timeout
@@ -134,6 +203,179 @@ void                milter_manager_egg_set_evaluation_mode
                                                  gboolean          evaluation_mode);
 gboolean            milter_manager_egg_is_evaluation_mode
                                                 (MilterManagerEgg *egg);
+void                milter_manager_egg_set_evaluation_sampling_rate
+                                                (MilterManagerEgg *egg,
+                                                 gdouble           rate);
+gdouble             milter_manager_egg_get_evaluation_sampling_rate
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_evaluation_sampling_by_client_address
+                                                (MilterManagerEgg *egg,
+                                                 gboolean          by_client_address);
+gboolean            milter_manager_egg_is_evaluation_sampling_by_client_address
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_latency_window
+                                                (MilterManagerEgg *egg,
+                                                 gdouble           window);
+gdouble             milter_manager_egg_get_latency_window
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_shared_cache
+                                                (MilterManagerEgg *egg,
+                                                 MilterManagerSharedCache *cache);
+MilterManagerSharedCache *
+                    milter_manager_egg_get_shared_cache
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_event_loop
+                                                (MilterManagerEgg *egg,
+                                                 MilterEventLoop  *loop);
+MilterEventLoop    *milter_manager_egg_get_event_loop
+                                                (MilterManagerEgg *egg);
+
+void                milter_manager_egg_record_latency
+                                                (MilterManagerEgg *egg,
+                                                 MilterServerContextState state,
+                                                 gdouble           elapsed);
+MilterHistogram    *milter_manager_egg_get_latency_histogram
+                                                (MilterManagerEgg *egg,
+                                                 MilterServerContextState state);
+void                milter_manager_egg_reset_latencies
+                                                (MilterManagerEgg *egg);
+gboolean            milter_manager_egg_get_latency_summary
+                                                (MilterManagerEgg *egg,
+                                                 pid_t             pid,
+                                                 MilterServerContextState state,
+                                                 MilterManagerEggLatencySummary *summary);
+const gchar        *milter_manager_egg_latency_stage_name
+                                                (MilterServerContextState state);
+
+void                milter_manager_egg_set_circuit_breaker_threshold
+                                                (MilterManagerEgg *egg,
+                                                 gdouble           threshold);
+gdouble             milter_manager_egg_get_circuit_breaker_threshold
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_circuit_breaker_minimum_requests
+                                                (MilterManagerEgg *egg,
+                                                 guint             n_requests);
+guint               milter_manager_egg_get_circuit_breaker_minimum_requests
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_circuit_breaker_window
+                                                (MilterManagerEgg *egg,
+                                                 gdouble           window);
+gdouble             milter_manager_egg_get_circuit_breaker_window
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_circuit_breaker_open_time
+                                                (MilterManagerEgg *egg,
+                                                 gdouble           open_time);
+gdouble             milter_manager_egg_get_circuit_breaker_open_time
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_circuit_breaker_latency_threshold
+                                                (MilterManagerEgg *egg,
+                                                 gdouble           threshold);
+gdouble             milter_manager_egg_get_circuit_breaker_latency_threshold
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_record_circuit_result
+                                                (MilterManagerEgg *egg,
+                                                 gboolean          success,
+                                                 const gchar      *reason);
+MilterManagerEggCircuitState
+                    milter_manager_egg_get_circuit_state
+                                                (MilterManagerEgg *egg);
+gboolean            milter_manager_egg_get_circuit_summary
+                                                (MilterManagerEgg *egg,
+                                                 pid_t             pid,
+                                                 MilterManagerEggCircuitSummary *summary);
+
+void                milter_manager_egg_set_adaptive_timeout
+                                                (MilterManagerEgg *egg,
+                                                 gboolean          adaptive);
+gboolean            milter_manager_egg_is_adaptive_timeout
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_adaptive_timeout_percentile
+                                                (MilterManagerEgg *egg,
+                                                 gdouble           percentile);
+gdouble             milter_manager_egg_get_adaptive_timeout_percentile
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_adaptive_timeout_factor
+                                                (MilterManagerEgg *egg,
+                                                 gdouble           factor);
+gdouble             milter_manager_egg_get_adaptive_timeout_factor
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_adaptive_timeout_minimum
+                                                (MilterManagerEgg *egg,
+                                                 gdouble           minimum);
+gdouble             milter_manager_egg_get_adaptive_timeout_minimum
+                                                (MilterManagerEgg *egg);
+gdouble             milter_manager_egg_get_effective_connection_timeout
+                                                (MilterManagerEgg *egg);
+gdouble             milter_manager_egg_get_effective_reading_timeout
+                                                (MilterManagerEgg *egg);
+gdouble             milter_manager_egg_get_effective_end_of_message_timeout
+                                                (MilterManagerEgg *egg,
+                                                 guint64           body_size);
+
+void                milter_manager_egg_set_max_concurrent_sessions
+                                                (MilterManagerEgg *egg,
+                                                 guint             n_sessions);
+guint               milter_manager_egg_get_max_concurrent_sessions
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_max_queued_sessions
+                                                (MilterManagerEgg *egg,
+                                                 guint             n_sessions);
+guint               milter_manager_egg_get_max_queued_sessions
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_queue_timeout
+                                                (MilterManagerEgg *egg,
+                                                 gdouble           timeout);
+gdouble             milter_manager_egg_get_queue_timeout
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_shed_status
+                                                (MilterManagerEgg *egg,
+                                                 MilterStatus      status);
+MilterStatus        milter_manager_egg_get_shed_status
+                                                (MilterManagerEgg *egg);
+gboolean            milter_manager_egg_get_session_summary
+                                                (MilterManagerEgg *egg,
+                                                 pid_t             pid,
+                                                 MilterManagerEggSessionSummary *summary);
+void                milter_manager_egg_set_backend_ejection_failures
+                                                (MilterManagerEgg *egg,
+                                                 guint             n_failures);
+guint               milter_manager_egg_get_backend_ejection_failures
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_backend_ejection_time
+                                                (MilterManagerEgg *egg,
+                                                 gdouble           time);
+gdouble             milter_manager_egg_get_backend_ejection_time
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_max_warm_connections
+                                                (MilterManagerEgg *egg,
+                                                 guint             n_connections);
+guint               milter_manager_egg_get_max_warm_connections
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_negotiate_cache
+                                                (MilterManagerEgg *egg,
+                                                 gboolean          cache);
+gboolean            milter_manager_egg_get_negotiate_cache
+                                                (MilterManagerEgg *egg);
+MilterOption       *milter_manager_egg_get_cached_option
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_verdict_cache_ttl
+                                                (MilterManagerEgg *egg,
+                                                 gdouble           ttl);
+gdouble             milter_manager_egg_get_verdict_cache_ttl
+                                                (MilterManagerEgg *egg);
+void                milter_manager_egg_set_verdict_cache_size
+                                                (MilterManagerEgg *egg,
+                                                 guint             size);
+guint               milter_manager_egg_get_verdict_cache_size
+                                                (MilterManagerEgg *egg);
+guint               milter_manager_egg_get_n_cached_verdicts
+                                                (MilterManagerEgg *egg);
+guint               milter_manager_egg_get_n_warm_connections
+                                                (MilterManagerEgg *egg);
+gboolean            milter_manager_egg_get_backend_summary
+                                                (MilterManagerEgg *egg,
+                                                 const gchar      *connection_spec,
+                                                 MilterManagerEggBackendSummary *summary);
 
 void                milter_manager_egg_add_applicable_condition
                                                 (MilterManagerEgg *egg,
@@ -523,6 +523,20 @@ cb_negotiate_reply (MilterServerContext *context, MilterOption *option,
                           option, macros_requests, MILTER_STATUS_CONTINUE);
 }
 
+static gboolean
+is_no_reply_header_negotiated (MilterManagerLeader *leader)
+{
+    MilterManagerLeaderPrivate *priv;
+    MilterOption *option;
+
+    priv = MILTER_MANAGER_LEADER_GET_PRIVATE(leader);
+    option = milter_client_context_get_option(priv->client_context);
+    if (!option)
+        return FALSE;
+
+    return (milter_option_get_step(option) & MILTER_STEP_NO_REPLY_HEADER) != 0;
+}
+
 static void
 reply (MilterManagerLeader *leader, MilterStatus status)
 {
@@ -536,6 +550,11 @@ reply (MilterManagerLeader *leader, MilterStatus status)
     } else {
         const gchar *signal_name;
 
+        if (priv->state == MILTER_MANAGER_LEADER_STATE_HEADER &&
+            status == MILTER_STATUS_CONTINUE &&
+            is_no_reply_header_negotiated(leader))
+            status = MILTER_STATUS_NO_REPLY;
+
         signal_name = state_to_response_signal_name(priv->state);
         if (signal_name) {
             g_signal_emit_by_name(priv->client_context, signal_name, status);
@@ -0,0 +1,359 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "../../config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+
+#include "milter-manager-literal-matcher.h"
+
+#define ROOT 0
+#define NONE G_MAXUINT32
+
+#define MILTER_MANAGER_LITERAL_MATCHER_GET_PRIVATE(obj)                 \
+    (G_TYPE_INSTANCE_GET_PRIVATE((obj),                                 \
+                                 MILTER_TYPE_MANAGER_LITERAL_MATCHER,   \
+                                 MilterManagerLiteralMatcherPrivate))
+
+typedef struct _Literal Literal;
+struct _Literal
+{
+    gchar *literal;
+    guint id;
+};
+
+typedef struct _Output Output;
+struct _Output
+{
+    guint id;
+    guint32 next;
+};
+
+typedef struct _MilterManagerLiteralMatcherPrivate MilterManagerLiteralMatcherPrivate;
+struct _MilterManagerLiteralMatcherPrivate
+{
+    GArray *literals;
+    guint max_id;
+    gboolean built;
+
+    guint8 codes[256];
+    guint n_codes;
+    guint32 n_nodes;
+    guint32 *transitions;
+    guint32 *outputs;
+    guint32 *dictionary_links;
+    GArray *output_entries;
+};
+
+G_DEFINE_TYPE(MilterManagerLiteralMatcher,
+              milter_manager_literal_matcher,
+              G_TYPE_OBJECT)
+
+static void dispose        (GObject         *object);
+
+static void
+milter_manager_literal_matcher_class_init (MilterManagerLiteralMatcherClass *klass)
+{
+    GObjectClass *gobject_class;
+
+    gobject_class = G_OBJECT_CLASS(klass);
+
+    gobject_class->dispose = dispose;
+
+    g_type_class_add_private(gobject_class,
+                             sizeof(MilterManagerLiteralMatcherPrivate));
+}
+
+static void
+milter_manager_literal_matcher_init (MilterManagerLiteralMatcher *matcher)
+{
+    MilterManagerLiteralMatcherPrivate *priv;
+
+    priv = MILTER_MANAGER_LITERAL_MATCHER_GET_PRIVATE(matcher);
+    priv->literals = g_array_new(FALSE, FALSE, sizeof(Literal));
+    priv->max_id = 0;
+    priv->built = FALSE;
+    memset(priv->codes, 0, sizeof(priv->codes));
+    priv->n_codes = 0;
+    priv->n_nodes = 0;
+    priv->transitions = NULL;
+    priv->outputs = NULL;
+    priv->dictionary_links = NULL;
+    priv->output_entries = NULL;
+}
+
+static void
+dispose_automaton (MilterManagerLiteralMatcherPrivate *priv)
+{
+    if (priv->transitions) {
+        g_free(priv->transitions);
+        priv->transitions = NULL;
+    }
+
+    if (priv->outputs) {
+        g_free(priv->outputs);
+        priv->outputs = NULL;
+    }
+
+    if (priv->dictionary_links) {
+        g_free(priv->dictionary_links);
+        priv->dictionary_links = NULL;
+    }
+
+    if (priv->output_entries) {
+        g_array_free(priv->output_entries, TRUE);
+        priv->output_entries = NULL;
+    }
+
+    priv->n_nodes = 0;
+    priv->built = FALSE;
+}
+
+static void
+dispose (GObject *object)
+{
+    MilterManagerLiteralMatcherPrivate *priv;
+
+    priv = MILTER_MANAGER_LITERAL_MATCHER_GET_PRIVATE(object);
+
+    dispose_automaton(priv);
+
+    if (priv->literals) {
+        guint i;
+
+        for (i = 0; i < priv->literals->len; i++) {
+            g_free(g_array_index(priv->literals, Literal, i).literal);
+        }
+        g_array_free(priv->literals, TRUE);
+        priv->literals = NULL;
+    }
+
+    G_OBJECT_CLASS(milter_manager_literal_matcher_parent_class)->dispose(object);
+}
+
+MilterManagerLiteralMatcher *
+milter_manager_literal_matcher_new (void)
+{
+    return g_object_new(MILTER_TYPE_MANAGER_LITERAL_MATCHER, NULL);
+}
+
+void
+milter_manager_literal_matcher_add (MilterManagerLiteralMatcher *matcher,
+                                    const gchar *literal,
+                                    guint id)
+{
+    MilterManagerLiteralMatcherPrivate *priv;
+    Literal new_literal;
+
+    if (!literal || literal[0] == '\0')
+        return;
+
+    priv = MILTER_MANAGER_LITERAL_MATCHER_GET_PRIVATE(matcher);
+    new_literal.literal = g_ascii_strdown(literal, -1);
+    new_literal.id = id;
+    g_array_append_val(priv->literals, new_literal);
+    priv->max_id = MAX(priv->max_id, id);
+    dispose_automaton(priv);
+}
+
+guint
+milter_manager_literal_matcher_get_size (MilterManagerLiteralMatcher *matcher)
+{
+    return MILTER_MANAGER_LITERAL_MATCHER_GET_PRIVATE(matcher)->literals->len;
+}
+
+#define TRANSITION(priv, node, code)                    \
+    ((priv)->transitions[(node) * (priv)->n_codes + (code)])
+
+static void
+build (MilterManagerLiteralMatcherPrivate *priv)
+{
+    guint32 max_n_nodes, *failure_links, *queue;
+    guint queue_head = 0, queue_tail = 0;
+    guint i;
+
+    memset(priv->codes, 0, sizeof(priv->codes));
+    priv->n_codes = 1;
+    max_n_nodes = 1;
+    for (i = 0; i < priv->literals->len; i++) {
+        const guchar *literal;
+
+        literal = (const guchar *)g_array_index(priv->literals, Literal, i).literal;
+        for (; *literal; literal++) {
+            if (priv->codes[*literal] == 0)
+                priv->codes[*literal] = priv->n_codes++;
+            max_n_nodes++;
+        }
+    }
+    for (i = 'a'; i <= 'z'; i++) {
+        priv->codes[(guchar)g_ascii_toupper(i)] = priv->codes[i];
+    }
+
+    priv->transitions = g_new(guint32, max_n_nodes * priv->n_codes);
+    memset(priv->transitions, 0xff,
+           sizeof(guint32) * max_n_nodes * priv->n_codes);
+    priv->outputs = g_new(guint32, max_n_nodes);
+    priv->dictionary_links = g_new(guint32, max_n_nodes);
+    priv->output_entries = g_array_new(FALSE, FALSE, sizeof(Output));
+    priv->n_nodes = 1;
+    priv->outputs[ROOT] = NONE;
+
+    for (i = 0; i < priv->literals->len; i++) {
+        Literal *literal = &g_array_index(priv->literals, Literal, i);
+        const guchar *character;
+        guint32 node = ROOT;
+        Output output;
+
+        for (character = (const guchar *)literal->literal;
+             *character;
+             character++) {
+            guint code = priv->codes[*character];
+
+            if (TRANSITION(priv, node, code) == NONE) {
+                priv->outputs[priv->n_nodes] = NONE;
+                TRANSITION(priv, node, code) = priv->n_nodes++;
+            }
+            node = TRANSITION(priv, node, code);
+        }
+
+        output.id = literal->id;
+        output.next = priv->outputs[node];
+        g_array_append_val(priv->output_entries, output);
+        priv->outputs[node] = priv->output_entries->len - 1;
+    }
+
+    failure_links = g_new(guint32, priv->n_nodes);
+    queue = g_new(guint32, priv->n_nodes);
+    failure_links[ROOT] = ROOT;
+    priv->dictionary_links[ROOT] = NONE;
+    for (i = 0; i < priv->n_codes; i++) {
+        guint32 child = TRANSITION(priv, ROOT, i);
+
+        if (child == NONE) {
+            TRANSITION(priv, ROOT, i) = ROOT;
+        } else {
+            failure_links[child] = ROOT;
+            priv->dictionary_links[child] = NONE;
+            queue[queue_tail++] = child;
+        }
+    }
+
+    while (queue_head < queue_tail) {
+        guint32 node = queue[queue_head++];
+
+        for (i = 0; i < priv->n_codes; i++) {
+            guint32 child = TRANSITION(priv, node, i);
+            guint32 failure;
+
+            failure = TRANSITION(priv, failure_links[node], i);
+            if (child == NONE) {
+                TRANSITION(priv, node, i) = failure;
+                continue;
+            }
+
+            failure_links[child] = failure;
+            if (priv->outputs[failure] != NONE)
+                priv->dictionary_links[child] = failure;
+            else
+                priv->dictionary_links[child] =
+                    priv->dictionary_links[failure];
+            queue[queue_tail++] = child;
+        }
+    }
+
+    g_free(queue);
+    g_free(failure_links);
+    priv->built = TRUE;
+}
+
+static gint
+compare_id (gconstpointer a, gconstpointer b)
+{
+    guint id_a = *(const guint *)a;
+    guint id_b = *(const guint *)b;
+
+    if (id_a < id_b)
+        return -1;
+    if (id_a > id_b)
+        return 1;
+    return 0;
+}
+
+guint
+milter_manager_literal_matcher_match (MilterManagerLiteralMatcher *matcher,
+                                      const gchar *text,
+                                      gsize text_size,
+                                      GArray *ids)
+{
+    MilterManagerLiteralMatcherPrivate *priv;
+    guint8 *found;
+    guint32 node = ROOT;
+    guint n_found_ids = 0, first_index;
+    gsize i;
+
+    priv = MILTER_MANAGER_LITERAL_MATCHER_GET_PRIVATE(matcher);
+    if (priv->literals->len == 0)
+        return 0;
+    if (!priv->built)
+        build(priv);
+
+    first_index = ids->len;
+    found = g_new0(guint8, priv->max_id + 1);
+    for (i = 0; i < text_size; i++) {
+        guint32 output_node;
+
+        node = TRANSITION(priv, node, priv->codes[(guchar)text[i]]);
+        output_node = node;
+        if (priv->outputs[output_node] == NONE)
+            output_node = priv->dictionary_links[output_node];
+        while (output_node != NONE) {
+            guint32 output_index;
+
+            for (output_index = priv->outputs[output_node];
+                 output_index != NONE;
+                 output_index =
+                     g_array_index(priv->output_entries, Output,
+                                   output_index).next) {
+                guint id;
+
+                id = g_array_index(priv->output_entries, Output,
+                                   output_index).id;
+                if (found[id])
+                    continue;
+                found[id] = 1;
+                g_array_append_val(ids, id);
+                n_found_ids++;
+            }
+            output_node = priv->dictionary_links[output_node];
+        }
+    }
+    g_free(found);
+
+    if (n_found_ids > 1)
+        qsort(&g_array_index(ids, guint, first_index), n_found_ids,
+              sizeof(guint), compare_id);
+
+    return n_found_ids;
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
@@ -0,0 +1,104 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __MILTER_MANAGER_LITERAL_MATCHER_H__
+#define __MILTER_MANAGER_LITERAL_MATCHER_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * SECTION: milter-manager-literal-matcher
+ * @title: MilterManagerLiteralMatcher
+ * @short_description: Finds many literals in a text at once.
+ *
+ * The %MilterManagerLiteralMatcher finds all registered
+ * literals in a text by scanning the text only once with
+ * Aho-Corasick automaton. Literals are matched ASCII
+ * case-insensitively. It is used to select candidate
+ * patterns before running regular expressions.
+ */
+
+#define MILTER_TYPE_MANAGER_LITERAL_MATCHER            (milter_manager_literal_matcher_get_type())
+#define MILTER_MANAGER_LITERAL_MATCHER(obj)            (G_TYPE_CHECK_INSTANCE_CAST((obj), MILTER_TYPE_MANAGER_LITERAL_MATCHER, MilterManagerLiteralMatcher))
+#define MILTER_MANAGER_LITERAL_MATCHER_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST((klass), MILTER_TYPE_MANAGER_LITERAL_MATCHER, MilterManagerLiteralMatcherClass))
+#define MILTER_MANAGER_IS_LITERAL_MATCHER(obj)         (G_TYPE_CHECK_INSTANCE_TYPE((obj), MILTER_TYPE_MANAGER_LITERAL_MATCHER))
+#define MILTER_MANAGER_IS_LITERAL_MATCHER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), MILTER_TYPE_MANAGER_LITERAL_MATCHER))
+#define MILTER_MANAGER_LITERAL_MATCHER_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS((obj), MILTER_TYPE_MANAGER_LITERAL_MATCHER, MilterManagerLiteralMatcherClass))
+
+typedef struct _MilterManagerLiteralMatcher         MilterManagerLiteralMatcher;
+typedef struct _MilterManagerLiteralMatcherClass    MilterManagerLiteralMatcherClass;
+
+struct _MilterManagerLiteralMatcher
+{
+    GObject object;
+};
+
+struct _MilterManagerLiteralMatcherClass
+{
+    GObjectClass parent_class;
+};
+
+GType                milter_manager_literal_matcher_get_type    (void) G_GNUC_CONST;
+
+MilterManagerLiteralMatcher *
+                     milter_manager_literal_matcher_new (void);
+
+/**
+ * milter_manager_literal_matcher_add:
+ * @matcher: a %MilterManagerLiteralMatcher.
+ * @literal: a non empty literal.
+ * @id: the ID reported when @literal is found.
+ *
+ * Registers @literal. The same @id can be used for
+ * multiple literals.
+ */
+void                 milter_manager_literal_matcher_add
+                                          (MilterManagerLiteralMatcher *matcher,
+                                           const gchar *literal,
+                                           guint        id);
+guint                milter_manager_literal_matcher_get_size
+                                          (MilterManagerLiteralMatcher *matcher);
+
+/**
+ * milter_manager_literal_matcher_match:
+ * @matcher: a %MilterManagerLiteralMatcher.
+ * @text: the text to be scanned.
+ * @text_size: the size of @text in bytes.
+ * @ids: the array of guint to store found IDs.
+ *
+ * Scans @text and appends IDs of found literals to @ids in
+ * ascending order. Each ID is appended only once.
+ *
+ * Returns: the number of found IDs.
+ */
+guint                milter_manager_literal_matcher_match
+                                          (MilterManagerLiteralMatcher *matcher,
+                                           const gchar *text,
+                                           gsize        text_size,
+                                           GArray      *ids);
+
+G_END_DECLS
+
+#endif /* __MILTER_MANAGER_LITERAL_MATCHER_H__ */
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
@@ -46,6 +46,7 @@ static gpointer *stack_address = NULL;
 static gboolean initialized = FALSE;
 static MilterManager *the_manager = NULL;
 static gchar *option_config_dir = NULL;
+static gchar *option_snapshot = NULL;
 static gboolean option_show_config = FALSE;
 
 static gboolean io_detached = FALSE;
@@ -103,6 +104,12 @@ static const GOptionEntry option_entries[] =
      0, G_OPTION_ARG_FILENAME, &option_config_dir,
      N_("The configuration directory that has configuration file."),
      "DIRECTORY"},
+    {"snapshot", 0,
+     0, G_OPTION_ARG_FILENAME, &option_snapshot,
+     N_("Load configuration from FILE if configuration files "
+        "aren't changed and save configuration to FILE after loading "
+        "configuration files."),
+     "FILE"},
     {"show-config", 0, 0, G_OPTION_ARG_NONE, &option_show_config,
      N_("Show configuration and exit"), NULL},
     {"version", 0, G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, print_version,
@@ -600,6 +607,8 @@ milter_manager_main (void)
     manager = the_manager;
     config = milter_manager_get_configuration(manager);
 
+    if (option_snapshot)
+        milter_manager_configuration_set_snapshot_path(config, option_snapshot);
     if (option_config_dir) {
         milter_manager_configuration_prepend_load_path(config,
                                                        option_config_dir);
@@ -656,6 +665,13 @@ milter_manager_main (void)
         return FALSE;
     }
 
+    if (!milter_manager_configuration_create_shared_cache(config, &error)) {
+        milter_manager_error("failed to create shared cache: %s",
+                             error->message);
+        g_error_free(error);
+        error = NULL;
+    }
+
     loop = milter_client_get_event_loop(client);
     controller = milter_manager_controller_new(manager, loop);
     if (controller && !milter_manager_controller_listen(controller, &error)) {
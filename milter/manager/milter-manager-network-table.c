@@ -0,0 +1,584 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "../../config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+#include <stdlib.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <milter/core.h>
+
+#include "milter-manager-network-table.h"
+
+#define FILE_MAGIC "MMNETTB1"
+#define FILE_MAGIC_SIZE 8
+
+#define IPV4_ROOT 0
+#define IPV6_ROOT 1
+#define NO_CHILD 0
+#define NO_ENTRY G_MAXUINT32
+#define NO_VALUE G_MAXUINT32
+
+#define MILTER_MANAGER_NETWORK_TABLE_GET_PRIVATE(obj)                   \
+    (G_TYPE_INSTANCE_GET_PRIVATE((obj),                                 \
+                                 MILTER_TYPE_MANAGER_NETWORK_TABLE,     \
+                                 MilterManagerNetworkTablePrivate))
+
+typedef struct _Node Node;
+struct _Node
+{
+    guint32 children[2];
+    guint32 entry;
+};
+
+typedef struct _FileHeader FileHeader;
+struct _FileHeader
+{
+    gchar magic[FILE_MAGIC_SIZE];
+    guint32 n_nodes;
+    guint32 n_entries;
+    guint32 values_size;
+    guint32 reserved;
+};
+
+typedef struct _MilterManagerNetworkTablePrivate MilterManagerNetworkTablePrivate;
+struct _MilterManagerNetworkTablePrivate
+{
+    GArray *nodes;
+    GArray *entries;
+    GString *values;
+    GMappedFile *mapped_file;
+
+    const Node *node_data;
+    guint32 n_nodes;
+    const guint32 *entry_data;
+    guint32 n_entries;
+    const gchar *value_data;
+    guint32 values_size;
+};
+
+G_DEFINE_TYPE(MilterManagerNetworkTable,
+              milter_manager_network_table,
+              G_TYPE_OBJECT)
+
+static void dispose        (GObject         *object);
+
+static void
+milter_manager_network_table_class_init (MilterManagerNetworkTableClass *klass)
+{
+    GObjectClass *gobject_class;
+
+    gobject_class = G_OBJECT_CLASS(klass);
+
+    gobject_class->dispose = dispose;
+
+    g_type_class_add_private(gobject_class,
+                             sizeof(MilterManagerNetworkTablePrivate));
+}
+
+static void
+sync_data (MilterManagerNetworkTablePrivate *priv)
+{
+    priv->node_data = (const Node *)priv->nodes->data;
+    priv->n_nodes = priv->nodes->len;
+    priv->entry_data = (const guint32 *)priv->entries->data;
+    priv->n_entries = priv->entries->len;
+    priv->value_data = priv->values->str;
+    priv->values_size = priv->values->len;
+}
+
+static void
+milter_manager_network_table_init (MilterManagerNetworkTable *table)
+{
+    MilterManagerNetworkTablePrivate *priv;
+    Node root = {{NO_CHILD, NO_CHILD}, NO_ENTRY};
+
+    priv = MILTER_MANAGER_NETWORK_TABLE_GET_PRIVATE(table);
+    priv->nodes = g_array_new(FALSE, FALSE, sizeof(Node));
+    g_array_append_val(priv->nodes, root);
+    g_array_append_val(priv->nodes, root);
+    priv->entries = g_array_new(FALSE, FALSE, sizeof(guint32));
+    priv->values = g_string_new(NULL);
+    priv->mapped_file = NULL;
+    sync_data(priv);
+}
+
+static void
+dispose (GObject *object)
+{
+    MilterManagerNetworkTablePrivate *priv;
+
+    priv = MILTER_MANAGER_NETWORK_TABLE_GET_PRIVATE(object);
+
+    if (priv->nodes) {
+        g_array_free(priv->nodes, TRUE);
+        priv->nodes = NULL;
+    }
+
+    if (priv->entries) {
+        g_array_free(priv->entries, TRUE);
+        priv->entries = NULL;
+    }
+
+    if (priv->values) {
+        g_string_free(priv->values, TRUE);
+        priv->values = NULL;
+    }
+
+    if (priv->mapped_file) {
+        g_mapped_file_unref(priv->mapped_file);
+        priv->mapped_file = NULL;
+    }
+
+    priv->node_data = NULL;
+    priv->n_nodes = 0;
+    priv->entry_data = NULL;
+    priv->n_entries = 0;
+    priv->value_data = NULL;
+    priv->values_size = 0;
+
+    G_OBJECT_CLASS(milter_manager_network_table_parent_class)->dispose(object);
+}
+
+GQuark
+milter_manager_network_table_error_quark (void)
+{
+    return g_quark_from_static_string("milter-manager-network-table-error-quark");
+}
+
+MilterManagerNetworkTable *
+milter_manager_network_table_new (void)
+{
+    return g_object_new(MILTER_TYPE_MANAGER_NETWORK_TABLE, NULL);
+}
+
+static gboolean
+validate_mapped_data (MilterManagerNetworkTablePrivate *priv,
+                      const gchar *path,
+                      GError **error)
+{
+    guint32 i;
+
+    if (priv->n_nodes < 2)
+        goto invalid;
+
+    for (i = 0; i < priv->n_nodes; i++) {
+        const Node *node = &(priv->node_data[i]);
+
+        if (node->children[0] >= priv->n_nodes ||
+            node->children[1] >= priv->n_nodes)
+            goto invalid;
+        if (node->entry != NO_ENTRY && node->entry >= priv->n_entries)
+            goto invalid;
+    }
+
+    for (i = 0; i < priv->n_entries; i++) {
+        guint32 value_offset = priv->entry_data[i];
+
+        if (value_offset != NO_VALUE && value_offset >= priv->values_size)
+            goto invalid;
+    }
+
+    if (priv->values_size > 0 &&
+        priv->value_data[priv->values_size - 1] != '\0')
+        goto invalid;
+
+    return TRUE;
+
+invalid:
+    g_set_error(error,
+                MILTER_MANAGER_NETWORK_TABLE_ERROR,
+                MILTER_MANAGER_NETWORK_TABLE_ERROR_INVALID_FILE,
+                "broken network table file: <%s>", path);
+    return FALSE;
+}
+
+MilterManagerNetworkTable *
+milter_manager_network_table_new_from_file (const gchar *path, GError **error)
+{
+    MilterManagerNetworkTable *table;
+    MilterManagerNetworkTablePrivate *priv;
+    GMappedFile *mapped_file;
+    const gchar *contents;
+    FileHeader header;
+    gsize length;
+    guint64 expected_length;
+
+    mapped_file = g_mapped_file_new(path, FALSE, error);
+    if (!mapped_file)
+        return NULL;
+
+    contents = g_mapped_file_get_contents(mapped_file);
+    length = g_mapped_file_get_length(mapped_file);
+    if (length < sizeof(header)) {
+        g_set_error(error,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR_INVALID_FILE,
+                    "too short network table file: <%s>", path);
+        g_mapped_file_unref(mapped_file);
+        return NULL;
+    }
+
+    memcpy(&header, contents, sizeof(header));
+    if (memcmp(header.magic, FILE_MAGIC, FILE_MAGIC_SIZE) != 0) {
+        g_set_error(error,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR_INVALID_FILE,
+                    "not a network table file: <%s>", path);
+        g_mapped_file_unref(mapped_file);
+        return NULL;
+    }
+
+    expected_length = sizeof(header);
+    expected_length += (guint64)header.n_nodes * sizeof(Node);
+    expected_length += (guint64)header.n_entries * sizeof(guint32);
+    expected_length += header.values_size;
+    if (expected_length != length) {
+        g_set_error(error,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR_INVALID_FILE,
+                    "network table file size mismatch: <%s>: "
+                    "expected: <%" G_GUINT64_FORMAT "> "
+                    "actual: <%" G_GSIZE_FORMAT ">",
+                    path, expected_length, length);
+        g_mapped_file_unref(mapped_file);
+        return NULL;
+    }
+
+    table = milter_manager_network_table_new();
+    priv = MILTER_MANAGER_NETWORK_TABLE_GET_PRIVATE(table);
+    priv->mapped_file = mapped_file;
+    contents += sizeof(header);
+    priv->node_data = (const Node *)contents;
+    priv->n_nodes = header.n_nodes;
+    contents += header.n_nodes * sizeof(Node);
+    priv->entry_data = (const guint32 *)contents;
+    priv->n_entries = header.n_entries;
+    contents += header.n_entries * sizeof(guint32);
+    priv->value_data = contents;
+    priv->values_size = header.values_size;
+
+    if (!validate_mapped_data(priv, path, error)) {
+        g_object_unref(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+static gboolean
+parse_network (const gchar *network, gint *family, guint8 *bytes,
+               guint *prefix_length, GError **error)
+{
+    gchar *address, *slash;
+    guint max_prefix_length;
+    guint i;
+
+    address = g_strdup(network);
+    slash = strchr(address, '/');
+    if (slash)
+        *slash = '\0';
+
+    if (inet_pton(AF_INET, address, bytes) == 1) {
+        *family = AF_INET;
+        max_prefix_length = 32;
+    } else if (inet_pton(AF_INET6, address, bytes) == 1) {
+        *family = AF_INET6;
+        max_prefix_length = 128;
+    } else {
+        g_set_error(error,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR_INVALID_NETWORK,
+                    "invalid address: <%s>", network);
+        g_free(address);
+        return FALSE;
+    }
+
+    *prefix_length = max_prefix_length;
+    if (slash) {
+        const gchar *prefix_length_string = slash + 1;
+        gchar *end = NULL;
+        gulong parsed_prefix_length;
+
+        parsed_prefix_length = strtoul(prefix_length_string, &end, 10);
+        if (prefix_length_string[0] == '\0' || !end || end[0] != '\0' ||
+            parsed_prefix_length > max_prefix_length) {
+            g_set_error(error,
+                        MILTER_MANAGER_NETWORK_TABLE_ERROR,
+                        MILTER_MANAGER_NETWORK_TABLE_ERROR_INVALID_NETWORK,
+                        "invalid prefix length: <%s>", network);
+            g_free(address);
+            return FALSE;
+        }
+        *prefix_length = parsed_prefix_length;
+    }
+    g_free(address);
+
+    for (i = *prefix_length; i < max_prefix_length; i++) {
+        bytes[i / 8] &= ~(0x80 >> (i % 8));
+    }
+
+    return TRUE;
+}
+
+#define BIT_AT(bytes, i) (((bytes)[(i) / 8] >> (7 - ((i) % 8))) & 1)
+
+gboolean
+milter_manager_network_table_add (MilterManagerNetworkTable *table,
+                                  const gchar *network,
+                                  const gchar *value,
+                                  GError **error)
+{
+    MilterManagerNetworkTablePrivate *priv;
+    guint8 bytes[16];
+    gint family;
+    guint prefix_length;
+    guint32 node_index, value_offset;
+    guint i;
+    Node *node;
+
+    priv = MILTER_MANAGER_NETWORK_TABLE_GET_PRIVATE(table);
+    if (priv->mapped_file) {
+        g_set_error(error,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR_READ_ONLY,
+                    "can't add a network to a table loaded from file: <%s>",
+                    network);
+        return FALSE;
+    }
+
+    memset(bytes, 0, sizeof(bytes));
+    if (!parse_network(network, &family, bytes, &prefix_length, error))
+        return FALSE;
+
+    node_index = (family == AF_INET) ? IPV4_ROOT : IPV6_ROOT;
+    for (i = 0; i < prefix_length; i++) {
+        guint bit = BIT_AT(bytes, i);
+        guint32 child;
+
+        child = g_array_index(priv->nodes, Node, node_index).children[bit];
+        if (child == NO_CHILD) {
+            Node new_node = {{NO_CHILD, NO_CHILD}, NO_ENTRY};
+
+            g_array_append_val(priv->nodes, new_node);
+            child = priv->nodes->len - 1;
+            g_array_index(priv->nodes, Node, node_index).children[bit] = child;
+        }
+        node_index = child;
+    }
+
+    node = &g_array_index(priv->nodes, Node, node_index);
+    if (node->entry == NO_ENTRY) {
+        if (value) {
+            value_offset = priv->values->len;
+            g_string_append_len(priv->values, value, strlen(value) + 1);
+        } else {
+            value_offset = NO_VALUE;
+        }
+        g_array_append_val(priv->entries, value_offset);
+        node->entry = priv->entries->len - 1;
+    }
+    sync_data(priv);
+
+    return TRUE;
+}
+
+static gboolean
+lookup_bytes (MilterManagerNetworkTablePrivate *priv,
+              gint family, const guint8 *bytes,
+              gboolean longest, const gchar **value)
+{
+    guint32 node_index, found_entry = NO_ENTRY;
+    guint i, n_bits;
+
+    if (family == AF_INET) {
+        node_index = IPV4_ROOT;
+        n_bits = 32;
+    } else {
+        node_index = IPV6_ROOT;
+        n_bits = 128;
+    }
+
+    for (i = 0; ; i++) {
+        const Node *node = &(priv->node_data[node_index]);
+
+        if (node->entry != NO_ENTRY) {
+            if (longest || node->entry < found_entry)
+                found_entry = node->entry;
+        }
+        if (i == n_bits)
+            break;
+        node_index = node->children[BIT_AT(bytes, i)];
+        if (node_index == NO_CHILD)
+            break;
+    }
+
+    if (found_entry == NO_ENTRY)
+        return FALSE;
+
+    if (value) {
+        guint32 value_offset = priv->entry_data[found_entry];
+
+        if (value_offset == NO_VALUE)
+            *value = NULL;
+        else
+            *value = priv->value_data + value_offset;
+    }
+    return TRUE;
+}
+
+static gboolean
+lookup_address (MilterManagerNetworkTable *table,
+                struct sockaddr *address, socklen_t address_length,
+                gboolean longest, const gchar **value)
+{
+    MilterManagerNetworkTablePrivate *priv;
+
+    priv = MILTER_MANAGER_NETWORK_TABLE_GET_PRIVATE(table);
+    if (!address)
+        return FALSE;
+
+    switch (address->sa_family) {
+    case AF_INET:
+    {
+        struct sockaddr_in *address_in = (struct sockaddr_in *)address;
+
+        if (address_length < sizeof(*address_in))
+            return FALSE;
+        return lookup_bytes(priv, AF_INET,
+                            (const guint8 *)&(address_in->sin_addr),
+                            longest, value);
+    }
+    case AF_INET6:
+    {
+        struct sockaddr_in6 *address_in6 = (struct sockaddr_in6 *)address;
+        const guint8 *bytes;
+
+        if (address_length < sizeof(*address_in6))
+            return FALSE;
+        bytes = (const guint8 *)&(address_in6->sin6_addr);
+        if (IN6_IS_ADDR_V4MAPPED(&(address_in6->sin6_addr)))
+            return lookup_bytes(priv, AF_INET, bytes + 12, longest, value);
+        return lookup_bytes(priv, AF_INET6, bytes, longest, value);
+    }
+    default:
+        return FALSE;
+    }
+}
+
+gboolean
+milter_manager_network_table_lookup (MilterManagerNetworkTable *table,
+                                     struct sockaddr *address,
+                                     socklen_t address_length,
+                                     const gchar **value)
+{
+    return lookup_address(table, address, address_length, FALSE, value);
+}
+
+gboolean
+milter_manager_network_table_lookup_longest (MilterManagerNetworkTable *table,
+                                             struct sockaddr *address,
+                                             socklen_t address_length,
+                                             const gchar **value)
+{
+    return lookup_address(table, address, address_length, TRUE, value);
+}
+
+gboolean
+milter_manager_network_table_lookup_string (MilterManagerNetworkTable *table,
+                                            const gchar *address,
+                                            gboolean longest,
+                                            const gchar **value)
+{
+    MilterManagerNetworkTablePrivate *priv;
+    guint8 bytes[16];
+
+    priv = MILTER_MANAGER_NETWORK_TABLE_GET_PRIVATE(table);
+    if (inet_pton(AF_INET, address, bytes) == 1)
+        return lookup_bytes(priv, AF_INET, bytes, longest, value);
+    if (inet_pton(AF_INET6, address, bytes) == 1) {
+        if (IN6_IS_ADDR_V4MAPPED((struct in6_addr *)bytes))
+            return lookup_bytes(priv, AF_INET, bytes + 12, longest, value);
+        return lookup_bytes(priv, AF_INET6, bytes, longest, value);
+    }
+    return FALSE;
+}
+
+guint
+milter_manager_network_table_get_size (MilterManagerNetworkTable *table)
+{
+    return MILTER_MANAGER_NETWORK_TABLE_GET_PRIVATE(table)->n_entries;
+}
+
+gboolean
+milter_manager_network_table_is_read_only (MilterManagerNetworkTable *table)
+{
+    return MILTER_MANAGER_NETWORK_TABLE_GET_PRIVATE(table)->mapped_file != NULL;
+}
+
+gboolean
+milter_manager_network_table_save (MilterManagerNetworkTable *table,
+                                   const gchar *path,
+                                   GError **error)
+{
+    MilterManagerNetworkTablePrivate *priv;
+    FileHeader header;
+    GString *content;
+    GError *local_error = NULL;
+    gboolean success;
+
+    priv = MILTER_MANAGER_NETWORK_TABLE_GET_PRIVATE(table);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FILE_MAGIC, FILE_MAGIC_SIZE);
+    header.n_nodes = priv->n_nodes;
+    header.n_entries = priv->n_entries;
+    header.values_size = priv->values_size;
+
+    content = g_string_new(NULL);
+    g_string_append_len(content, (const gchar *)&header, sizeof(header));
+    g_string_append_len(content, (const gchar *)priv->node_data,
+                        priv->n_nodes * sizeof(Node));
+    g_string_append_len(content, (const gchar *)priv->entry_data,
+                        priv->n_entries * sizeof(guint32));
+    g_string_append_len(content, priv->value_data, priv->values_size);
+
+    success = g_file_set_contents(path, content->str, content->len,
+                                  &local_error);
+    g_string_free(content, TRUE);
+    if (!success) {
+        g_set_error(error,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR_IO,
+                    "failed to save network table: <%s>: %s",
+                    path, local_error->message);
+        g_error_free(local_error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
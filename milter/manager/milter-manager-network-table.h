@@ -0,0 +1,165 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __MILTER_MANAGER_NETWORK_TABLE_H__
+#define __MILTER_MANAGER_NETWORK_TABLE_H__
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * SECTION: milter-manager-network-table
+ * @title: MilterManagerNetworkTable
+ * @short_description: IPv4/IPv6 network table on a radix trie.
+ *
+ * The %MilterManagerNetworkTable maps IPv4 and IPv6
+ * networks to values. Look up cost depends only on the
+ * address length, not the number of networks.
+ *
+ * milter_manager_network_table_lookup() returns the value
+ * of the network that is added first like Postfix's
+ * cidr_table. milter_manager_network_table_lookup_longest()
+ * returns the value of the most specific network.
+ *
+ * A table can be saved as a compiled file by
+ * milter_manager_network_table_save() and loaded by
+ * milter_manager_network_table_new_from_file() without
+ * parsing. The loaded table is mapped into memory and
+ * read-only. The compiled file uses the host byte order.
+ */
+
+#define MILTER_MANAGER_NETWORK_TABLE_ERROR           (milter_manager_network_table_error_quark())
+
+#define MILTER_TYPE_MANAGER_NETWORK_TABLE            (milter_manager_network_table_get_type())
+#define MILTER_MANAGER_NETWORK_TABLE(obj)            (G_TYPE_CHECK_INSTANCE_CAST((obj), MILTER_TYPE_MANAGER_NETWORK_TABLE, MilterManagerNetworkTable))
+#define MILTER_MANAGER_NETWORK_TABLE_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST((klass), MILTER_TYPE_MANAGER_NETWORK_TABLE, MilterManagerNetworkTableClass))
+#define MILTER_MANAGER_IS_NETWORK_TABLE(obj)         (G_TYPE_CHECK_INSTANCE_TYPE((obj), MILTER_TYPE_MANAGER_NETWORK_TABLE))
+#define MILTER_MANAGER_IS_NETWORK_TABLE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), MILTER_TYPE_MANAGER_NETWORK_TABLE))
+#define MILTER_MANAGER_NETWORK_TABLE_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS((obj), MILTER_TYPE_MANAGER_NETWORK_TABLE, MilterManagerNetworkTableClass))
+
+typedef enum
+{
+    MILTER_MANAGER_NETWORK_TABLE_ERROR_INVALID_NETWORK,
+    MILTER_MANAGER_NETWORK_TABLE_ERROR_READ_ONLY,
+    MILTER_MANAGER_NETWORK_TABLE_ERROR_INVALID_FILE,
+    MILTER_MANAGER_NETWORK_TABLE_ERROR_IO
+} MilterManagerNetworkTableError;
+
+typedef struct _MilterManagerNetworkTable         MilterManagerNetworkTable;
+typedef struct _MilterManagerNetworkTableClass    MilterManagerNetworkTableClass;
+
+struct _MilterManagerNetworkTable
+{
+    GObject object;
+};
+
+struct _MilterManagerNetworkTableClass
+{
+    GObjectClass parent_class;
+};
+
+GQuark               milter_manager_network_table_error_quark (void);
+GType                milter_manager_network_table_get_type    (void) G_GNUC_CONST;
+
+MilterManagerNetworkTable *
+                     milter_manager_network_table_new (void);
+
+/**
+ * milter_manager_network_table_new_from_file:
+ * @path: the path of a file saved by
+ *        milter_manager_network_table_save().
+ * @error: return location for an error, or %NULL.
+ *
+ * Maps a compiled table into memory. The returned table is
+ * read-only.
+ *
+ * Returns: a new %MilterManagerNetworkTable or %NULL on error.
+ */
+MilterManagerNetworkTable *
+                     milter_manager_network_table_new_from_file
+                                          (const gchar *path,
+                                           GError     **error);
+
+/**
+ * milter_manager_network_table_add:
+ * @table: a %MilterManagerNetworkTable.
+ * @network: a network such as "192.168.0.0/16",
+ *           "2001:db8::/32" or an address.
+ * @value: the value of @network or %NULL.
+ * @error: return location for an error, or %NULL.
+ *
+ * Adds @network. Host bits of @network are ignored. If
+ * @network is already added, the first value is kept.
+ *
+ * Returns: %TRUE on success.
+ */
+gboolean             milter_manager_network_table_add
+                                          (MilterManagerNetworkTable *table,
+                                           const gchar *network,
+                                           const gchar *value,
+                                           GError     **error);
+
+/**
+ * milter_manager_network_table_lookup:
+ * @table: a %MilterManagerNetworkTable.
+ * @address: the address to be looked up.
+ * @address_length: the length of @address.
+ * @value: return location for the value or %NULL.
+ *
+ * Looks up the first added network that contains @address.
+ *
+ * Returns: %TRUE if a network is found.
+ */
+gboolean             milter_manager_network_table_lookup
+                                          (MilterManagerNetworkTable *table,
+                                           struct sockaddr *address,
+                                           socklen_t        address_length,
+                                           const gchar    **value);
+gboolean             milter_manager_network_table_lookup_longest
+                                          (MilterManagerNetworkTable *table,
+                                           struct sockaddr *address,
+                                           socklen_t        address_length,
+                                           const gchar    **value);
+gboolean             milter_manager_network_table_lookup_string
+                                          (MilterManagerNetworkTable *table,
+                                           const gchar     *address,
+                                           gboolean         longest,
+                                           const gchar    **value);
+
+guint                milter_manager_network_table_get_size
+                                          (MilterManagerNetworkTable *table);
+gboolean             milter_manager_network_table_is_read_only
+                                          (MilterManagerNetworkTable *table);
+
+gboolean             milter_manager_network_table_save
+                                          (MilterManagerNetworkTable *table,
+                                           const gchar *path,
+                                           GError     **error);
+
+G_END_DECLS
+
+#endif /* __MILTER_MANAGER_NETWORK_TABLE_H__ */
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
@@ -0,0 +1,524 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "../../config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include <milter/core.h>
+
+#include "milter-manager-shared-cache.h"
+
+#ifndef MAP_ANONYMOUS
+#  define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#define SEGMENT_MAGIC 0x4d4d5343 /* MMSC */
+#define N_WAYS 8
+#define N_PINNED_WAYS (N_WAYS / 2)
+#define N_STRIPES 64
+#define N_SPINS_BEFORE_YIELD 100
+#define N_YIELDS_BEFORE_OWNER_CHECK 1000
+
+#define MILTER_MANAGER_SHARED_CACHE_GET_PRIVATE(obj)                    \
+    (G_TYPE_INSTANCE_GET_PRIVATE((obj),                                 \
+                                 MILTER_TYPE_MANAGER_SHARED_CACHE,      \
+                                 MilterManagerSharedCachePrivate))
+
+typedef struct _Stripe Stripe;
+struct _Stripe
+{
+    volatile gint owner;
+    guint64 tick;
+    MilterManagerSharedCacheStatistics statistics;
+};
+
+typedef struct _Entry Entry;
+struct _Entry
+{
+    guint32 hash;
+    guint16 key_size;
+    guint16 value_size;
+    gboolean pinned;
+    gdouble expire_time;
+    guint64 last_used;
+    gchar key[MILTER_MANAGER_SHARED_CACHE_MAX_KEY_SIZE + 1];
+    gchar value[MILTER_MANAGER_SHARED_CACHE_MAX_VALUE_SIZE];
+};
+
+typedef struct _Segment Segment;
+struct _Segment
+{
+    guint32 magic;
+    guint32 n_buckets;
+    Stripe stripes[N_STRIPES];
+    Entry entries[1];
+};
+
+typedef struct _MilterManagerSharedCachePrivate MilterManagerSharedCachePrivate;
+struct _MilterManagerSharedCachePrivate
+{
+    Segment *segment;
+    gsize segment_size;
+};
+
+G_DEFINE_TYPE(MilterManagerSharedCache,
+              milter_manager_shared_cache,
+              G_TYPE_OBJECT)
+
+static void finalize       (GObject         *object);
+
+static void
+milter_manager_shared_cache_class_init (MilterManagerSharedCacheClass *klass)
+{
+    GObjectClass *gobject_class;
+
+    gobject_class = G_OBJECT_CLASS(klass);
+
+    gobject_class->finalize = finalize;
+
+    g_type_class_add_private(gobject_class,
+                             sizeof(MilterManagerSharedCachePrivate));
+}
+
+static void
+milter_manager_shared_cache_init (MilterManagerSharedCache *cache)
+{
+    MilterManagerSharedCachePrivate *priv;
+
+    priv = MILTER_MANAGER_SHARED_CACHE_GET_PRIVATE(cache);
+    priv->segment = NULL;
+    priv->segment_size = 0;
+}
+
+static void
+finalize (GObject *object)
+{
+    MilterManagerSharedCachePrivate *priv;
+
+    priv = MILTER_MANAGER_SHARED_CACHE_GET_PRIVATE(object);
+    if (priv->segment) {
+        munmap(priv->segment, priv->segment_size);
+        priv->segment = NULL;
+    }
+
+    G_OBJECT_CLASS(milter_manager_shared_cache_parent_class)->finalize(object);
+}
+
+GQuark
+milter_manager_shared_cache_error_quark (void)
+{
+    return g_quark_from_static_string("milter-manager-shared-cache-error-quark");
+}
+
+MilterManagerSharedCache *
+milter_manager_shared_cache_new (guint n_entries, GError **error)
+{
+    MilterManagerSharedCache *cache;
+    MilterManagerSharedCachePrivate *priv;
+    guint n_buckets;
+    gsize segment_size;
+    gpointer segment;
+
+    if (n_entries == 0) {
+        g_set_error(error,
+                    MILTER_MANAGER_SHARED_CACHE_ERROR,
+                    MILTER_MANAGER_SHARED_CACHE_ERROR_INVALID_SIZE,
+                    "the number of entries should be larger than 0");
+        return NULL;
+    }
+
+    n_buckets = (n_entries + N_WAYS - 1) / N_WAYS;
+    segment_size = sizeof(Segment) + sizeof(Entry) * (n_buckets * N_WAYS - 1);
+    segment = mmap(NULL, segment_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (segment == MAP_FAILED) {
+        g_set_error(error,
+                    MILTER_MANAGER_SHARED_CACHE_ERROR,
+                    MILTER_MANAGER_SHARED_CACHE_ERROR_MAP,
+                    "failed to map shared cache segment: "
+                    "<%" G_GSIZE_FORMAT ">: %s",
+                    segment_size, g_strerror(errno));
+        return NULL;
+    }
+
+    cache = g_object_new(MILTER_TYPE_MANAGER_SHARED_CACHE, NULL);
+    priv = MILTER_MANAGER_SHARED_CACHE_GET_PRIVATE(cache);
+    priv->segment = segment;
+    priv->segment_size = segment_size;
+    priv->segment->magic = SEGMENT_MAGIC;
+    priv->segment->n_buckets = n_buckets;
+
+    milter_debug("[shared-cache][new] <%u> <%" G_GSIZE_FORMAT ">",
+                 n_buckets * N_WAYS, segment_size);
+
+    return cache;
+}
+
+guint
+milter_manager_shared_cache_get_n_entries (MilterManagerSharedCache *cache)
+{
+    MilterManagerSharedCachePrivate *priv;
+
+    priv = MILTER_MANAGER_SHARED_CACHE_GET_PRIVATE(cache);
+    return priv->segment->n_buckets * N_WAYS;
+}
+
+static void
+stripe_lock (Stripe *stripe)
+{
+    gint self;
+    guint n_tries = 0;
+
+    self = getpid();
+    while (!g_atomic_int_compare_and_exchange(&(stripe->owner), 0, self)) {
+        gint owner;
+
+        n_tries++;
+        if (n_tries < N_SPINS_BEFORE_YIELD)
+            continue;
+
+        sched_yield();
+        if ((n_tries % N_YIELDS_BEFORE_OWNER_CHECK) != 0)
+            continue;
+
+        owner = g_atomic_int_get(&(stripe->owner));
+        if (owner != 0 && kill(owner, 0) == -1 && errno == ESRCH) {
+            milter_warning("[shared-cache][lock][steal] "
+                           "owner process is gone: <%d>", owner);
+            g_atomic_int_compare_and_exchange(&(stripe->owner), owner, 0);
+        }
+    }
+}
+
+static void
+stripe_unlock (Stripe *stripe)
+{
+    g_atomic_int_set(&(stripe->owner), 0);
+}
+
+static gdouble
+current_time (void)
+{
+    GTimeVal time_value;
+
+    g_get_current_time(&time_value);
+    return time_value.tv_sec + time_value.tv_usec / (gdouble)G_USEC_PER_SEC;
+}
+
+static guint32
+compute_hash (const gchar *key, gsize key_size)
+{
+    guint32 hash = 2166136261U;
+    gsize i;
+
+    for (i = 0; i < key_size; i++) {
+        hash ^= (guint8)key[i];
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+static Entry *
+bucket_get (Segment *segment, guint32 hash, Stripe **stripe)
+{
+    guint bucket;
+
+    bucket = hash % segment->n_buckets;
+    *stripe = &(segment->stripes[bucket % N_STRIPES]);
+    return &(segment->entries[bucket * N_WAYS]);
+}
+
+static Entry *
+bucket_find (Entry *entries, guint32 hash, const gchar *key, gsize key_size)
+{
+    guint i;
+
+    for (i = 0; i < N_WAYS; i++) {
+        Entry *entry = &(entries[i]);
+
+        if (entry->key_size == key_size &&
+            entry->hash == hash &&
+            memcmp(entry->key, key, key_size) == 0)
+            return entry;
+    }
+
+    return NULL;
+}
+
+static void
+entry_clear (Entry *entry)
+{
+    entry->key_size = 0;
+    entry->value_size = 0;
+    entry->pinned = FALSE;
+}
+
+static guint
+bucket_count_pinned (Entry *entries, gdouble now)
+{
+    guint i, n_pinned = 0;
+
+    for (i = 0; i < N_WAYS; i++) {
+        Entry *entry = &(entries[i]);
+
+        if (entry->key_size > 0 && entry->pinned && entry->expire_time > now)
+            n_pinned++;
+    }
+
+    return n_pinned;
+}
+
+static gboolean
+cache_set (MilterManagerSharedCache *cache,
+           const gchar *key,
+           const gchar *value,
+           gsize value_size,
+           gdouble ttl,
+           gboolean pinned)
+{
+    MilterManagerSharedCachePrivate *priv;
+    Stripe *stripe;
+    Entry *entries, *entry;
+    gsize key_size;
+    guint32 hash;
+    gdouble now;
+
+    key_size = strlen(key);
+    if (key_size == 0 ||
+        key_size > MILTER_MANAGER_SHARED_CACHE_MAX_KEY_SIZE ||
+        value_size > MILTER_MANAGER_SHARED_CACHE_MAX_VALUE_SIZE)
+        return FALSE;
+
+    priv = MILTER_MANAGER_SHARED_CACHE_GET_PRIVATE(cache);
+    hash = compute_hash(key, key_size);
+    entries = bucket_get(priv->segment, hash, &stripe);
+    now = current_time();
+
+    stripe_lock(stripe);
+    entry = bucket_find(entries, hash, key, key_size);
+    if (pinned && !(entry && entry->pinned) &&
+        bucket_count_pinned(entries, now) >= N_PINNED_WAYS) {
+        stripe_unlock(stripe);
+        return FALSE;
+    }
+    if (!entry) {
+        Entry *victim = NULL;
+        guint i;
+
+        for (i = 0; i < N_WAYS; i++) {
+            Entry *candidate = &(entries[i]);
+
+            if (candidate->key_size == 0) {
+                victim = candidate;
+                break;
+            }
+            if (candidate->expire_time <= now) {
+                victim = candidate;
+                stripe->statistics.n_expirations++;
+                break;
+            }
+            if (candidate->pinned)
+                continue;
+            if (!victim || candidate->last_used < victim->last_used)
+                victim = candidate;
+        }
+        if (victim->key_size > 0 && victim->expire_time > now)
+            stripe->statistics.n_evictions++;
+        entry = victim;
+        entry->hash = hash;
+        entry->key_size = key_size;
+        memcpy(entry->key, key, key_size);
+        entry->key[key_size] = '\0';
+    }
+    entry->value_size = value_size;
+    entry->pinned = pinned;
+    memcpy(entry->value, value, value_size);
+    entry->expire_time = now + ttl;
+    entry->last_used = ++stripe->tick;
+    stripe->statistics.n_stores++;
+    stripe_unlock(stripe);
+
+    return TRUE;
+}
+
+gboolean
+milter_manager_shared_cache_set (MilterManagerSharedCache *cache,
+                                 const gchar *key,
+                                 const gchar *value,
+                                 gsize value_size,
+                                 gdouble ttl)
+{
+    return cache_set(cache, key, value, value_size, ttl, FALSE);
+}
+
+gboolean
+milter_manager_shared_cache_set_pinned (MilterManagerSharedCache *cache,
+                                        const gchar *key,
+                                        const gchar *value,
+                                        gsize value_size,
+                                        gdouble ttl)
+{
+    return cache_set(cache, key, value, value_size, ttl, TRUE);
+}
+
+gboolean
+milter_manager_shared_cache_get (MilterManagerSharedCache *cache,
+                                 const gchar *key,
+                                 gchar **value,
+                                 gsize *value_size)
+{
+    MilterManagerSharedCachePrivate *priv;
+    Stripe *stripe;
+    Entry *entries, *entry;
+    gsize key_size;
+    guint32 hash;
+    gboolean found = FALSE;
+
+    key_size = strlen(key);
+    if (key_size == 0 || key_size > MILTER_MANAGER_SHARED_CACHE_MAX_KEY_SIZE)
+        return FALSE;
+
+    priv = MILTER_MANAGER_SHARED_CACHE_GET_PRIVATE(cache);
+    hash = compute_hash(key, key_size);
+    entries = bucket_get(priv->segment, hash, &stripe);
+
+    stripe_lock(stripe);
+    entry = bucket_find(entries, hash, key, key_size);
+    if (entry && entry->expire_time <= current_time()) {
+        entry_clear(entry);
+        stripe->statistics.n_expirations++;
+        entry = NULL;
+    }
+    if (entry) {
+        found = TRUE;
+        entry->last_used = ++stripe->tick;
+        if (value)
+            *value = g_strndup(entry->value, entry->value_size);
+        if (value_size)
+            *value_size = entry->value_size;
+        stripe->statistics.n_hits++;
+    } else {
+        stripe->statistics.n_misses++;
+    }
+    stripe_unlock(stripe);
+
+    return found;
+}
+
+gboolean
+milter_manager_shared_cache_remove (MilterManagerSharedCache *cache,
+                                    const gchar *key)
+{
+    MilterManagerSharedCachePrivate *priv;
+    Stripe *stripe;
+    Entry *entries, *entry;
+    gsize key_size;
+    guint32 hash;
+
+    key_size = strlen(key);
+    if (key_size == 0 || key_size > MILTER_MANAGER_SHARED_CACHE_MAX_KEY_SIZE)
+        return FALSE;
+
+    priv = MILTER_MANAGER_SHARED_CACHE_GET_PRIVATE(cache);
+    hash = compute_hash(key, key_size);
+    entries = bucket_get(priv->segment, hash, &stripe);
+
+    stripe_lock(stripe);
+    entry = bucket_find(entries, hash, key, key_size);
+    if (entry)
+        entry_clear(entry);
+    stripe_unlock(stripe);
+
+    return entry != NULL;
+}
+
+void
+milter_manager_shared_cache_clear (MilterManagerSharedCache *cache)
+{
+    MilterManagerSharedCachePrivate *priv;
+    Segment *segment;
+    guint bucket;
+
+    priv = MILTER_MANAGER_SHARED_CACHE_GET_PRIVATE(cache);
+    segment = priv->segment;
+    for (bucket = 0; bucket < segment->n_buckets; bucket++) {
+        Stripe *stripe;
+        guint i;
+
+        stripe = &(segment->stripes[bucket % N_STRIPES]);
+        stripe_lock(stripe);
+        for (i = 0; i < N_WAYS; i++) {
+            entry_clear(&(segment->entries[bucket * N_WAYS + i]));
+        }
+        stripe_unlock(stripe);
+    }
+}
+
+void
+milter_manager_shared_cache_get_statistics (MilterManagerSharedCache *cache,
+                                            MilterManagerSharedCacheStatistics *statistics)
+{
+    MilterManagerSharedCachePrivate *priv;
+    guint i;
+
+    memset(statistics, 0, sizeof(*statistics));
+
+    priv = MILTER_MANAGER_SHARED_CACHE_GET_PRIVATE(cache);
+    for (i = 0; i < N_STRIPES; i++) {
+        Stripe *stripe = &(priv->segment->stripes[i]);
+
+        stripe_lock(stripe);
+        statistics->n_hits += stripe->statistics.n_hits;
+        statistics->n_misses += stripe->statistics.n_misses;
+        statistics->n_stores += stripe->statistics.n_stores;
+        statistics->n_evictions += stripe->statistics.n_evictions;
+        statistics->n_expirations += stripe->statistics.n_expirations;
+        stripe_unlock(stripe);
+    }
+}
+
+void
+milter_manager_shared_cache_reset_statistics (MilterManagerSharedCache *cache)
+{
+    MilterManagerSharedCachePrivate *priv;
+    guint i;
+
+    priv = MILTER_MANAGER_SHARED_CACHE_GET_PRIVATE(cache);
+    for (i = 0; i < N_STRIPES; i++) {
+        Stripe *stripe = &(priv->segment->stripes[i]);
+
+        stripe_lock(stripe);
+        memset(&(stripe->statistics), 0, sizeof(stripe->statistics));
+        stripe_unlock(stripe);
+    }
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
@@ -0,0 +1,180 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __MILTER_MANAGER_SHARED_CACHE_H__
+#define __MILTER_MANAGER_SHARED_CACHE_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * SECTION: milter-manager-shared-cache
+ * @title: MilterManagerSharedCache
+ * @short_description: Key/value cache shared by worker processes.
+ *
+ * The %MilterManagerSharedCache is a fixed size key/value
+ * cache on anonymous shared memory. It must be created
+ * before worker processes are forked. Then all workers
+ * share the same entries. Each entry has TTL. If there is
+ * no free space, the least recently used entry in the same
+ * set is evicted.
+ */
+
+#define MILTER_MANAGER_SHARED_CACHE_ERROR           (milter_manager_shared_cache_error_quark())
+
+#define MILTER_TYPE_MANAGER_SHARED_CACHE            (milter_manager_shared_cache_get_type())
+#define MILTER_MANAGER_SHARED_CACHE(obj)            (G_TYPE_CHECK_INSTANCE_CAST((obj), MILTER_TYPE_MANAGER_SHARED_CACHE, MilterManagerSharedCache))
+#define MILTER_MANAGER_SHARED_CACHE_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST((klass), MILTER_TYPE_MANAGER_SHARED_CACHE, MilterManagerSharedCacheClass))
+#define MILTER_MANAGER_IS_SHARED_CACHE(obj)         (G_TYPE_CHECK_INSTANCE_TYPE((obj), MILTER_TYPE_MANAGER_SHARED_CACHE))
+#define MILTER_MANAGER_IS_SHARED_CACHE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), MILTER_TYPE_MANAGER_SHARED_CACHE))
+#define MILTER_MANAGER_SHARED_CACHE_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS((obj), MILTER_TYPE_MANAGER_SHARED_CACHE, MilterManagerSharedCacheClass))
+
+#define MILTER_MANAGER_SHARED_CACHE_MAX_KEY_SIZE   127
+#define MILTER_MANAGER_SHARED_CACHE_MAX_VALUE_SIZE 256
+
+typedef enum
+{
+    MILTER_MANAGER_SHARED_CACHE_ERROR_INVALID_SIZE,
+    MILTER_MANAGER_SHARED_CACHE_ERROR_MAP
+} MilterManagerSharedCacheError;
+
+typedef struct _MilterManagerSharedCache         MilterManagerSharedCache;
+typedef struct _MilterManagerSharedCacheClass    MilterManagerSharedCacheClass;
+typedef struct _MilterManagerSharedCacheStatistics MilterManagerSharedCacheStatistics;
+
+struct _MilterManagerSharedCache
+{
+    GObject object;
+};
+
+struct _MilterManagerSharedCacheClass
+{
+    GObjectClass parent_class;
+};
+
+struct _MilterManagerSharedCacheStatistics
+{
+    guint64 n_hits;
+    guint64 n_misses;
+    guint64 n_stores;
+    guint64 n_evictions;
+    guint64 n_expirations;
+};
+
+GQuark               milter_manager_shared_cache_error_quark (void);
+GType                milter_manager_shared_cache_get_type    (void) G_GNUC_CONST;
+
+/**
+ * milter_manager_shared_cache_new:
+ * @n_entries: the max number of entries.
+ * @error: return location for an error, or %NULL.
+ *
+ * Creates a new shared cache. It should be called in the
+ * master process before worker processes are forked.
+ *
+ * Returns: a new %MilterManagerSharedCache or %NULL on error.
+ */
+MilterManagerSharedCache *
+                     milter_manager_shared_cache_new (guint n_entries,
+                                                      GError **error);
+
+guint                milter_manager_shared_cache_get_n_entries
+                                          (MilterManagerSharedCache *cache);
+
+/**
+ * milter_manager_shared_cache_set:
+ * @cache: a %MilterManagerSharedCache.
+ * @key: the key. It must not be longer than
+ *       %MILTER_MANAGER_SHARED_CACHE_MAX_KEY_SIZE.
+ * @value: the value.
+ * @value_size: the size of @value. It must not be larger
+ *              than %MILTER_MANAGER_SHARED_CACHE_MAX_VALUE_SIZE.
+ * @ttl: the TTL of the entry in seconds.
+ *
+ * Stores @value for @key.
+ *
+ * Returns: %TRUE if @value is stored, %FALSE if @key or
+ * @value is too large.
+ */
+gboolean             milter_manager_shared_cache_set (MilterManagerSharedCache *cache,
+                                                      const gchar *key,
+                                                      const gchar *value,
+                                                      gsize        value_size,
+                                                      gdouble      ttl);
+
+/**
+ * milter_manager_shared_cache_set_pinned:
+ * @cache: a %MilterManagerSharedCache.
+ * @key: the key.
+ * @value: the value.
+ * @value_size: the size of @value.
+ * @ttl: the TTL of the entry in seconds.
+ *
+ * Stores @value for @key like milter_manager_shared_cache_set()
+ * but the entry is never evicted for other entries. It is
+ * removed only when it is expired, removed or cleared. Up to
+ * half of the entries in a set can be pinned.
+ *
+ * Returns: %TRUE if @value is stored, %FALSE if @key or
+ * @value is too large or there is no room for a pinned entry.
+ */
+gboolean             milter_manager_shared_cache_set_pinned
+                                          (MilterManagerSharedCache *cache,
+                                           const gchar *key,
+                                           const gchar *value,
+                                           gsize        value_size,
+                                           gdouble      ttl);
+
+/**
+ * milter_manager_shared_cache_get:
+ * @cache: a %MilterManagerSharedCache.
+ * @key: the key.
+ * @value: return location for the newly allocated value
+ *         or %NULL.
+ * @value_size: return location for the size of @value
+ *              or %NULL.
+ *
+ * Looks up the value for @key.
+ *
+ * Returns: %TRUE if @key is found and not expired.
+ */
+gboolean             milter_manager_shared_cache_get (MilterManagerSharedCache *cache,
+                                                      const gchar *key,
+                                                      gchar      **value,
+                                                      gsize       *value_size);
+gboolean             milter_manager_shared_cache_remove
+                                          (MilterManagerSharedCache *cache,
+                                           const gchar *key);
+void                 milter_manager_shared_cache_clear
+                                          (MilterManagerSharedCache *cache);
+
+void                 milter_manager_shared_cache_get_statistics
+                                          (MilterManagerSharedCache *cache,
+                                           MilterManagerSharedCacheStatistics *statistics);
+void                 milter_manager_shared_cache_reset_statistics
+                                          (MilterManagerSharedCache *cache);
+
+G_END_DECLS
+
+#endif /* __MILTER_MANAGER_SHARED_CACHE_H__ */
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
@@ -61,6 +61,8 @@ enum
 
     STATE_TRANSITED,
 
+    REPLIED,
+
     LAST_SIGNAL
 };
 
@@ -85,6 +87,7 @@ struct _MilterServerContextPrivate
     gint domain;
     struct sockaddr *address;
     socklen_t address_size;
+    gint connected_fd;
     MilterStatus status;
     MilterStatus envelope_recipient_status;
     MilterServerContextState state;
@@ -109,6 +112,7 @@ struct _MilterServerContextPrivate
     gboolean sent_end_of_message;
 
     GTimer *elapsed;
+    gint64 command_start_time;
 
     gboolean negotiated;
     gboolean processing_message;
@@ -117,6 +121,13 @@ struct _MilterServerContextPrivate
     gchar *current_recipient;
 
     MilterMessageResult *message_result;
+
+    guint n_connect_delays;
+    gboolean in_stop_on_connect;
+    gboolean stop_delayed_connect;
+    gchar *delayed_connect_host_name;
+    struct sockaddr *delayed_connect_address;
+    socklen_t delayed_connect_address_length;
 };
 
 enum
@@ -445,6 +456,16 @@ milter_server_context_class_init (MilterServerContextClass *klass)
                      g_cclosure_marshal_VOID__ENUM,
                      G_TYPE_NONE, 1, MILTER_TYPE_SERVER_CONTEXT_STATE);
 
+    signals[REPLIED] =
+        g_signal_new("replied",
+                     G_TYPE_FROM_CLASS(klass),
+                     G_SIGNAL_RUN_LAST,
+                     G_STRUCT_OFFSET(MilterServerContextClass, replied),
+                     NULL, NULL,
+                     _milter_marshal_VOID__ENUM_DOUBLE,
+                     G_TYPE_NONE, 2,
+                     MILTER_TYPE_SERVER_CONTEXT_STATE, G_TYPE_DOUBLE);
+
     g_type_class_add_private(gobject_class, sizeof(MilterServerContextPrivate));
 }
 
@@ -460,6 +481,7 @@ milter_server_context_init (MilterServerContext *context)
     priv->domain = PF_UNSPEC;
     priv->address = NULL;
     priv->address_size = 0;
+    priv->connected_fd = -1;
 
     priv->status = MILTER_STATUS_NOT_CHANGE;
     priv->envelope_recipient_status = MILTER_STATUS_DEFAULT;
@@ -486,6 +508,7 @@ milter_server_context_init (MilterServerContext *context)
     priv->elapsed = g_timer_new();
     g_timer_stop(priv->elapsed);
     g_timer_reset(priv->elapsed);
+    priv->command_start_time = 0;
 
     priv->negotiated = FALSE;
     priv->processing_message = FALSE;
@@ -494,6 +517,13 @@ milter_server_context_init (MilterServerContext *context)
     priv->current_recipient = NULL;
 
     priv->message_result = NULL;
+
+    priv->n_connect_delays = 0;
+    priv->in_stop_on_connect = FALSE;
+    priv->stop_delayed_connect = FALSE;
+    priv->delayed_connect_host_name = NULL;
+    priv->delayed_connect_address = NULL;
+    priv->delayed_connect_address_length = 0;
 }
 
 static void
@@ -520,6 +550,40 @@ disable_timeout (MilterServerContext *context)
     }
 }
 
+static gint64
+get_current_time (void)
+{
+    GTimeVal time_value;
+
+    g_get_current_time(&time_value);
+    return (gint64)time_value.tv_sec * G_USEC_PER_SEC + time_value.tv_usec;
+}
+
+static void
+start_reply_timer (MilterServerContext *context)
+{
+    MilterServerContextPrivate *priv;
+
+    priv = MILTER_SERVER_CONTEXT_GET_PRIVATE(context);
+    priv->command_start_time = get_current_time();
+}
+
+static void
+emit_replied_signal (MilterServerContext *context)
+{
+    MilterServerContextPrivate *priv;
+    gdouble elapsed;
+
+    priv = MILTER_SERVER_CONTEXT_GET_PRIVATE(context);
+    if (priv->command_start_time == 0)
+        return;
+
+    elapsed = (get_current_time() - priv->command_start_time) /
+        (gdouble)G_USEC_PER_SEC;
+    priv->command_start_time = 0;
+    g_signal_emit(context, signals[REPLIED], 0, priv->state, MAX(elapsed, 0.0));
+}
+
 static void
 dispose_connect_watch (MilterServerContext *context)
 {
@@ -543,6 +607,15 @@ dispose_client_channel (MilterServerContextPrivate *priv)
     }
 }
 
+static void
+dispose_connected_fd (MilterServerContextPrivate *priv)
+{
+    if (priv->connected_fd != -1) {
+        close(priv->connected_fd);
+        priv->connected_fd = -1;
+    }
+}
+
 static void
 ensure_message_result (MilterServerContextPrivate *priv)
 {
@@ -598,6 +671,24 @@ dispose_next_states (MilterServerContext *context)
     }
 }
 
+static void
+dispose_delayed_connect (MilterServerContextPrivate *priv)
+{
+    priv->n_connect_delays = 0;
+    priv->stop_delayed_connect = FALSE;
+
+    if (priv->delayed_connect_host_name) {
+        g_free(priv->delayed_connect_host_name);
+        priv->delayed_connect_host_name = NULL;
+    }
+
+    if (priv->delayed_connect_address) {
+        g_free(priv->delayed_connect_address);
+        priv->delayed_connect_address = NULL;
+    }
+    priv->delayed_connect_address_length = 0;
+}
+
 static void
 dispose (GObject *object)
 {
@@ -615,6 +706,7 @@ dispose (GObject *object)
     disable_timeout(context);
     dispose_connect_watch(context);
     dispose_client_channel(priv);
+    dispose_connected_fd(priv);
 
     if (priv->spec) {
         g_free(priv->spec);
@@ -666,6 +758,7 @@ dispose (GObject *object)
     }
 
     dispose_message_result(priv);
+    dispose_delayed_connect(priv);
 
     G_OBJECT_CLASS(milter_server_context_parent_class)->dispose(object);
 }
@@ -1118,6 +1211,8 @@ milter_server_context_need_reply (MilterServerContext *context,
 
     switch (state) {
     case MILTER_SERVER_CONTEXT_STATE_CONNECT:
+        if (priv->n_connect_delays > 0)
+            return TRUE;
         return !(step & MILTER_STEP_NO_REPLY_CONNECT);
         break;
     case MILTER_SERVER_CONTEXT_STATE_HELO:
@@ -1475,6 +1570,40 @@ flushed (MilterAgent *agent)
                  tag, NULL_SAFE_NAME(name));
 }
 
+/* Headers that don't need reply are written without waiting
+ * for the previous ones to be flushed. */
+static gboolean
+is_pipelined_header (MilterServerContext *context,
+                     MilterServerContextState next_state)
+{
+    MilterServerContextPrivate *priv;
+    GList *node;
+
+    priv = MILTER_SERVER_CONTEXT_GET_PRIVATE(context);
+    if (!priv->next_states)
+        return FALSE;
+
+    switch (next_state) {
+    case MILTER_SERVER_CONTEXT_STATE_HEADER:
+    case MILTER_SERVER_CONTEXT_STATE_END_OF_HEADER:
+        break;
+    default:
+        return FALSE;
+    }
+
+    for (node = priv->next_states; node; node = g_list_next(node)) {
+        MilterServerContextState state;
+
+        state = GPOINTER_TO_UINT(node->data);
+        if (state != MILTER_SERVER_CONTEXT_STATE_HEADER)
+            return FALSE;
+        if (milter_server_context_need_reply(context, state))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
 static gboolean
 write_packet (MilterServerContext *context,
               const gchar *packet, gsize packet_size,
@@ -1504,7 +1633,8 @@ write_packet (MilterServerContext *context,
     case MILTER_SERVER_CONTEXT_STATE_QUIT:
         break;
     default:
-        if (milter_server_context_is_processing(context)) {
+        if (milter_server_context_is_processing(context) &&
+            !is_pipelined_header(context, next_state)) {
             gchar *inspected_current_state;
             gchar *inspected_next_state;
             GError *error = NULL;
@@ -1617,6 +1747,19 @@ write_packet (MilterServerContext *context,
         return FALSE;
     }
 
+    switch (next_state) {
+    case MILTER_SERVER_CONTEXT_STATE_ABORT:
+    case MILTER_SERVER_CONTEXT_STATE_QUIT:
+        break;
+    default:
+        /* The latency of a command that is not replied isn't
+         * recorded. It must not be counted into the next reply. */
+        if (milter_server_context_need_reply(context, next_state))
+            start_reply_timer(context);
+        else
+            priv->command_start_time = 0;
+        break;
+    }
     priv->next_states = g_list_append(priv->next_states,
                                       GUINT_TO_POINTER(next_state));
     return TRUE;
@@ -1766,19 +1909,48 @@ milter_server_context_is_enable_step (MilterServerContext *context,
     return priv->option ? (milter_option_get_step(priv->option) & step) : TRUE;
 }
 
+static gboolean
+send_connect (MilterServerContext *context,
+              const gchar         *host_name,
+              struct sockaddr     *address,
+              socklen_t            address_length)
+{
+    const gchar *packet = NULL;
+    gsize packet_size;
+    MilterEncoder *encoder;
+
+    if (milter_server_context_is_enable_step(context, MILTER_STEP_NO_CONNECT)) {
+        milter_debug("[%u] [server][connect][skip] %s",
+                     milter_agent_get_tag(MILTER_AGENT(context)),
+                     milter_server_context_get_name(context));
+        milter_server_context_set_state(context,
+                                        MILTER_SERVER_CONTEXT_STATE_CONNECT);
+        g_signal_emit_by_name(context, "continue");
+        return TRUE;
+    }
+
+    encoder = milter_agent_get_encoder(MILTER_AGENT(context));
+    milter_command_encoder_encode_connect(MILTER_COMMAND_ENCODER(encoder),
+                                          &packet, &packet_size,
+                                          host_name, address, address_length);
+
+    return write_packet(context, packet, packet_size,
+                        MILTER_SERVER_CONTEXT_STATE_CONNECT);
+}
+
 gboolean
 milter_server_context_connect (MilterServerContext *context,
                                const gchar         *host_name,
                                struct sockaddr     *address,
                                socklen_t            address_length)
 {
-    const gchar *packet = NULL;
-    gsize packet_size;
-    MilterEncoder *encoder;
+    MilterServerContextPrivate *priv;
     gboolean stop = FALSE;
     guint tag = 0;
     const gchar *name = NULL;
 
+    priv = MILTER_SERVER_CONTEXT_GET_PRIVATE(context);
+
     if (milter_need_debug_log()) {
         tag = milter_agent_get_tag(MILTER_AGENT(context));
         name = milter_server_context_get_name(context);
@@ -1789,31 +1961,107 @@ milter_server_context_connect (MilterServerContext *context,
 
     milter_protocol_agent_set_macro_context(MILTER_PROTOCOL_AGENT(context),
                                             MILTER_COMMAND_CONNECT);
+    dispose_delayed_connect(priv);
     milter_debug("[%u] [server][stop-on-connect][start] %s", tag, name);
+    priv->in_stop_on_connect = TRUE;
     g_signal_emit(context, signals[STOP_ON_CONNECT], 0,
                   host_name, address, address_length, &stop);
+    priv->in_stop_on_connect = FALSE;
+    if (priv->stop_delayed_connect)
+        stop = TRUE;
     milter_debug("[%u] [server][stop-on-connect][end] %s: stop=<%s>",
                  tag, name, stop ? "true" : "false");
     if (stop) {
+        dispose_delayed_connect(priv);
         stop_on_state(context, MILTER_SERVER_CONTEXT_STATE_CONNECT);
         return TRUE;
     }
 
-    if (milter_server_context_is_enable_step(context, MILTER_STEP_NO_CONNECT)) {
-        milter_debug("[%u] [server][connect][skip] %s", tag, name);
+    if (priv->n_connect_delays > 0) {
+        milter_debug("[%u] [server][connect][delay] %s: <%u>",
+                     tag, name, priv->n_connect_delays);
+        priv->delayed_connect_host_name = g_strdup(host_name);
+        priv->delayed_connect_address = g_memdup(address, address_length);
+        priv->delayed_connect_address_length = address_length;
         milter_server_context_set_state(context,
                                         MILTER_SERVER_CONTEXT_STATE_CONNECT);
-        g_signal_emit_by_name(context, "continue");
         return TRUE;
     }
 
-    encoder = milter_agent_get_encoder(MILTER_AGENT(context));
-    milter_command_encoder_encode_connect(MILTER_COMMAND_ENCODER(encoder),
-                                          &packet, &packet_size,
-                                          host_name, address, address_length);
+    return send_connect(context, host_name, address, address_length);
+}
 
-    return write_packet(context, packet, packet_size,
-                        MILTER_SERVER_CONTEXT_STATE_CONNECT);
+void
+milter_server_context_delay_connect (MilterServerContext *context)
+{
+    MilterServerContextPrivate *priv;
+
+    priv = MILTER_SERVER_CONTEXT_GET_PRIVATE(context);
+    if (!priv->in_stop_on_connect) {
+        milter_error("[%u] [server][error][connect][delay] "
+                     "must be called in stop-on-connect handler: %s",
+                     milter_agent_get_tag(MILTER_AGENT(context)),
+                     milter_server_context_get_name(context));
+        return;
+    }
+
+    priv->n_connect_delays++;
+}
+
+void
+milter_server_context_resume_connect (MilterServerContext *context,
+                                      gboolean             stop)
+{
+    MilterServerContextPrivate *priv;
+    gchar *host_name;
+    struct sockaddr *address;
+    socklen_t address_length;
+
+    priv = MILTER_SERVER_CONTEXT_GET_PRIVATE(context);
+    if (priv->n_connect_delays == 0)
+        return;
+
+    milter_debug("[%u] [server][connect][resume] %s: stop=<%s> <%u>",
+                 milter_agent_get_tag(MILTER_AGENT(context)),
+                 milter_server_context_get_name(context),
+                 stop ? "true" : "false",
+                 priv->n_connect_delays);
+
+    priv->n_connect_delays--;
+    if (stop)
+        priv->stop_delayed_connect = TRUE;
+
+    if (priv->in_stop_on_connect)
+        return;
+
+    if (priv->stop_delayed_connect) {
+        dispose_delayed_connect(priv);
+        if (!priv->quitted)
+            stop_on_state(context, MILTER_SERVER_CONTEXT_STATE_CONNECT);
+        return;
+    }
+
+    if (priv->n_connect_delays > 0)
+        return;
+
+    host_name = priv->delayed_connect_host_name;
+    address = priv->delayed_connect_address;
+    address_length = priv->delayed_connect_address_length;
+    priv->delayed_connect_host_name = NULL;
+    priv->delayed_connect_address = NULL;
+    dispose_delayed_connect(priv);
+
+    if (!priv->quitted)
+        send_connect(context, host_name, address, address_length);
+
+    g_free(host_name);
+    g_free(address);
+}
+
+gboolean
+milter_server_context_is_delaying_connect (MilterServerContext *context)
+{
+    return MILTER_SERVER_CONTEXT_GET_PRIVATE(context)->n_connect_delays > 0;
 }
 
 void
@@ -2282,6 +2530,7 @@ milter_server_context_quit (MilterServerContext *context)
 
     priv = MILTER_SERVER_CONTEXT_GET_PRIVATE(context);
     priv->quitted = TRUE;
+    dispose_delayed_connect(priv);
 
     milter_debug("[%u] [server][send][quit] [%s]",
                  milter_agent_get_tag(MILTER_AGENT(context)),
@@ -2401,6 +2650,7 @@ cb_decoder_negotiate_reply (MilterDecoder *decoder,
     state = priv->state;
 
     disable_timeout(context);
+    emit_replied_signal(context);
 
     if (milter_need_log(MILTER_LOG_LEVEL_ERROR |
                         MILTER_LOG_LEVEL_DEBUG)) {
@@ -2525,6 +2775,7 @@ cb_decoder_continue (MilterReplyDecoder *decoder, gpointer user_data)
     priv = MILTER_SERVER_CONTEXT_GET_PRIVATE(context);
 
     disable_timeout(context);
+    emit_replied_signal(context);
 
     if (milter_need_debug_log()) {
         gchar *state_name;
@@ -2625,6 +2876,7 @@ cb_decoder_reply_code (MilterReplyDecoder *decoder,
     }
 
     disable_timeout(context);
+    emit_replied_signal(context);
 
     milter_debug("[%u] [server][receive][reply-code] [%s] <%d %s %s>",
                  tag, name, code, extended_code, message);
@@ -2689,6 +2941,7 @@ cb_decoder_temporary_failure (MilterReplyDecoder *decoder, gpointer user_data)
     }
 
     disable_timeout(context);
+    emit_replied_signal(context);
     g_timer_stop(priv->elapsed);
 
     if (milter_need_debug_log()) {
@@ -2751,6 +3004,7 @@ cb_decoder_reject (MilterReplyDecoder *decoder, gpointer user_data)
     }
 
     disable_timeout(context);
+    emit_replied_signal(context);
     g_timer_stop(priv->elapsed);
 
     if (milter_need_debug_log()) {
@@ -2801,6 +3055,7 @@ cb_decoder_accept (MilterReplyDecoder *decoder, gpointer user_data)
     priv->status = MILTER_STATUS_ACCEPT;
 
     disable_timeout(context);
+    emit_replied_signal(context);
     g_timer_stop(priv->elapsed);
 
     if (milter_need_debug_log()) {
@@ -2850,6 +3105,7 @@ cb_decoder_discard (MilterReplyDecoder *decoder, gpointer user_data)
     priv->status = MILTER_STATUS_DISCARD;
 
     disable_timeout(context);
+    emit_replied_signal(context);
     g_timer_stop(priv->elapsed);
 
     if (milter_need_debug_log()) {
@@ -3252,6 +3508,7 @@ cb_decoder_skip (MilterReplyDecoder *decoder, gpointer user_data)
     }
 
     disable_timeout(context);
+    emit_replied_signal(context);
 
     milter_debug("[%u] [server][receive][skip] [%s]", tag, name);
 
@@ -3322,6 +3579,8 @@ milter_server_context_set_connection_spec (MilterServerContext *context,
 
     priv = MILTER_SERVER_CONTEXT_GET_PRIVATE(context);
 
+    dispose_connected_fd(priv);
+
     if (priv->address) {
         g_free(priv->address);
         priv->address = NULL;
@@ -3340,6 +3599,17 @@ milter_server_context_set_connection_spec (MilterServerContext *context,
     return success;
 }
 
+void
+milter_server_context_set_connected_fd (MilterServerContext *context,
+                                        gint fd)
+{
+    MilterServerContextPrivate *priv;
+
+    priv = MILTER_SERVER_CONTEXT_GET_PRIVATE(context);
+    dispose_connected_fd(priv);
+    priv->connected_fd = fd;
+}
+
 static gboolean
 cb_connection_timeout (gpointer data)
 {
@@ -3443,6 +3713,7 @@ connect_watch_func (GIOChannel *channel, GIOCondition condition, gpointer data)
 
                 dispose_client_channel(priv);
             } else {
+                emit_replied_signal(context);
                 g_signal_emit(context, signals[READY], 0);
             }
         } else {
@@ -3462,6 +3733,7 @@ milter_server_context_establish_connection (MilterServerContext *context,
     MilterEventLoop *loop;
     GError *io_error = NULL;
     gint client_fd;
+    gboolean connected = FALSE;
 
     priv = MILTER_SERVER_CONTEXT_GET_PRIVATE(context);
 
@@ -3473,7 +3745,13 @@ milter_server_context_establish_connection (MilterServerContext *context,
         return FALSE;
     }
 
-    client_fd = socket(priv->domain, SOCK_STREAM, 0);
+    if (priv->connected_fd != -1) {
+        client_fd = priv->connected_fd;
+        priv->connected_fd = -1;
+        connected = TRUE;
+    } else {
+        client_fd = socket(priv->domain, SOCK_STREAM, 0);
+    }
     if (client_fd == -1) {
         g_set_error(error,
                     MILTER_SERVER_CONTEXT_ERROR,
@@ -3541,6 +3819,17 @@ milter_server_context_establish_connection (MilterServerContext *context,
                      context);
     }
 
+    /* A pre-connected socket isn't recorded as establish latency.
+     * Its near zero latency would make its backend look faster. */
+    if (connected) {
+        priv->command_start_time = 0;
+        milter_debug("[%u] [server][established][connected] [%s] %d",
+                     milter_agent_get_tag(agent),
+                     milter_server_context_get_name(context),
+                     client_fd);
+        return TRUE;
+    }
+    start_reply_timer(context);
     if (connect(client_fd, priv->address, priv->address_size) == -1) {
         if (errno == EINPROGRESS)
             return TRUE;
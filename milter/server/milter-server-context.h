@@ -208,6 +208,10 @@ struct _MilterServerContextClass
 
     void (*state_transited)     (MilterServerContext *context,
                                  MilterServerContextState state);
+
+    void (*replied)             (MilterServerContext *context,
+                                 MilterServerContextState state,
+                                 gdouble elapsed);
 };
 
 GQuark               milter_server_context_error_quark (void);
@@ -317,6 +321,24 @@ gboolean             milter_server_context_set_connection_spec
                                                         const gchar *spec,
                                                         GError **error);
 
+/**
+ * milter_server_context_set_connected_fd:
+ * @context: a %MilterServerContext.
+ * @fd: a non-blocking socket that is already connected,
+ *      or is connecting, to the connection spec of
+ *      @context. -1 unsets it.
+ *
+ * Sets a socket that is used by the next
+ * milter_server_context_establish_connection() instead of
+ * creating a new socket. @context owns @fd. It is closed
+ * when the connection spec is changed.
+ *
+ * Since: 2.1.6
+ */
+void                 milter_server_context_set_connected_fd
+                                                       (MilterServerContext *context,
+                                                        gint fd);
+
 /**
  * milter_server_context_establish_connection:
  * @context: a %MilterServerContext.
@@ -426,6 +448,51 @@ gboolean             milter_server_context_connect     (MilterServerContext *con
                                                         struct sockaddr     *address,
                                                         socklen_t            address_length);
 
+/**
+ * milter_server_context_delay_connect:
+ * @context: a %MilterServerContext.
+ *
+ * Delays sending connect information until
+ * milter_server_context_resume_connect() is called. This
+ * must be called in a #MilterServerContext::stop-on-connect
+ * handler that needs an asynchronous operation such as a
+ * DNS lookup to decide whether @context is stopped or not.
+ * @context is treated as waiting for a reply while it is
+ * delayed.
+ *
+ * Since: 2.1.6
+ */
+void                 milter_server_context_delay_connect
+                                                       (MilterServerContext *context);
+
+/**
+ * milter_server_context_resume_connect:
+ * @context: a %MilterServerContext.
+ * @stop: whether @context should be stopped on connect.
+ *
+ * Resumes connect delayed by
+ * milter_server_context_delay_connect(). @context is
+ * stopped if @stop is %TRUE. Otherwise, connect
+ * information is sent after all delays are resumed. It is
+ * ignored if @context isn't delayed.
+ *
+ * Since: 2.1.6
+ */
+void                 milter_server_context_resume_connect
+                                                       (MilterServerContext *context,
+                                                        gboolean             stop);
+
+/**
+ * milter_server_context_is_delaying_connect:
+ * @context: a %MilterServerContext.
+ *
+ * Returns: %TRUE if connect is delayed, %FALSE otherwise.
+ *
+ * Since: 2.1.6
+ */
+gboolean             milter_server_context_is_delaying_connect
+                                                       (MilterServerContext *context);
+
 /**
  * milter_server_context_helo:
  * @context: a %MilterServerContext.
@@ -89,6 +89,8 @@ static gchar   *real_dump         (MilterManagerConfiguration *configuration);
 static gboolean real_clear        (MilterManagerConfiguration *configuration,
                                    GError                    **error);
 static GPid     real_fork         (MilterManagerConfiguration *configuration);
+static gboolean real_is_snapshot_available
+                                  (MilterManagerConfiguration *configuration);
 
 static gpointer milter_manager_ruby_configuration_parent_class = NULL;
 static GType    milter_manager_ruby_configuration_type_id = 0;
@@ -119,6 +121,7 @@ milter_manager_ruby_configuration_class_init (MilterManagerRubyConfigurationClas
     configuration_class->dump = real_dump;
     configuration_class->clear = real_clear;
     configuration_class->fork = real_fork;
+    configuration_class->is_snapshot_available = real_is_snapshot_available;
 }
 
 static void
@@ -631,6 +634,27 @@ real_fork (MilterManagerConfiguration *_configuration)
 #endif
 }
 
+static gboolean
+real_is_snapshot_available (MilterManagerConfiguration *_configuration)
+{
+    MilterManagerRubyConfiguration *configuration;
+    VALUE result;
+    GError *local_error = NULL;
+
+    configuration = MILTER_MANAGER_RUBY_CONFIGURATION(_configuration);
+    result = rb_funcall_protect(&local_error,
+                                GOBJ2RVAL(configuration),
+                                rb_intern("snapshot_available?"), 0);
+    if (local_error) {
+        milter_error("[ruby-configuration][error][snapshot-available] %s",
+                     local_error->message);
+        g_error_free(local_error);
+        return FALSE;
+    }
+
+    return RVAL2CBOOL(result);
+}
+
 /*
 vi:ts=4:nowrap:ai:expandtab:sw=4
 */
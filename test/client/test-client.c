@@ -66,6 +66,8 @@ void test_need_maintain_no_processing_sessions (void);
 void test_need_maintain_no_processing_sessions_below_processed_sessions (void);
 void test_need_maintain_no_processing_sessions_no_interval (void);
 void test_n_workers (void);
+void test_multi_thread_mode (void);
+void test_n_threads (void);
 void test_custom_fork (void);
 void test_default_packet_buffer_size (void);
 void test_worker_id (void);
@@ -1047,6 +1049,22 @@ test_n_workers (void)
         10, milter_client_get_n_workers(client));
 }
 
+void
+test_multi_thread_mode (void)
+{
+    cut_assert_false(milter_client_is_multi_thread_mode(client));
+    milter_client_set_multi_thread_mode(client, TRUE);
+    cut_assert_true(milter_client_is_multi_thread_mode(client));
+}
+
+void
+test_n_threads (void)
+{
+    cut_assert_equal_uint(0, milter_client_get_n_threads(client));
+    milter_client_set_n_threads(client, 4);
+    cut_assert_equal_uint(4, milter_client_get_n_threads(client));
+}
+
 static GPid
 worker_fork (MilterClient *loop)
 {
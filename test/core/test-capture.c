@@ -0,0 +1,163 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include <milter/core/milter-capture.h>
+#include <milter/core/milter-enum-types.h>
+#include <milter-test-utils.h>
+
+#include <gcutter.h>
+
+void test_record (void);
+void test_not_active (void);
+void test_max_size (void);
+void test_invalid_format (void);
+
+static gchar *tmp_dir;
+static gchar *path;
+static MilterCaptureReader *reader;
+static GError *expected_error;
+static GError *actual_error;
+
+void
+setup (void)
+{
+    tmp_dir = g_build_filename(milter_test_get_base_dir(),
+                               "tmp",
+                               NULL);
+    cut_remove_path(tmp_dir, NULL);
+    if (g_mkdir_with_parents(tmp_dir, 0700) == -1)
+        cut_assert_errno();
+    path = g_build_filename(tmp_dir, "capture.trace", NULL);
+
+    reader = NULL;
+    expected_error = NULL;
+    actual_error = NULL;
+}
+
+void
+teardown (void)
+{
+    milter_capture_stop();
+
+    if (reader)
+        milter_capture_reader_close(reader);
+    if (expected_error)
+        g_error_free(expected_error);
+    if (actual_error)
+        g_error_free(actual_error);
+
+    g_free(path);
+    if (tmp_dir) {
+        cut_remove_path(tmp_dir, NULL);
+        g_free(tmp_dir);
+    }
+}
+
+static void
+open_reader (void)
+{
+    GError *error = NULL;
+
+    reader = milter_capture_reader_open(path, &error);
+    gcut_assert_error(error);
+}
+
+void
+test_record (void)
+{
+    MilterCaptureRecord record;
+    GError *error = NULL;
+
+    milter_capture_start(path, MILTER_CAPTURE_DEFAULT_MAX_SIZE, &error);
+    gcut_assert_error(error);
+    cut_assert_true(milter_capture_is_active());
+
+    milter_capture_record(29, MILTER_CAPTURE_DIRECTION_READ, "\0\0\0\1O", 5);
+    milter_capture_record(29, MILTER_CAPTURE_DIRECTION_WRITE, "\0\0\0\1c", 5);
+    milter_capture_stop();
+    cut_assert_false(milter_capture_is_active());
+
+    open_reader();
+    cut_assert_true(milter_capture_reader_read(reader, &record, &error));
+    gcut_assert_error(error);
+    cut_assert_equal_uint(29, record.tag);
+    gcut_assert_equal_enum(MILTER_TYPE_CAPTURE_DIRECTION,
+                           MILTER_CAPTURE_DIRECTION_READ,
+                           record.direction);
+    cut_assert_equal_memory("\0\0\0\1O", 5, record.chunk, record.chunk_size);
+    cut_assert_operator_int(0, <, record.time);
+
+    cut_assert_true(milter_capture_reader_read(reader, &record, &error));
+    gcut_assert_error(error);
+    gcut_assert_equal_enum(MILTER_TYPE_CAPTURE_DIRECTION,
+                           MILTER_CAPTURE_DIRECTION_WRITE,
+                           record.direction);
+    cut_assert_equal_memory("\0\0\0\1c", 5, record.chunk, record.chunk_size);
+
+    cut_assert_false(milter_capture_reader_read(reader, &record, &error));
+    gcut_assert_error(error);
+}
+
+void
+test_not_active (void)
+{
+    milter_capture_record(29, MILTER_CAPTURE_DIRECTION_READ, "O", 1);
+    cut_assert_false(milter_capture_is_active());
+    cut_assert_false(g_file_test(path, G_FILE_TEST_EXISTS));
+}
+
+void
+test_max_size (void)
+{
+    MilterCaptureRecord record;
+    GError *error = NULL;
+
+    milter_capture_start(path, 8 + 17 + 5, &error);
+    gcut_assert_error(error);
+
+    milter_capture_record(29, MILTER_CAPTURE_DIRECTION_READ, "first", 5);
+    milter_capture_record(29, MILTER_CAPTURE_DIRECTION_READ, "second", 6);
+    cut_assert_false(milter_capture_is_active());
+    milter_capture_stop();
+
+    open_reader();
+    cut_assert_true(milter_capture_reader_read(reader, &record, &error));
+    cut_assert_equal_memory("first", 5, record.chunk, record.chunk_size);
+    cut_assert_false(milter_capture_reader_read(reader, &record, &error));
+    gcut_assert_error(error);
+}
+
+void
+test_invalid_format (void)
+{
+    g_file_set_contents(path, "not trace", -1, NULL);
+    reader = milter_capture_reader_open(path, &actual_error);
+    expected_error = g_error_new(MILTER_CAPTURE_ERROR,
+                                 MILTER_CAPTURE_ERROR_INVALID_FORMAT,
+                                 "not a trace file: <%s>", path);
+    gcut_assert_equal_error(expected_error, actual_error);
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
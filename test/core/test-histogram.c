@@ -0,0 +1,148 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <milter/core/milter-histogram.h>
+
+#include <gcutter.h>
+
+void test_empty (void);
+void test_small_values (void);
+void test_percentile (void);
+void test_highest_trackable_value (void);
+void test_record_corrected (void);
+void test_merge (void);
+void test_reset (void);
+
+static MilterHistogram *histogram;
+static MilterHistogram *other_histogram;
+
+void
+setup (void)
+{
+    histogram = milter_histogram_new(G_GUINT64_CONSTANT(3600000000));
+    other_histogram = NULL;
+}
+
+void
+teardown (void)
+{
+    if (histogram)
+        milter_histogram_free(histogram);
+    if (other_histogram)
+        milter_histogram_free(other_histogram);
+}
+
+void
+test_empty (void)
+{
+    cut_assert_equal_uint(0, milter_histogram_get_count(histogram));
+    cut_assert_equal_uint(0, milter_histogram_get_max(histogram));
+    cut_assert_equal_uint(0,
+                          milter_histogram_get_value_at_percentile(histogram,
+                                                                   99.0));
+    cut_assert_equal_double(0.0, 0.0, milter_histogram_get_mean(histogram));
+}
+
+void
+test_small_values (void)
+{
+    milter_histogram_record(histogram, 3);
+    milter_histogram_record(histogram, 1);
+    milter_histogram_record(histogram, 2);
+
+    cut_assert_equal_uint(3, milter_histogram_get_count(histogram));
+    cut_assert_equal_uint(1, milter_histogram_get_min(histogram));
+    cut_assert_equal_uint(3, milter_histogram_get_max(histogram));
+    cut_assert_equal_uint(2,
+                          milter_histogram_get_value_at_percentile(histogram,
+                                                                   50.0));
+    cut_assert_equal_double(2.0, 0.001, milter_histogram_get_mean(histogram));
+}
+
+void
+test_percentile (void)
+{
+    guint64 value;
+
+    for (value = 1; value <= 100000; value++) {
+        milter_histogram_record(histogram, value);
+    }
+
+    cut_assert_equal_uint(100000, milter_histogram_get_count(histogram));
+    cut_assert_equal_double(50000.0, 500.0,
+                            milter_histogram_get_value_at_percentile(histogram,
+                                                                     50.0));
+    cut_assert_equal_double(99000.0, 990.0,
+                            milter_histogram_get_value_at_percentile(histogram,
+                                                                     99.0));
+    cut_assert_equal_uint(100000,
+                          milter_histogram_get_value_at_percentile(histogram,
+                                                                   100.0));
+}
+
+void
+test_highest_trackable_value (void)
+{
+    milter_histogram_free(histogram);
+    histogram = milter_histogram_new(1000);
+
+    milter_histogram_record(histogram, 5000);
+    cut_assert_equal_uint(1000, milter_histogram_get_max(histogram));
+    cut_assert_equal_uint(1000,
+                          milter_histogram_get_value_at_percentile(histogram,
+                                                                   100.0));
+}
+
+void
+test_record_corrected (void)
+{
+    milter_histogram_record_corrected(histogram, 1000, 100);
+
+    cut_assert_equal_uint(10, milter_histogram_get_count(histogram));
+    cut_assert_equal_uint(100, milter_histogram_get_min(histogram));
+    cut_assert_equal_uint(1000, milter_histogram_get_max(histogram));
+}
+
+void
+test_merge (void)
+{
+    other_histogram = milter_histogram_new(G_GUINT64_CONSTANT(3600000000));
+    milter_histogram_record(histogram, 10);
+    milter_histogram_record(other_histogram, 5);
+    milter_histogram_record(other_histogram, 20);
+
+    milter_histogram_merge(histogram, other_histogram);
+    cut_assert_equal_uint(3, milter_histogram_get_count(histogram));
+    cut_assert_equal_uint(5, milter_histogram_get_min(histogram));
+    cut_assert_equal_uint(20, milter_histogram_get_max(histogram));
+}
+
+void
+test_reset (void)
+{
+    milter_histogram_record(histogram, 10);
+    milter_histogram_reset(histogram);
+
+    cut_assert_equal_uint(0, milter_histogram_get_count(histogram));
+    cut_assert_equal_uint(0, milter_histogram_get_max(histogram));
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
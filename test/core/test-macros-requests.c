@@ -33,6 +33,7 @@
 void test_symbols_new (void);
 void data_merge (void);
 void test_merge (gconstpointer data);
+void test_equal (void);
 
 static MilterMacrosRequests *requests;
 static MilterMacrosRequests *another_requests;
@@ -198,6 +199,32 @@ test_merge (gconstpointer data)
     milter_assert_equal_macros_requests(expected_requests, requests);
 }
 
+void
+test_equal (void)
+{
+    requests = milter_macros_requests_new();
+    another_requests = milter_macros_requests_new();
+    cut_assert_true(milter_macros_requests_equal(requests, another_requests));
+
+    milter_macros_requests_set_symbols(requests,
+                                       MILTER_COMMAND_CONNECT,
+                                       "G", "N", "U",
+                                       NULL);
+    cut_assert_false(milter_macros_requests_equal(requests, another_requests));
+
+    milter_macros_requests_set_symbols(another_requests,
+                                       MILTER_COMMAND_CONNECT,
+                                       "G", "N",
+                                       NULL);
+    cut_assert_false(milter_macros_requests_equal(requests, another_requests));
+
+    milter_macros_requests_set_symbols(another_requests,
+                                       MILTER_COMMAND_CONNECT,
+                                       "G", "N", "U",
+                                       NULL);
+    cut_assert_true(milter_macros_requests_equal(requests, another_requests));
+}
+
 /*
 vi:ts=4:nowrap:ai:expandtab:sw=4
 */
@@ -47,6 +47,7 @@ void test_delrcpt (gconstpointer data);
 void test_progress (void);
 void test_quarantine (void);
 void test_replacebody (void);
+void test_callback_thread (void);
 
 static MilterEventLoop *loop;
 
@@ -332,6 +333,8 @@ cut_setup (void)
 void
 cut_teardown (void)
 {
+    libmilter_compatible_set_n_callback_threads(0);
+
     if (context)
         g_object_unref(context);
     if (client_context)
@@ -1029,6 +1032,44 @@ test_replacebody (void)
                             actual_data->str, actual_data->len);
 }
 
+void
+test_callback_thread (void)
+{
+    const gchar *packet;
+    gsize packet_size;
+    GString *actual_data;
+    GTimer *timer;
+
+    g_object_unref(context);
+    libmilter_compatible_set_n_callback_threads(2);
+    cut_assert_equal_uint(2, libmilter_compatible_get_n_callback_threads());
+    context = smfi_context_new(client_context);
+
+    send_progress = TRUE;
+    milter_command_encoder_encode_helo(command_encoder,
+                                       &packet, &packet_size, "delian");
+    gcut_assert_error(feed(packet, packet_size));
+
+
+    expected_output = g_string_new(NULL);
+
+    milter_reply_encoder_encode_progress(reply_encoder, &packet, &packet_size);
+    g_string_append_len(expected_output, packet, packet_size);
+
+    milter_reply_encoder_encode_continue(reply_encoder, &packet, &packet_size);
+    g_string_append_len(expected_output, packet, packet_size);
+
+    timer = g_timer_new();
+    cut_take(timer, (CutDestroyFunction)g_timer_destroy);
+    actual_data = gcut_string_io_channel_get_string(channel);
+    while (actual_data->len < expected_output->len &&
+           g_timer_elapsed(timer, NULL) < 1.0) {
+        milter_event_loop_iterate(loop, FALSE);
+    }
+    cut_assert_equal_memory(expected_output->str, expected_output->len,
+                            actual_data->str, actual_data->len);
+}
+
 /*
 vi:ts=4:nowrap:ai:expandtab:sw=4
 */
@@ -27,6 +27,7 @@
 #include <milter/manager/milter-manager-children.h>
 #include <milter/manager/milter-manager-enum-types.h>
 #include <milter/manager/milter-manager-process-launcher.h>
+#include <milter/manager/milter-manager-shared-cache.h>
 
 #include <milter-test-utils.h>
 #include <milter-test-enum-types.h>
@@ -57,12 +58,23 @@ void test_data_no_reply (void);
 void test_header (void);
 void test_header_with_protocol_version2 (void);
 void test_header_no_reply (void);
+void test_header_no_reply_burst (void);
 void test_end_of_header (void);
 void test_end_of_header_with_protocol_version2 (void);
 void test_end_of_header_no_reply (void);
 void test_body (void);
 void test_body_with_protocol_version2 (void);
 void test_body_no_reply (void);
+void test_end_of_message_early_termination (void);
+void test_header_fallback_early_termination (void);
+void test_end_of_header_fallback_early_termination (void);
+void test_body_fallback_early_termination (void);
+void test_body_temporary_failure_early_termination (void);
+void test_body_fallback_accept_no_early_termination (void);
+void test_negotiate_cache_hit (void);
+void test_negotiate_cache_mismatch (void);
+void test_verdict_cache_deferred_hit (void);
+void test_evaluation_unsampled (void);
 void data_important_status (void);
 void test_important_status (gconstpointer data);
 void data_not_important_status (void);
@@ -1539,6 +1551,26 @@ test_header_no_reply (void)
     cut_assert_false(milter_manager_children_is_waiting_reply(children));
 }
 
+void
+test_header_no_reply_burst (void)
+{
+    step |= MILTER_STEP_NO_REPLY_HEADER;
+    arguments_append(arguments1,
+                     "--negotiate-flags", "no-reply-header",
+                     NULL);
+    arguments_append(arguments2,
+                     "--negotiate-flags", "no-reply-header",
+                     NULL);
+    cut_trace(test_data());
+
+    milter_manager_children_header(children, "From", "kou@example.com");
+    milter_manager_children_header(children, "To", "info@example.com");
+    milter_manager_children_header(children, "Subject", "Hello");
+    milter_test_pump_all_events(loop);
+    cut_assert_false(milter_manager_children_is_waiting_reply(children));
+    cut_assert_equal_uint(0, n_error_emitted);
+}
+
 void
 test_end_of_header (void)
 {
@@ -1628,6 +1660,354 @@ test_body_no_reply (void)
     cut_assert_false(milter_manager_children_is_waiting_reply(children));
 }
 
+void
+test_end_of_message_early_termination (void)
+{
+    const gchar chunk[] = "message body";
+
+    arguments_append(arguments1,
+                     "--action", "reject",
+                     "--end-of-message",
+                     NULL);
+
+    cut_trace(test_body());
+    cut_assert_equal_uint(0,
+                          milter_manager_children_get_n_saved_body_bytes(children));
+
+    milter_manager_children_end_of_message(children, NULL, 0);
+    wait_reply(1, n_reject_emitted);
+    cut_assert_equal_uint(strlen(chunk),
+                          milter_manager_children_get_n_saved_body_bytes(children));
+}
+
+static void
+set_first_child_fallback_status (MilterStatus status)
+{
+    MilterManagerChild *child;
+
+    child = milter_manager_children_get_children(children)->data;
+    g_object_set(child, "fallback-status", status, NULL);
+}
+
+void
+test_header_fallback_early_termination (void)
+{
+    const gchar name[] = "X-Test-Header";
+    const gchar value[] = "Test Header Value";
+
+    arguments_append(arguments1,
+                     "--quit-without-reply", "header",
+                     NULL);
+
+    cut_trace(test_data());
+    set_first_child_fallback_status(MILTER_STATUS_REJECT);
+
+    milter_manager_children_header(children, name, value);
+    wait_reply(1, n_reject_emitted);
+    milter_test_pump_all_events(loop);
+    cut_assert_equal_uint(5, n_continue_emitted);
+    cut_assert_equal_uint(1, collect_n_received(header));
+    cut_assert_equal_uint(0,
+                          milter_manager_children_get_n_saved_body_bytes(children));
+}
+
+void
+test_end_of_header_fallback_early_termination (void)
+{
+    arguments_append(arguments1,
+                     "--quit-without-reply", "end-of-header",
+                     NULL);
+
+    cut_trace(test_header());
+    set_first_child_fallback_status(MILTER_STATUS_REJECT);
+
+    milter_manager_children_end_of_header(children);
+    wait_reply(1, n_reject_emitted);
+    milter_test_pump_all_events(loop);
+    cut_assert_equal_uint(6, n_continue_emitted);
+    cut_assert_equal_uint(1, collect_n_received(end_of_header));
+}
+
+void
+test_body_fallback_early_termination (void)
+{
+    const gchar chunk[] = "message body";
+
+    arguments_append(arguments1,
+                     "--quit-without-reply", "body",
+                     NULL);
+
+    cut_trace(test_end_of_header());
+    set_first_child_fallback_status(MILTER_STATUS_REJECT);
+
+    milter_manager_children_body(children, chunk, strlen(chunk));
+    wait_reply(1, n_reject_emitted);
+    milter_test_pump_all_events(loop);
+    cut_assert_equal_uint(7, n_continue_emitted);
+    cut_assert_equal_uint(1, collect_n_received(body));
+    cut_assert_equal_uint(strlen(chunk),
+                          milter_manager_children_get_n_saved_body_bytes(children));
+}
+
+void
+test_body_temporary_failure_early_termination (void)
+{
+    const gchar chunk[] = "message body";
+
+    arguments_append(arguments1,
+                     "--quit-without-reply", "body",
+                     NULL);
+
+    cut_trace(test_end_of_header());
+    set_first_child_fallback_status(MILTER_STATUS_TEMPORARY_FAILURE);
+
+    milter_manager_children_body(children, chunk, strlen(chunk));
+    wait_reply(1, n_temporary_failure_emitted);
+    milter_test_pump_all_events(loop);
+    cut_assert_equal_uint(0, n_reject_emitted);
+    cut_assert_equal_uint(1, collect_n_received(body));
+    cut_assert_equal_uint(strlen(chunk),
+                          milter_manager_children_get_n_saved_body_bytes(children));
+}
+
+void
+test_body_fallback_accept_no_early_termination (void)
+{
+    const gchar chunk[] = "message body";
+
+    arguments_append(arguments1,
+                     "--quit-without-reply", "body",
+                     NULL);
+
+    cut_trace(test_end_of_header());
+    set_first_child_fallback_status(MILTER_STATUS_ACCEPT);
+
+    milter_manager_children_body(children, chunk, strlen(chunk));
+    wait_reply(8, n_continue_emitted);
+    cut_assert_equal_uint(0, n_reject_emitted);
+    cut_assert_equal_uint(2, collect_n_received(body));
+    cut_assert_equal_uint(0,
+                          milter_manager_children_get_n_saved_body_bytes(children));
+}
+
+static void
+wait_negotiate_done (void)
+{
+    gboolean timeout_waiting = TRUE;
+    guint timeout_waiting_id;
+
+    timeout_waiting_id = milter_event_loop_add_timeout(loop, 0.5,
+                                                       cb_timeout_waiting,
+                                                       &timeout_waiting);
+    while (timeout_waiting &&
+           milter_manager_children_is_waiting_reply(children)) {
+        milter_event_loop_iterate(loop, TRUE);
+    }
+    milter_event_loop_remove(loop, timeout_waiting_id);
+
+    cut_assert_true(timeout_waiting,
+                    cut_message("timeout: negotiate isn't finished"));
+}
+
+static void
+negotiate_by_egg (MilterManagerEgg *egg)
+{
+    MilterManagerChild *child;
+
+    child = milter_manager_egg_hatch(egg);
+    milter_manager_children_add_child(children, child);
+    g_object_unref(child);
+
+    milter_manager_children_negotiate(children, option, NULL);
+    wait_reply(1, n_negotiate_reply_emitted);
+    cut_trace(wait_negotiate_done());
+}
+
+void
+test_negotiate_cache_hit (void)
+{
+    MilterManagerEgg *egg;
+    struct sockaddr_in address;
+
+    option = milter_option_new(6,
+                               MILTER_ACTION_ADD_HEADERS |
+                               MILTER_ACTION_CHANGE_BODY,
+                               step);
+    start_client(10026, arguments1);
+
+    egg = egg_new("milter@10026", "inet:10026@localhost");
+    cut_assert_not_null(egg);
+    gcut_take_object(G_OBJECT(egg));
+    milter_manager_egg_set_negotiate_cache(egg, TRUE);
+
+    cut_trace(negotiate_by_egg(egg));
+    cut_assert_not_null(milter_manager_egg_get_cached_option(egg));
+
+    g_object_unref(children);
+    children = milter_manager_children_new(config, loop);
+    setup_signals(children);
+    clear_n_emitted();
+
+    cut_trace(negotiate_by_egg(egg));
+    cut_assert_not_null(milter_manager_egg_get_cached_option(egg));
+
+    address.sin_family = AF_INET;
+    address.sin_port = g_htons(50443);
+    inet_pton(AF_INET, "192.168.123.123", &(address.sin_addr));
+    milter_manager_children_connect(children,
+                                    "mx.local.net",
+                                    (struct sockaddr *)(&address),
+                                    sizeof(address));
+    wait_reply(1, n_continue_emitted);
+    cut_assert_equal_uint(0, n_temporary_failure_emitted);
+}
+
+void
+test_negotiate_cache_mismatch (void)
+{
+    MilterManagerEgg *egg;
+    MilterManagerChild *child;
+    MilterOption *cached_option;
+    struct sockaddr_in address;
+
+    option = milter_option_new(6,
+                               MILTER_ACTION_ADD_HEADERS |
+                               MILTER_ACTION_CHANGE_BODY,
+                               step);
+    start_client(10026, arguments1);
+
+    egg = egg_new("milter@10026", "inet:10026@localhost");
+    cut_assert_not_null(egg);
+    gcut_take_object(G_OBJECT(egg));
+
+    cached_option = milter_option_new(2, MILTER_ACTION_NONE, MILTER_STEP_NONE);
+    gcut_take_object(G_OBJECT(cached_option));
+    child = milter_manager_egg_hatch(egg);
+    milter_manager_child_set_cached_negotiate_reply(child, cached_option, NULL);
+    milter_manager_children_add_child(children, child);
+    g_object_unref(child);
+
+    milter_manager_children_negotiate(children, option, NULL);
+    wait_reply(1, n_negotiate_reply_emitted);
+    cut_trace(wait_negotiate_done());
+
+    address.sin_family = AF_INET;
+    address.sin_port = g_htons(50443);
+    inet_pton(AF_INET, "192.168.123.123", &(address.sin_addr));
+    milter_manager_children_connect(children,
+                                    "mx.local.net",
+                                    (struct sockaddr *)(&address),
+                                    sizeof(address));
+    cut_assert_equal_uint(1, n_temporary_failure_emitted);
+    cut_assert_equal_uint(0, n_continue_emitted);
+}
+
+void
+test_verdict_cache_deferred_hit (void)
+{
+    MilterManagerEgg *egg;
+    MilterManagerChild *child;
+    MilterManagerSharedCache *cache;
+    GError *error = NULL;
+    struct sockaddr_in address;
+
+    arguments_append(arguments1,
+                     "--action", "reject",
+                     "--connect-host", "mx.local.net",
+                     NULL);
+    option = milter_option_new(6,
+                               MILTER_ACTION_ADD_HEADERS |
+                               MILTER_ACTION_CHANGE_BODY,
+                               step);
+    start_client(10026, arguments1);
+
+    cache = milter_manager_shared_cache_new(64, &error);
+    gcut_assert_error(error);
+    gcut_take_object(G_OBJECT(cache));
+
+    egg = egg_new("milter@10026", "inet:10026@localhost");
+    cut_assert_not_null(egg);
+    gcut_take_object(G_OBJECT(egg));
+    milter_manager_egg_set_negotiate_cache(egg, TRUE);
+    milter_manager_egg_set_shared_cache(egg, cache);
+    milter_manager_egg_set_verdict_cache_ttl(egg, 60.0);
+
+    address.sin_family = AF_INET;
+    address.sin_port = g_htons(50443);
+    inet_pton(AF_INET, "192.168.123.123", &(address.sin_addr));
+
+    cut_trace(negotiate_by_egg(egg));
+    milter_manager_children_connect(children,
+                                    "mx.local.net",
+                                    (struct sockaddr *)(&address),
+                                    sizeof(address));
+    wait_reply(1, n_reject_emitted);
+    cut_assert_equal_uint(1, milter_manager_egg_get_n_cached_verdicts(egg));
+
+    g_object_unref(children);
+    children = milter_manager_children_new(config, loop);
+    setup_signals(children);
+    clear_n_emitted();
+
+    child = milter_manager_egg_hatch(egg);
+    gcut_take_object(G_OBJECT(child));
+    milter_manager_children_add_child(children, child);
+    milter_manager_children_negotiate(children, option, NULL);
+    wait_reply(1, n_negotiate_reply_emitted);
+    cut_trace(wait_negotiate_done());
+
+    milter_manager_children_connect(children,
+                                    "mx.local.net",
+                                    (struct sockaddr *)(&address),
+                                    sizeof(address));
+    cut_assert_equal_uint(1, n_reject_emitted);
+    cut_assert_false(milter_server_context_is_negotiated(
+                         MILTER_SERVER_CONTEXT(child)));
+}
+
+void
+test_evaluation_unsampled (void)
+{
+    MilterManagerEgg *egg;
+    MilterManagerChild *child;
+    struct sockaddr_in address;
+
+    option = milter_option_new(6,
+                               MILTER_ACTION_ADD_HEADERS |
+                               MILTER_ACTION_CHANGE_BODY,
+                               step);
+    start_client(10026, arguments1);
+    start_client(10027, arguments2);
+
+    add_child("milter@10026", "inet:10026@localhost");
+
+    egg = egg_new("milter@10027", "inet:10027@localhost");
+    cut_assert_not_null(egg);
+    gcut_take_object(G_OBJECT(egg));
+    milter_manager_egg_set_evaluation_mode(egg, TRUE);
+    milter_manager_egg_set_evaluation_sampling_by_client_address(egg, TRUE);
+    milter_manager_egg_set_evaluation_sampling_rate(egg, 0.0);
+    child = milter_manager_egg_hatch(egg);
+    cut_assert_not_null(child);
+    milter_manager_children_add_child(children, child);
+    g_object_unref(child);
+
+    milter_manager_children_negotiate(children, option, NULL);
+    wait_reply(1, n_negotiate_reply_emitted);
+    cut_assert_equal_uint(2, milter_manager_children_length(children));
+
+    address.sin_family = AF_INET;
+    address.sin_port = g_htons(50443);
+    inet_pton(AF_INET, "192.168.123.123", &(address.sin_addr));
+    milter_manager_children_connect(children,
+                                    "mx.local.net",
+                                    (struct sockaddr *)(&address),
+                                    sizeof(address));
+    cut_assert_equal_uint(1, milter_manager_children_length(children));
+    wait_reply(1, n_continue_emitted);
+    cut_assert_equal_uint(0, n_accept_emitted);
+}
+
 #define is_important_status(children, state, next_status)                    \
     milter_manager_children_is_important_status(children, state, next_status)
 
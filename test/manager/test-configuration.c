@@ -17,6 +17,12 @@
  *
  */
 
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+#include <glib/gstdio.h>
+
 #include <milter/manager/milter-manager-configuration.h>
 #include <milter/manager/milter-manager-children.h>
 
@@ -73,6 +79,10 @@ void test_load_absolute_path (void);
 void test_save_custom (void);
 void test_to_xml_full (void);
 void test_to_xml_signal (void);
+void test_snapshot (void);
+void test_snapshot_stale (void);
+void test_snapshot_stale_in_same_second (void);
+void test_snapshot_unavailable (void);
 
 static MilterManagerConfiguration *config;
 static MilterEventLoop *loop;
@@ -92,6 +102,9 @@ static gchar *actual_xml;
 
 static gchar *tmp_dir;
 
+static GError *expected_error;
+static GError *actual_error;
+
 void
 cut_setup (void)
 {
@@ -118,6 +131,9 @@ cut_setup (void)
     cut_remove_path(tmp_dir, NULL);
     if (g_mkdir_with_parents(tmp_dir, 0700) == -1)
         cut_assert_errno();
+
+    expected_error = NULL;
+    actual_error = NULL;
 }
 
 void
@@ -156,6 +172,11 @@ cut_teardown (void)
         cut_remove_path(tmp_dir, NULL);
         g_free(tmp_dir);
     }
+
+    if (expected_error)
+        g_error_free(expected_error);
+    if (actual_error)
+        g_error_free(actual_error);
 }
 
 static gboolean
@@ -1186,6 +1207,182 @@ test_location (void)
     milter_assert_equal_location_keys(NULL);
 }
 
+static const gchar *
+setup_snapshot_load_path (void)
+{
+    GError *error = NULL;
+    const gchar *config_file;
+
+    milter_manager_configuration_clear_load_paths(config);
+    milter_manager_configuration_append_load_path(config, tmp_dir);
+
+    config_file = cut_build_path(tmp_dir, CONFIG_FILE_NAME, NULL);
+    g_file_set_contents(config_file, "", 0, &error);
+    gcut_assert_error(error);
+
+    return config_file;
+}
+
+void
+test_snapshot (void)
+{
+    GError *error = NULL;
+    const gchar *snapshot_path;
+    MilterManagerEgg *loaded_egg;
+    GList *connection_specs;
+    gconstpointer location;
+
+    setup_snapshot_load_path();
+    snapshot_path = cut_build_path(tmp_dir, "snapshot", NULL);
+
+    milter_manager_configuration_set_package_platform(config, "debian");
+    milter_manager_configuration_set_maintenance_interval(config, 29);
+    milter_manager_configuration_set_location(config, "package.platform",
+                                              "milter-manager.local.conf", 2);
+    egg = milter_manager_egg_new("milter@10025");
+    milter_manager_egg_set_connection_spec(egg, "inet:10025", &error);
+    gcut_assert_error(error);
+    milter_manager_egg_add_connection_spec(egg, "inet:10026", &error);
+    gcut_assert_error(error);
+    milter_manager_egg_set_command(egg, "test-milter");
+    milter_manager_egg_set_enabled(egg, FALSE);
+    milter_manager_configuration_add_egg(config, egg);
+
+    milter_manager_configuration_save_snapshot(config, snapshot_path, &error);
+    gcut_assert_error(error);
+
+    milter_manager_configuration_clear(config, &error);
+    gcut_assert_error(error);
+    cut_assert_equal_uint(
+        0, g_list_length((GList *)milter_manager_configuration_get_eggs(config)));
+
+    milter_manager_configuration_load_snapshot(config, snapshot_path, &error);
+    gcut_assert_error(error);
+
+    cut_assert_equal_string(
+        "debian",
+        milter_manager_configuration_get_package_platform(config));
+    cut_assert_equal_uint(
+        29,
+        milter_manager_configuration_get_maintenance_interval(config));
+    expected_eggs = g_list_append(expected_eggs, egg);
+    gcut_assert_equal_list_object_custom(
+        expected_eggs,
+        milter_manager_configuration_get_eggs(config),
+        milter_manager_test_egg_equal);
+    loaded_egg = milter_manager_configuration_find_egg(config, "milter@10025");
+    cut_assert_equal_string("test-milter",
+                            milter_manager_egg_get_command(loaded_egg));
+    cut_assert_equal_string("inet:10025",
+                            milter_manager_egg_get_connection_spec(loaded_egg));
+    connection_specs = milter_manager_egg_get_connection_specs(loaded_egg);
+    gcut_assert_equal_list_string(
+        gcut_take_new_list_string("inet:10025", "inet:10026", NULL),
+        gcut_take_list(connection_specs, NULL));
+    cut_assert_false(milter_manager_egg_is_enabled(loaded_egg));
+
+    location = milter_manager_configuration_get_location(config,
+                                                         "package.platform");
+    cut_assert_equal_string("milter-manager.local.conf",
+                            g_dataset_get_data(location, "file"));
+    cut_assert_equal_int(2,
+                         GPOINTER_TO_INT(g_dataset_get_data(location, "line")));
+}
+
+void
+test_snapshot_stale (void)
+{
+    GError *error = NULL;
+    const gchar *config_file;
+    const gchar *snapshot_path;
+    struct utimbuf times;
+
+    config_file = setup_snapshot_load_path();
+    snapshot_path = cut_build_path(tmp_dir, "snapshot", NULL);
+
+    milter_manager_configuration_set_maintenance_interval(config, 29);
+    milter_manager_configuration_save_snapshot(config, snapshot_path, &error);
+    gcut_assert_error(error);
+
+    times.actime = times.modtime = time(NULL) + 60;
+    if (g_utime(config_file, &times) == -1)
+        cut_assert_errno();
+
+    milter_manager_configuration_load_snapshot(config, snapshot_path,
+                                               &actual_error);
+    expected_error =
+        g_error_new(MILTER_MANAGER_CONFIGURATION_ERROR,
+                    MILTER_MANAGER_CONFIGURATION_ERROR_STALE_SNAPSHOT,
+                    "<%s> is changed after snapshot is saved: <%s>",
+                    config_file, snapshot_path);
+    gcut_assert_equal_error(expected_error, actual_error);
+    cut_assert_equal_uint(
+        29,
+        milter_manager_configuration_get_maintenance_interval(config));
+}
+
+void
+test_snapshot_stale_in_same_second (void)
+{
+    GError *error = NULL;
+    const gchar *config_file;
+    const gchar *snapshot_path;
+    const gchar content[] = "manager.maintenance_interval = 10\n";
+    struct stat status;
+    struct utimbuf times;
+
+    config_file = setup_snapshot_load_path();
+    snapshot_path = cut_build_path(tmp_dir, "snapshot", NULL);
+
+    milter_manager_configuration_save_snapshot(config, snapshot_path, &error);
+    gcut_assert_error(error);
+
+    if (g_stat(config_file, &status) == -1)
+        cut_assert_errno();
+    g_file_set_contents(config_file, content, -1, &error);
+    gcut_assert_error(error);
+    times.actime = status.st_atime;
+    times.modtime = status.st_mtime;
+    if (g_utime(config_file, &times) == -1)
+        cut_assert_errno();
+
+    milter_manager_configuration_load_snapshot(config, snapshot_path,
+                                               &actual_error);
+    expected_error =
+        g_error_new(MILTER_MANAGER_CONFIGURATION_ERROR,
+                    MILTER_MANAGER_CONFIGURATION_ERROR_STALE_SNAPSHOT,
+                    "<%s> is changed after snapshot is saved: <%s>",
+                    config_file, snapshot_path);
+    gcut_assert_equal_error(expected_error, actual_error);
+}
+
+void
+test_snapshot_unavailable (void)
+{
+    const gchar *snapshot_path;
+
+    setup_snapshot_load_path();
+    snapshot_path = cut_build_path(tmp_dir, "snapshot", NULL);
+
+    egg = milter_manager_egg_new("milter@10025");
+    condition = milter_manager_applicable_condition_new("S25R");
+    milter_manager_egg_add_applicable_condition(egg, condition);
+    milter_manager_configuration_add_egg(config, egg);
+
+    cut_assert_false(milter_manager_configuration_is_snapshot_available(config));
+    milter_manager_configuration_save_snapshot(config, snapshot_path,
+                                               &actual_error);
+    expected_error =
+        g_error_new(MILTER_MANAGER_CONFIGURATION_ERROR,
+                    MILTER_MANAGER_CONFIGURATION_ERROR_SNAPSHOT_UNAVAILABLE,
+                    "configuration that uses applicable conditions, "
+                    "hooks or signal handlers can't be saved as snapshot: "
+                    "<%s>",
+                    snapshot_path);
+    gcut_assert_equal_error(expected_error, actual_error);
+    cut_assert_path_not_exist(snapshot_path);
+}
+
 /*
 vi:ts=4:nowrap:ai:expandtab:sw=4
 */
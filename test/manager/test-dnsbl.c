@@ -0,0 +1,461 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <milter/manager/milter-manager-dnsbl.h>
+
+#include <milter-test-utils.h>
+
+#include <gcutter.h>
+
+void test_listed (void);
+void test_not_listed (void);
+void test_expected_answer_mismatch (void);
+void test_parallel_zones (void);
+void test_cache (void);
+void test_shared_cache (void);
+void test_join_pending_query (void);
+void test_timeout (void);
+void test_not_ipv4 (void);
+void test_invalid_expected_answer (void);
+void test_invalid_name_server (void);
+
+static MilterEventLoop *loop;
+static MilterManagerDNSBL *dnsbl;
+
+static GIOChannel *server_channel;
+static guint server_watch_id;
+static gchar *server_spec;
+static GHashTable *listed_names;
+static gboolean server_respond;
+static guint n_received_queries;
+
+static guint n_checked;
+static gboolean actual_listed;
+static gchar *actual_zone;
+
+static gboolean
+cb_server_readable (GIOChannel *channel, GIOCondition condition,
+                    gpointer user_data)
+{
+    guchar packet[512];
+    struct sockaddr_in client_address;
+    socklen_t client_address_length = sizeof(client_address);
+    ssize_t size;
+    gsize offset;
+    GString *name;
+    gint fd;
+
+    fd = g_io_channel_unix_get_fd(channel);
+    size = recvfrom(fd, packet, sizeof(packet), 0,
+                    (struct sockaddr *)&client_address,
+                    &client_address_length);
+    if (size < 12)
+        return TRUE;
+    n_received_queries++;
+    if (!server_respond)
+        return TRUE;
+
+    name = g_string_new(NULL);
+    offset = 12;
+    while (offset < (gsize)size && packet[offset] != 0) {
+        if (name->len > 0)
+            g_string_append_c(name, '.');
+        g_string_append_len(name,
+                            (const gchar *)packet + offset + 1,
+                            packet[offset]);
+        offset += 1 + packet[offset];
+    }
+    offset += 1 + 4;
+
+    packet[2] |= 0x80;
+    if (g_hash_table_lookup(listed_names, name->str)) {
+        const gchar *answer;
+        struct in_addr answer_address;
+        guchar record[] = {
+            0xc0, 0x0c,
+            0x00, 0x01,
+            0x00, 0x01,
+            0x00, 0x00, 0x00, 0x3c,
+            0x00, 0x04,
+            0x00, 0x00, 0x00, 0x00
+        };
+
+        answer = g_hash_table_lookup(listed_names, name->str);
+        inet_pton(AF_INET, answer, &answer_address);
+        memcpy(record + 12, &answer_address, 4);
+        packet[3] = 0x80;
+        packet[7] = 1;
+        memcpy(packet + offset, record, sizeof(record));
+        offset += sizeof(record);
+    } else {
+        packet[3] = 0x80 | 3;
+    }
+    g_string_free(name, TRUE);
+
+    sendto(fd, packet, offset, 0,
+           (struct sockaddr *)&client_address, client_address_length);
+
+    return TRUE;
+}
+
+static void
+setup_server (void)
+{
+    struct sockaddr_in address;
+    socklen_t address_length = sizeof(address);
+    gint fd;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    bind(fd, (struct sockaddr *)&address, address_length);
+    getsockname(fd, (struct sockaddr *)&address, &address_length);
+    server_spec = g_strdup_printf("inet:%u@127.0.0.1",
+                                  ntohs(address.sin_port));
+
+    server_channel = g_io_channel_unix_new(fd);
+    g_io_channel_set_close_on_unref(server_channel, TRUE);
+    server_watch_id = milter_event_loop_watch_io(loop,
+                                                 server_channel,
+                                                 G_IO_IN | G_IO_PRI,
+                                                 cb_server_readable,
+                                                 NULL);
+}
+
+void
+cut_setup (void)
+{
+    GError *error = NULL;
+
+    loop = milter_test_event_loop_new();
+
+    listed_names = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                         g_free, g_free);
+    server_respond = TRUE;
+    n_received_queries = 0;
+    setup_server();
+
+    dnsbl = milter_manager_dnsbl_new(loop);
+    milter_manager_dnsbl_add_name_server(dnsbl, server_spec, &error);
+    gcut_assert_error(error);
+
+    n_checked = 0;
+    actual_listed = FALSE;
+    actual_zone = NULL;
+}
+
+void
+cut_teardown (void)
+{
+    if (dnsbl)
+        g_object_unref(dnsbl);
+
+    if (server_watch_id > 0)
+        milter_event_loop_remove(loop, server_watch_id);
+    if (server_channel)
+        g_io_channel_unref(server_channel);
+    if (server_spec)
+        g_free(server_spec);
+    if (listed_names)
+        g_hash_table_unref(listed_names);
+
+    if (actual_zone)
+        g_free(actual_zone);
+
+    if (loop)
+        g_object_unref(loop);
+}
+
+static void
+list (const gchar *name, const gchar *answer)
+{
+    g_hash_table_insert(listed_names, g_strdup(name), g_strdup(answer));
+}
+
+static void
+add_service (const gchar *zone, const gchar *expected_answer)
+{
+    GError *error = NULL;
+
+    milter_manager_dnsbl_add_service(dnsbl, zone, expected_answer, &error);
+    gcut_assert_error(error);
+}
+
+static void
+cb_check (MilterManagerDNSBL *dnsbl, gboolean listed, const gchar *zone,
+          gpointer user_data)
+{
+    n_checked++;
+    actual_listed = listed;
+    if (actual_zone)
+        g_free(actual_zone);
+    actual_zone = g_strdup(zone);
+}
+
+static void
+check (const gchar *ip_address)
+{
+    struct sockaddr_in address;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    inet_pton(AF_INET, ip_address, &(address.sin_addr));
+    milter_manager_dnsbl_check(dnsbl,
+                               (struct sockaddr *)&address, sizeof(address),
+                               cb_check, NULL, NULL);
+}
+
+static gboolean
+cb_timeout_waiting (gpointer data)
+{
+    gboolean *waiting = data;
+
+    *waiting = FALSE;
+    return FALSE;
+}
+
+#define wait_checked(expected)                  \
+    cut_trace_with_info_expression(             \
+        wait_checked_helper(expected),          \
+        wait_checked(expected))
+
+static void
+wait_checked_helper (guint expected)
+{
+    gboolean timeout_waiting = TRUE;
+    guint timeout_waiting_id;
+
+    timeout_waiting_id = milter_event_loop_add_timeout(loop, 1.0,
+                                                       cb_timeout_waiting,
+                                                       &timeout_waiting);
+    while (timeout_waiting && expected > n_checked) {
+        milter_event_loop_iterate(loop, TRUE);
+    }
+    milter_event_loop_remove(loop, timeout_waiting_id);
+
+    cut_assert_true(timeout_waiting,
+                    cut_message("timeout: expect:<%u> actual:<%u>",
+                                expected, n_checked));
+    cut_assert_equal_uint(expected, n_checked);
+}
+
+void
+test_listed (void)
+{
+    add_service("bl.example.com", "127.0.0.2");
+    list("2.0.0.192.bl.example.com", "127.0.0.2");
+
+    check("192.0.0.2");
+    wait_checked(1);
+    cut_assert_true(actual_listed);
+    cut_assert_equal_string("bl.example.com", actual_zone);
+}
+
+void
+test_not_listed (void)
+{
+    add_service("bl.example.com", "127.0.0.2");
+    list("2.0.0.192.bl.example.com", "127.0.0.2");
+
+    check("192.0.0.3");
+    wait_checked(1);
+    cut_assert_false(actual_listed);
+    cut_assert_equal_string(NULL, actual_zone);
+}
+
+void
+test_expected_answer_mismatch (void)
+{
+    add_service("zen.example.com", "127.0.0.10/31");
+    list("2.0.0.192.zen.example.com", "127.0.0.4");
+
+    check("192.0.0.2");
+    wait_checked(1);
+    cut_assert_false(actual_listed);
+}
+
+void
+test_parallel_zones (void)
+{
+    add_service("bl1.example.com", NULL);
+    add_service("bl2.example.com", NULL);
+    list("2.0.0.192.bl2.example.com", "127.0.0.2");
+
+    check("192.0.0.2");
+    wait_checked(1);
+    cut_assert_true(actual_listed);
+    cut_assert_equal_string("bl2.example.com", actual_zone);
+}
+
+void
+test_cache (void)
+{
+    add_service("bl.example.com", NULL);
+    list("2.0.0.192.bl.example.com", "127.0.0.2");
+
+    check("192.0.0.2");
+    wait_checked(1);
+    cut_assert_equal_uint(1, n_received_queries);
+
+    check("192.0.0.2");
+    cut_assert_equal_uint(2, n_checked);
+    cut_assert_true(actual_listed);
+    cut_assert_equal_uint(1, n_received_queries);
+
+    check("192.0.0.3");
+    wait_checked(3);
+    cut_assert_false(actual_listed);
+    cut_assert_equal_uint(2, n_received_queries);
+
+    check("192.0.0.3");
+    cut_assert_equal_uint(4, n_checked);
+    cut_assert_false(actual_listed);
+    cut_assert_equal_uint(2, n_received_queries);
+}
+
+void
+test_shared_cache (void)
+{
+    MilterManagerSharedCache *cache;
+    MilterManagerDNSBL *other_dnsbl;
+    struct sockaddr_in address;
+    gboolean listed = FALSE;
+    GError *error = NULL;
+
+    cache = milter_manager_shared_cache_new(64, &error);
+    gcut_assert_error(error);
+    gcut_take_object(G_OBJECT(cache));
+    milter_manager_dnsbl_set_shared_cache(dnsbl, cache);
+
+    add_service("bl.example.com", NULL);
+    list("2.0.0.192.bl.example.com", "127.0.0.2");
+
+    check("192.0.0.2");
+    wait_checked(1);
+    cut_assert_true(actual_listed);
+
+    other_dnsbl = milter_manager_dnsbl_new(loop);
+    gcut_take_object(G_OBJECT(other_dnsbl));
+    milter_manager_dnsbl_add_service(other_dnsbl, "bl.example.com", NULL,
+                                     &error);
+    gcut_assert_error(error);
+    milter_manager_dnsbl_set_shared_cache(other_dnsbl, cache);
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    inet_pton(AF_INET, "192.0.0.2", &(address.sin_addr));
+    cut_assert_true(milter_manager_dnsbl_lookup_cache(other_dnsbl,
+                                                      (struct sockaddr *)&address,
+                                                      sizeof(address),
+                                                      &listed));
+    cut_assert_true(listed);
+    cut_assert_equal_uint(1, n_received_queries);
+}
+
+void
+test_join_pending_query (void)
+{
+    add_service("bl.example.com", NULL);
+    list("2.0.0.192.bl.example.com", "127.0.0.2");
+
+    check("192.0.0.2");
+    check("192.0.0.2");
+    cut_assert_equal_uint(1, milter_manager_dnsbl_get_n_pending_queries(dnsbl));
+    wait_checked(2);
+    cut_assert_equal_uint(1, n_received_queries);
+}
+
+void
+test_timeout (void)
+{
+    server_respond = FALSE;
+    milter_manager_dnsbl_set_timeout(dnsbl, 0.2);
+    milter_manager_dnsbl_set_n_retries(dnsbl, 1);
+    add_service("bl.example.com", NULL);
+
+    check("192.0.0.2");
+    wait_checked(1);
+    cut_assert_false(actual_listed);
+    cut_assert_equal_uint(2, n_received_queries);
+    cut_assert_equal_uint(0, milter_manager_dnsbl_get_n_pending_queries(dnsbl));
+}
+
+void
+test_not_ipv4 (void)
+{
+    struct sockaddr_in6 address;
+
+    add_service("bl.example.com", NULL);
+
+    memset(&address, 0, sizeof(address));
+    address.sin6_family = AF_INET6;
+    inet_pton(AF_INET6, "::1", &(address.sin6_addr));
+    milter_manager_dnsbl_check(dnsbl,
+                               (struct sockaddr *)&address, sizeof(address),
+                               cb_check, NULL, NULL);
+    cut_assert_equal_uint(1, n_checked);
+    cut_assert_false(actual_listed);
+    cut_assert_equal_uint(0, n_received_queries);
+}
+
+void
+test_invalid_expected_answer (void)
+{
+    GError *expected_error = NULL;
+    GError *actual_error = NULL;
+
+    expected_error = g_error_new(MILTER_MANAGER_DNSBL_ERROR,
+                                 MILTER_MANAGER_DNSBL_ERROR_INVALID_EXPECTED_ANSWER,
+                                 "expected answer should be "
+                                 "IPv4 address or network: <127.0.0.2/33>");
+    milter_manager_dnsbl_add_service(dnsbl, "bl.example.com", "127.0.0.2/33",
+                                     &actual_error);
+    gcut_take_error(expected_error);
+    gcut_take_error(actual_error);
+    gcut_assert_equal_error(expected_error, actual_error);
+}
+
+void
+test_invalid_name_server (void)
+{
+    GError *expected_error = NULL;
+    GError *actual_error = NULL;
+
+    expected_error = g_error_new(MILTER_MANAGER_DNSBL_ERROR,
+                                 MILTER_MANAGER_DNSBL_ERROR_INVALID_NAME_SERVER,
+                                 "name server should be IPv4 or IPv6 address: "
+                                 "<unix:/tmp/dns.sock>");
+    milter_manager_dnsbl_add_name_server(dnsbl, "unix:/tmp/dns.sock",
+                                         &actual_error);
+    gcut_take_error(expected_error);
+    gcut_take_error(actual_error);
+    gcut_assert_equal_error(expected_error, actual_error);
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
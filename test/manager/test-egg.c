@@ -51,6 +51,20 @@ void test_command (void);
 void test_command_options (void);
 void test_fallback_status (void);
 void test_evaluation_mode (void);
+void test_latency (void);
+void test_latency_replied (void);
+void test_circuit_breaker (void);
+void test_adaptive_timeout (void);
+void test_max_concurrent_sessions (void);
+void test_max_concurrent_sessions_release (void);
+void test_backends (void);
+void test_backend_failover (void);
+void test_warm_connections (void);
+void test_warm_connections_refill (void);
+void test_negotiate_cache (void);
+void test_verdict_cache (void);
+void test_verdict_cache_size (void);
+void test_evaluation_sampling (void);
 void test_merge (void);
 void test_applicable_condition (void);
 void test_attach_applicable_conditions (void);
@@ -70,6 +84,8 @@ static GList *expected_applicable_conditions;
 
 static gchar *actual_xml;
 
+static MilterEventLoop *loop;
+
 
 static const gchar *milter_log_level;
 
@@ -82,6 +98,7 @@ setup (void)
     hatched_child = NULL;
     children = NULL;
     condition = NULL;
+    loop = NULL;
 
     expected_error = NULL;
     actual_error = NULL;
@@ -108,6 +125,8 @@ teardown (void)
         g_object_unref(children);
     if (condition)
         g_object_unref(condition);
+    if (loop)
+        g_object_unref(loop);
 
     if (expected_error)
         g_error_free(expected_error);
@@ -392,6 +411,507 @@ test_evaluation_mode (void)
     cut_assert_true(milter_manager_child_is_evaluation_mode(child));
 }
 
+void
+test_latency (void)
+{
+    MilterManagerEggLatencySummary summary;
+    MilterHistogram *histogram;
+
+    egg = milter_manager_egg_new("child-milter");
+    cut_assert_equal_double(MILTER_MANAGER_EGG_DEFAULT_LATENCY_WINDOW, 0.001,
+                            milter_manager_egg_get_latency_window(egg));
+    cut_assert_null(milter_manager_egg_get_latency_histogram(
+                        egg, MILTER_SERVER_CONTEXT_STATE_HELO));
+
+    milter_manager_egg_record_latency(egg,
+                                      MILTER_SERVER_CONTEXT_STATE_HELO,
+                                      0.001);
+    milter_manager_egg_record_latency(egg,
+                                      MILTER_SERVER_CONTEXT_STATE_HELO,
+                                      0.003);
+    milter_manager_egg_record_latency(egg,
+                                      MILTER_SERVER_CONTEXT_STATE_QUIT,
+                                      0.1);
+
+    histogram =
+        milter_manager_egg_get_latency_histogram(egg,
+                                                 MILTER_SERVER_CONTEXT_STATE_HELO);
+    cut_assert_not_null(histogram);
+    cut_assert_equal_uint(2, milter_histogram_get_count(histogram));
+    cut_assert_null(milter_manager_egg_get_latency_histogram(
+                        egg, MILTER_SERVER_CONTEXT_STATE_QUIT));
+
+    cut_assert_true(milter_manager_egg_get_latency_summary(
+                        egg, 0, MILTER_SERVER_CONTEXT_STATE_HELO, &summary));
+    cut_assert_equal_uint(2, summary.count);
+    cut_assert_equal_double(0.002, 0.0001, summary.mean);
+    cut_assert_equal_double(0.003, 0.0001, summary.max);
+
+    milter_manager_egg_reset_latencies(egg);
+    cut_assert_equal_uint(0, milter_histogram_get_count(histogram));
+}
+
+void
+test_latency_replied (void)
+{
+    const gchar spec[] = "inet:9999@127.0.0.1";
+    GError *error = NULL;
+    MilterHistogram *histogram;
+
+    egg = milter_manager_egg_new("child-milter");
+    milter_manager_egg_set_connection_spec(egg, spec, &error);
+    gcut_assert_error(error);
+
+    child = milter_manager_egg_hatch(egg);
+    cut_assert_not_null(child);
+    g_signal_emit_by_name(child, "replied",
+                          MILTER_SERVER_CONTEXT_STATE_END_OF_MESSAGE, 0.5);
+
+    histogram = milter_manager_egg_get_latency_histogram(
+        egg, MILTER_SERVER_CONTEXT_STATE_END_OF_MESSAGE);
+    cut_assert_not_null(histogram);
+    cut_assert_equal_uint(1, milter_histogram_get_count(histogram));
+    cut_assert_equal_double(500000, 5000, milter_histogram_get_max(histogram));
+}
+
+void
+test_circuit_breaker (void)
+{
+    const gchar spec[] = "inet:9999@127.0.0.1";
+    GError *error = NULL;
+    MilterManagerEggCircuitSummary summary;
+
+    egg = milter_manager_egg_new("child-milter");
+    milter_manager_egg_set_connection_spec(egg, spec, &error);
+    gcut_assert_error(error);
+    milter_manager_egg_set_circuit_breaker_threshold(egg, 0.5);
+    milter_manager_egg_set_circuit_breaker_minimum_requests(egg, 2);
+
+    child = milter_manager_egg_hatch(egg);
+    cut_assert_false(milter_manager_child_is_bypassed(child));
+    g_signal_emit_by_name(child, "replied",
+                          MILTER_SERVER_CONTEXT_STATE_HELO, 0.1);
+    cut_assert_equal_int(MILTER_MANAGER_EGG_CIRCUIT_CLOSED,
+                         milter_manager_egg_get_circuit_state(egg));
+    g_signal_emit_by_name(child, "reading-timeout");
+    cut_assert_equal_int(MILTER_MANAGER_EGG_CIRCUIT_OPEN,
+                         milter_manager_egg_get_circuit_state(egg));
+
+    cut_assert_true(milter_manager_egg_get_circuit_summary(egg, 0, &summary));
+    cut_assert_equal_int(MILTER_MANAGER_EGG_CIRCUIT_OPEN, summary.state);
+    cut_assert_equal_uint(1, summary.n_successes);
+    cut_assert_equal_uint(1, summary.n_failures);
+
+    g_object_unref(child);
+    child = milter_manager_egg_hatch(egg);
+    cut_assert_true(milter_manager_child_is_bypassed(child));
+
+    milter_manager_egg_set_circuit_breaker_open_time(egg, 0.0);
+    g_object_unref(child);
+    child = milter_manager_egg_hatch(egg);
+    cut_assert_false(milter_manager_child_is_bypassed(child));
+    cut_assert_equal_int(MILTER_MANAGER_EGG_CIRCUIT_HALF_OPEN,
+                         milter_manager_egg_get_circuit_state(egg));
+
+    milter_manager_egg_record_circuit_result(egg, TRUE, NULL);
+    cut_assert_equal_int(MILTER_MANAGER_EGG_CIRCUIT_CLOSED,
+                         milter_manager_egg_get_circuit_state(egg));
+}
+
+void
+test_adaptive_timeout (void)
+{
+    guint i;
+
+    egg = milter_manager_egg_new("child-milter");
+    milter_manager_egg_set_reading_timeout(egg, 10.0);
+    milter_manager_egg_set_end_of_message_timeout(egg, 100.0);
+    milter_manager_egg_set_adaptive_timeout(egg, TRUE);
+    milter_manager_egg_set_adaptive_timeout_minimum(egg, 0.0);
+
+    for (i = 0; i < 100; i++) {
+        milter_manager_egg_record_latency(egg,
+                                          MILTER_SERVER_CONTEXT_STATE_HELO,
+                                          0.1);
+        milter_manager_egg_record_latency(egg,
+                                          MILTER_SERVER_CONTEXT_STATE_END_OF_MESSAGE,
+                                          0.5);
+    }
+    cut_assert_equal_double(0.3, 0.01,
+                            milter_manager_egg_get_effective_reading_timeout(egg));
+    cut_assert_equal_double(1.5, 0.05,
+                            milter_manager_egg_get_effective_end_of_message_timeout(egg, 0));
+
+    milter_manager_egg_reset_latencies(egg);
+    cut_assert_equal_double(0.3, 0.01,
+                            milter_manager_egg_get_effective_reading_timeout(egg));
+
+    milter_manager_egg_set_reading_timeout(egg, 0.2);
+    cut_assert_equal_double(0.2, 0.001,
+                            milter_manager_egg_get_effective_reading_timeout(egg));
+
+    milter_manager_egg_set_adaptive_timeout(egg, FALSE);
+    cut_assert_equal_double(100.0, 0.001,
+                            milter_manager_egg_get_effective_end_of_message_timeout(egg, 0));
+}
+
+void
+test_max_concurrent_sessions (void)
+{
+    const gchar spec[] = "inet:9999@127.0.0.1";
+    GError *error = NULL;
+    MilterManagerChild *shed_child;
+    MilterManagerEggSessionSummary summary;
+
+    egg = milter_manager_egg_new("child-milter");
+    milter_manager_egg_set_connection_spec(egg, spec, &error);
+    gcut_assert_error(error);
+    milter_manager_egg_set_max_concurrent_sessions(egg, 1);
+    milter_manager_egg_set_max_queued_sessions(egg, 1);
+    milter_manager_egg_set_shed_status(egg, MILTER_STATUS_TEMPORARY_FAILURE);
+
+    child = milter_manager_egg_hatch(egg);
+    cut_assert_false(milter_manager_child_is_queued(child));
+    cut_assert_false(milter_manager_child_is_bypassed(child));
+
+    hatched_child = milter_manager_egg_hatch(egg);
+    cut_assert_true(milter_manager_child_is_queued(hatched_child));
+    cut_assert_equal_double(MILTER_MANAGER_EGG_DEFAULT_QUEUE_TIMEOUT, 0.001,
+                            milter_manager_child_get_queue_timeout(hatched_child));
+
+    shed_child = milter_manager_egg_hatch(egg);
+    cut_assert_true(milter_manager_child_is_bypassed(shed_child));
+    gcut_assert_equal_enum(MILTER_TYPE_STATUS,
+                           MILTER_STATUS_TEMPORARY_FAILURE,
+                           milter_manager_child_get_fallback_status(shed_child));
+    g_object_unref(shed_child);
+
+    cut_assert_true(milter_manager_egg_get_session_summary(egg, 0, &summary));
+    cut_assert_equal_uint(1, summary.n_active_sessions);
+    cut_assert_equal_uint(1, summary.n_queued_sessions);
+    cut_assert_equal_uint(1, summary.n_shed_sessions);
+
+    g_object_unref(child);
+    child = NULL;
+    cut_assert_false(milter_manager_child_is_queued(hatched_child));
+    cut_assert_true(milter_manager_egg_get_session_summary(egg, 0, &summary));
+    cut_assert_equal_uint(1, summary.n_active_sessions);
+    cut_assert_equal_uint(0, summary.n_queued_sessions);
+}
+
+void
+test_max_concurrent_sessions_release (void)
+{
+    const gchar spec[] = "inet:9999@127.0.0.1";
+    GError *error = NULL;
+    MilterManagerEggSessionSummary summary;
+
+    egg = milter_manager_egg_new("child-milter");
+    milter_manager_egg_set_connection_spec(egg, spec, &error);
+    gcut_assert_error(error);
+    milter_manager_egg_set_max_concurrent_sessions(egg, 1);
+    milter_manager_egg_set_max_queued_sessions(egg, 1);
+    milter_manager_egg_set_queue_timeout(egg, 60);
+    cut_assert_equal_double(MILTER_MANAGER_EGG_MAXIMUM_QUEUE_TIMEOUT, 0.001,
+                            milter_manager_egg_get_queue_timeout(egg));
+
+    child = milter_manager_egg_hatch(egg);
+    hatched_child = milter_manager_egg_hatch(egg);
+    cut_assert_true(milter_manager_child_is_queued(hatched_child));
+    cut_assert_equal_double(MILTER_MANAGER_EGG_MAXIMUM_QUEUE_TIMEOUT, 0.001,
+                            milter_manager_child_get_queue_timeout(hatched_child));
+
+    milter_finished_emittable_emit(MILTER_FINISHED_EMITTABLE(child));
+    cut_assert_false(milter_manager_child_is_queued(hatched_child));
+    cut_assert_true(milter_manager_egg_get_session_summary(egg, 0, &summary));
+    cut_assert_equal_uint(1, summary.n_active_sessions);
+    cut_assert_equal_uint(0, summary.n_queued_sessions);
+
+    g_signal_emit_by_name(hatched_child, "state-transited",
+                          MILTER_SERVER_CONTEXT_STATE_QUIT);
+    cut_assert_true(milter_manager_egg_get_session_summary(egg, 0, &summary));
+    cut_assert_equal_uint(0, summary.n_active_sessions);
+}
+
+void
+test_backends (void)
+{
+    const gchar spec1[] = "inet:9999@127.0.0.1";
+    const gchar spec2[] = "inet:9998@127.0.0.1";
+    GError *error = NULL;
+    MilterManagerChild *third_child;
+    MilterManagerEggBackendSummary summary;
+    GList *specs;
+    gint i;
+
+    egg = milter_manager_egg_new("child-milter");
+    milter_manager_egg_set_connection_spec(egg, spec1, &error);
+    gcut_assert_error(error);
+    milter_manager_egg_add_connection_spec(egg, spec2, &error);
+    gcut_assert_error(error);
+    cut_assert_equal_string(spec1, milter_manager_egg_get_connection_spec(egg));
+    specs = milter_manager_egg_get_connection_specs(egg);
+    cut_assert_equal_uint(2, g_list_length(specs));
+    g_list_free(specs);
+
+    child = milter_manager_egg_hatch(egg);
+    hatched_child = milter_manager_egg_hatch(egg);
+    cut_assert_true(milter_manager_egg_get_backend_summary(egg, spec1,
+                                                           &summary));
+    cut_assert_equal_uint(1, summary.n_outstanding_sessions);
+    cut_assert_true(milter_manager_egg_get_backend_summary(egg, spec2,
+                                                           &summary));
+    cut_assert_equal_uint(1, summary.n_outstanding_sessions);
+
+    for (i = 0; i < MILTER_MANAGER_EGG_DEFAULT_BACKEND_EJECTION_FAILURES; i++) {
+        g_signal_emit_by_name(child, "reading-timeout");
+    }
+    cut_assert_true(milter_manager_egg_get_backend_summary(egg, spec1,
+                                                           &summary));
+    cut_assert_true(summary.ejected);
+    cut_assert_equal_uint(MILTER_MANAGER_EGG_DEFAULT_BACKEND_EJECTION_FAILURES,
+                          summary.n_failures);
+
+    third_child = milter_manager_egg_hatch(egg);
+    cut_assert_true(milter_manager_egg_get_backend_summary(egg, spec2,
+                                                           &summary));
+    cut_assert_equal_uint(2, summary.n_outstanding_sessions);
+    g_object_unref(third_child);
+
+    cut_assert_true(milter_manager_egg_get_backend_summary(egg, spec2,
+                                                           &summary));
+    cut_assert_equal_uint(1, summary.n_outstanding_sessions);
+    cut_assert_equal_uint(2, summary.n_sessions);
+}
+
+void
+test_backend_failover (void)
+{
+    const gchar spec1[] = "inet:9999@127.0.0.1";
+    const gchar spec2[] = "inet:9998@127.0.0.1";
+    GError *error = NULL;
+    MilterManagerEggBackendSummary summary;
+
+    egg = milter_manager_egg_new("child-milter");
+    milter_manager_egg_set_connection_spec(egg, spec1, &error);
+    gcut_assert_error(error);
+    milter_manager_egg_add_connection_spec(egg, spec2, &error);
+    gcut_assert_error(error);
+
+    child = milter_manager_egg_hatch(egg);
+    cut_assert_true(milter_manager_child_failover(child));
+    cut_assert_true(milter_manager_egg_get_backend_summary(egg, spec1,
+                                                           &summary));
+    cut_assert_equal_uint(0, summary.n_outstanding_sessions);
+    cut_assert_equal_uint(1, summary.n_failures);
+    cut_assert_true(milter_manager_egg_get_backend_summary(egg, spec2,
+                                                           &summary));
+    cut_assert_equal_uint(1, summary.n_outstanding_sessions);
+
+    cut_assert_false(milter_manager_child_failover(child));
+    cut_assert_true(milter_manager_egg_get_backend_summary(egg, spec2,
+                                                           &summary));
+    cut_assert_equal_uint(1, summary.n_failures);
+}
+
+void
+test_warm_connections (void)
+{
+    const gchar spec[] = "inet:9999@127.0.0.1";
+    GError *error = NULL;
+
+    egg = milter_manager_egg_new("child-milter");
+    milter_manager_egg_set_connection_spec(egg, spec, &error);
+    gcut_assert_error(error);
+    cut_assert_equal_uint(0, milter_manager_egg_get_max_warm_connections(egg));
+
+    child = milter_manager_egg_hatch(egg);
+    cut_assert_equal_uint(0, milter_manager_egg_get_n_warm_connections(egg));
+    g_object_unref(child);
+
+    milter_manager_egg_set_max_warm_connections(egg, 2);
+    cut_assert_equal_uint(2, milter_manager_egg_get_max_warm_connections(egg));
+    child = milter_manager_egg_hatch(egg);
+    cut_assert_equal_uint(1, milter_manager_egg_get_n_warm_connections(egg));
+
+    milter_manager_egg_set_max_warm_connections(egg, 0);
+    cut_assert_equal_uint(0, milter_manager_egg_get_n_warm_connections(egg));
+}
+
+void
+test_warm_connections_refill (void)
+{
+    const gchar spec[] = "inet:9999@127.0.0.1";
+    GError *error = NULL;
+
+    loop = milter_test_event_loop_new();
+    egg = milter_manager_egg_new("child-milter");
+    milter_manager_egg_set_connection_spec(egg, spec, &error);
+    gcut_assert_error(error);
+    milter_manager_egg_set_event_loop(egg, loop);
+
+    milter_manager_egg_set_max_warm_connections(egg, 2);
+    cut_assert_equal_uint(0, milter_manager_egg_get_n_warm_connections(egg));
+    milter_test_pump_all_events(loop);
+    cut_assert_equal_uint(1, milter_manager_egg_get_n_warm_connections(egg));
+
+    child = milter_manager_egg_hatch(egg);
+    milter_test_pump_all_events(loop);
+    cut_assert_equal_uint(1, milter_manager_egg_get_n_warm_connections(egg));
+
+    milter_manager_egg_set_max_warm_connections(egg, 0);
+    cut_assert_equal_uint(0, milter_manager_egg_get_n_warm_connections(egg));
+}
+
+void
+test_negotiate_cache (void)
+{
+    const gchar spec[] = "inet:9999@127.0.0.1";
+    GError *error = NULL;
+    MilterOption *option, *changed_option;
+    MilterMacrosRequests *macros_requests;
+
+    egg = milter_manager_egg_new("child-milter");
+    milter_manager_egg_set_connection_spec(egg, spec, &error);
+    gcut_assert_error(error);
+    milter_manager_egg_set_negotiate_cache(egg, TRUE);
+
+    child = milter_manager_egg_hatch(egg);
+    cut_assert_null(milter_manager_child_get_cached_option(child));
+
+    option = milter_option_new(6, MILTER_ACTION_ADD_HEADERS,
+                               MILTER_STEP_NO_BODY);
+    macros_requests = milter_macros_requests_new();
+    g_signal_emit_by_name(child, "negotiate-reply", option, macros_requests);
+    cut_assert_not_null(milter_manager_egg_get_cached_option(egg));
+    cut_assert_true(milter_option_equal(option,
+                                        milter_manager_egg_get_cached_option(egg)));
+
+    hatched_child = milter_manager_egg_hatch(egg);
+    cut_assert_not_null(milter_manager_child_get_cached_option(hatched_child));
+
+    changed_option = milter_option_new(6, MILTER_ACTION_ADD_HEADERS,
+                                       MILTER_STEP_NONE);
+    g_signal_emit_by_name(hatched_child, "negotiate-reply",
+                          changed_option, macros_requests);
+    cut_assert_null(milter_manager_egg_get_cached_option(egg));
+
+    g_object_unref(option);
+    g_object_unref(changed_option);
+    g_object_unref(macros_requests);
+}
+
+void
+test_verdict_cache (void)
+{
+    const gchar spec[] = "inet:9999@127.0.0.1";
+    MilterManagerSharedCache *cache;
+    GError *error = NULL;
+
+    cache = milter_manager_shared_cache_new(64, &error);
+    gcut_assert_error(error);
+    gcut_take_object(G_OBJECT(cache));
+
+    egg = milter_manager_egg_new("child-milter");
+    milter_manager_egg_set_connection_spec(egg, spec, &error);
+    gcut_assert_error(error);
+    milter_manager_egg_set_shared_cache(egg, cache);
+    cut_assert_equal_double(0.0, 0.0,
+                            milter_manager_egg_get_verdict_cache_ttl(egg));
+
+    child = milter_manager_egg_hatch(egg);
+    cut_assert_null(milter_manager_child_get_verdict_cache(child));
+
+    milter_manager_egg_set_verdict_cache_ttl(egg, 30.0);
+    cut_assert_equal_double(30.0, 0.0,
+                            milter_manager_egg_get_verdict_cache_ttl(egg));
+
+    hatched_child = milter_manager_egg_hatch(egg);
+    cut_assert_equal_pointer(cache,
+                             milter_manager_child_get_verdict_cache(hatched_child));
+    cut_assert_equal_double(30.0, 0.0,
+                            milter_manager_child_get_verdict_cache_ttl(hatched_child));
+}
+
+void
+test_verdict_cache_size (void)
+{
+    const gchar spec[] = "inet:9999@127.0.0.1";
+    MilterManagerSharedCache *cache;
+    GError *error = NULL;
+    gchar *verdict;
+
+    cache = milter_manager_shared_cache_new(64, &error);
+    gcut_assert_error(error);
+    gcut_take_object(G_OBJECT(cache));
+
+    egg = milter_manager_egg_new("child-milter");
+    milter_manager_egg_set_connection_spec(egg, spec, &error);
+    gcut_assert_error(error);
+    milter_manager_egg_set_verdict_cache_ttl(egg, 30.0);
+    cut_assert_equal_uint(MILTER_MANAGER_EGG_DEFAULT_VERDICT_CACHE_SIZE,
+                          milter_manager_egg_get_verdict_cache_size(egg));
+
+    child = milter_manager_egg_hatch(egg);
+    cut_assert_null(milter_manager_child_get_verdict_cache(child));
+
+    milter_manager_egg_set_shared_cache(egg, cache);
+    milter_manager_egg_set_verdict_cache_size(egg, 2);
+    hatched_child = milter_manager_egg_hatch(egg);
+
+    cut_assert_true(milter_manager_child_store_verdict(hatched_child,
+                                                       "verdict:1", "reject"));
+    cut_assert_true(milter_manager_child_store_verdict(hatched_child,
+                                                       "verdict:2", "accept"));
+    verdict = milter_manager_child_lookup_verdict(hatched_child, "verdict:1");
+    cut_take_string(verdict);
+    cut_assert_equal_string("reject", verdict);
+    cut_assert_true(milter_manager_child_store_verdict(hatched_child,
+                                                       "verdict:3", "accept"));
+    cut_assert_equal_uint(2, milter_manager_egg_get_n_cached_verdicts(egg));
+
+    cut_assert_null(milter_manager_child_lookup_verdict(hatched_child,
+                                                        "verdict:2"));
+    verdict = milter_manager_child_lookup_verdict(hatched_child, "verdict:1");
+    cut_take_string(verdict);
+    cut_assert_equal_string("reject", verdict);
+
+    milter_manager_egg_set_verdict_cache_size(egg, 1);
+    cut_assert_equal_uint(1, milter_manager_egg_get_n_cached_verdicts(egg));
+    cut_assert_null(milter_manager_child_lookup_verdict(hatched_child,
+                                                        "verdict:3"));
+}
+
+void
+test_evaluation_sampling (void)
+{
+    const gchar spec[] = "inet:9999@127.0.0.1";
+    GError *error = NULL;
+
+    egg = milter_manager_egg_new("child-milter");
+    milter_manager_egg_set_connection_spec(egg, spec, &error);
+    gcut_assert_error(error);
+    cut_assert_equal_double(1.0, 0.0,
+                            milter_manager_egg_get_evaluation_sampling_rate(egg));
+
+    milter_manager_egg_set_evaluation_sampling_rate(egg, 0.0);
+    child = milter_manager_egg_hatch(egg);
+    cut_assert_false(milter_manager_child_is_bypassed(child));
+    g_object_unref(child);
+
+    milter_manager_egg_set_evaluation_mode(egg, TRUE);
+    child = milter_manager_egg_hatch(egg);
+    cut_assert_null(child);
+
+    milter_manager_egg_set_evaluation_sampling_by_client_address(egg, TRUE);
+    milter_manager_egg_set_evaluation_sampling_rate(egg, 0.25);
+    hatched_child = milter_manager_egg_hatch(egg);
+    cut_assert_false(milter_manager_child_is_bypassed(hatched_child));
+    cut_assert_equal_double(
+        0.25, 0.0,
+        milter_manager_child_get_evaluation_sampling_rate(hatched_child));
+}
+
 void
 test_applicable_condition (void)
 {
@@ -0,0 +1,162 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+
+#include <milter/manager/milter-manager-literal-matcher.h>
+
+#include <gcutter.h>
+
+void test_empty (void);
+void test_single (void);
+void test_overlapped (void);
+void test_suffix (void);
+void test_case_insensitive (void);
+void test_same_id (void);
+void test_order (void);
+void test_add_after_match (void);
+void test_not_found (void);
+
+static MilterManagerLiteralMatcher *matcher;
+static GArray *ids;
+
+void
+cut_setup (void)
+{
+    matcher = milter_manager_literal_matcher_new();
+    ids = g_array_new(FALSE, FALSE, sizeof(guint));
+}
+
+void
+cut_teardown (void)
+{
+    if (matcher)
+        g_object_unref(matcher);
+    if (ids)
+        g_array_free(ids, TRUE);
+}
+
+static const GList *
+match (const gchar *text)
+{
+    GList *found_ids = NULL;
+    guint i;
+
+    g_array_set_size(ids, 0);
+    milter_manager_literal_matcher_match(matcher, text, strlen(text), ids);
+    for (i = 0; i < ids->len; i++) {
+        found_ids = g_list_append(found_ids,
+                                  GUINT_TO_POINTER(g_array_index(ids, guint, i)));
+    }
+    return gcut_take_list(found_ids, NULL);
+}
+
+#define assert_match(expected, text)                            \
+    gcut_assert_equal_list_uint(gcut_take_new_list_uint expected, \
+                                match(text))
+
+void
+test_empty (void)
+{
+    cut_assert_equal_uint(0, milter_manager_literal_matcher_get_size(matcher));
+    cut_assert_equal_uint(0,
+                          milter_manager_literal_matcher_match(matcher,
+                                                               "text", 4,
+                                                               ids));
+}
+
+void
+test_single (void)
+{
+    milter_manager_literal_matcher_add(matcher, "dynamic", 0);
+
+    cut_assert_equal_uint(1, milter_manager_literal_matcher_get_size(matcher));
+    assert_match((1, 0), "pc1.dynamic.example.com");
+}
+
+void
+test_overlapped (void)
+{
+    milter_manager_literal_matcher_add(matcher, "he", 0);
+    milter_manager_literal_matcher_add(matcher, "she", 1);
+    milter_manager_literal_matcher_add(matcher, "his", 2);
+    milter_manager_literal_matcher_add(matcher, "hers", 3);
+
+    assert_match((3, 0, 1, 3), "ushers");
+}
+
+void
+test_suffix (void)
+{
+    milter_manager_literal_matcher_add(matcher, "abcd", 0);
+    milter_manager_literal_matcher_add(matcher, "bc", 1);
+
+    assert_match((1, 1), "xabcx");
+}
+
+void
+test_case_insensitive (void)
+{
+    milter_manager_literal_matcher_add(matcher, "DSL", 0);
+    milter_manager_literal_matcher_add(matcher, "ppp", 1);
+
+    assert_match((2, 0, 1), "PPP-dsl.Example.COM");
+}
+
+void
+test_same_id (void)
+{
+    milter_manager_literal_matcher_add(matcher, "dhcp", 5);
+    milter_manager_literal_matcher_add(matcher, "dsl", 5);
+
+    assert_match((1, 5), "dsl.dhcp.dsl.example.com");
+}
+
+void
+test_order (void)
+{
+    milter_manager_literal_matcher_add(matcher, "example", 2);
+    milter_manager_literal_matcher_add(matcher, "mail", 0);
+    milter_manager_literal_matcher_add(matcher, "com", 1);
+
+    assert_match((3, 0, 1, 2), "mail.example.com");
+}
+
+void
+test_add_after_match (void)
+{
+    milter_manager_literal_matcher_add(matcher, "mail", 0);
+    assert_match((0), "www.example.com");
+
+    milter_manager_literal_matcher_add(matcher, "www", 1);
+    assert_match((1, 1), "www.example.com");
+}
+
+void
+test_not_found (void)
+{
+    milter_manager_literal_matcher_add(matcher, "dynamic", 0);
+    milter_manager_literal_matcher_add(matcher, "dialup", 1);
+
+    assert_match((0), "mx.example.com");
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
@@ -0,0 +1,334 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <milter/manager/milter-manager-network-table.h>
+
+#include <milter-test-utils.h>
+
+#include <gcutter.h>
+
+void test_empty (void);
+void test_first_match (void);
+void test_longest_match (void);
+void test_all_match (void);
+void test_ipv6 (void);
+void test_ipv4_mapped_ipv6 (void);
+void test_host_bits (void);
+void test_no_value (void);
+void test_sockaddr (void);
+void test_invalid_address (void);
+void test_invalid_prefix_length (void);
+void test_save_and_load (void);
+void test_load_read_only (void);
+void test_load_broken_file (void);
+
+static MilterManagerNetworkTable *table;
+static gchar *tmp_dir;
+
+void
+cut_setup (void)
+{
+    table = milter_manager_network_table_new();
+    tmp_dir = milter_test_get_tmp_dir();
+}
+
+void
+cut_teardown (void)
+{
+    if (table)
+        g_object_unref(table);
+    if (tmp_dir) {
+        cut_remove_path(tmp_dir, NULL);
+        g_free(tmp_dir);
+    }
+}
+
+static void
+add (const gchar *network, const gchar *value)
+{
+    GError *error = NULL;
+
+    milter_manager_network_table_add(table, network, value, &error);
+    gcut_assert_error(error);
+}
+
+static const gchar *
+find (const gchar *address)
+{
+    const gchar *value = NULL;
+
+    if (!milter_manager_network_table_lookup_string(table, address, FALSE,
+                                                    &value))
+        return NULL;
+    return value;
+}
+
+static const gchar *
+find_longest (const gchar *address)
+{
+    const gchar *value = NULL;
+
+    if (!milter_manager_network_table_lookup_string(table, address, TRUE,
+                                                    &value))
+        return NULL;
+    return value;
+}
+
+void
+test_empty (void)
+{
+    cut_assert_equal_uint(0, milter_manager_network_table_get_size(table));
+    cut_assert_null(find("127.0.0.1"));
+    cut_assert_null(find("::1"));
+}
+
+void
+test_first_match (void)
+{
+    add("192.168.1.1", "OK");
+    add("192.168.1.0/24", "REJECT");
+    add("192.168.0.0/16", "DISCARD");
+
+    cut_assert_equal_uint(3, milter_manager_network_table_get_size(table));
+    cut_assert_equal_string("OK", find("192.168.1.1"));
+    cut_assert_equal_string("REJECT", find("192.168.1.29"));
+    cut_assert_equal_string("DISCARD", find("192.168.2.1"));
+    cut_assert_null(find("192.169.0.1"));
+}
+
+void
+test_longest_match (void)
+{
+    add("192.168.0.0/16", "DISCARD");
+    add("192.168.1.0/24", "REJECT");
+    add("192.168.1.1", "OK");
+
+    cut_assert_equal_string("DISCARD", find("192.168.1.1"));
+    cut_assert_equal_string("OK", find_longest("192.168.1.1"));
+    cut_assert_equal_string("REJECT", find_longest("192.168.1.29"));
+    cut_assert_equal_string("DISCARD", find_longest("192.168.2.1"));
+}
+
+void
+test_all_match (void)
+{
+    add("0.0.0.0/0", "OK");
+    add("192.168.1.1", "REJECT");
+
+    cut_assert_equal_string("OK", find("192.168.1.1"));
+    cut_assert_equal_string("OK", find("10.0.0.1"));
+    cut_assert_null(find("::1"));
+}
+
+void
+test_ipv6 (void)
+{
+    add("2001:2f8:c2:201::fff0", "OK");
+    add("2001:2f8:c2:201::0/64", "REJECT");
+
+    cut_assert_equal_string("OK", find("2001:2f8:c2:201::fff0"));
+    cut_assert_equal_string("REJECT", find("2001:2f8:c2:201::1"));
+    cut_assert_null(find("2001:2f8:c2:202::1"));
+    cut_assert_null(find("192.168.1.1"));
+}
+
+void
+test_ipv4_mapped_ipv6 (void)
+{
+    add("192.168.1.0/24", "REJECT");
+
+    cut_assert_equal_string("REJECT", find("::ffff:192.168.1.1"));
+}
+
+void
+test_host_bits (void)
+{
+    add("192.168.1.29/24", "REJECT");
+
+    cut_assert_equal_string("REJECT", find("192.168.1.1"));
+}
+
+void
+test_no_value (void)
+{
+    const gchar *value = "not changed";
+
+    add("192.168.1.0/24", NULL);
+
+    cut_assert_true(milter_manager_network_table_lookup_string(table,
+                                                               "192.168.1.1",
+                                                               FALSE,
+                                                               &value));
+    cut_assert_null(value);
+}
+
+void
+test_sockaddr (void)
+{
+    struct sockaddr_in address;
+    struct sockaddr_in6 address6;
+    const gchar *value = NULL;
+
+    add("192.168.1.0/24", "IPv4");
+    add("2001:db8::/32", "IPv6");
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    inet_pton(AF_INET, "192.168.1.1", &(address.sin_addr));
+    cut_assert_true(milter_manager_network_table_lookup(table,
+                                                        (struct sockaddr *)&address,
+                                                        sizeof(address),
+                                                        &value));
+    cut_assert_equal_string("IPv4", value);
+
+    memset(&address6, 0, sizeof(address6));
+    address6.sin6_family = AF_INET6;
+    inet_pton(AF_INET6, "2001:db8::1", &(address6.sin6_addr));
+    cut_assert_true(milter_manager_network_table_lookup_longest(table,
+                                                                (struct sockaddr *)&address6,
+                                                                sizeof(address6),
+                                                                &value));
+    cut_assert_equal_string("IPv6", value);
+}
+
+void
+test_invalid_address (void)
+{
+    GError *expected_error, *actual_error = NULL;
+
+    cut_assert_false(milter_manager_network_table_add(table, "192.168.1",
+                                                      "OK", &actual_error));
+    actual_error = gcut_take_error(actual_error);
+
+    expected_error =
+        g_error_new(MILTER_MANAGER_NETWORK_TABLE_ERROR,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR_INVALID_NETWORK,
+                    "invalid address: <192.168.1>");
+    expected_error = gcut_take_error(expected_error);
+    gcut_assert_equal_error(expected_error, actual_error);
+}
+
+void
+test_invalid_prefix_length (void)
+{
+    GError *expected_error, *actual_error = NULL;
+
+    cut_assert_false(milter_manager_network_table_add(table, "192.168.1.0/33",
+                                                      "OK", &actual_error));
+    actual_error = gcut_take_error(actual_error);
+
+    expected_error =
+        g_error_new(MILTER_MANAGER_NETWORK_TABLE_ERROR,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR_INVALID_NETWORK,
+                    "invalid prefix length: <192.168.1.0/33>");
+    expected_error = gcut_take_error(expected_error);
+    gcut_assert_equal_error(expected_error, actual_error);
+}
+
+static const gchar *
+save (void)
+{
+    const gchar *path;
+    GError *error = NULL;
+
+    path = cut_take_string(g_build_filename(tmp_dir, "table", NULL));
+    milter_manager_network_table_save(table, path, &error);
+    gcut_assert_error(error);
+
+    return path;
+}
+
+static void
+load (const gchar *path)
+{
+    GError *error = NULL;
+
+    g_object_unref(table);
+    table = milter_manager_network_table_new_from_file(path, &error);
+    gcut_assert_error(error);
+}
+
+void
+test_save_and_load (void)
+{
+    add("192.168.1.1", "OK");
+    add("192.168.1.0/24", "REJECT");
+    add("2001:db8::/32", NULL);
+
+    load(save());
+    cut_assert_true(milter_manager_network_table_is_read_only(table));
+    cut_assert_equal_uint(3, milter_manager_network_table_get_size(table));
+    cut_assert_equal_string("OK", find("192.168.1.1"));
+    cut_assert_equal_string("REJECT", find("192.168.1.29"));
+    cut_assert_true(milter_manager_network_table_lookup_string(table,
+                                                               "2001:db8::1",
+                                                               FALSE,
+                                                               NULL));
+    cut_assert_null(find("10.0.0.1"));
+}
+
+void
+test_load_read_only (void)
+{
+    GError *expected_error, *actual_error = NULL;
+
+    load(save());
+    cut_assert_false(milter_manager_network_table_add(table, "10.0.0.0/8",
+                                                      "OK", &actual_error));
+    actual_error = gcut_take_error(actual_error);
+
+    expected_error =
+        g_error_new(MILTER_MANAGER_NETWORK_TABLE_ERROR,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR_READ_ONLY,
+                    "can't add a network to a table loaded from file: "
+                    "<10.0.0.0/8>");
+    expected_error = gcut_take_error(expected_error);
+    gcut_assert_equal_error(expected_error, actual_error);
+}
+
+void
+test_load_broken_file (void)
+{
+    const gchar *path;
+    GError *expected_error, *actual_error = NULL;
+
+    path = cut_take_string(g_build_filename(tmp_dir, "broken", NULL));
+    g_file_set_contents(path, "192.168.1.0/24 OK\n", -1, NULL);
+
+    cut_assert_null(milter_manager_network_table_new_from_file(path,
+                                                               &actual_error));
+    actual_error = gcut_take_error(actual_error);
+
+    expected_error =
+        g_error_new(MILTER_MANAGER_NETWORK_TABLE_ERROR,
+                    MILTER_MANAGER_NETWORK_TABLE_ERROR_INVALID_FILE,
+                    "not a network table file: <%s>", path);
+    expected_error = gcut_take_error(expected_error);
+    gcut_assert_equal_error(expected_error, actual_error);
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
@@ -0,0 +1,266 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2011  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <milter/manager/milter-manager-shared-cache.h>
+
+#include <milter-test-utils.h>
+
+#include <gcutter.h>
+
+void test_set_and_get (void);
+void test_overwrite (void);
+void test_remove (void);
+void test_clear (void);
+void test_expire (void);
+void test_evict (void);
+void test_pinned (void);
+void test_too_large (void);
+void test_share_with_child_process (void);
+void test_statistics (void);
+void test_invalid_size (void);
+
+static MilterManagerSharedCache *cache;
+static gchar *actual_value;
+
+void
+cut_setup (void)
+{
+    GError *error = NULL;
+
+    cache = milter_manager_shared_cache_new(64, &error);
+    gcut_assert_error(error);
+    actual_value = NULL;
+}
+
+void
+cut_teardown (void)
+{
+    if (cache)
+        g_object_unref(cache);
+    if (actual_value)
+        g_free(actual_value);
+}
+
+static const gchar *
+get (const gchar *key)
+{
+    if (actual_value) {
+        g_free(actual_value);
+        actual_value = NULL;
+    }
+
+    if (!milter_manager_shared_cache_get(cache, key, &actual_value, NULL))
+        return NULL;
+    return actual_value;
+}
+
+static gboolean
+set (const gchar *key, const gchar *value, gdouble ttl)
+{
+    return milter_manager_shared_cache_set(cache, key,
+                                           value, strlen(value), ttl);
+}
+
+void
+test_set_and_get (void)
+{
+    cut_assert_equal_uint(64, milter_manager_shared_cache_get_n_entries(cache));
+
+    cut_assert_null(get("dnsbl:2.0.0.192.bl.example.com"));
+    cut_assert_true(set("dnsbl:2.0.0.192.bl.example.com", "1", 60));
+    cut_assert_equal_string("1", get("dnsbl:2.0.0.192.bl.example.com"));
+}
+
+void
+test_overwrite (void)
+{
+    cut_assert_true(set("key", "value", 60));
+    cut_assert_true(set("key", "new value", 60));
+    cut_assert_equal_string("new value", get("key"));
+}
+
+void
+test_remove (void)
+{
+    cut_assert_true(set("key", "value", 60));
+    cut_assert_true(milter_manager_shared_cache_remove(cache, "key"));
+    cut_assert_null(get("key"));
+    cut_assert_false(milter_manager_shared_cache_remove(cache, "key"));
+}
+
+void
+test_clear (void)
+{
+    cut_assert_true(set("key1", "value1", 60));
+    cut_assert_true(set("key2", "value2", 60));
+    milter_manager_shared_cache_clear(cache);
+    cut_assert_null(get("key1"));
+    cut_assert_null(get("key2"));
+}
+
+void
+test_expire (void)
+{
+    cut_assert_true(set("key", "value", 0.1));
+    cut_assert_equal_string("value", get("key"));
+    g_usleep(0.2 * G_USEC_PER_SEC);
+    cut_assert_null(get("key"));
+}
+
+void
+test_evict (void)
+{
+    guint i, n_entries;
+
+    n_entries = milter_manager_shared_cache_get_n_entries(cache);
+    cut_assert_true(set("recently-used", "value", 60));
+    for (i = 0; i < n_entries * 4; i++) {
+        gchar *key;
+
+        cut_assert_equal_string("value", get("recently-used"));
+        key = g_strdup_printf("key%u", i);
+        cut_assert_true(set(key, "value", 60));
+        g_free(key);
+    }
+
+    cut_assert_equal_string("value", get("recently-used"));
+    cut_assert_equal_string("value", get(cut_take_printf("key%u", i - 1)));
+    cut_assert_null(get("key0"));
+}
+
+void
+test_pinned (void)
+{
+    guint i, n_entries, n_pinned = 0;
+
+    n_entries = milter_manager_shared_cache_get_n_entries(cache);
+    cut_assert_true(milter_manager_shared_cache_set_pinned(cache, "pinned",
+                                                           "value", 5, 60));
+    for (i = 0; i < n_entries * 4; i++) {
+        gchar *key;
+
+        key = g_strdup_printf("key%u", i);
+        cut_assert_true(set(key, "value", 60));
+        g_free(key);
+    }
+    cut_assert_equal_string("value", get("pinned"));
+
+    for (i = 0; i < n_entries; i++) {
+        gchar *key;
+
+        key = g_strdup_printf("pinned%u", i);
+        if (milter_manager_shared_cache_set_pinned(cache, key,
+                                                   "value", 5, 60))
+            n_pinned++;
+        g_free(key);
+    }
+    cut_assert_operator_uint(n_pinned, <, n_entries);
+    cut_assert_true(set("not-pinned", "value", 60));
+    cut_assert_equal_string("value", get("not-pinned"));
+}
+
+void
+test_too_large (void)
+{
+    gchar key[MILTER_MANAGER_SHARED_CACHE_MAX_KEY_SIZE + 2];
+    gchar value[MILTER_MANAGER_SHARED_CACHE_MAX_VALUE_SIZE + 1];
+
+    memset(key, 'k', sizeof(key) - 1);
+    key[sizeof(key) - 1] = '\0';
+    cut_assert_false(set(key, "value", 60));
+
+    memset(value, 'v', sizeof(value));
+    cut_assert_false(milter_manager_shared_cache_set(cache, "key",
+                                                     value, sizeof(value),
+                                                     60));
+    cut_assert_true(milter_manager_shared_cache_set(cache, "key",
+                                                    value, sizeof(value) - 1,
+                                                    60));
+}
+
+void
+test_share_with_child_process (void)
+{
+    pid_t pid;
+    gint status;
+
+    cut_assert_true(set("parent", "value", 60));
+
+    pid = fork();
+    if (pid == 0) {
+        gboolean found;
+
+        found = milter_manager_shared_cache_get(cache, "parent", NULL, NULL);
+        set("child", "value", 60);
+        _exit(found ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    cut_assert_operator_int(0, <, pid);
+
+    cut_assert_equal_int(pid, waitpid(pid, &status, 0));
+    cut_assert_true(WIFEXITED(status));
+    cut_assert_equal_int(EXIT_SUCCESS, WEXITSTATUS(status));
+    cut_assert_equal_string("value", get("child"));
+}
+
+void
+test_statistics (void)
+{
+    MilterManagerSharedCacheStatistics statistics;
+
+    set("key", "value", 60);
+    get("key");
+    get("key");
+    get("nonexistent");
+
+    milter_manager_shared_cache_get_statistics(cache, &statistics);
+    cut_assert_equal_uint(2, statistics.n_hits);
+    cut_assert_equal_uint(1, statistics.n_misses);
+    cut_assert_equal_uint(1, statistics.n_stores);
+
+    milter_manager_shared_cache_reset_statistics(cache);
+    milter_manager_shared_cache_get_statistics(cache, &statistics);
+    cut_assert_equal_uint(0, statistics.n_hits);
+    cut_assert_equal_uint(0, statistics.n_misses);
+    cut_assert_equal_uint(0, statistics.n_stores);
+}
+
+void
+test_invalid_size (void)
+{
+    GError *expected_error, *actual_error = NULL;
+
+    cut_assert_null(milter_manager_shared_cache_new(0, &actual_error));
+    actual_error = gcut_take_error(actual_error);
+
+    expected_error = g_error_new(MILTER_MANAGER_SHARED_CACHE_ERROR,
+                                 MILTER_MANAGER_SHARED_CACHE_ERROR_INVALID_SIZE,
+                                 "the number of entries should be "
+                                 "larger than 0");
+    expected_error = gcut_take_error(expected_error);
+    gcut_assert_equal_error(expected_error, actual_error);
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
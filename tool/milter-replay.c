@@ -0,0 +1,857 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ *  Copyright (C) 2013  Kouhei Sutou <kou@clear-code.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "../config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <glib/gi18n.h>
+
+#ifdef HAVE_LOCALE_H
+#  include <locale.h>
+#endif
+
+#include <sys/socket.h>
+
+#include <milter/core.h>
+
+#define MAX_REPLY_LATENCY (G_GUINT64_CONSTANT(3600) * G_USEC_PER_SEC)
+
+static gchar *spec = NULL;
+static gchar *connections_type = NULL;
+static gdouble speed = 1.0;
+static gint target_tag = -1;
+static gboolean verbose = FALSE;
+
+typedef struct _Replayer Replayer;
+typedef struct _ReplayConnection ReplayConnection;
+typedef struct _ReplayCommand ReplayCommand;
+
+struct _ReplayCommand
+{
+    gint64 time;
+    GString *packet;
+    GString *reply_commands;
+};
+
+struct _ReplayConnection
+{
+    Replayer *replayer;
+    guint tag;
+    MilterCaptureDirection command_direction;
+    GPtrArray *commands;
+    GString *command_buffer;
+    GString *reply_buffer;
+    guint next_command;
+    gboolean waiting_reply;
+    GString *reply_commands;
+    gint64 sent_time;
+    MilterReader *reader;
+    MilterWriter *writer;
+    guint timeout_id;
+    gboolean started;
+    gboolean finished;
+};
+
+struct _Replayer
+{
+    MilterEventLoop *loop;
+    GTimer *timer;
+    GHashTable *connections;
+    GPtrArray *replayed_connections;
+    gint64 origin_time;
+    gint64 last_time;
+    guint n_running;
+    guint64 n_finished;
+    guint64 n_diverged;
+    guint64 n_failed;
+    guint64 n_commands;
+    guint64 n_mismatched_replies;
+    MilterHistogram *reply_latency;
+};
+
+static gboolean
+print_version (const gchar *option_name,
+               const gchar *value,
+               gpointer data,
+               GError **error)
+{
+    g_print("%s %s\n", g_get_prgname(), VERSION);
+    exit(EXIT_SUCCESS);
+    return TRUE;
+}
+
+static gboolean
+parse_spec_arg (const gchar *option_name,
+                const gchar *value,
+                gpointer data,
+                GError **error)
+{
+    GError *spec_error = NULL;
+    gchar *normalized_value;
+    gboolean success;
+
+    if (g_str_has_prefix(value, "/"))
+        normalized_value = g_strdup_printf("unix:%s", value);
+    else
+        normalized_value = g_strdup(value);
+
+    success = milter_connection_parse_spec(normalized_value,
+                                           NULL, NULL, NULL,
+                                           &spec_error);
+    if (success) {
+        g_free(spec);
+        spec = normalized_value;
+    } else {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "%s", spec_error->message);
+        g_error_free(spec_error);
+        g_free(normalized_value);
+    }
+
+    return success;
+}
+
+static const GOptionEntry option_entries[] =
+{
+    {"connection-spec", 's', 0, G_OPTION_ARG_CALLBACK, parse_spec_arg,
+     N_("The spec of socket to be replayed to. "
+        "(unix:PATH|inet:PORT[@HOST]|inet6:PORT[@HOST])"),
+     "SPEC"},
+    {"connections", 0, 0, G_OPTION_ARG_STRING, &connections_type,
+     N_("Replay TYPE connections in the trace. "
+        "\"incoming\" replays commands read by the captured process "
+        "such as MTA to milter-manager traffic. "
+        "\"outgoing\" replays commands written by the captured process "
+        "such as milter-manager to child milter traffic. (incoming)"),
+     "[incoming|outgoing]"},
+    {"speed", 0, 0, G_OPTION_ARG_DOUBLE, &speed,
+     N_("Replay SPEED times faster than the original timing. "
+        "0 replays as fast as replies arrive. (1)"),
+     "SPEED"},
+    {"tag", 0, 0, G_OPTION_ARG_INT, &target_tag,
+     N_("Replay only the connection that has TAG. (all)"), "TAG"},
+    {"verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+     N_("Be verbose"), NULL},
+    {"version", 0, G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, print_version,
+     N_("Show version"), NULL},
+    {NULL}
+};
+
+static gint64
+replayer_now (Replayer *replayer)
+{
+    return (gint64)(g_timer_elapsed(replayer->timer, NULL) * G_USEC_PER_SEC);
+}
+
+static ReplayCommand *
+replay_command_new (gint64 time, const gchar *packet, gsize packet_size)
+{
+    ReplayCommand *command;
+
+    command = g_new0(ReplayCommand, 1);
+    command->time = time;
+    command->packet = g_string_new_len(packet, packet_size);
+    command->reply_commands = g_string_new(NULL);
+
+    return command;
+}
+
+static void
+replay_command_free (ReplayCommand *command)
+{
+    g_string_free(command->packet, TRUE);
+    g_string_free(command->reply_commands, TRUE);
+    g_free(command);
+}
+
+static ReplayConnection *
+replay_connection_new (Replayer *replayer,
+                       guint tag,
+                       MilterCaptureDirection command_direction)
+{
+    ReplayConnection *connection;
+
+    connection = g_new0(ReplayConnection, 1);
+    connection->replayer = replayer;
+    connection->tag = tag;
+    connection->command_direction = command_direction;
+    connection->commands = g_ptr_array_new();
+    connection->command_buffer = g_string_new(NULL);
+    connection->reply_buffer = g_string_new(NULL);
+    connection->reply_commands = g_string_new(NULL);
+
+    return connection;
+}
+
+static void
+replay_connection_free (ReplayConnection *connection)
+{
+    g_ptr_array_foreach(connection->commands, (GFunc)replay_command_free, NULL);
+    g_ptr_array_free(connection->commands, TRUE);
+    g_string_free(connection->command_buffer, TRUE);
+    g_string_free(connection->reply_buffer, TRUE);
+    g_string_free(connection->reply_commands, TRUE);
+    if (connection->timeout_id > 0)
+        milter_event_loop_remove(connection->replayer->loop,
+                                 connection->timeout_id);
+    if (connection->reader)
+        g_object_unref(connection->reader);
+    if (connection->writer)
+        g_object_unref(connection->writer);
+    g_free(connection);
+}
+
+/*
+ * Removes the first complete milter packet, 32 bits size
+ * and the content, from @buffer and returns it. NULL is
+ * returned if @buffer doesn't have a complete packet yet.
+ */
+static GString *
+shift_packet (GString *buffer)
+{
+    guint32 size;
+    GString *packet;
+
+    if (buffer->len < sizeof(size))
+        return NULL;
+
+    memcpy(&size, buffer->str, sizeof(size));
+    size = g_ntohl(size);
+    if (buffer->len < sizeof(size) + size)
+        return NULL;
+
+    packet = g_string_new_len(buffer->str, sizeof(size) + size);
+    g_string_erase(buffer, 0, sizeof(size) + size);
+    return packet;
+}
+
+static gchar
+packet_command (GString *packet)
+{
+    if (packet->len > sizeof(guint32))
+        return packet->str[sizeof(guint32)];
+    else
+        return '?';
+}
+
+/*
+ * Progress and message modification replies precede the
+ * final reply that lets the peer send the next command.
+ */
+static gboolean
+is_final_reply (gchar command)
+{
+    switch (command) {
+    case MILTER_COMMAND_NEGOTIATE:
+    case MILTER_REPLY_ACCEPT:
+    case MILTER_REPLY_CONTINUE:
+    case MILTER_REPLY_DISCARD:
+    case MILTER_REPLY_CONNECTION_FAILURE:
+    case MILTER_REPLY_REJECT:
+    case MILTER_REPLY_SKIP:
+    case MILTER_REPLY_SHUTDOWN:
+    case MILTER_REPLY_TEMPORARY_FAILURE:
+    case MILTER_REPLY_REPLY_CODE:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static gboolean
+has_final_reply (GString *reply_commands)
+{
+    gsize i;
+
+    for (i = 0; i < reply_commands->len; i++) {
+        if (is_final_reply(reply_commands->str[i]))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static void
+replay_connection_load (ReplayConnection *connection,
+                        MilterCaptureRecord *record)
+{
+    GString *packet;
+
+    if (record->direction == connection->command_direction) {
+        g_string_append_len(connection->command_buffer,
+                            record->chunk, record->chunk_size);
+        while ((packet = shift_packet(connection->command_buffer))) {
+            g_ptr_array_add(connection->commands,
+                            replay_command_new(record->time,
+                                               packet->str, packet->len));
+            g_string_free(packet, TRUE);
+        }
+    } else {
+        g_string_append_len(connection->reply_buffer,
+                            record->chunk, record->chunk_size);
+        while ((packet = shift_packet(connection->reply_buffer))) {
+            ReplayCommand *command;
+
+            if (connection->commands->len > 0) {
+                command = g_ptr_array_index(connection->commands,
+                                            connection->commands->len - 1);
+                g_string_append_c(command->reply_commands,
+                                  packet_command(packet));
+            }
+            g_string_free(packet, TRUE);
+        }
+    }
+}
+
+static gboolean
+replayer_load (Replayer *replayer, const gchar *path, GError **error)
+{
+    MilterCaptureReader *reader;
+    MilterCaptureRecord record;
+    MilterCaptureDirection command_direction;
+    GError *read_error = NULL;
+    guint i;
+
+    if (g_str_equal(connections_type, "outgoing"))
+        command_direction = MILTER_CAPTURE_DIRECTION_WRITE;
+    else
+        command_direction = MILTER_CAPTURE_DIRECTION_READ;
+
+    reader = milter_capture_reader_open(path, error);
+    if (!reader)
+        return FALSE;
+
+    while (milter_capture_reader_read(reader, &record, &read_error)) {
+        ReplayConnection *connection;
+
+        if (target_tag >= 0 && record.tag != (guint)target_tag)
+            continue;
+        connection = g_hash_table_lookup(replayer->connections,
+                                         GUINT_TO_POINTER(record.tag));
+        if (!connection) {
+            connection = replay_connection_new(replayer,
+                                               record.tag,
+                                               record.direction);
+            g_hash_table_insert(replayer->connections,
+                                GUINT_TO_POINTER(record.tag),
+                                connection);
+        }
+        replay_connection_load(connection, &record);
+    }
+    milter_capture_reader_close(reader);
+    if (read_error) {
+        g_propagate_error(error, read_error);
+        return FALSE;
+    }
+
+    {
+        GHashTableIter iter;
+        gpointer value;
+
+        g_hash_table_iter_init(&iter, replayer->connections);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            ReplayConnection *connection = value;
+
+            if (connection->command_direction != command_direction)
+                continue;
+            if (connection->commands->len == 0)
+                continue;
+            g_ptr_array_add(replayer->replayed_connections, connection);
+        }
+    }
+
+    for (i = 0; i < replayer->replayed_connections->len; i++) {
+        ReplayConnection *connection;
+        ReplayCommand *first_command, *last_command;
+
+        connection = g_ptr_array_index(replayer->replayed_connections, i);
+        g_string_truncate(connection->command_buffer, 0);
+        g_string_truncate(connection->reply_buffer, 0);
+        first_command = g_ptr_array_index(connection->commands, 0);
+        last_command = g_ptr_array_index(connection->commands,
+                                         connection->commands->len - 1);
+        if (i == 0 || first_command->time < replayer->origin_time)
+            replayer->origin_time = first_command->time;
+        if (i == 0 || last_command->time > replayer->last_time)
+            replayer->last_time = last_command->time;
+    }
+
+    return TRUE;
+}
+
+static gint64
+replayer_scheduled_time (Replayer *replayer, gint64 time)
+{
+    if (speed <= 0.0)
+        return 0;
+    return (gint64)((time - replayer->origin_time) / speed);
+}
+
+static void
+replayer_quit_if_done (Replayer *replayer)
+{
+    if (replayer->n_running == 0)
+        milter_event_loop_quit(replayer->loop);
+}
+
+static void
+replay_connection_finish (ReplayConnection *connection)
+{
+    Replayer *replayer = connection->replayer;
+
+    if (connection->finished)
+        return;
+    connection->finished = TRUE;
+
+    if (connection->timeout_id > 0) {
+        milter_event_loop_remove(replayer->loop, connection->timeout_id);
+        connection->timeout_id = 0;
+    }
+
+    if (!connection->started) {
+        replayer->n_failed++;
+    } else if (connection->next_command < connection->commands->len ||
+               connection->waiting_reply) {
+        milter_debug("[%u] [replay][diverged] <%u/%u> waiting: <%s>",
+                     connection->tag,
+                     connection->next_command,
+                     connection->commands->len,
+                     connection->waiting_reply ? "true" : "false");
+        replayer->n_diverged++;
+    } else {
+        replayer->n_finished++;
+    }
+
+    if (connection->writer)
+        milter_writer_shutdown(connection->writer);
+    if (connection->reader)
+        milter_reader_shutdown(connection->reader);
+
+    replayer->n_running--;
+    replayer_quit_if_done(replayer);
+}
+
+static void replay_connection_schedule (ReplayConnection *connection);
+
+static gboolean
+cb_send_timeout (gpointer user_data)
+{
+    ReplayConnection *connection = user_data;
+
+    connection->timeout_id = 0;
+    replay_connection_schedule(connection);
+
+    return FALSE;
+}
+
+static gboolean
+replay_connection_send (ReplayConnection *connection)
+{
+    Replayer *replayer = connection->replayer;
+    ReplayCommand *command;
+    GError *error = NULL;
+
+    command = g_ptr_array_index(connection->commands,
+                                connection->next_command);
+    if (!milter_writer_write(connection->writer,
+                             command->packet->str, command->packet->len,
+                             &error) ||
+        !milter_writer_flush(connection->writer, &error)) {
+        milter_error("[%u] [replay][write][error] %s",
+                     connection->tag, error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    replayer->n_commands++;
+    connection->next_command++;
+    connection->waiting_reply = has_final_reply(command->reply_commands);
+    g_string_truncate(connection->reply_commands, 0);
+    connection->sent_time = replayer_now(replayer);
+
+    return TRUE;
+}
+
+static void
+replay_connection_schedule (ReplayConnection *connection)
+{
+    Replayer *replayer = connection->replayer;
+
+    while (!connection->waiting_reply) {
+        ReplayCommand *command;
+        gint64 delay;
+
+        if (connection->next_command == connection->commands->len) {
+            replay_connection_finish(connection);
+            return;
+        }
+
+        command = g_ptr_array_index(connection->commands,
+                                    connection->next_command);
+        delay = replayer_scheduled_time(replayer, command->time) -
+            replayer_now(replayer);
+        if (delay > 0) {
+            connection->timeout_id =
+                milter_event_loop_add_timeout(replayer->loop,
+                                              (gdouble)delay / G_USEC_PER_SEC,
+                                              cb_send_timeout,
+                                              connection);
+            return;
+        }
+
+        if (!replay_connection_send(connection)) {
+            replay_connection_finish(connection);
+            return;
+        }
+    }
+}
+
+static void
+replay_connection_receive_reply (ReplayConnection *connection,
+                                 GString *packet)
+{
+    Replayer *replayer = connection->replayer;
+    ReplayCommand *command;
+
+    if (!connection->waiting_reply) {
+        milter_debug("[%u] [replay][reply][unexpected] <%c>",
+                     connection->tag, packet_command(packet));
+        replayer->n_mismatched_replies++;
+        return;
+    }
+
+    g_string_append_c(connection->reply_commands, packet_command(packet));
+    if (!is_final_reply(packet_command(packet)))
+        return;
+    connection->waiting_reply = FALSE;
+
+    milter_histogram_record(replayer->reply_latency,
+                            replayer_now(replayer) - connection->sent_time);
+    command = g_ptr_array_index(connection->commands,
+                                connection->next_command - 1);
+    if (!g_str_equal(command->reply_commands->str,
+                     connection->reply_commands->str)) {
+        milter_debug("[%u] [replay][reply][mismatched] <%c>: <%s> -> <%s>",
+                     connection->tag,
+                     packet_command(command->packet),
+                     command->reply_commands->str,
+                     connection->reply_commands->str);
+        replayer->n_mismatched_replies++;
+    }
+    replay_connection_schedule(connection);
+}
+
+static void
+cb_reader_flow (MilterReader *reader,
+                const gchar *data,
+                gsize data_size,
+                gpointer user_data)
+{
+    ReplayConnection *connection = user_data;
+    GString *packet;
+
+    g_string_append_len(connection->reply_buffer, data, data_size);
+    while (!connection->finished &&
+           (packet = shift_packet(connection->reply_buffer))) {
+        replay_connection_receive_reply(connection, packet);
+        g_string_free(packet, TRUE);
+    }
+}
+
+static void
+cb_reader_finished (MilterFinishedEmittable *emittable, gpointer user_data)
+{
+    ReplayConnection *connection = user_data;
+
+    replay_connection_finish(connection);
+}
+
+static void
+cb_error (MilterErrorEmittable *emittable, GError *error, gpointer user_data)
+{
+    ReplayConnection *connection = user_data;
+
+    milter_error("[%u] [replay][error] %s", connection->tag, error->message);
+    replay_connection_finish(connection);
+}
+
+static gboolean
+replay_connection_connect (ReplayConnection *connection, GError **error)
+{
+    Replayer *replayer = connection->replayer;
+    GIOChannel *channel;
+    struct sockaddr *address = NULL;
+    socklen_t address_size = 0;
+    gint domain;
+    gint fd;
+
+    if (!milter_connection_parse_spec(spec, &domain, &address, &address_size,
+                                      error))
+        return FALSE;
+
+    fd = socket(domain, SOCK_STREAM, 0);
+    if (fd == -1) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "failed to socket(): %s", g_strerror(errno));
+        g_free(address);
+        return FALSE;
+    }
+    if (connect(fd, address, address_size) == -1) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "failed to connect to %s: %s", spec, g_strerror(errno));
+        close(fd);
+        g_free(address);
+        return FALSE;
+    }
+    g_free(address);
+
+    channel = g_io_channel_unix_new(fd);
+    g_io_channel_set_close_on_unref(channel, TRUE);
+    g_io_channel_set_encoding(channel, NULL, NULL);
+    g_io_channel_set_flags(channel,
+                           G_IO_FLAG_NONBLOCK |
+                           G_IO_FLAG_IS_READABLE |
+                           G_IO_FLAG_IS_WRITEABLE,
+                           NULL);
+
+    connection->reader = milter_reader_io_channel_new(channel);
+    milter_reader_set_tag(connection->reader, connection->tag);
+    g_signal_connect(connection->reader, "flow",
+                     G_CALLBACK(cb_reader_flow), connection);
+    g_signal_connect(connection->reader, "finished",
+                     G_CALLBACK(cb_reader_finished), connection);
+    g_signal_connect(connection->reader, "error",
+                     G_CALLBACK(cb_error), connection);
+
+    connection->writer = milter_writer_io_channel_new(channel);
+    milter_writer_set_tag(connection->writer, connection->tag);
+    g_signal_connect(connection->writer, "error",
+                     G_CALLBACK(cb_error), connection);
+    g_io_channel_unref(channel);
+
+    milter_reader_start(connection->reader, replayer->loop);
+    milter_writer_start(connection->writer, replayer->loop);
+
+    return TRUE;
+}
+
+static gboolean
+cb_start_connection (gpointer user_data)
+{
+    ReplayConnection *connection = user_data;
+    GError *error = NULL;
+
+    connection->timeout_id = 0;
+    if (!replay_connection_connect(connection, &error)) {
+        milter_error("[%u] [replay][connect][error] %s",
+                     connection->tag, error->message);
+        g_error_free(error);
+        replay_connection_finish(connection);
+        return FALSE;
+    }
+
+    connection->started = TRUE;
+    replay_connection_schedule(connection);
+
+    return FALSE;
+}
+
+static void
+replayer_start (Replayer *replayer)
+{
+    guint i;
+
+    g_timer_start(replayer->timer);
+    for (i = 0; i < replayer->replayed_connections->len; i++) {
+        ReplayConnection *connection;
+        ReplayCommand *first_command;
+        gint64 delay;
+
+        connection = g_ptr_array_index(replayer->replayed_connections, i);
+        first_command = g_ptr_array_index(connection->commands, 0);
+        delay = replayer_scheduled_time(replayer, first_command->time);
+        replayer->n_running++;
+        connection->timeout_id =
+            milter_event_loop_add_timeout(replayer->loop,
+                                          (gdouble)delay / G_USEC_PER_SEC,
+                                          cb_start_connection,
+                                          connection);
+    }
+}
+
+static Replayer *
+replayer_new (void)
+{
+    Replayer *replayer;
+
+    replayer = g_new0(Replayer, 1);
+    replayer->loop = milter_glib_event_loop_new(NULL);
+    replayer->timer = g_timer_new();
+    replayer->connections =
+        g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                              NULL,
+                              (GDestroyNotify)replay_connection_free);
+    replayer->replayed_connections = g_ptr_array_new();
+    replayer->reply_latency = milter_histogram_new(MAX_REPLY_LATENCY);
+
+    return replayer;
+}
+
+static void
+replayer_free (Replayer *replayer)
+{
+    g_ptr_array_free(replayer->replayed_connections, TRUE);
+    g_hash_table_destroy(replayer->connections);
+    milter_histogram_free(replayer->reply_latency);
+    g_timer_destroy(replayer->timer);
+    g_object_unref(replayer->loop);
+    g_free(replayer);
+}
+
+static void
+replayer_print_report (Replayer *replayer)
+{
+    const gdouble percentiles[] = {50.0, 90.0, 99.0, 99.9, 100.0};
+    const gchar *percentile_names[] = {"p50", "p90", "p99", "p99_9", "p100"};
+    MilterHistogram *histogram = replayer->reply_latency;
+    gdouble original_seconds, elapsed_seconds;
+    guint i;
+
+    original_seconds =
+        (gdouble)(replayer->last_time - replayer->origin_time) /
+        G_USEC_PER_SEC;
+    elapsed_seconds = g_timer_elapsed(replayer->timer, NULL);
+
+    g_print("{\n");
+    g_print("  \"config\": {\n");
+    g_print("    \"connections\": \"%s\",\n", connections_type);
+    g_print("    \"speed\": %g\n", speed);
+    g_print("  },\n");
+    g_print("  \"sessions\": {\n");
+    g_print("    \"replayed\": %u,\n", replayer->replayed_connections->len);
+    g_print("    \"finished\": %" G_GUINT64_FORMAT ",\n", replayer->n_finished);
+    g_print("    \"diverged\": %" G_GUINT64_FORMAT ",\n", replayer->n_diverged);
+    g_print("    \"failed\": %" G_GUINT64_FORMAT "\n", replayer->n_failed);
+    g_print("  },\n");
+    g_print("  \"commands\": %" G_GUINT64_FORMAT ",\n", replayer->n_commands);
+    g_print("  \"mismatched_replies\": %" G_GUINT64_FORMAT ",\n",
+            replayer->n_mismatched_replies);
+    g_print("  \"original_seconds\": %.3f,\n", original_seconds);
+    g_print("  \"elapsed_seconds\": %.3f,\n", elapsed_seconds);
+    g_print("  \"reply_latency\": {\n");
+    g_print("    \"unit\": \"usec\",\n");
+    g_print("    \"count\": %" G_GUINT64_FORMAT ",\n",
+            milter_histogram_get_count(histogram));
+    g_print("    \"mean\": %.1f,\n", milter_histogram_get_mean(histogram));
+    for (i = 0; i < G_N_ELEMENTS(percentiles); i++) {
+        g_print("    \"%s\": %" G_GUINT64_FORMAT "%s\n",
+                percentile_names[i],
+                milter_histogram_get_value_at_percentile(histogram,
+                                                         percentiles[i]),
+                i == G_N_ELEMENTS(percentiles) - 1 ? "" : ",");
+    }
+    g_print("  }\n");
+    g_print("}\n");
+}
+
+int
+main (int argc, char *argv[])
+{
+    gboolean success = TRUE;
+    GError *error = NULL;
+    GOptionContext *option_context;
+    Replayer *replayer;
+
+#ifdef HAVE_LOCALE_H
+    setlocale(LC_ALL, "");
+#endif
+
+    option_context = g_option_context_new("TRACE_FILE");
+    g_option_context_add_main_entries(option_context, option_entries, NULL);
+    if (!g_option_context_parse(option_context, &argc, &argv, &error)) {
+        g_print("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(option_context);
+        exit(EXIT_FAILURE);
+    }
+    g_option_context_free(option_context);
+
+    if (argc != 2) {
+        g_print("%s\n", _("TRACE_FILE is missing"));
+        exit(EXIT_FAILURE);
+    }
+    if (!spec) {
+        g_print("%s\n", _("--connection-spec is missing"));
+        exit(EXIT_FAILURE);
+    }
+    if (!connections_type)
+        connections_type = g_strdup("incoming");
+    if (!g_str_equal(connections_type, "incoming") &&
+        !g_str_equal(connections_type, "outgoing")) {
+        g_print(_("Invalid connections type: %s"), connections_type);
+        g_print("\n");
+        exit(EXIT_FAILURE);
+    }
+    if (speed < 0.0) {
+        g_print(_("Speed must be 0 or larger: %g"), speed);
+        g_print("\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (verbose)
+        g_setenv("MILTER_LOG_LEVEL", "all", FALSE);
+    g_unsetenv("MILTER_CAPTURE_PATH");
+    milter_init();
+
+    replayer = replayer_new();
+    if (replayer_load(replayer, argv[1], &error)) {
+        if (replayer->replayed_connections->len > 0) {
+            replayer_start(replayer);
+            milter_event_loop_run(replayer->loop);
+        }
+        replayer_print_report(replayer);
+        success = (replayer->n_failed == 0);
+    } else {
+        g_print("%s\n", error->message);
+        g_error_free(error);
+        success = FALSE;
+    }
+    replayer_free(replayer);
+
+    g_free(spec);
+    g_free(connections_type);
+
+    milter_quit();
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab:sw=4
+*/
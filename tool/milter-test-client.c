@@ -22,6 +22,8 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -32,10 +34,84 @@
 #endif
 
 #include <milter/client.h>
+#include <milter/core/milter-glib-compatible.h>
+
+#define DELAYED_REPLY_KEY "milter-test-client-delayed-reply"
+
+typedef enum
+{
+    STAGE_CONNECT,
+    STAGE_HELO,
+    STAGE_ENVELOPE_FROM,
+    STAGE_ENVELOPE_RECIPIENT,
+    STAGE_DATA,
+    STAGE_UNKNOWN,
+    STAGE_HEADER,
+    STAGE_END_OF_HEADER,
+    STAGE_BODY,
+    STAGE_END_OF_MESSAGE,
+    N_STAGES
+} Stage;
+
+static const gchar *stage_names[N_STAGES] = {
+    "connect",
+    "helo",
+    "envelope-from",
+    "envelope-recipient",
+    "data",
+    "unknown",
+    "header",
+    "end-of-header",
+    "body",
+    "end-of-message"
+};
+
+typedef enum
+{
+    DISTRIBUTION_NONE,
+    DISTRIBUTION_FIXED,
+    DISTRIBUTION_UNIFORM,
+    DISTRIBUTION_LOGNORMAL
+} DistributionType;
+
+typedef struct _Distribution
+{
+    DistributionType type;
+    gdouble parameter1;
+    gdouble parameter2;
+} Distribution;
+
+typedef struct _Verdict
+{
+    MilterStatus status;
+    gdouble weight;
+} Verdict;
+
+typedef struct _DelayedReply
+{
+    MilterClientContext *context;
+    MilterEventLoop *loop;
+    Stage stage;
+    MilterStatus status;
+    gboolean disconnect;
+    guint id;
+} DelayedReply;
 
 static gboolean report_request = TRUE;
 static gboolean report_memory_profile = FALSE;
+static gboolean multi_thread_mode = FALSE;
+static gint n_threads = 0;
 static MilterClient *client = NULL;
+static Distribution latencies[N_STAGES];
+static GArray *verdicts = NULL;
+static gdouble add_header_rate = 0.0;
+static gdouble change_header_rate = 0.0;
+static gdouble replace_body_rate = 0.0;
+static gdouble timeout_rate = 0.0;
+static gdouble disconnect_rate = 0.0;
+static gint seed = 0;
+static GRand *random_generator = NULL;
+static GMutex *random_mutex = NULL;
 
 static gboolean
 print_version (const gchar *option_name,
@@ -48,6 +124,148 @@ print_version (const gchar *option_name,
     return TRUE;
 }
 
+static gboolean
+parse_distribution (const gchar *value, Distribution *distribution)
+{
+    gchar **items;
+    guint n_items;
+    gboolean success = TRUE;
+
+    items = g_strsplit(value, ":", -1);
+    n_items = g_strv_length(items);
+    if (n_items >= 2) {
+        distribution->parameter1 = g_ascii_strtod(items[1], NULL);
+        if (n_items >= 3)
+            distribution->parameter2 = g_ascii_strtod(items[2], NULL);
+    }
+
+    if (n_items == 2 && g_str_equal(items[0], "fixed")) {
+        distribution->type = DISTRIBUTION_FIXED;
+    } else if (n_items == 3 && g_str_equal(items[0], "uniform")) {
+        distribution->type = DISTRIBUTION_UNIFORM;
+        if (distribution->parameter2 < distribution->parameter1)
+            success = FALSE;
+    } else if (n_items == 3 && g_str_equal(items[0], "lognormal")) {
+        distribution->type = DISTRIBUTION_LOGNORMAL;
+    } else {
+        success = FALSE;
+    }
+    if (distribution->parameter1 < 0.0 || distribution->parameter2 < 0.0)
+        success = FALSE;
+    g_strfreev(items);
+
+    return success;
+}
+
+static gboolean
+parse_latency_arg (const gchar *option_name,
+                   const gchar *value,
+                   gpointer data,
+                   GError **error)
+{
+    const gchar *distribution_value;
+    gchar *stage_name;
+    Distribution distribution;
+    gint i;
+
+    distribution_value = strchr(value, ':');
+    if (!distribution_value) {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    _("latency must be STAGE:DISTRIBUTION: <%s>"), value);
+        return FALSE;
+    }
+
+    memset(&distribution, 0, sizeof(distribution));
+    if (!parse_distribution(distribution_value + 1, &distribution)) {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    _("invalid latency distribution: <%s>"), value);
+        return FALSE;
+    }
+
+    stage_name = g_strndup(value, distribution_value - value);
+    if (g_str_equal(stage_name, "all")) {
+        for (i = 0; i < N_STAGES; i++) {
+            latencies[i] = distribution;
+        }
+        g_free(stage_name);
+        return TRUE;
+    }
+    for (i = 0; i < N_STAGES; i++) {
+        if (g_str_equal(stage_name, stage_names[i])) {
+            latencies[i] = distribution;
+            g_free(stage_name);
+            return TRUE;
+        }
+    }
+
+    g_set_error(error,
+                G_OPTION_ERROR,
+                G_OPTION_ERROR_BAD_VALUE,
+                _("unknown latency stage: <%s>"), stage_name);
+    g_free(stage_name);
+    return FALSE;
+}
+
+static gboolean
+parse_verdicts_arg (const gchar *option_name,
+                    const gchar *value,
+                    gpointer data,
+                    GError **error)
+{
+    GEnumClass *status_class;
+    gchar **items;
+    gint i;
+
+    if (!verdicts)
+        verdicts = g_array_new(FALSE, FALSE, sizeof(Verdict));
+    g_array_set_size(verdicts, 0);
+
+    status_class = g_type_class_ref(MILTER_TYPE_STATUS);
+    items = g_strsplit(value, ",", -1);
+    for (i = 0; items[i]; i++) {
+        GEnumValue *status_value;
+        Verdict verdict;
+        gchar *weight;
+
+        weight = strchr(items[i], ':');
+        if (weight) {
+            *weight = '\0';
+            weight++;
+        }
+        status_value = g_enum_get_value_by_nick(status_class, items[i]);
+        if (!status_value)
+            break;
+        verdict.status = status_value->value;
+        if (verdict.status != MILTER_STATUS_CONTINUE &&
+            verdict.status != MILTER_STATUS_ACCEPT &&
+            verdict.status != MILTER_STATUS_REJECT &&
+            verdict.status != MILTER_STATUS_TEMPORARY_FAILURE &&
+            verdict.status != MILTER_STATUS_DISCARD)
+            break;
+        verdict.weight = weight ? g_ascii_strtod(weight, NULL) : 1.0;
+        if (verdict.weight <= 0.0)
+            break;
+        g_array_append_val(verdicts, verdict);
+    }
+    g_type_class_unref(status_class);
+
+    if (items[i] || i == 0) {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    _("invalid verdicts: <%s>"), value);
+        g_strfreev(items);
+        return FALSE;
+    }
+    g_strfreev(items);
+
+    return TRUE;
+}
+
 static const GOptionEntry option_entries[] =
 {
     {"no-report-request", 0, G_OPTION_FLAG_REVERSE,
@@ -56,6 +274,37 @@ static const GOptionEntry option_entries[] =
     {"report-memory-profile", 0, 0, G_OPTION_ARG_NONE, &report_memory_profile,
      N_("Report memory profile. "
         "Need to set MILTER_MEMORY_PROFILE=yes environment variable."), NULL},
+    {"multi-thread", 0, 0, G_OPTION_ARG_NONE, &multi_thread_mode,
+     N_("Process sessions by event loop threads"), NULL},
+    {"n-threads", 0, 0, G_OPTION_ARG_INT, &n_threads,
+     N_("Use N_THREADS event loop threads in multi-thread mode. "
+        "0 means the number of processors. (0)"), "N_THREADS"},
+    {"latency", 0, 0, G_OPTION_ARG_CALLBACK, parse_latency_arg,
+     N_("Delay replies on STAGE by milliseconds chosen from DISTRIBUTION. "
+        "STAGE is a command name such as envelope-from or all. "
+        "DISTRIBUTION is fixed:MSEC, uniform:MIN_MSEC:MAX_MSEC or "
+        "lognormal:MEDIAN_MSEC:SIGMA. "
+        "To set N stages, use --latency option N times."),
+     "STAGE:DISTRIBUTION"},
+    {"verdicts", 0, 0, G_OPTION_ARG_CALLBACK, parse_verdicts_arg,
+     N_("Reply STATUS on end-of-message in proportion to WEIGHT. "
+        "STATUS is continue, accept, reject, temporary-failure or discard. "
+        "(continue)"),
+     "STATUS[:WEIGHT],..."},
+    {"add-header-rate", 0, 0, G_OPTION_ARG_DOUBLE, &add_header_rate,
+     N_("Add a header to RATE of messages. (0.0)"), "RATE"},
+    {"change-header-rate", 0, 0, G_OPTION_ARG_DOUBLE, &change_header_rate,
+     N_("Change Subject header of RATE of messages. (0.0)"), "RATE"},
+    {"replace-body-rate", 0, 0, G_OPTION_ARG_DOUBLE, &replace_body_rate,
+     N_("Replace body of RATE of messages. (0.0)"), "RATE"},
+    {"timeout-rate", 0, 0, G_OPTION_ARG_DOUBLE, &timeout_rate,
+     N_("Never reply on end-of-message to RATE of messages. (0.0)"), "RATE"},
+    {"disconnect-rate", 0, 0, G_OPTION_ARG_DOUBLE, &disconnect_rate,
+     N_("Disconnect on end-of-message of RATE of messages. (0.0)"), "RATE"},
+    {"seed", 0, 0, G_OPTION_ARG_INT, &seed,
+     N_("Use SEED as the random seed. "
+        "Each worker process uses SEED + its process ID. (random)"),
+     "SEED"},
     {"version", 0, G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, print_version,
      N_("Show version"), NULL},
     {NULL}
@@ -83,6 +332,191 @@ print_macros (MilterClientContext *context)
     g_hash_table_foreach(macros, print_macro, NULL);
 }
 
+static gdouble
+random_double (void)
+{
+    gdouble value;
+
+    g_mutex_lock(random_mutex);
+    value = g_rand_double(random_generator);
+    g_mutex_unlock(random_mutex);
+
+    return value;
+}
+
+static gdouble
+sample_latency (Stage stage)
+{
+    Distribution *distribution = &(latencies[stage]);
+    gdouble u1, u2;
+
+    switch (distribution->type) {
+    case DISTRIBUTION_FIXED:
+        return distribution->parameter1;
+    case DISTRIBUTION_UNIFORM:
+        return distribution->parameter1 +
+            random_double() *
+            (distribution->parameter2 - distribution->parameter1);
+    case DISTRIBUTION_LOGNORMAL:
+        u1 = 1.0 - random_double();
+        u2 = random_double();
+        return distribution->parameter1 *
+            exp(distribution->parameter2 *
+                sqrt(-2.0 * log(u1)) * cos(2.0 * G_PI * u2));
+    default:
+        return 0.0;
+    }
+}
+
+static MilterStatus
+choose_verdict (void)
+{
+    gdouble total_weight = 0.0, point;
+    guint i;
+
+    if (!verdicts)
+        return MILTER_STATUS_CONTINUE;
+
+    for (i = 0; i < verdicts->len; i++) {
+        total_weight += g_array_index(verdicts, Verdict, i).weight;
+    }
+    point = random_double() * total_weight;
+    for (i = 0; i < verdicts->len - 1; i++) {
+        point -= g_array_index(verdicts, Verdict, i).weight;
+        if (point < 0.0)
+            break;
+    }
+
+    return g_array_index(verdicts, Verdict, i).status;
+}
+
+static void
+modify_message (MilterClientContext *context, MilterStatus status)
+{
+    if (status != MILTER_STATUS_CONTINUE && status != MILTER_STATUS_ACCEPT)
+        return;
+
+    if (add_header_rate > 0.0 && random_double() < add_header_rate)
+        milter_client_context_add_header(context,
+                                         "X-Test-Client", "synthetic");
+    if (change_header_rate > 0.0 && random_double() < change_header_rate)
+        milter_client_context_change_header(context,
+                                            "Subject", 1,
+                                            "[synthetic] changed");
+    if (replace_body_rate > 0.0 && random_double() < replace_body_rate) {
+        const gchar body[] = "Replaced by milter-test-client.\n";
+
+        milter_client_context_replace_body(context, body, sizeof(body) - 1);
+    }
+}
+
+static void
+delayed_reply_free (gpointer data)
+{
+    DelayedReply *reply = data;
+
+    if (reply->id > 0)
+        milter_event_loop_remove(reply->loop, reply->id);
+    g_object_unref(reply->loop);
+    g_free(reply);
+}
+
+static gboolean
+cb_delayed_reply (gpointer user_data)
+{
+    DelayedReply *reply = user_data;
+    MilterClientContext *context = reply->context;
+
+    reply->id = 0;
+    g_object_ref(context);
+    g_object_steal_data(G_OBJECT(context), DELAYED_REPLY_KEY);
+    if (reply->disconnect) {
+        milter_agent_shutdown(MILTER_AGENT(context));
+    } else {
+        gchar *signal_name;
+
+        if (reply->stage == STAGE_END_OF_MESSAGE)
+            modify_message(context, reply->status);
+        signal_name = g_strconcat(stage_names[reply->stage], "-response",
+                                  NULL);
+        g_signal_emit_by_name(context, signal_name, reply->status);
+        g_free(signal_name);
+    }
+    delayed_reply_free(reply);
+    g_object_unref(context);
+
+    return FALSE;
+}
+
+static void
+delay_reply (MilterClientContext *context, Stage stage,
+             MilterStatus status, gboolean disconnect, gdouble delay_in_msec)
+{
+    DelayedReply *reply;
+
+    reply = g_new0(DelayedReply, 1);
+    reply->context = context;
+    reply->loop = milter_agent_get_event_loop(MILTER_AGENT(context));
+    g_object_ref(reply->loop);
+    reply->stage = stage;
+    reply->status = status;
+    reply->disconnect = disconnect;
+    reply->id = milter_event_loop_add_timeout(reply->loop,
+                                              delay_in_msec / 1000.0,
+                                              cb_delayed_reply,
+                                              reply);
+    g_object_set_data_full(G_OBJECT(context), DELAYED_REPLY_KEY,
+                           reply, delayed_reply_free);
+}
+
+static void
+cancel_delayed_reply (MilterClientContext *context)
+{
+    g_object_set_data(G_OBJECT(context), DELAYED_REPLY_KEY, NULL);
+}
+
+static MilterStatus
+reply (MilterClientContext *context, Stage stage)
+{
+    gdouble delay;
+
+    delay = sample_latency(stage);
+    if (delay <= 0.0)
+        return MILTER_STATUS_CONTINUE;
+
+    delay_reply(context, stage, MILTER_STATUS_CONTINUE, FALSE, delay);
+    return MILTER_STATUS_PROGRESS;
+}
+
+static MilterStatus
+reply_end_of_message (MilterClientContext *context)
+{
+    MilterStatus status;
+    gdouble point, delay;
+
+    if (timeout_rate > 0.0 || disconnect_rate > 0.0) {
+        point = random_double();
+        if (point < timeout_rate)
+            return MILTER_STATUS_PROGRESS;
+        if (point < timeout_rate + disconnect_rate) {
+            delay_reply(context, STAGE_END_OF_MESSAGE,
+                        MILTER_STATUS_DEFAULT, TRUE,
+                        sample_latency(STAGE_END_OF_MESSAGE));
+            return MILTER_STATUS_PROGRESS;
+        }
+    }
+
+    status = choose_verdict();
+    delay = sample_latency(STAGE_END_OF_MESSAGE);
+    if (delay <= 0.0) {
+        modify_message(context, status);
+        return status;
+    }
+
+    delay_reply(context, STAGE_END_OF_MESSAGE, status, FALSE, delay);
+    return MILTER_STATUS_PROGRESS;
+}
+
 static MilterStatus
 cb_negotiate (MilterClientContext *context, MilterOption *option,
               gpointer user_data)
@@ -130,7 +564,7 @@ cb_connect (MilterClientContext *context, const gchar *host_name,
         print_macros(context);
     }
 
-    return MILTER_STATUS_CONTINUE;
+    return reply(context, STAGE_CONNECT);
 }
 
 static MilterStatus
@@ -142,7 +576,7 @@ cb_helo (MilterClientContext *context, const gchar *fqdn, gpointer user_data)
         print_macros(context);
     }
 
-    return MILTER_STATUS_CONTINUE;
+    return reply(context, STAGE_HELO);
 }
 
 static MilterStatus
@@ -155,7 +589,7 @@ cb_envelope_from (MilterClientContext *context, const gchar *from,
         print_macros(context);
     }
 
-    return MILTER_STATUS_CONTINUE;
+    return reply(context, STAGE_ENVELOPE_FROM);
 }
 
 static MilterStatus
@@ -168,7 +602,7 @@ cb_envelope_recipient (MilterClientContext *context, const gchar *to,
         print_macros(context);
     }
 
-    return MILTER_STATUS_CONTINUE;
+    return reply(context, STAGE_ENVELOPE_RECIPIENT);
 }
 
 static MilterStatus
@@ -180,7 +614,7 @@ cb_data (MilterClientContext *context, gpointer user_data)
         print_macros(context);
     }
 
-    return MILTER_STATUS_CONTINUE;
+    return reply(context, STAGE_DATA);
 }
 
 static MilterStatus
@@ -193,7 +627,7 @@ cb_header (MilterClientContext *context, const gchar *name, const gchar *value,
         print_macros(context);
     }
 
-    return MILTER_STATUS_CONTINUE;
+    return reply(context, STAGE_HEADER);
 }
 
 static MilterStatus
@@ -205,7 +639,7 @@ cb_end_of_header (MilterClientContext *context, gpointer user_data)
         print_macros(context);
     }
 
-    return MILTER_STATUS_CONTINUE;
+    return reply(context, STAGE_END_OF_HEADER);
 }
 
 static MilterStatus
@@ -218,7 +652,7 @@ cb_body (MilterClientContext *context, const gchar *chunk, gsize length,
         print_macros(context);
     }
 
-    return MILTER_STATUS_CONTINUE;
+    return reply(context, STAGE_BODY);
 }
 
 static MilterStatus
@@ -236,7 +670,7 @@ cb_end_of_message (MilterClientContext *context,
         print_macros(context);
     }
 
-    return MILTER_STATUS_CONTINUE;
+    return reply_end_of_message(context);
 }
 
 static MilterStatus
@@ -249,6 +683,7 @@ cb_abort (MilterClientContext *context, MilterClientContextState state,
         print_macros(context);
     }
 
+    cancel_delayed_reply(context);
     return MILTER_STATUS_CONTINUE;
 }
 
@@ -262,7 +697,7 @@ cb_unknown (MilterClientContext *context, const gchar *command,
         print_macros(context);
     }
 
-    return MILTER_STATUS_CONTINUE;
+    return reply(context, STAGE_UNKNOWN);
 }
 
 static void
@@ -271,6 +706,8 @@ cb_finished (MilterFinishedEmittable *emittable)
     if (report_request) {
         g_print("finished\n");
     }
+
+    cancel_delayed_reply(MILTER_CLIENT_CONTEXT(emittable));
 }
 
 static void
@@ -371,6 +808,14 @@ cb_maintain (MilterClient *client, gpointer user_data)
     g_string_free(report, TRUE);
 }
 
+static void
+cb_worker_created (MilterClient *client, gpointer user_data)
+{
+    g_mutex_lock(random_mutex);
+    g_rand_set_seed(random_generator, seed + getpid());
+    g_mutex_unlock(random_mutex);
+}
+
 static void
 setup_client_signals (MilterClient *client)
 {
@@ -379,6 +824,7 @@ setup_client_signals (MilterClient *client)
 
     CONNECT(connection_established);
     CONNECT(error);
+    CONNECT(worker_created);
 
     if (report_memory_profile)
         CONNECT(maintain);
@@ -425,6 +871,26 @@ main (int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    if (add_header_rate < 0.0 || add_header_rate > 1.0 ||
+        change_header_rate < 0.0 || change_header_rate > 1.0 ||
+        replace_body_rate < 0.0 || replace_body_rate > 1.0 ||
+        timeout_rate < 0.0 || disconnect_rate < 0.0 ||
+        timeout_rate + disconnect_rate > 1.0) {
+        g_print("%s\n", _("rates must be between 0.0 and 1.0"));
+        g_option_context_free(option_context);
+        g_object_unref(client);
+        exit(EXIT_FAILURE);
+    }
+
+    if (seed == 0)
+        seed = g_random_int();
+    random_generator = g_rand_new_with_seed(seed);
+    random_mutex = g_mutex_new();
+
+    milter_client_set_multi_thread_mode(client, multi_thread_mode);
+    if (n_threads > 0)
+        milter_client_set_n_threads(client, n_threads);
+
     if (success)
         success = milter_client_listen(client, &error);
     if (success)
@@ -451,6 +917,11 @@ main (int argc, char *argv[])
 
     g_option_context_free(option_context);
 
+    g_rand_free(random_generator);
+    g_mutex_free(random_mutex);
+    if (verdicts)
+        g_array_free(verdicts, TRUE);
+
     milter_client_quit();
     milter_quit();
 
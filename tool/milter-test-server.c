@@ -23,6 +23,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <unistd.h>
 #include <glib/gstdio.h>
 #include <glib/gi18n.h>
@@ -75,6 +76,13 @@ static gdouble writing_timeout = MILTER_SERVER_CONTEXT_DEFAULT_WRITING_TIMEOUT;
 static gdouble reading_timeout = MILTER_SERVER_CONTEXT_DEFAULT_READING_TIMEOUT;
 static gdouble end_of_message_timeout = MILTER_SERVER_CONTEXT_DEFAULT_END_OF_MESSAGE_TIMEOUT;
 static gdouble all_timeouts = MILTER_TEST_SERVER_ALL_TIMEOUTS_UNSPECIFIED;
+static gdouble load_rate = 0.0;
+static gdouble load_duration = 10.0;
+static gdouble load_warmup = 0.0;
+static gint load_max_concurrency = 100;
+static GArray *load_message_sizes = NULL;
+static GArray *load_recipient_counts = NULL;
+static gint load_seed = 0;
 
 #define MILTER_TEST_SERVER_ERROR                                \
     (g_quark_from_static_string("milter-test-server-error-quark"))
@@ -98,6 +106,8 @@ typedef struct _Message
     GString *replaced_body_string;
 } Message;
 
+typedef struct _LoadGenerator LoadGenerator;
+
 typedef struct _ProcessData
 {
     MilterEventLoop *loop;
@@ -112,10 +122,29 @@ typedef struct _ProcessData
     gint current_recipient;
     gchar **body_chunks;
     gint current_body_chunk;
+    gchar **recipients;
     Message *message;
     GError *error;
+    MilterServerContext *context;
+    LoadGenerator *load;
+    gint64 intended_start_time;
+    gint64 start_time;
+    MilterServerContextState stage;
+    gint64 stage_start_time;
+    gboolean load_finished;
 } ProcessData;
 
+typedef struct _LoadMixEntry
+{
+    guint64 value;
+    gdouble weight;
+} LoadMixEntry;
+
+static void load_start_stage    (ProcessData *data,
+                                 MilterServerContextState state);
+static void load_record_stage   (ProcessData *data);
+static void load_finish_session (ProcessData *data);
+
 #define RED_COLOR "\033[01;31m"
 #define RED_BACK_COLOR "\033[41m"
 #define GREEN_COLOR "\033[01;32m"
@@ -311,7 +340,7 @@ send_envelope_recipient (MilterServerContext *context, ProcessData *data)
 {
     gchar *recipient;
 
-    recipient = recipients[data->current_recipient];
+    recipient = data->recipients[data->current_recipient];
     if (!recipient)
         return FALSE;
 
@@ -413,6 +442,8 @@ cb_continue (MilterServerContext *context, gpointer user_data)
 {
     ProcessData *data = user_data;
 
+    load_record_stage(data);
+
     switch (milter_server_context_get_state(context)) {
     case MILTER_SERVER_CONTEXT_STATE_NEGOTIATE:
         if (send_connect(context, data))
@@ -466,6 +497,7 @@ cb_negotiate_reply (MilterServerContext *context, MilterOption *option,
 {
     ProcessData *data = user_data;
 
+    load_record_stage(data);
     if (data->option) {
         milter_error("duplicated negotiate");
         send_abort(context, data);
@@ -484,12 +516,13 @@ cb_temporary_failure (MilterServerContext *context, gpointer user_data)
     ProcessData *data = user_data;
     MilterServerContextState state;
 
+    load_record_stage(data);
     state = milter_server_context_get_state(context);
 
     switch (state) {
     case MILTER_SERVER_CONTEXT_STATE_ENVELOPE_RECIPIENT:
         remove_recipient(&(data->message->recipients),
-                         *(recipients + data->current_recipient - 1));
+                         *(data->recipients + data->current_recipient - 1));
         if (data->message->recipients) {
             cb_continue(context, user_data);
             break;
@@ -507,12 +540,13 @@ cb_reject (MilterServerContext *context, gpointer user_data)
     ProcessData *data = user_data;
     MilterServerContextState state;
 
+    load_record_stage(data);
     state = milter_server_context_get_state(context);
 
     switch (state) {
     case MILTER_SERVER_CONTEXT_STATE_ENVELOPE_RECIPIENT:
         remove_recipient(&(data->message->recipients),
-                         *(recipients + data->current_recipient - 1));
+                         *(data->recipients + data->current_recipient - 1));
         if (data->message->recipients) {
             cb_continue(context, user_data);
             break;
@@ -533,6 +567,7 @@ cb_reply_code (MilterServerContext *context,
 {
     ProcessData *data = user_data;
 
+    load_record_stage(data);
     data->reply_code = code;
     if (data->reply_extended_code)
         g_free(data->reply_extended_code);
@@ -552,6 +587,7 @@ cb_accept (MilterServerContext *context, gpointer user_data)
 {
     ProcessData *data = user_data;
 
+    load_record_stage(data);
     send_abort(context, data);
     data->success = TRUE;
 }
@@ -561,6 +597,7 @@ cb_discard (MilterServerContext *context, gpointer user_data)
 {
     ProcessData *data = user_data;
 
+    load_record_stage(data);
     send_abort(context, data);
     data->success = FALSE;
 }
@@ -696,6 +733,8 @@ static void
 cb_skip (MilterServerContext *context, gpointer user_data)
 {
     ProcessData *data = user_data;
+
+    load_record_stage(data);
     while (data->body_chunks[data->current_body_chunk])
         data->current_body_chunk++;
 
@@ -718,7 +757,10 @@ cb_finished (MilterFinishedEmittable *emittable, gpointer user_data)
     ProcessData *data = user_data;
 
     g_timer_stop(data->timer);
-    milter_event_loop_quit(data->loop);
+    if (data->load)
+        load_finish_session(data);
+    else
+        milter_event_loop_quit(data->loop);
 }
 
 static void
@@ -775,6 +817,7 @@ cb_state_transited (MilterServerContext *context,
     ProcessData *data = user_data;
     MilterStepFlags step = MILTER_STEP_NONE;
 
+    load_start_stage(data, state);
     if (data->option)
         step = milter_option_get_step(data->option);
 
@@ -932,7 +975,10 @@ cb_connection_error (MilterErrorEmittable *emittable, GError *error, gpointer us
 
     data->success = FALSE;
     data->error = g_error_copy(error);
-    milter_event_loop_quit(data->loop);
+    if (data->load)
+        load_finish_session(data);
+    else
+        milter_event_loop_quit(data->loop);
 }
 
 static gboolean
@@ -1506,6 +1552,101 @@ parse_color_arg (const gchar *option_name, const gchar *value,
     return TRUE;
 }
 
+static gboolean
+parse_load_mix_arg (const gchar *option_name,
+                    const gchar *value,
+                    gboolean size_unit_available,
+                    GArray **entries,
+                    GError **error)
+{
+    gchar **items;
+    gint i;
+
+    if (!*entries)
+        *entries = g_array_new(FALSE, FALSE, sizeof(LoadMixEntry));
+    g_array_set_size(*entries, 0);
+
+    items = g_strsplit(value, ",", -1);
+    for (i = 0; items[i]; i++) {
+        LoadMixEntry entry;
+        gchar *end;
+
+        entry.value = g_ascii_strtoull(items[i], &end, 10);
+        if (end == items[i])
+            break;
+        if (size_unit_available) {
+            if (*end == 'K' || *end == 'k') {
+                entry.value *= 1024;
+                end++;
+            } else if (*end == 'M' || *end == 'm') {
+                entry.value *= 1024 * 1024;
+                end++;
+            }
+        }
+        entry.weight = 1.0;
+        if (*end == ':') {
+            gchar *weight = end + 1;
+
+            entry.weight = g_ascii_strtod(weight, &end);
+            if (end == weight || entry.weight <= 0.0)
+                break;
+        }
+        if (*end != '\0')
+            break;
+        g_array_append_val(*entries, entry);
+    }
+
+    if (items[i] || i == 0) {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    _("Invalid %s value: %s"), option_name, value);
+        g_strfreev(items);
+        return FALSE;
+    }
+    g_strfreev(items);
+
+    return TRUE;
+}
+
+static gboolean
+parse_message_sizes_arg (const gchar *option_name,
+                         const gchar *value,
+                         gpointer data,
+                         GError **error)
+{
+    return parse_load_mix_arg(option_name, value, TRUE,
+                              &load_message_sizes, error);
+}
+
+static gboolean
+parse_recipient_counts_arg (const gchar *option_name,
+                            const gchar *value,
+                            gpointer data,
+                            GError **error)
+{
+    guint i;
+
+    if (!parse_load_mix_arg(option_name, value, FALSE,
+                            &load_recipient_counts, error))
+        return FALSE;
+
+    for (i = 0; i < load_recipient_counts->len; i++) {
+        LoadMixEntry *entry;
+
+        entry = &g_array_index(load_recipient_counts, LoadMixEntry, i);
+        if (entry->value == 0) {
+            g_set_error(error,
+                        G_OPTION_ERROR,
+                        G_OPTION_ERROR_BAD_VALUE,
+                        _("%s must be 1 or larger: %s"), option_name, value);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
 static const GOptionEntry option_entries[] =
 {
     {"name", 0, 0, G_OPTION_ARG_CALLBACK, set_name,
@@ -1611,6 +1752,31 @@ static const GOptionEntry option_entries[] =
      "SECONDS"},
     {"threads", 't', 0, G_OPTION_ARG_INT, &n_threads,
      N_("Create N threads."), "N"},
+    {"rate", 0, 0, G_OPTION_ARG_DOUBLE, &load_rate,
+     N_("Generate open-loop load: start RATE sessions per second "
+        "on average with Poisson arrivals "
+        "and report latency percentiles as JSON."),
+     "RATE"},
+    {"duration", 0, 0, G_OPTION_ARG_DOUBLE, &load_duration,
+     N_("Generate load for SECONDS seconds after warmup. (10)"), "SECONDS"},
+    {"warmup", 0, 0, G_OPTION_ARG_DOUBLE, &load_warmup,
+     N_("Don't measure sessions started in the first SECONDS seconds. (0)"),
+     "SECONDS"},
+    {"max-concurrency", 0, 0, G_OPTION_ARG_INT, &load_max_concurrency,
+     N_("Run at most N sessions concurrently. "
+        "Late sessions wait for their turn "
+        "but their latencies are measured from their scheduled time. (100)"),
+     "N"},
+    {"message-sizes", 0, 0, G_OPTION_ARG_CALLBACK, parse_message_sizes_arg,
+     N_("Choose a body size from SIZE list by WEIGHT for each session."),
+     "SIZE[K|M][:WEIGHT],..."},
+    {"recipient-counts", 0, 0, G_OPTION_ARG_CALLBACK,
+     parse_recipient_counts_arg,
+     N_("Choose the number of recipients from N list by WEIGHT "
+        "for each session."),
+     "N[:WEIGHT],..."},
+    {"seed", 0, 0, G_OPTION_ARG_INT, &load_seed,
+     N_("Use SEED as the random seed of load generation. (random)"), "SEED"},
     {"verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
      N_("Be verbose"), NULL},
     {"version", 0, G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, print_version,
@@ -1672,9 +1838,12 @@ free_message (Message *message)
 }
 
 static void
-init_process_data (ProcessData *data)
+init_process_data (ProcessData *data, MilterEventLoop *loop)
 {
-    data->loop = milter_glib_event_loop_new(NULL);
+    if (loop)
+        data->loop = g_object_ref(loop);
+    else
+        data->loop = milter_glib_event_loop_new(NULL);
     data->timer = g_timer_new();
     data->success = TRUE;
     data->quarantine_reason = NULL;
@@ -1683,11 +1852,19 @@ init_process_data (ProcessData *data)
     data->body_chunks = g_strdupv(body_chunks);
     data->current_body_chunk = 0;
     data->current_recipient = 0;
+    data->recipients = g_strdupv(recipients);
     data->reply_code = 0;
     data->reply_extended_code = NULL;
     data->reply_message = NULL;
     data->message = message_new();
     data->error = NULL;
+    data->context = NULL;
+    data->load = NULL;
+    data->intended_start_time = 0;
+    data->start_time = 0;
+    data->stage = MILTER_SERVER_CONTEXT_STATE_INVALID;
+    data->stage_start_time = 0;
+    data->load_finished = FALSE;
 }
 
 static void
@@ -1703,6 +1880,8 @@ free_process_data (ProcessData *data)
         g_object_unref(data->option_headers);
     if (data->body_chunks)
         g_strfreev(data->body_chunks);
+    if (data->recipients)
+        g_strfreev(data->recipients);
     if (data->reply_extended_code)
         g_free(data->reply_extended_code);
     if (data->reply_message)
@@ -1888,6 +2067,39 @@ post_option_parse (GOptionContext *option_context,
 
     apply_options_to_macros();
 
+    if (load_rate < 0.0) {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    _("--rate must not be negative: %g"), load_rate);
+        return FALSE;
+    }
+    if (load_rate > 0.0) {
+        if (n_threads > 0) {
+            g_set_error(error,
+                        G_OPTION_ERROR,
+                        G_OPTION_ERROR_BAD_VALUE,
+                        _("--rate can't be used with --threads"));
+            return FALSE;
+        }
+        if (load_duration <= 0.0 || load_warmup < 0.0) {
+            g_set_error(error,
+                        G_OPTION_ERROR,
+                        G_OPTION_ERROR_BAD_VALUE,
+                        _("Invalid load duration: duration=%g, warmup=%g"),
+                        load_duration, load_warmup);
+            return FALSE;
+        }
+        if (load_max_concurrency <= 0) {
+            g_set_error(error,
+                        G_OPTION_ERROR,
+                        G_OPTION_ERROR_BAD_VALUE,
+                        _("--max-concurrency must be 1 or larger: %d"),
+                        load_max_concurrency);
+            return FALSE;
+        }
+    }
+
     return TRUE;
 }
 
@@ -1911,6 +2123,11 @@ free_option_values (void)
         g_hash_table_unref(end_of_header_macros);
     if (end_of_message_macros)
         g_hash_table_unref(end_of_message_macros);
+
+    if (load_message_sizes)
+        g_array_free(load_message_sizes, TRUE);
+    if (load_recipient_counts)
+        g_array_free(load_recipient_counts, TRUE);
 }
 
 static void
@@ -2308,6 +2525,504 @@ test_server_thread (gpointer data)
     return GINT_TO_POINTER(success);
 }
 
+#define LOAD_HIGHEST_TRACKABLE_LATENCY G_GUINT64_CONSTANT(3600000000)
+#define LOAD_FIRST_STAGE MILTER_SERVER_CONTEXT_STATE_NEGOTIATE
+#define LOAD_LAST_STAGE MILTER_SERVER_CONTEXT_STATE_END_OF_MESSAGE
+#define LOAD_N_STAGES (LOAD_LAST_STAGE - LOAD_FIRST_STAGE + 1)
+
+static const gchar *load_stage_names[LOAD_N_STAGES] = {
+    "negotiate",
+    "connect",
+    "helo",
+    "envelope_from",
+    "envelope_recipient",
+    "data",
+    "unknown",
+    "header",
+    "end_of_header",
+    "body",
+    "end_of_message"
+};
+
+struct _LoadGenerator
+{
+    MilterEventLoop *loop;
+    GTimer *timer;
+    GRand *rand;
+    guint32 seed;
+    gint64 warmup_end_time;
+    gint64 end_time;
+    gint64 next_arrival_time;
+    gint64 last_finished_time;
+    gboolean generating;
+    GQueue *pending_start_times;
+    guint n_running;
+    guint max_pending;
+    guint64 n_started;
+    guint64 n_finished;
+    guint64 n_succeeded;
+    guint64 n_failed;
+    guint64 n_measured;
+    GPtrArray *bodies;
+    GPtrArray *recipients_list;
+    MilterHistogram *session_latency;
+    MilterHistogram *uncorrected_session_latency;
+    MilterHistogram *stage_latencies[LOAD_N_STAGES];
+};
+
+static gint64
+load_now (LoadGenerator *load)
+{
+    return (gint64)(g_timer_elapsed(load->timer, NULL) * G_USEC_PER_SEC);
+}
+
+static gchar **
+load_body_chunks_new (guint64 size)
+{
+    const gchar line[] = "La de da de da.\n";
+    GPtrArray *chunks;
+
+    chunks = g_ptr_array_new();
+    while (size > 0) {
+        gchar *chunk;
+        guint i, chunk_size;
+
+        chunk_size = MIN(size, MILTER_CHUNK_SIZE);
+        chunk = g_new(gchar, chunk_size + 1);
+        for (i = 0; i < chunk_size; i++) {
+            chunk[i] = line[i % (sizeof(line) - 1)];
+        }
+        chunk[chunk_size] = '\0';
+        g_ptr_array_add(chunks, chunk);
+        size -= chunk_size;
+    }
+    g_ptr_array_add(chunks, NULL);
+
+    return (gchar **)g_ptr_array_free(chunks, FALSE);
+}
+
+static gchar **
+load_recipients_new (guint64 n_recipients)
+{
+    gchar **load_recipients;
+    guint64 i;
+
+    load_recipients = g_new0(gchar *, n_recipients + 1);
+    for (i = 0; i < n_recipients; i++) {
+        load_recipients[i] =
+            g_strdup_printf("<receiver%" G_GUINT64_FORMAT "@example.org>",
+                            i + 1);
+    }
+
+    return load_recipients;
+}
+
+static LoadGenerator *
+load_generator_new (void)
+{
+    LoadGenerator *load;
+    guint i;
+
+    load = g_new0(LoadGenerator, 1);
+    load->loop = milter_glib_event_loop_new(NULL);
+    load->timer = g_timer_new();
+    if (load_seed == 0)
+        load->seed = g_random_int();
+    else
+        load->seed = load_seed;
+    load->rand = g_rand_new_with_seed(load->seed);
+    load->warmup_end_time = load_warmup * G_USEC_PER_SEC;
+    load->end_time = (load_warmup + load_duration) * G_USEC_PER_SEC;
+    load->generating = TRUE;
+    load->pending_start_times = g_queue_new();
+
+    load->bodies = g_ptr_array_new();
+    if (load_message_sizes) {
+        for (i = 0; i < load_message_sizes->len; i++) {
+            LoadMixEntry *entry;
+
+            entry = &g_array_index(load_message_sizes, LoadMixEntry, i);
+            g_ptr_array_add(load->bodies, load_body_chunks_new(entry->value));
+        }
+    } else {
+        g_ptr_array_add(load->bodies, g_strdupv(body_chunks));
+    }
+
+    load->recipients_list = g_ptr_array_new();
+    if (load_recipient_counts) {
+        for (i = 0; i < load_recipient_counts->len; i++) {
+            LoadMixEntry *entry;
+
+            entry = &g_array_index(load_recipient_counts, LoadMixEntry, i);
+            g_ptr_array_add(load->recipients_list,
+                            load_recipients_new(entry->value));
+        }
+    } else {
+        g_ptr_array_add(load->recipients_list, g_strdupv(recipients));
+    }
+
+    load->session_latency =
+        milter_histogram_new(LOAD_HIGHEST_TRACKABLE_LATENCY);
+    load->uncorrected_session_latency =
+        milter_histogram_new(LOAD_HIGHEST_TRACKABLE_LATENCY);
+    for (i = 0; i < LOAD_N_STAGES; i++) {
+        load->stage_latencies[i] =
+            milter_histogram_new(LOAD_HIGHEST_TRACKABLE_LATENCY);
+    }
+
+    return load;
+}
+
+static void
+load_generator_free (LoadGenerator *load)
+{
+    guint i;
+
+    g_object_unref(load->loop);
+    g_timer_destroy(load->timer);
+    g_rand_free(load->rand);
+    g_queue_foreach(load->pending_start_times, (GFunc)g_free, NULL);
+    g_queue_free(load->pending_start_times);
+
+    for (i = 0; i < load->bodies->len; i++) {
+        g_strfreev(g_ptr_array_index(load->bodies, i));
+    }
+    g_ptr_array_free(load->bodies, TRUE);
+    for (i = 0; i < load->recipients_list->len; i++) {
+        g_strfreev(g_ptr_array_index(load->recipients_list, i));
+    }
+    g_ptr_array_free(load->recipients_list, TRUE);
+
+    milter_histogram_free(load->session_latency);
+    milter_histogram_free(load->uncorrected_session_latency);
+    for (i = 0; i < LOAD_N_STAGES; i++) {
+        milter_histogram_free(load->stage_latencies[i]);
+    }
+
+    g_free(load);
+}
+
+static gpointer
+load_choose (LoadGenerator *load, GArray *entries, GPtrArray *values)
+{
+    gdouble total_weight = 0.0, point;
+    guint i;
+
+    if (!entries)
+        return g_ptr_array_index(values, 0);
+
+    for (i = 0; i < entries->len; i++) {
+        total_weight += g_array_index(entries, LoadMixEntry, i).weight;
+    }
+    point = g_rand_double(load->rand) * total_weight;
+    for (i = 0; i < entries->len - 1; i++) {
+        point -= g_array_index(entries, LoadMixEntry, i).weight;
+        if (point < 0.0)
+            break;
+    }
+
+    return g_ptr_array_index(values, i);
+}
+
+static gint64
+load_next_interval (LoadGenerator *load)
+{
+    gdouble uniform;
+
+    uniform = g_rand_double(load->rand);
+    return (gint64)(-log(1.0 - uniform) / load_rate * G_USEC_PER_SEC);
+}
+
+static void
+load_quit_if_done (LoadGenerator *load)
+{
+    if (load->generating)
+        return;
+    if (load->n_running > 0)
+        return;
+    if (!g_queue_is_empty(load->pending_start_times))
+        return;
+
+    milter_event_loop_quit(load->loop);
+}
+
+static void
+load_start_session (LoadGenerator *load, gint64 intended_start_time)
+{
+    ProcessData *data;
+    MilterServerContext *context;
+    GError *error = NULL;
+
+    data = g_new0(ProcessData, 1);
+    init_process_data(data, load->loop);
+    data->load = load;
+    data->intended_start_time = intended_start_time;
+    data->start_time = load_now(load);
+    g_strfreev(data->body_chunks);
+    data->body_chunks = load_choose(load, load_message_sizes, load->bodies);
+    g_strfreev(data->recipients);
+    data->recipients = load_choose(load,
+                                   load_recipient_counts,
+                                   load->recipients_list);
+
+    context = milter_server_context_new();
+    data->context = context;
+    setup_context(context, data);
+
+    load->n_running++;
+    load->n_started++;
+    if (!milter_server_context_set_connection_spec(context, spec, &error) ||
+        !milter_server_context_establish_connection(context, &error)) {
+        data->success = FALSE;
+        if (data->error)
+            g_error_free(error);
+        else
+            data->error = error;
+        load_finish_session(data);
+    }
+}
+
+static void
+load_start_pending_sessions (LoadGenerator *load)
+{
+    while (load->n_running < (guint)load_max_concurrency &&
+           !g_queue_is_empty(load->pending_start_times)) {
+        gint64 *intended_start_time;
+
+        intended_start_time = g_queue_pop_head(load->pending_start_times);
+        load_start_session(load, *intended_start_time);
+        g_free(intended_start_time);
+    }
+}
+
+static void
+load_arrive (LoadGenerator *load, gint64 intended_start_time)
+{
+    gint64 *pending_start_time;
+
+    if (load->n_running < (guint)load_max_concurrency) {
+        load_start_session(load, intended_start_time);
+        return;
+    }
+
+    pending_start_time = g_new(gint64, 1);
+    *pending_start_time = intended_start_time;
+    g_queue_push_tail(load->pending_start_times, pending_start_time);
+    load->max_pending = MAX(load->max_pending,
+                            g_queue_get_length(load->pending_start_times));
+}
+
+static gboolean cb_load_arrival (gpointer user_data);
+
+static void
+load_schedule_arrival (LoadGenerator *load)
+{
+    gint64 delay;
+
+    if (load->next_arrival_time >= load->end_time) {
+        load->generating = FALSE;
+        load_quit_if_done(load);
+        return;
+    }
+
+    delay = MAX(load->next_arrival_time - load_now(load), 0);
+    milter_event_loop_add_timeout(load->loop,
+                                  (gdouble)delay / G_USEC_PER_SEC,
+                                  cb_load_arrival,
+                                  load);
+}
+
+static gboolean
+cb_load_arrival (gpointer user_data)
+{
+    LoadGenerator *load = user_data;
+    gint64 now;
+
+    now = load_now(load);
+    while (load->next_arrival_time <= now &&
+           load->next_arrival_time < load->end_time) {
+        load_arrive(load, load->next_arrival_time);
+        load->next_arrival_time += load_next_interval(load);
+    }
+    load_schedule_arrival(load);
+
+    return FALSE;
+}
+
+static void
+load_start_stage (ProcessData *data, MilterServerContextState state)
+{
+    if (!data->load)
+        return;
+
+    data->stage = state;
+    data->stage_start_time = load_now(data->load);
+}
+
+static void
+load_record_stage (ProcessData *data)
+{
+    LoadGenerator *load = data->load;
+
+    if (!load)
+        return;
+    if (data->stage < LOAD_FIRST_STAGE || data->stage > LOAD_LAST_STAGE)
+        return;
+
+    if (data->intended_start_time >= load->warmup_end_time) {
+        milter_histogram_record(load->stage_latencies[data->stage -
+                                                      LOAD_FIRST_STAGE],
+                                load_now(load) - data->stage_start_time);
+    }
+    data->stage = MILTER_SERVER_CONTEXT_STATE_INVALID;
+}
+
+static gboolean
+cb_load_free_session (gpointer user_data)
+{
+    ProcessData *data = user_data;
+    LoadGenerator *load = data->load;
+
+    g_object_unref(data->context);
+    data->body_chunks = NULL;
+    data->recipients = NULL;
+    free_process_data(data);
+    g_free(data);
+
+    load->n_running--;
+    load->n_finished++;
+    load_start_pending_sessions(load);
+    load_quit_if_done(load);
+
+    return FALSE;
+}
+
+static void
+load_finish_session (ProcessData *data)
+{
+    LoadGenerator *load = data->load;
+
+    if (data->load_finished)
+        return;
+    data->load_finished = TRUE;
+
+    if (data->intended_start_time >= load->warmup_end_time) {
+        gint64 now;
+
+        now = load_now(load);
+        milter_histogram_record(load->session_latency,
+                                now - data->intended_start_time);
+        milter_histogram_record(load->uncorrected_session_latency,
+                                now - data->start_time);
+        load->n_measured++;
+        load->last_finished_time = now;
+    }
+    if (data->error)
+        load->n_failed++;
+    else
+        load->n_succeeded++;
+
+    milter_event_loop_add_idle(load->loop, cb_load_free_session, data);
+}
+
+static void
+load_print_histogram (const gchar *indent,
+                      const gchar *name,
+                      MilterHistogram *histogram,
+                      gboolean last)
+{
+    const gdouble percentiles[] = {50.0, 90.0, 99.0, 99.9, 99.99, 100.0};
+    const gchar *percentile_names[] = {
+        "p50", "p90", "p99", "p99_9", "p99_99", "p100"
+    };
+    guint i;
+
+    g_print("%s\"%s\": {\n", indent, name);
+    g_print("%s  \"count\": %" G_GUINT64_FORMAT ",\n",
+            indent, milter_histogram_get_count(histogram));
+    g_print("%s  \"min\": %" G_GUINT64_FORMAT ",\n",
+            indent, milter_histogram_get_min(histogram));
+    g_print("%s  \"mean\": %.1f,\n",
+            indent, milter_histogram_get_mean(histogram));
+    g_print("%s  \"max\": %" G_GUINT64_FORMAT ",\n",
+            indent, milter_histogram_get_max(histogram));
+    for (i = 0; i < G_N_ELEMENTS(percentiles); i++) {
+        guint64 value;
+
+        value = milter_histogram_get_value_at_percentile(histogram,
+                                                         percentiles[i]);
+        g_print("%s  \"%s\": %" G_GUINT64_FORMAT "%s\n",
+                indent, percentile_names[i], value,
+                i == G_N_ELEMENTS(percentiles) - 1 ? "" : ",");
+    }
+    g_print("%s}%s\n", indent, last ? "" : ",");
+}
+
+static void
+load_print_report (LoadGenerator *load)
+{
+    gdouble measured_seconds, throughput = 0.0;
+    guint i;
+
+    measured_seconds =
+        (gdouble)(load->last_finished_time - load->warmup_end_time) /
+        G_USEC_PER_SEC;
+    if (measured_seconds > 0.0)
+        throughput = load->n_measured / measured_seconds;
+
+    g_print("{\n");
+    g_print("  \"config\": {\n");
+    g_print("    \"rate\": %g,\n", load_rate);
+    g_print("    \"duration\": %g,\n", load_duration);
+    g_print("    \"warmup\": %g,\n", load_warmup);
+    g_print("    \"max_concurrency\": %d,\n", load_max_concurrency);
+    g_print("    \"seed\": %u\n", load->seed);
+    g_print("  },\n");
+    g_print("  \"sessions\": {\n");
+    g_print("    \"started\": %" G_GUINT64_FORMAT ",\n", load->n_started);
+    g_print("    \"finished\": %" G_GUINT64_FORMAT ",\n", load->n_finished);
+    g_print("    \"succeeded\": %" G_GUINT64_FORMAT ",\n", load->n_succeeded);
+    g_print("    \"failed\": %" G_GUINT64_FORMAT ",\n", load->n_failed);
+    g_print("    \"measured\": %" G_GUINT64_FORMAT ",\n", load->n_measured);
+    g_print("    \"max_pending\": %u\n", load->max_pending);
+    g_print("  },\n");
+    g_print("  \"throughput\": %.3f,\n", throughput);
+    g_print("  \"latency\": {\n");
+    g_print("    \"unit\": \"usec\",\n");
+    load_print_histogram("    ", "session", load->session_latency, FALSE);
+    load_print_histogram("    ", "session_uncorrected",
+                         load->uncorrected_session_latency, FALSE);
+    g_print("    \"stages\": {\n");
+    for (i = 0; i < LOAD_N_STAGES; i++) {
+        load_print_histogram("      ",
+                             load_stage_names[i],
+                             load->stage_latencies[i],
+                             i == LOAD_N_STAGES - 1);
+    }
+    g_print("    }\n");
+    g_print("  }\n");
+    g_print("}\n");
+}
+
+static gboolean
+run_load (void)
+{
+    LoadGenerator *load;
+    gboolean success;
+
+    load = load_generator_new();
+    g_timer_start(load->timer);
+    load->next_arrival_time = load_next_interval(load);
+    load_schedule_arrival(load);
+    milter_event_loop_run(load->loop);
+
+    load_print_report(load);
+    success = (load->n_failed == 0);
+    load_generator_free(load);
+
+    return success;
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -2341,7 +3056,9 @@ main (int argc, char *argv[])
     if (verbose)
         g_setenv("MILTER_LOG_LEVEL", "all", FALSE);
 
-    if (n_threads > 0) {
+    if (load_rate > 0.0) {
+        success = run_load();
+    } else if (n_threads > 0) {
         GThread **threads;
         ProcessData *process_data;
         gint i;
@@ -2349,7 +3066,7 @@ main (int argc, char *argv[])
         threads = g_new0(GThread *, n_threads);
         process_data = g_new0(ProcessData, n_threads);
         for (i = 0; i < n_threads; i++) {
-            init_process_data(&process_data[i]);
+            init_process_data(&process_data[i], NULL);
             threads[i] = g_thread_try_new("test_server_thread",
                                           test_server_thread,
                                           &process_data[i],
@@ -2365,7 +3082,7 @@ main (int argc, char *argv[])
         g_free(threads);
     } else {
         ProcessData process_data;
-        init_process_data(&process_data);
+        init_process_data(&process_data, NULL);
         success = GPOINTER_TO_INT(test_server_thread(&process_data));
         free_process_data(&process_data);
     }